@@ -0,0 +1,133 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "AudioThreadStalls.h"
+
+//==============================================================================
+
+namespace
+{
+    // The worst wait of the block the calling thread is processing, or nullptr outside a block
+    thread_local double* currentWorstWait = nullptr;
+}
+
+AudioThreadStalls::ScopedBlock::ScopedBlock(AudioThreadStalls& stallsToRecordTo)
+    : stalls(stallsToRecordTo), previousWorstWait(currentWorstWait)
+{
+    currentWorstWait = &worstWaitMicroseconds;
+}
+
+AudioThreadStalls::ScopedBlock::~ScopedBlock()
+{
+    currentWorstWait = previousWorstWait;
+    stalls.recordBlock(worstWaitMicroseconds);
+}
+
+bool AudioThreadStalls::isMeasuring()
+{
+    return currentWorstWait != nullptr;
+}
+
+void AudioThreadStalls::recordWait(double microseconds)
+{
+    if (currentWorstWait != nullptr)
+    {
+        *currentWorstWait = juce::jmax(*currentWorstWait, microseconds);
+    }
+}
+
+//==============================================================================
+
+void AudioThreadStalls::recordBlock(double worstWaitMicroseconds)
+{
+    // Most blocks never wait, so the logarithm is only computed for the stalled ones
+    auto bucket = 0;
+
+    if (worstWaitMicroseconds >= 1.0)
+    {
+        bucket = juce::jmin(numBuckets - 1, 1 + (int) (std::log2(worstWaitMicroseconds) * bucketsPerOctave));
+
+        auto previousMax = maxMicroseconds.load(std::memory_order_relaxed);
+
+        while (worstWaitMicroseconds > previousMax
+               && !maxMicroseconds.compare_exchange_weak(previousMax, worstWaitMicroseconds, std::memory_order_relaxed)) {}
+    }
+
+    buckets[(size_t) bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+double AudioThreadStalls::getPercentile(const std::array<juce::int64, numBuckets>& counts, juce::int64 total, double fraction) const
+{
+    const auto rank = (juce::int64) std::ceil(fraction * (double) total);
+    juce::int64 cumulative = 0;
+
+    for (int bucket = 0; bucket < numBuckets; ++bucket)
+    {
+        cumulative += counts[(size_t) bucket];
+
+        if (cumulative >= rank)
+        {
+            // The last bucket has no upper edge, so the longest wait stands in for it
+            if (bucket == numBuckets - 1) { return maxMicroseconds.load(std::memory_order_relaxed); }
+
+            return bucket == 0 ? 1.0 : std::exp2((double) bucket / (double) bucketsPerOctave);
+        }
+    }
+
+    return 0.0;
+}
+
+AudioThreadStalls::Summary AudioThreadStalls::getSummary() const
+{
+    std::array<juce::int64, numBuckets> counts {};
+    Summary summary;
+
+    for (int bucket = 0; bucket < numBuckets; ++bucket)
+    {
+        counts[(size_t) bucket] = buckets[(size_t) bucket].load(std::memory_order_relaxed);
+        summary.numBlocks += counts[(size_t) bucket];
+    }
+
+    if (summary.numBlocks == 0) { return summary; }
+
+    summary.numStalledBlocks = summary.numBlocks - counts[0];
+    summary.p99Microseconds = getPercentile(counts, summary.numBlocks, 0.99);
+    summary.p999Microseconds = getPercentile(counts, summary.numBlocks, 0.999);
+    summary.maxMicroseconds = maxMicroseconds.load(std::memory_order_relaxed);
+    return summary;
+}
+
+bool AudioThreadStalls::Summary::isWithinBudget() const
+{
+    return budgetMicroseconds <= 0.0 || p999Microseconds <= budgetMicroseconds;
+}
+
+void AudioThreadStalls::logSummary(const juce::String& pluginName) const
+{
+    const auto summary = getSummary();
+
+    if (summary.numBlocks == 0) { return; }
+
+    juce::Logger::writeToLog("AU-VST3-Wrapper stalls: plugin=" + pluginName
+                             + " blocks=" + juce::String(summary.numBlocks)
+                             + " stalled_blocks=" + juce::String(summary.numStalledBlocks)
+                             + " p99_us=" + juce::String(summary.p99Microseconds, 1)
+                             + " p999_us=" + juce::String(summary.p999Microseconds, 1)
+                             + " max_us=" + juce::String(summary.maxMicroseconds, 1)
+                             + " budget_us=" + juce::String(budgetMicroseconds, 0)
+                             + " result=" + (summary.isWithinBudget() ? "pass" : "fail"));
+
+    // Stops stress runs of debug builds at the instance which went over the budget
+    jassert (summary.isWithinBudget());
+}
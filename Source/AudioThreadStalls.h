@@ -0,0 +1,86 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/// Fails (logs "result=fail" and asserts in debug builds) when the 99.9th percentile of the per block stalls exceeds this many microseconds. 0 disables the check.
+#ifndef VST3WRAPPER_STALL_BUDGET_US
+ #define VST3WRAPPER_STALL_BUDGET_US 0
+#endif
+
+/**
+ * @brief A histogram of the worst time the audio thread waited for a lock in each block.
+ *
+ * Every block processed inside a `ScopedBlock` is recorded, stalled or not, so the percentiles are per block.
+ * Waits are reported by `CheckedScopedLock`, which only times them when the lock is actually contended.
+ * Buckets are a quarter of an octave wide, from 1 µs to about 50 ms, and percentiles are reported at the upper edge of their bucket.
+ *
+ * Recording never blocks or allocates, and the histogram can be read on any thread.
+ */
+class AudioThreadStalls
+{
+public:
+    /// Measures the waits of the calling thread until the object is deleted, and records the worst of them as one block.
+    class ScopedBlock
+    {
+    public:
+        explicit ScopedBlock(AudioThreadStalls& stallsToRecordTo);
+        ~ScopedBlock();
+
+    private:
+        AudioThreadStalls& stalls;
+        double worstWaitMicroseconds = 0.0;
+        double* previousWorstWait;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedBlock)
+    };
+
+    /// Returns `true` if the calling thread is inside a `ScopedBlock`.
+    static bool isMeasuring();
+
+    /// Records a wait of the calling thread, if it's inside a `ScopedBlock`.
+    static void recordWait(double microseconds);
+
+    struct Summary
+    {
+        juce::int64 numBlocks = 0;
+        juce::int64 numStalledBlocks = 0;
+        double p99Microseconds = 0.0;
+        double p999Microseconds = 0.0;
+        double maxMicroseconds = 0.0;
+
+        /// Returns `false` if a budget is set and the 99.9th percentile exceeds it.
+        bool isWithinBudget() const;
+    };
+
+    Summary getSummary() const;
+
+    /// Writes the summary to the log as an "AU-VST3-Wrapper stalls" line, and asserts if it exceeds the budget.
+    void logSummary(const juce::String& pluginName) const;
+
+    static constexpr double budgetMicroseconds = VST3WRAPPER_STALL_BUDGET_US;
+
+private:
+    static constexpr int bucketsPerOctave = 4;
+    static constexpr int numBuckets = 64;
+
+    void recordBlock(double worstWaitMicroseconds);
+    double getPercentile(const std::array<juce::int64, numBuckets>& counts, juce::int64 total, double fraction) const;
+
+    // Bucket 0 counts the blocks which waited less than 1 µs, and bucket `i` those up to 2^(i / bucketsPerOctave) µs
+    std::array<std::atomic<juce::int64>, numBuckets> buckets {};
+    std::atomic<double> maxMicroseconds { 0.0 };
+};
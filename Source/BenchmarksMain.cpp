@@ -0,0 +1,386 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+// The entry point of "VST3 Wrapper Benchmarks", a command-line tool which times the wrapper's real-time building blocks
+// in isolation, with the same inputs on every run. It's built by the "Benchmarks" Projucer project, as the MIDI FX variant
+// of the wrapper with the real-time safety checker, so that whole-wrapper benchmarks can count allocations too.
+//
+// Usage: "VST3 Wrapper Benchmarks" [--only=<name>] [--blocks=<count>] [--plugin=<path>]
+// Every benchmark prints one "AU-VST3-Wrapper bench" line. Use a Release build, as Debug builds are several times slower.
+
+#include <JuceHeader.h>
+#include "MidiTransformStage.h"
+#include "SampleRateAdapter.h"
+#include "BusMeters.h"
+#include "SandboxTransport.h"
+#include "PluginProcessor.h"
+
+//==============================================================================
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+
+    double getElapsedNanoseconds(juce::int64 startTicks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1.0e9;
+    }
+
+    // The same block of white noise on every run
+    juce::AudioBuffer<float> makeNoise(int numChannels)
+    {
+        juce::AudioBuffer<float> noise (numChannels, blockSize);
+        juce::Random random (1);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            for (int sample = 0; sample < blockSize; ++sample)
+            {
+                noise.setSample(channel, sample, random.nextFloat() * 2.0f - 1.0f);
+            }
+        }
+
+        return noise;
+    }
+
+    // A dense MPE stream: per-note pitch bend on every sample of all 15 member channels, plus CC 74 every 4 samples,
+    // through a channel remap, a transposition and a thinned controller
+    juce::String benchmarkMidiTransform(int numBlocks)
+    {
+        MidiTransformStage::Tables tables;
+        const auto error = MidiTransformStage::compile("in: channel 2 > 3\nin: transpose 12\nin: thin cc 74 1ms", tables);
+        jassert(error.isEmpty());
+        juce::ignoreUnused(error);
+
+        MidiTransformStage stage;
+        stage.setTables(tables);
+        stage.prepare(sampleRate);
+
+        juce::MidiBuffer source;
+
+        for (int sample = 0; sample < blockSize; ++sample)
+        {
+            for (int channel = 2; channel <= 16; ++channel)
+            {
+                source.addEvent(juce::MidiMessage::pitchWheel(channel, 8192 + sample), sample);
+
+                if (sample % 4 == 0)
+                {
+                    source.addEvent(juce::MidiMessage::controllerEvent(channel, 74, sample % 128), sample);
+                }
+            }
+        }
+
+        juce::MidiBuffer midiMessages;
+        midiMessages.ensureSize((size_t) MidiTransformStage::preallocatedBytes);
+        juce::int64 numEvents = 0;
+        double totalNanoseconds = 0.0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            midiMessages.clear();
+            midiMessages.addEvents(source, 0, -1, 0);
+            numEvents += source.getNumEvents();
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            stage.process(MidiTransformStage::Stage::input, midiMessages);
+            totalNanoseconds += getElapsedNanoseconds(startTicks);
+
+            stage.advance(blockSize);
+        }
+
+        return "events_per_block=" + juce::String(source.getNumEvents())
+            + " ns_per_event=" + juce::String(totalNanoseconds / (double) numEvents, 2)
+            + " us_per_block=" + juce::String(totalNanoseconds / 1000.0 / numBlocks, 2);
+    }
+
+    // A stereo 44.1 kHz host running the hosted plugin at 48 kHz, with a render callback that does nothing,
+    // so only the conversion in both directions and the output FIFO are timed
+    juce::String benchmarkResampler(SampleRateAdapter::Quality quality, int numBlocks)
+    {
+        SampleRateAdapter adapter;
+        adapter.prepare(44100.0, sampleRate, 2, 2, blockSize, quality);
+
+        const auto noise = makeNoise(2);
+        juce::AudioBuffer<float> buffer (2, blockSize);
+        juce::MidiBuffer midiMessages;
+        double totalNanoseconds = 0.0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            buffer.makeCopyOf(noise, true);
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            adapter.process(buffer, midiMessages, {}, [] (auto&, auto&, const auto&) {});
+            totalNanoseconds += getElapsedNanoseconds(startTicks);
+        }
+
+        return "latency_samples=" + juce::String(adapter.getLatencySamples())
+            + " us_per_block=" + juce::String(totalNanoseconds / 1000.0 / numBlocks, 2);
+    }
+
+    // Eight stereo output buses, as a multi-output instrument would have
+    juce::String benchmarkBusMeters(int numBlocks)
+    {
+        constexpr int numBuses = 8;
+        juce::Array<BusMeters::Bus> buses;
+
+        for (int bus = 0; bus < numBuses; ++bus)
+        {
+            buses.add({ "Output " + juce::String(bus + 1), bus * 2, 2 });
+        }
+
+        BusMeters meters;
+        meters.prepare(buses, sampleRate);
+
+        const auto buffer = makeNoise(numBuses * 2);
+        double totalNanoseconds = 0.0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            meters.process(buffer);
+            totalNanoseconds += getElapsedNanoseconds(startTicks);
+        }
+
+        return "buses=" + juce::String(numBuses)
+            + " us_per_block=" + juce::String(totalNanoseconds / 1000.0 / numBlocks, 2);
+    }
+
+    // Stands in for the sandbox helper's render thread, answering every request as soon as it wakes up
+    class SandboxEchoThread : private juce::Thread
+    {
+    public:
+        explicit SandboxEchoThread(SandboxSharedMemory& memory) : juce::Thread("Sandbox echo"), sharedMemory(memory)
+        {
+            startThread(juce::Thread::Priority::highest);
+        }
+
+        ~SandboxEchoThread() override
+        {
+            signalThreadShouldExit();
+            sharedMemory.wakeHelper();
+            stopThread(1000);
+        }
+
+    private:
+        void run() override
+        {
+            juce::uint32 lastRequest = 0;
+
+            while (!threadShouldExit())
+            {
+                if (!sharedMemory.waitForRequest(lastRequest, 100)) { continue; }
+
+                lastRequest = sharedMemory.getBlock().requestCounter.load(std::memory_order_acquire);
+                sharedMemory.postResponse(lastRequest);
+            }
+        }
+
+        SandboxSharedMemory& sharedMemory;
+    };
+
+    // The wake-up latency of the shared memory transport in both directions, both ends being in this process.
+    // As the audio thread's wait is what a block costs the host, the 99th percentile matters more than the mean.
+    juce::String benchmarkSandboxRoundTrip(int numBlocks)
+    {
+        const auto wrapperSide = SandboxSharedMemory::create(SandboxSharedMemory::createUniqueName());
+        const auto helperSide = wrapperSide != nullptr ? SandboxSharedMemory::open(wrapperSide->getName()) : nullptr;
+
+        if (helperSide == nullptr) { return "error=shared_memory"; }
+
+        std::vector<double> roundTrips;
+        roundTrips.reserve((size_t) numBlocks);
+        auto numTimeouts = 0;
+
+        {
+            SandboxEchoThread echoThread (*helperSide);
+
+            for (int block = 0; block < numBlocks; ++block)
+            {
+                const auto startTicks = juce::Time::getHighResolutionTicks();
+                const auto request = wrapperSide->postRequest();
+
+                if (!wrapperSide->waitForResponse(request, 100.0))
+                {
+                    ++numTimeouts;
+                    continue;
+                }
+
+                roundTrips.push_back(getElapsedNanoseconds(startTicks) / 1000.0);
+            }
+        }
+
+        if (roundTrips.empty()) { return "timeouts=" + juce::String(numTimeouts); }
+
+        std::sort(roundTrips.begin(), roundTrips.end());
+        const auto getPercentile = [&] (double percentile) { return roundTrips[(size_t) ((double) (roundTrips.size() - 1) * percentile)]; };
+
+        return "timeouts=" + juce::String(numTimeouts)
+            + " us_median=" + juce::String(getPercentile(0.5), 2)
+            + " us_p99=" + juce::String(getPercentile(0.99), 2)
+            + " us_max=" + juce::String(roundTrips.back(), 2);
+    }
+
+    // The hosted plugin of the benchmarks which run the whole wrapper, set with --plugin
+    juce::String hostedPluginPath;
+
+    // Stops the message loop once the wrapper has finished loading its hosted plugin
+    class LoadWaiter : private VST3WrapperAudioProcessor::LoadListener
+    {
+    public:
+        explicit LoadWaiter(VST3WrapperAudioProcessor& processorToWatch) : processor(processorToWatch)
+        {
+            processor.addLoadListener(this);
+        }
+
+        ~LoadWaiter() override
+        {
+            processor.removeLoadListener(this);
+        }
+
+    private:
+        void hostedPluginLoadFinished(const VST3WrapperAudioProcessor::LoadResult&) override
+        {
+            juce::MessageManager::getInstance()->stopDispatchLoop();
+        }
+
+        VST3WrapperAudioProcessor& processor;
+    };
+
+    // The MIDI FX's whole processBlock path with the stream of a dense arpeggiator or sequencer: 24 events on every sample
+    // of a 512-sample block. Without --plugin, only the wrapper's own part of the path is timed, as nothing is hosted.
+    // Allocations are counted by the real-time safety checker on the audio thread, which only sees them on Linux.
+    juce::String benchmarkMidiEffectPath(int numBlocks)
+    {
+        VST3WrapperAudioProcessor processor;
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        if (hostedPluginPath.isNotEmpty())
+        {
+            LoadWaiter loadWaiter (processor);
+            processor.loadPlugin(hostedPluginPath);
+            juce::MessageManager::getInstance()->runDispatchLoop();
+
+            if (!processor.isHostedPluginLoaded()) { return "error=" + processor.getHostedPluginLoadingError().quoted(); }
+        }
+
+        juce::MidiBuffer source;
+
+        for (int sample = 0; sample < blockSize; ++sample)
+        {
+            for (int channel = 1; channel <= 8; ++channel)
+            {
+                const auto note = 36 + (sample + channel) % 48;
+                source.addEvent(juce::MidiMessage::noteOff(channel, note == 36 ? 83 : note - 1), sample);
+                source.addEvent(juce::MidiMessage::noteOn(channel, note, (juce::uint8) 100), sample);
+                source.addEvent(juce::MidiMessage::controllerEvent(channel, 1, sample % 128), sample);
+            }
+        }
+
+        juce::AudioBuffer<float> buffer (juce::jmax(1, processor.getTotalNumOutputChannels()), blockSize);
+        juce::MidiBuffer midiMessages;
+        const auto getNumAllocations = [] (RealtimeSafetyChecker::Origin origin)
+        {
+            return RealtimeSafetyChecker::getNumViolations(RealtimeSafetyChecker::Kind::allocation, origin);
+        };
+        const auto wrapperAllocationsBefore = getNumAllocations(RealtimeSafetyChecker::Origin::wrapper);
+        const auto pluginAllocationsBefore = getNumAllocations(RealtimeSafetyChecker::Origin::hostedPlugin);
+        juce::int64 numOutputEvents = 0;
+        double totalNanoseconds = 0.0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            // Hosts reuse their buffer, which is what lets the wrapper swap in its reserved one only once
+            midiMessages.clear();
+            midiMessages.addEvents(source, 0, -1, 0);
+            buffer.clear();
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            processor.processBlock(buffer, midiMessages);
+            totalNanoseconds += getElapsedNanoseconds(startTicks);
+
+            numOutputEvents += midiMessages.getNumEvents();
+        }
+
+        processor.releaseResources();
+
+        const auto numEvents = (double) source.getNumEvents() * numBlocks;
+
+        return "plugin=" + (hostedPluginPath.isNotEmpty() ? processor.getHostedPluginName().quoted() : juce::String("none"))
+            + " events_per_block=" + juce::String(source.getNumEvents())
+            + " output_events_per_block=" + juce::String((double) numOutputEvents / numBlocks, 0)
+            + " events_per_s=" + juce::String(numEvents / (totalNanoseconds * 1.0e-9), 0)
+            + " us_per_block=" + juce::String(totalNanoseconds / 1000.0 / numBlocks, 2)
+            + " allocations_wrapper=" + juce::String(getNumAllocations(RealtimeSafetyChecker::Origin::wrapper) - wrapperAllocationsBefore)
+            + " allocations_plugin=" + juce::String(getNumAllocations(RealtimeSafetyChecker::Origin::hostedPlugin) - pluginAllocationsBefore);
+    }
+
+    struct Benchmark
+    {
+        const char* name;
+        juce::String (*run)(int numBlocks);
+    };
+
+    const Benchmark benchmarks[] =
+    {
+        { "midi_transform", benchmarkMidiTransform },
+        { "resampler_low", [] (int numBlocks) { return benchmarkResampler(SampleRateAdapter::Quality::low, numBlocks); } },
+        { "resampler_medium", [] (int numBlocks) { return benchmarkResampler(SampleRateAdapter::Quality::medium, numBlocks); } },
+        { "resampler_high", [] (int numBlocks) { return benchmarkResampler(SampleRateAdapter::Quality::high, numBlocks); } },
+        { "bus_meters", benchmarkBusMeters },
+        { "sandbox_round_trip", benchmarkSandboxRoundTrip },
+        { "midi_effect_path", benchmarkMidiEffectPath }
+    };
+
+    int getIntOption(const juce::ArgumentList& arguments, const juce::String& option, int defaultValue)
+    {
+        return arguments.containsOption(option) ? arguments.getValueForOption(option).getIntValue() : defaultValue;
+    }
+}
+
+//==============================================================================
+
+int main(int argc, char* argv[])
+{
+    const juce::ArgumentList arguments (argc, argv);
+
+    const auto only = arguments.getValueForOption("--only");
+    const auto numBlocks = juce::jmax(1, getIntOption(arguments, "--blocks", 2000));
+    hostedPluginPath = arguments.getValueForOption("--plugin");
+    auto numRun = 0;
+
+    // The wrapper loads its hosted plugin on the message thread
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    for (const auto& benchmark : benchmarks)
+    {
+        if (only.isNotEmpty() && only != benchmark.name) { continue; }
+
+        std::cout << "AU-VST3-Wrapper bench: name=" << benchmark.name << " blocks=" << numBlocks
+                  << " " << benchmark.run(numBlocks) << std::endl;
+        ++numRun;
+    }
+
+    if (numRun == 0)
+    {
+        std::cerr << "No benchmark named " << only << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "BusMeterComponent.h"
+
+//==============================================================================
+
+namespace
+{
+    float toProportion(float gain, float minimumDecibels)
+    {
+        const auto decibels = juce::Decibels::gainToDecibels(gain, minimumDecibels);
+        return juce::jlimit(0.0f, 1.0f, (decibels - minimumDecibels) / -minimumDecibels);
+    }
+}
+
+BusMeterComponent::BusMeterComponent(BusMeters& busMeters)
+: meters(busMeters)
+{
+    setOpaque(true);
+}
+
+void BusMeterComponent::update()
+{
+    const auto nowMs = juce::Time::getMillisecondCounter();
+
+    if (meters.readLevels(levels))
+    {
+        lastLevelsMs = nowMs;
+    }
+    else if (nowMs - lastLevelsMs > staleLevelsMs)
+    {
+        // Nothing is published while the host isn't processing, so the meters fall on their own
+        levels.rms.fill(0.0f);
+        levels.peak.fill(0.0f);
+    }
+
+    if (busNames.size() != levels.numBuses)
+    {
+        busNames = meters.getBusNames();
+    }
+
+    for (size_t bus = 0; bus < displayedPeak.size(); ++bus)
+    {
+        displayedPeak[bus] = juce::jmax(levels.peak[bus], displayedPeak[bus] * peakDecay);
+    }
+
+    repaint();
+}
+
+juce::Rectangle<float> BusMeterComponent::getMeterBounds(int bus) const
+{
+    const auto meterWidth = (float) (getWidth() - (levels.numBuses - 1) * meterSpacing) / (float) juce::jmax(1, levels.numBuses);
+    return { (float) bus * (meterWidth + (float) meterSpacing), 0.0f, meterWidth, (float) getHeight() };
+}
+
+int BusMeterComponent::getBusAt(int x) const
+{
+    for (int bus = 0; bus < levels.numBuses; ++bus)
+    {
+        if (getMeterBounds(bus).getRight() >= (float) x) { return bus; }
+    }
+
+    return -1;
+}
+
+void BusMeterComponent::paint(juce::Graphics& g)
+{
+    g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+
+    for (int bus = 0; bus < levels.numBuses; ++bus)
+    {
+        const auto bounds = getMeterBounds(bus);
+        g.setColour(juce::Colours::black);
+        g.fillRect(bounds);
+
+        const auto rmsProportion = toProportion(levels.rms[(size_t) bus], minimumDecibels);
+        g.setColour(juce::Colours::green);
+        g.fillRect(bounds.withWidth(bounds.getWidth() * rmsProportion));
+
+        const auto peak = displayedPeak[(size_t) bus];
+        const auto peakX = bounds.getX() + bounds.getWidth() * toProportion(peak, minimumDecibels);
+        g.setColour(peak >= 1.0f ? juce::Colours::red : juce::Colours::yellow);
+        g.fillRect(juce::jmin(peakX, bounds.getRight() - 1.0f), bounds.getY(), 1.0f, bounds.getHeight());
+    }
+}
+
+juce::String BusMeterComponent::getTooltip()
+{
+    const auto bus = getBusAt(getMouseXYRelative().x);
+
+    if (!juce::isPositiveAndBelow(bus, busNames.size())) { return {}; }
+
+    return busNames[bus]
+        + ": peak " + juce::Decibels::toString(juce::Decibels::gainToDecibels(displayedPeak[(size_t) bus]), 1)
+        + ", RMS " + juce::Decibels::toString(juce::Decibels::gainToDecibels(levels.rms[(size_t) bus]), 1);
+}
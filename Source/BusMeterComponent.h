@@ -0,0 +1,50 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "BusMeters.h"
+
+/// A strip of peak and RMS meters, one for each active output bus, refreshed at the display's rate.
+class BusMeterComponent : public juce::Component, public juce::TooltipClient
+{
+public:
+    explicit BusMeterComponent(BusMeters& busMeters);
+
+    void paint(juce::Graphics& g) override;
+
+    /// Shows the name and the levels of the bus under the mouse.
+    juce::String getTooltip() override;
+
+private:
+    void update();
+    int getBusAt(int x) const;
+    juce::Rectangle<float> getMeterBounds(int bus) const;
+
+    BusMeters& meters;
+    BusMeters::Levels levels;
+    std::array<float, BusMeters::maxBuses> displayedPeak {};
+    juce::StringArray busNames;
+    juce::uint32 lastLevelsMs = 0;
+    juce::VBlankAttachment vBlankAttachment { this, [this] { update(); } };
+
+    // The displayed peak falls by this factor on every refresh, so that short peaks stay visible
+    static constexpr float peakDecay = 0.92f;
+    static constexpr float minimumDecibels = -60.0f;
+    static constexpr int meterSpacing = 2;
+    static constexpr juce::uint32 staleLevelsMs = 100;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BusMeterComponent)
+};
@@ -0,0 +1,48 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "BusMeters.h"
+
+//==============================================================================
+
+void BusMeters::prepare(const juce::Array<Bus>& newBuses, double sampleRate)
+{
+    busNames.clear();
+    numBuses = juce::jmin(newBuses.size(), maxBuses);
+
+    for (int i = 0; i < numBuses; ++i)
+    {
+        const auto& bus = newBuses.getReference(i);
+        ranges[(size_t) i] = { bus.firstChannel, bus.numChannels };
+        busNames.add(bus.name);
+    }
+
+    runningPeak.fill(0.0f);
+    runningSumOfSquares.fill(0.0);
+    runningSamples = 0;
+    publishIntervalSamples = juce::jmax(1, juce::roundToInt(sampleRate * publishIntervalMs / 1000.0));
+}
+
+juce::StringArray BusMeters::getBusNames() const
+{
+    return busNames;
+}
+
+bool BusMeters::readLevels(Levels& levels)
+{
+    if (!levelsBuffer.update()) { return false; }
+
+    levels = levelsBuffer.getReadBuffer();
+    return true;
+}
@@ -0,0 +1,188 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief A single-writer, single-reader exchange of the latest value, which never blocks either side.
+ *
+ * The writer fills `getWriteBuffer()` and publishes it. The reader picks up the most recently published value with `update()`.
+ * Values published between two reads are skipped.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    T& getWriteBuffer() { return buffers[(size_t) writeIndex]; }
+
+    void publish()
+    {
+        writeIndex = middle.exchange(writeIndex | dirtyBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    /// Returns `true` if a new value has been published since the last call, in which case it is now in `getReadBuffer()`.
+    bool update()
+    {
+        if ((middle.load(std::memory_order_relaxed) & dirtyBit) == 0) { return false; }
+
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const T& getReadBuffer() const { return buffers[(size_t) readIndex]; }
+
+private:
+    static constexpr int dirtyBit = 4;
+    static constexpr int indexMask = 3;
+
+    std::array<T, 3> buffers {};
+    int writeIndex = 0;
+    int readIndex = 1;
+    std::atomic<int> middle { 2 };
+};
+
+//==============================================================================
+
+/**
+ * @brief Peak and RMS levels of every active output bus, measured on the rendering thread and read by the editor.
+ *
+ * Levels are accumulated over `publishIntervalMs` and published through a `TripleBuffer`, so neither side ever waits for the other.
+ * `process` never blocks or allocates.
+ */
+class BusMeters
+{
+public:
+    static constexpr int maxBuses = 32;
+    static constexpr double publishIntervalMs = 1000.0 / 60.0;
+
+    struct Bus
+    {
+        juce::String name;
+        int firstChannel = 0;
+        int numChannels = 0;
+    };
+
+    struct Levels
+    {
+        int numBuses = 0;
+        std::array<float, maxBuses> peak {};
+        std::array<float, maxBuses> rms {};
+    };
+
+    /// Sets the buses to measure. Disabled buses shouldn't be passed. Must be called while the rendering thread isn't processing.
+    void prepare(const juce::Array<Bus>& newBuses, double sampleRate);
+
+    /// Returns the names of the measured buses, in the order of `Levels`. Call this on the message thread only.
+    juce::StringArray getBusNames() const;
+
+    template <typename FloatType>
+    void process(const juce::AudioBuffer<FloatType>& buffer);
+
+    /// Returns `true` and fills `levels` if new levels have been published since the last call. Call this on a single (e.g. message) thread.
+    bool readLevels(Levels& levels);
+
+private:
+    template <typename FloatType>
+    static double getSumOfSquares(const FloatType* samples, int numSamples);
+
+    juce::StringArray busNames;
+
+    // Rendering thread state
+    struct Range
+    {
+        int firstChannel;
+        int numChannels;
+    };
+
+    std::array<Range, maxBuses> ranges {};
+    int numBuses = 0;
+    std::array<float, maxBuses> runningPeak {};
+    std::array<double, maxBuses> runningSumOfSquares {};
+    int runningSamples = 0;
+    int publishIntervalSamples = 800;
+
+    TripleBuffer<Levels> levelsBuffer;
+};
+
+//==============================================================================
+
+template <typename FloatType>
+double BusMeters::getSumOfSquares(const FloatType* samples, int numSamples)
+{
+    // Independent accumulators let the compiler vectorize the loop without reordering a single floating point sum
+    FloatType sums[4] = {};
+    int i = 0;
+
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        sums[0] += samples[i] * samples[i];
+        sums[1] += samples[i + 1] * samples[i + 1];
+        sums[2] += samples[i + 2] * samples[i + 2];
+        sums[3] += samples[i + 3] * samples[i + 3];
+    }
+
+    for (; i < numSamples; ++i)
+    {
+        sums[0] += samples[i] * samples[i];
+    }
+
+    return (double) (sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+template <typename FloatType>
+void BusMeters::process(const juce::AudioBuffer<FloatType>& buffer)
+{
+    const auto numSamples = buffer.getNumSamples();
+
+    for (int bus = 0; bus < numBuses; ++bus)
+    {
+        const auto range = ranges[(size_t) bus];
+
+        if (range.firstChannel + range.numChannels > buffer.getNumChannels()) { continue; }
+
+        auto peak = runningPeak[(size_t) bus];
+        auto sumOfSquares = 0.0;
+
+        for (int channel = range.firstChannel; channel < range.firstChannel + range.numChannels; ++channel)
+        {
+            const auto* samples = buffer.getReadPointer(channel);
+            const auto minAndMax = juce::FloatVectorOperations::findMinAndMax(samples, numSamples);
+            peak = juce::jmax(peak, (float) -minAndMax.getStart(), (float) minAndMax.getEnd());
+            sumOfSquares += getSumOfSquares(samples, numSamples);
+        }
+
+        runningPeak[(size_t) bus] = peak;
+        runningSumOfSquares[(size_t) bus] += sumOfSquares / (double) juce::jmax(1, range.numChannels);
+    }
+
+    runningSamples += numSamples;
+
+    if (runningSamples < publishIntervalSamples) { return; }
+
+    auto& levels = levelsBuffer.getWriteBuffer();
+    levels.numBuses = numBuses;
+
+    for (int bus = 0; bus < numBuses; ++bus)
+    {
+        levels.peak[(size_t) bus] = runningPeak[(size_t) bus];
+        levels.rms[(size_t) bus] = (float) std::sqrt(runningSumOfSquares[(size_t) bus] / (double) runningSamples);
+        runningPeak[(size_t) bus] = 0.0f;
+        runningSumOfSquares[(size_t) bus] = 0.0;
+    }
+
+    levelsBuffer.publish();
+    runningSamples = 0;
+}
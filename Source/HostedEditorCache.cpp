@@ -0,0 +1,92 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "HostedEditorCache.h"
+
+//==============================================================================
+
+HostedEditorCache::~HostedEditorCache()
+{
+    // Every wrapper instance releases its editor before deleting its plugin
+    jassert(entries.empty());
+}
+
+void HostedEditorCache::retain(const void* owner, std::unique_ptr<juce::AudioProcessorEditor> editor)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    release(owner);
+
+    if (editor == nullptr) { return; }
+
+    const auto bytes = estimateBytes(*editor);
+    entries.push_back({ owner, std::move(editor), bytes });
+    evictIfNeeded();
+}
+
+std::unique_ptr<juce::AudioProcessorEditor> HostedEditorCache::take(const void* owner)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    const auto entry = std::find_if(entries.begin(), entries.end(), [owner](const auto& e) { return e.owner == owner; });
+
+    if (entry == entries.end()) { return nullptr; }
+
+    auto editor = std::move(entry->editor);
+    entries.erase(entry);
+    return editor;
+}
+
+void HostedEditorCache::release(const void* owner)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    // The editor is deleted when the taken pointer goes out of scope
+    take(owner);
+}
+
+size_t HostedEditorCache::getRetainedBytes() const
+{
+    size_t total = 0;
+
+    for (const auto& entry : entries)
+    {
+        total += entry.bytes;
+    }
+
+    return total;
+}
+
+size_t HostedEditorCache::estimateBytes(const juce::AudioProcessorEditor& editor)
+{
+    // Plugin GUIs are usually rendered into a backing image (or several) at the display's scale
+    auto scale = 1.0;
+
+    if (const auto* display = juce::Desktop::getInstance().getDisplays().getPrimaryDisplay())
+    {
+        scale = display->scale;
+    }
+
+    const auto pixels = (double) editor.getWidth() * (double) editor.getHeight() * scale * scale;
+    return baseEditorBytes + (size_t) (pixels * 4.0);
+}
+
+void HostedEditorCache::evictIfNeeded()
+{
+    // The editor which has just been retained stays, even if it alone is over the cap
+    while (entries.size() > 1 && getRetainedBytes() > maxRetainedBytes)
+    {
+        entries.erase(entries.begin());
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief Keeps the hosted plugin editors of closed wrapper windows alive, so that reopening a window doesn't rebuild the plugin's GUI.
+ *        Shared by all wrapper instances through `juce::SharedResourcePointer`. Must only be used on the message thread.
+ *
+ * The memory used by an editor can't be measured, so it is estimated from the editor's size in pixels.
+ * When the estimated total goes over `maxRetainedBytes`, the least recently retained editors are deleted.
+ */
+class HostedEditorCache
+{
+public:
+    ~HostedEditorCache();
+
+    /// Takes ownership of the detached editor. The owner is an opaque identifier of the wrapper instance, which may retain one editor at a time.
+    void retain(const void* owner, std::unique_ptr<juce::AudioProcessorEditor> editor);
+
+    /// Returns the editor retained by the owner and removes it from the cache, or `nullptr` if it has none (or it has been evicted).
+    std::unique_ptr<juce::AudioProcessorEditor> take(const void* owner);
+
+    /// Deletes the editor retained by the owner, if any. Must be called before the editor's processor is deleted.
+    void release(const void* owner);
+
+    size_t getRetainedBytes() const;
+
+    static size_t estimateBytes(const juce::AudioProcessorEditor& editor);
+
+    static constexpr size_t maxRetainedBytes = size_t (512) << 20;
+    // The part of an editor's memory which doesn't depend on its size (fonts, images, the plugin's own GUI framework)
+    static constexpr size_t baseEditorBytes = size_t (8) << 20;
+
+private:
+    struct Entry
+    {
+        const void* owner;
+        std::unique_ptr<juce::AudioProcessorEditor> editor;
+        size_t bytes;
+    };
+
+    void evictIfNeeded();
+
+    // Least recently retained first
+    std::vector<Entry> entries;
+};
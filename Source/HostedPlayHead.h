@@ -0,0 +1,52 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief A play head owned by the wrapper, which serves the hosted plugin a position captured earlier.
+ *
+ * The host's play head is only valid during the host's audio callback,
+ * so it can't be handed to a hosted plugin that renders on another thread.
+ * It is also queried once per block only, however many times the hosted plugin asks for the position.
+ *
+ * A block rendered at another rate (see `SampleRateAdapter`) is rendered in parts, and each part gets its own position.
+ * All the methods are called on the thread that renders the hosted plugin, except `getNumQueries`.
+ */
+class HostedPlayHead : public juce::AudioPlayHead
+{
+public:
+    void setPosition(const juce::Optional<PositionInfo>& newPosition)
+    {
+        position = newPosition;
+    }
+
+    juce::Optional<PositionInfo> getPosition() const override
+    {
+        numQueries.fetch_add(1, std::memory_order_relaxed);
+        return position;
+    }
+
+    /// The number of times the hosted plugin has asked for the position. Can be called on any thread.
+    juce::int64 getNumQueries() const
+    {
+        return numQueries.load(std::memory_order_relaxed);
+    }
+
+private:
+    juce::Optional<PositionInfo> position;
+    mutable std::atomic<juce::int64> numQueries { 0 };
+};
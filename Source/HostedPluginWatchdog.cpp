@@ -0,0 +1,149 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "HostedPluginWatchdog.h"
+
+//==============================================================================
+
+void HostedPluginWatchdog::setPolicy(const Policy& newPolicy)
+{
+    overrunThreshold = newPolicy.overrunThreshold;
+    overrunsToTrip = newPolicy.overrunsToTrip;
+    blocksPerRecoveredOverrun = juce::jmax(1, newPolicy.blocksPerRecoveredOverrun);
+    initialSuspensionSeconds = newPolicy.initialSuspensionSeconds;
+    maximumSuspensionSeconds = newPolicy.maximumSuspensionSeconds;
+    action = (int) newPolicy.action;
+}
+
+HostedPluginWatchdog::Policy HostedPluginWatchdog::getPolicy() const
+{
+    Policy policy;
+    policy.action = (Action) action.load();
+    policy.overrunThreshold = overrunThreshold;
+    policy.overrunsToTrip = overrunsToTrip;
+    policy.blocksPerRecoveredOverrun = blocksPerRecoveredOverrun;
+    policy.initialSuspensionSeconds = initialSuspensionSeconds;
+    policy.maximumSuspensionSeconds = maximumSuspensionSeconds;
+    return policy;
+}
+
+void HostedPluginWatchdog::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+    overrunBucket = 0.0;
+    suspendedSamplesRemaining = 0;
+    currentSuspensionSeconds = 0.0;
+    isOnProbation = false;
+    probationBlocksRemaining = 0;
+    tripped = false;
+    cpuLoad = 0.0f;
+}
+
+//==============================================================================
+
+bool HostedPluginWatchdog::shouldProcess(int numSamples)
+{
+    if (!tripped) { return true; }
+
+    // The policy may have been switched off while tripped, or the host may have started rendering offline
+    if ((Action) action.load() == Action::none || offline)
+    {
+        tripped = false;
+        return true;
+    }
+
+    suspendedSamplesRemaining -= numSamples;
+
+    if (suspendedSamplesRemaining > 0) { return false; }
+
+    // Try again, but trip immediately if the plugin still can't keep up
+    tripped = false;
+    isOnProbation = true;
+    probationBlocksRemaining = probationBlocks;
+    overrunBucket = overrunsToTrip.load() - 1.0;
+    return true;
+}
+
+void HostedPluginWatchdog::blockStarted()
+{
+    blockStartTicks = juce::Time::getHighResolutionTicks();
+}
+
+void HostedPluginWatchdog::blockFinished(int numSamples)
+{
+    const auto elapsedSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - blockStartTicks);
+    const auto budgetSeconds = numSamples / sampleRate;
+
+    if (budgetSeconds > 0.0)
+    {
+        const auto load = cpuLoad.load(std::memory_order_relaxed);
+        cpuLoad.store(load + cpuLoadSmoothing * ((float) (elapsedSeconds / budgetSeconds) - load), std::memory_order_relaxed);
+    }
+
+    if (offline || elapsedSeconds <= budgetSeconds * overrunThreshold)
+    {
+        overrunBucket = juce::jmax(0.0, overrunBucket - 1.0 / blocksPerRecoveredOverrun);
+
+        if (isOnProbation && --probationBlocksRemaining <= 0)
+        {
+            // The plugin has recovered
+            isOnProbation = false;
+            currentSuspensionSeconds = 0.0;
+            overrunBucket = 0.0;
+        }
+
+        return;
+    }
+
+    ++totalOverruns;
+    overrunBucket += 1.0;
+
+    const auto shouldTrip = (Action) action.load() != Action::none && overrunBucket >= overrunsToTrip;
+
+    if (shouldTrip)
+    {
+        currentSuspensionSeconds = isOnProbation ? juce::jmin(currentSuspensionSeconds * 2.0, maximumSuspensionSeconds.load())
+                                                 : initialSuspensionSeconds.load();
+        suspendedSamplesRemaining = (juce::int64) (currentSuspensionSeconds * sampleRate);
+        isOnProbation = false;
+        overrunBucket = 0.0;
+        tripped = true;
+    }
+
+    logOverrun((float) (elapsedSeconds * 1000.0), (float) (budgetSeconds * 1000.0), shouldTrip);
+}
+
+//==============================================================================
+
+void HostedPluginWatchdog::logOverrun(float elapsedMs, float budgetMs, bool hasTripped)
+{
+    // If nobody reads the log, the newest events are dropped
+    if (overrunLogFifo.getFreeSpace() < 1) { return; }
+
+    int start1, size1, start2, size2;
+    overrunLogFifo.prepareToWrite(1, start1, size1, start2, size2);
+    overrunLog[(size_t) start1] = { juce::Time::getMillisecondCounter(), elapsedMs, budgetMs, hasTripped };
+    overrunLogFifo.finishedWrite(1);
+}
+
+void HostedPluginWatchdog::readOverrunEvents(const std::function<void(const OverrunEvent&)>& callback)
+{
+    while (overrunLogFifo.getNumReady() > 0)
+    {
+        int start1, size1, start2, size2;
+        overrunLogFifo.prepareToRead(1, start1, size1, start2, size2);
+        callback(overrunLog[(size_t) start1]);
+        overrunLogFifo.finishedRead(1);
+    }
+}
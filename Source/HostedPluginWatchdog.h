@@ -0,0 +1,180 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief Measures every hosted `processBlock` call against the real-time budget of the block
+ *        and takes the hosted plugin out of the signal path when it keeps overrunning.
+ *
+ * Overruns fill a leaky bucket, which empties as the plugin keeps up with the deadline.
+ * When the bucket is full, the watchdog trips and the hosted plugin isn't called for a while.
+ * After that time, processing resumes on probation: an overrun during probation trips the watchdog again, for twice as long.
+ *
+ * All the methods except `setPolicy` and `readOverrunEvents` are called on the rendering thread and never block or allocate.
+ */
+class HostedPluginWatchdog
+{
+public:
+    enum class Action
+    {
+        /// The watchdog only logs overruns
+        none = 0,
+        /// The input is passed through, delayed by the hosted plugin's latency
+        bypass,
+        silence
+    };
+
+    struct Policy
+    {
+        Action action = Action::none;
+        /// A block overruns when the hosted plugin takes longer than this fraction of the block's duration
+        double overrunThreshold = 0.9;
+        /// The number of overruns (net of the recovered ones) that trips the watchdog
+        double overrunsToTrip = 4.0;
+        /// The number of on-time blocks which cancel out one overrun
+        int blocksPerRecoveredOverrun = 50;
+        double initialSuspensionSeconds = 2.0;
+        double maximumSuspensionSeconds = 30.0;
+    };
+
+    struct OverrunEvent
+    {
+        juce::uint32 timeMs;
+        float elapsedMs;
+        float budgetMs;
+        bool hasTripped;
+    };
+
+    void setPolicy(const Policy& newPolicy);
+    Policy getPolicy() const;
+
+    /// Offline rendering has no deadline, so while offline, no block counts as an overrun and the hosted plugin is never suspended.
+    void setOffline(bool shouldBeOffline) { offline = shouldBeOffline; }
+
+    void prepare(double newSampleRate);
+
+    /// Returns `false` while the watchdog is tripped, in which case the hosted plugin must not be called for this block.
+    bool shouldProcess(int numSamples);
+
+    void blockStarted();
+    void blockFinished(int numSamples);
+
+    bool isTripped() const { return tripped; }
+
+    int getTotalOverruns() const { return totalOverruns; }
+
+    /// Returns the time the hosted plugin takes to render a block as a fraction of the block's duration, exponentially weighted.
+    float getCpuLoad() const { return cpuLoad.load(std::memory_order_relaxed); }
+
+    /// Passes all overrun events logged since the last call to the callback. Call this on a single (e.g. message) thread.
+    void readOverrunEvents(const std::function<void(const OverrunEvent&)>& callback);
+
+private:
+    void logOverrun(float elapsedMs, float budgetMs, bool hasTripped);
+
+    std::atomic<int> action { (int) Action::none };
+    std::atomic<bool> offline { false };
+    std::atomic<double> overrunThreshold { Policy().overrunThreshold };
+    std::atomic<double> overrunsToTrip { Policy().overrunsToTrip };
+    std::atomic<int> blocksPerRecoveredOverrun { Policy().blocksPerRecoveredOverrun };
+    std::atomic<double> initialSuspensionSeconds { Policy().initialSuspensionSeconds };
+    std::atomic<double> maximumSuspensionSeconds { Policy().maximumSuspensionSeconds };
+
+    // Rendering thread state
+    double sampleRate = 44100.0;
+    juce::int64 blockStartTicks = 0;
+    double overrunBucket = 0.0;
+    juce::int64 suspendedSamplesRemaining = 0;
+    double currentSuspensionSeconds = 0.0;
+    bool isOnProbation = false;
+    int probationBlocksRemaining = 0;
+
+    std::atomic<bool> tripped { false };
+    std::atomic<int> totalOverruns { 0 };
+    std::atomic<float> cpuLoad { 0.0f };
+
+    // The weight of the newest block, which averages the load over roughly the last 20 blocks
+    static constexpr float cpuLoadSmoothing = 0.05f;
+
+    // Lock-free overrun log, written by the rendering thread
+    static constexpr int overrunLogSize = 256;
+    static constexpr int probationBlocks = 100;
+    juce::AbstractFifo overrunLogFifo { overrunLogSize };
+    std::array<OverrunEvent, overrunLogSize> overrunLog;
+};
+
+/**
+ * @brief A delay line as long as the hosted plugin's latency, so that the bypassed signal stays aligned with the processed one.
+ */
+template <typename FloatType>
+class LatencyCompensatedBypass
+{
+public:
+    void prepare(int numChannels, int latencySamples, int maximumBlockSize)
+    {
+        delaySamples = latencySamples;
+        ring.setSize(numChannels, latencySamples + maximumBlockSize + 1);
+        ring.clear();
+        writePosition = 0;
+    }
+
+    /**
+     * @brief Stores the first `getNumChannels()` channels of the block.
+     *        If `shouldReplaceWithDelayed` is `true`, replaces them with the signal from `latencySamples` ago.
+     */
+    void process(juce::AudioBuffer<FloatType>& buffer, bool shouldReplaceWithDelayed)
+    {
+        const auto ringSize = ring.getNumSamples();
+        const auto numChannels = juce::jmin(ring.getNumChannels(), buffer.getNumChannels());
+        const auto numSamples = buffer.getNumSamples();
+
+        if (ringSize <= delaySamples + numSamples) { return; }
+
+        for (int i = 0; i < numChannels; ++i)
+        {
+            auto* samples = buffer.getWritePointer(i);
+            auto* delayed = ring.getWritePointer(i);
+            auto position = writePosition;
+
+            for (int j = 0; j < numSamples; ++j)
+            {
+                delayed[position] = samples[j];
+
+                if (shouldReplaceWithDelayed)
+                {
+                    auto readPosition = position - delaySamples;
+                    if (readPosition < 0) { readPosition += ringSize; }
+                    samples[j] = delayed[readPosition];
+                }
+
+                if (++position == ringSize) { position = 0; }
+            }
+        }
+
+        for (int i = numChannels; i < buffer.getNumChannels() && shouldReplaceWithDelayed; ++i)
+        {
+            buffer.clear(i, 0, numSamples);
+        }
+
+        writePosition = (writePosition + numSamples) % ringSize;
+    }
+
+private:
+    juce::AudioBuffer<FloatType> ring;
+    int delaySamples = 0;
+    int writePosition = 0;
+};
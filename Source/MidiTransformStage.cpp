@@ -0,0 +1,288 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "MidiTransformStage.h"
+
+//==============================================================================
+
+namespace
+{
+    // `juce::MidiBuffer` stores every event as its sample position, its size and its bytes
+    constexpr int eventHeaderBytes = (int) (sizeof (juce::int32) + sizeof (juce::uint16));
+
+    bool parseChannel(const juce::String& token, int& channel)
+    {
+        channel = token.getIntValue() - 1;
+        return token.containsOnly("0123456789") && juce::isPositiveAndBelow(channel, 16);
+    }
+}
+
+void MidiTransformStage::resetTable(Table& table)
+{
+    table.isActive = false;
+    table.controllerIntervalsMs.fill(0.0f);
+
+    for (int channel = 0; channel < 16; ++channel)
+    {
+        table.channels[(size_t) channel] = (juce::int8) channel;
+
+        for (int note = 0; note < 128; ++note)
+        {
+            table.notes[(size_t) channel][(size_t) note] = (juce::int16) (channel * 128 + note);
+        }
+    }
+}
+
+bool MidiTransformStage::applyRule(const juce::String& rule, Table& table)
+{
+    auto tokens = juce::StringArray::fromTokens(rule.toLowerCase(), " \t>", {});
+    tokens.removeEmptyStrings();
+
+    if (tokens.isEmpty()) { return false; }
+
+    // Every rule is applied to where the previous rules have sent each channel and note, so that rules compose
+    const auto forEachDestination = [&table](const std::function<int(int channel, int note)>& mapNote,
+                                             const std::function<int(int channel)>& mapChannel)
+    {
+        for (auto& channel : table.channels)
+        {
+            if (channel >= 0) { channel = (juce::int8) mapChannel(channel); }
+        }
+
+        for (auto& channelNotes : table.notes)
+        {
+            for (auto& destination : channelNotes)
+            {
+                if (destination >= 0) { destination = (juce::int16) mapNote(destination / 128, destination % 128); }
+            }
+        }
+    };
+
+    const auto& kind = tokens[0];
+    int from = 0, to = 0;
+
+    if (kind == "channel" && tokens.size() == 3 && parseChannel(tokens[1], from) && parseChannel(tokens[2], to))
+    {
+        forEachDestination([from, to](int channel, int note) { return (channel == from ? to : channel) * 128 + note; },
+                           [from, to](int channel) { return channel == from ? to : channel; });
+    }
+    else if (kind == "drop" && tokens.size() == 3 && tokens[1] == "channel" && parseChannel(tokens[2], from))
+    {
+        forEachDestination([from](int channel, int note) { return channel == from ? -1 : channel * 128 + note; },
+                           [from](int channel) { return channel == from ? -1 : channel; });
+    }
+    else if (kind == "notes" && tokens.size() == 2 && tokens[1].containsChar('-'))
+    {
+        const auto low = tokens[1].upToFirstOccurrenceOf("-", false, false).getIntValue();
+        const auto high = tokens[1].fromFirstOccurrenceOf("-", false, false).getIntValue();
+
+        if (!juce::isPositiveAndBelow(low, 128) || !juce::isPositiveAndBelow(high, 128) || low > high) { return false; }
+
+        forEachDestination([low, high](int channel, int note) { return note < low || note > high ? -1 : channel * 128 + note; },
+                           [](int channel) { return channel; });
+    }
+    else if (kind == "transpose" && tokens.size() == 2 && tokens[1].trimCharactersAtStart("+-").isNotEmpty()
+             && tokens[1].trimCharactersAtStart("+-").containsOnly("0123456789"))
+    {
+        const auto semitones = tokens[1].getIntValue();
+
+        forEachDestination([semitones](int channel, int note) { return juce::isPositiveAndBelow(note + semitones, 128) ? channel * 128 + note + semitones : -1; },
+                           [](int channel) { return channel; });
+    }
+    else if (kind == "thin" && tokens.size() == 4 && tokens[1] == "cc" && tokens[3].endsWith("ms"))
+    {
+        const auto intervalMs = tokens[3].dropLastCharacters(2).getFloatValue();
+
+        if (intervalMs <= 0.0f) { return false; }
+
+        if (tokens[2] == "*")
+        {
+            table.controllerIntervalsMs.fill(intervalMs);
+        }
+        else
+        {
+            const auto controller = tokens[2].getIntValue();
+
+            if (!tokens[2].containsOnly("0123456789") || !juce::isPositiveAndBelow(controller, 128)) { return false; }
+
+            table.controllerIntervalsMs[(size_t) controller] = intervalMs;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    table.isActive = true;
+    return true;
+}
+
+juce::String MidiTransformStage::compile(const juce::String& rules, Tables& tables)
+{
+    resetTable(tables.input);
+    resetTable(tables.output);
+
+    const auto lines = juce::StringArray::fromLines(rules);
+
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        const auto line = lines[i].upToFirstOccurrenceOf("#", false, false).trim();
+
+        if (line.isEmpty()) { continue; }
+
+        const auto stage = line.upToFirstOccurrenceOf(":", false, false).trim().toLowerCase();
+        const auto rule = line.fromFirstOccurrenceOf(":", false, false);
+        auto* table = stage == "in" ? &tables.input : (stage == "out" ? &tables.output : nullptr);
+
+        if (table == nullptr || !applyRule(rule, *table))
+        {
+            return "Line " + juce::String(i + 1) + " isn't a valid rule: " + lines[i].trim();
+        }
+    }
+
+    return {};
+}
+
+void MidiTransformStage::setTables(const Tables& newTables)
+{
+    stages[(size_t) Stage::input].table = newTables.input;
+    stages[(size_t) Stage::output].table = newTables.output;
+    prepare(currentSampleRate);
+}
+
+void MidiTransformStage::prepare(double sampleRate)
+{
+    currentSampleRate = sampleRate;
+    samplePosition = 0;
+    scratch.ensureSize((size_t) preallocatedBytes);
+
+    for (auto& state : stages)
+    {
+        for (int controller = 0; controller < 128; ++controller)
+        {
+            state.controllerIntervals[(size_t) controller] = juce::roundToInt(state.table.controllerIntervalsMs[(size_t) controller] * sampleRate / 1000.0);
+        }
+
+        for (auto& channelTimes : state.lastControllerTimes)
+        {
+            channelTimes.fill(std::numeric_limits<juce::int64>::min() / 2);
+        }
+    }
+}
+
+//==============================================================================
+
+bool MidiTransformStage::transformEvent(StageState& state, juce::uint8* data, int numBytes, int time)
+{
+    const auto status = data[0];
+
+    // System messages have no channel, and pass unchanged
+    if (status < 0x80 || status >= 0xf0) { return true; }
+
+    const auto type = status & 0xf0;
+    const auto channel = status & 0x0f;
+
+    // Note on, note off and polyphonic aftertouch follow their note
+    if ((type == 0x80 || type == 0x90 || type == 0xa0) && numBytes >= 2)
+    {
+        const auto destination = state.table.notes[(size_t) channel][(size_t) (data[1] & 0x7f)];
+
+        if (destination < 0) { return false; }
+
+        data[0] = (juce::uint8) (type | (destination >> 7));
+        data[1] = (juce::uint8) (destination & 0x7f);
+        return true;
+    }
+
+    const auto destinationChannel = state.table.channels[(size_t) channel];
+
+    if (destinationChannel < 0) { return false; }
+
+    data[0] = (juce::uint8) (type | destinationChannel);
+
+    if (type == 0xb0 && numBytes >= 3)
+    {
+        const auto controller = (size_t) (data[1] & 0x7f);
+        const auto interval = state.controllerIntervals[controller];
+
+        if (interval > 0)
+        {
+            auto& lastTime = state.lastControllerTimes[(size_t) destinationChannel][controller];
+            const auto absoluteTime = samplePosition + time;
+
+            if (absoluteTime - lastTime < interval) { return false; }
+
+            lastTime = absoluteTime;
+        }
+    }
+
+    return true;
+}
+
+void MidiTransformStage::process(Stage stage, juce::MidiBuffer& midiMessages)
+{
+    auto& state = stages[(size_t) stage];
+
+    if (!state.table.isActive || midiMessages.isEmpty()) { return; }
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    auto* const begin = midiMessages.data.begin();
+    auto* const end = midiMessages.data.end();
+    auto* write = begin;
+    juce::int64 eventCount = 0;
+
+    // Events are rewritten in place, and the ones which pass are moved down over the dropped ones. Their order doesn't change.
+    for (auto* read = begin; read < end; ++eventCount)
+    {
+        const auto time = juce::readUnaligned<juce::int32>(read);
+        const auto numBytes = (int) juce::readUnaligned<juce::uint16>(read + sizeof (juce::int32));
+        const auto eventBytes = eventHeaderBytes + numBytes;
+
+        if (transformEvent(state, read + eventHeaderBytes, numBytes, time))
+        {
+            if (write != read) { std::memmove(write, read, (size_t) eventBytes); }
+
+            write += eventBytes;
+        }
+
+        read += eventBytes;
+    }
+
+    // Shrinking the host's buffer could release its memory, so the events are copied back into it instead
+    if (write != end)
+    {
+        const auto numBytes = (int) (write - begin);
+        scratch.data.clearQuick();
+        scratch.data.addArray(begin, numBytes);
+        midiMessages.data.clearQuick();
+        midiMessages.data.addArray(scratch.data.begin(), numBytes);
+    }
+
+    numEvents.fetch_add(eventCount, std::memory_order_relaxed);
+    processingTicks.fetch_add(juce::Time::getHighResolutionTicks() - startTicks, std::memory_order_relaxed);
+}
+
+MidiTransformStage::Statistics MidiTransformStage::getStatistics() const
+{
+    Statistics statistics;
+    statistics.numEvents = numEvents.load(std::memory_order_relaxed);
+
+    if (statistics.numEvents > 0)
+    {
+        const auto seconds = juce::Time::highResolutionTicksToSeconds(processingTicks.load(std::memory_order_relaxed));
+        statistics.nanosecondsPerEvent = seconds * 1.0e9 / (double) statistics.numEvents;
+    }
+
+    return statistics;
+}
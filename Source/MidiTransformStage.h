@@ -0,0 +1,112 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief Remaps channels, filters note ranges, transposes and thins controller streams around the hosted plugin, instead of extra MIDI FX.
+ *
+ * The rules are written one per line, and each line starts with the stage it belongs to: `in:` rules change the MIDI sent
+ * to the hosted plugin, `out:` rules the MIDI it sends. Within a stage, rules apply in the order they're written.
+ *
+ *     in: channel 2 > 1       moves the events of channel 2 to channel 1
+ *     in: drop channel 10     drops every event of channel 10
+ *     in: notes 36-84         drops note events outside the range
+ *     in: transpose -12       transposes notes, dropping those which fall outside 0-127
+ *     out: thin cc 1 10ms     passes at most one CC 1 per channel every 10 ms (`cc *` thins every controller)
+ *
+ * Text after `#` is a comment. The rules are compiled on the message thread into a flat table per stage, which maps every
+ * channel and note to its destination, so `process` does a couple of lookups per event. `process` never blocks, and never
+ * allocates as long as a block has less than `preallocatedBytes` of MIDI.
+ */
+class MidiTransformStage
+{
+public:
+    enum class Stage
+    {
+        input = 0,
+        output
+    };
+
+    struct Table
+    {
+        /// `false` if the stage has no rules, so that its events pass unchanged
+        bool isActive = false;
+        /// The destination channel (0-15) of every channel's events without a note, or -1 to drop them
+        std::array<juce::int8, 16> channels {};
+        /// The destination of every channel's notes, as `channel * 128 + note`, or -1 to drop them
+        std::array<std::array<juce::int16, 128>, 16> notes {};
+        /// The minimum time between two messages of every controller on a channel, or 0 to pass all of them
+        std::array<float, 128> controllerIntervalsMs {};
+    };
+
+    struct Tables
+    {
+        Table input;
+        Table output;
+    };
+
+    /**
+     * @brief Compiles the rules into `tables`.
+     * @return An error naming the first invalid line, or an empty string if all the rules are valid.
+     */
+    static juce::String compile(const juce::String& rules, Tables& tables);
+
+    /// Applies compiled rules. Must be called while `process` isn't running.
+    void setTables(const Tables& newTables);
+
+    /// Must be called while `process` isn't running.
+    void prepare(double sampleRate);
+
+    /// Transforms the block's MIDI in place.
+    void process(Stage stage, juce::MidiBuffer& midiMessages);
+
+    /// Moves the clock used for thinning to the next block. Called once per block, after both stages.
+    void advance(int numSamples) { samplePosition += numSamples; }
+
+    struct Statistics
+    {
+        juce::int64 numEvents = 0;
+        double nanosecondsPerEvent = 0.0;
+    };
+
+    /// Returns how many events have been transformed, and how long an event took on average. Can be called on any thread.
+    Statistics getStatistics() const;
+
+    // Enough for about 16k three-byte events per block, which covers dense MPE streams
+    static constexpr int preallocatedBytes = 16384 * 12;
+
+private:
+    struct StageState
+    {
+        Table table;
+        std::array<int, 128> controllerIntervals {};
+        // The time of the last message which passed, per channel and controller
+        std::array<std::array<juce::int64, 128>, 16> lastControllerTimes {};
+    };
+
+    static void resetTable(Table& table);
+    static bool applyRule(const juce::String& rule, Table& table);
+    bool transformEvent(StageState& state, juce::uint8* data, int numBytes, int time);
+
+    std::array<StageState, 2> stages;
+    double currentSampleRate = 44100.0;
+    juce::int64 samplePosition = 0;
+    juce::MidiBuffer scratch;
+
+    std::atomic<juce::int64> numEvents { 0 };
+    std::atomic<juce::int64> processingTicks { 0 };
+};
@@ -0,0 +1,400 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "PipelinedRenderer.h"
+
+#if JUCE_MAC
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+#endif
+
+//==============================================================================
+
+PipelinedRenderer::WakeUpSemaphore::WakeUpSemaphore()
+{
+   #if JUCE_MAC
+    semaphore = dispatch_semaphore_create(0);
+   #else
+    auto* posixSemaphore = new sem_t;
+    sem_init(posixSemaphore, 0, 0);
+    semaphore = posixSemaphore;
+   #endif
+}
+
+PipelinedRenderer::WakeUpSemaphore::~WakeUpSemaphore()
+{
+   #if JUCE_MAC
+    dispatch_release(static_cast<dispatch_semaphore_t>(semaphore));
+   #else
+    sem_destroy(static_cast<sem_t*>(semaphore));
+    delete static_cast<sem_t*>(semaphore);
+   #endif
+}
+
+void PipelinedRenderer::WakeUpSemaphore::post()
+{
+   #if JUCE_MAC
+    dispatch_semaphore_signal(static_cast<dispatch_semaphore_t>(semaphore));
+   #else
+    sem_post(static_cast<sem_t*>(semaphore));
+   #endif
+}
+
+bool PipelinedRenderer::WakeUpSemaphore::wait(int timeoutMs)
+{
+   #if JUCE_MAC
+    const auto timeout = dispatch_time(DISPATCH_TIME_NOW, (int64_t) timeoutMs * 1000000);
+    return dispatch_semaphore_wait(static_cast<dispatch_semaphore_t>(semaphore), timeout) == 0;
+   #else
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000;
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    // Interrupted waits are retried, as only a post or the timeout should end them
+    while (sem_timedwait(static_cast<sem_t*>(semaphore), &deadline) != 0)
+    {
+        if (errno != EINTR) { return false; }
+    }
+
+    return true;
+   #endif
+}
+
+//==============================================================================
+
+PipelinedRenderer::PipelinedRenderer(RenderCallback renderCallback)
+: juce::Thread("VST3 Wrapper Render"), render(std::move(renderCallback))
+{
+}
+
+PipelinedRenderer::~PipelinedRenderer()
+{
+    stop();
+}
+
+//==============================================================================
+
+void PipelinedRenderer::stop()
+{
+    signalThreadShouldExit();
+    workAvailable.post();
+    stopThread(-1);
+}
+
+void PipelinedRenderer::prepare(int newNumChannels, int maximumBlockSize)
+{
+    stop();
+
+    numChannels = newNumChannels;
+    maxBlockSize = juce::jmax(1, maximumBlockSize);
+    // The worker needs until the end of the next host block to render the current one
+    latencySamples = maxBlockSize;
+
+    const auto ringSize = latencySamples + (numBlockSlots + 1) * maxBlockSize;
+
+    // AbstractFifo keeps one slot empty to tell a full buffer from an empty one
+    inputFifo.setTotalSize(ringSize + 1);
+    inputFifo.reset();
+    inputRing.setSize(numChannels, ringSize + 1);
+    inputRing.clear();
+
+    // Big enough for the latency, every queued block and the silence standing in for blocks that couldn't be queued
+    outputFifo.setTotalSize(2 * ringSize + 1);
+    outputFifo.reset();
+    outputRing.setSize(numChannels, 2 * ringSize + 1);
+    outputRing.clear();
+
+    blockFifo.setTotalSize(numBlockSlots + 1);
+    blockFifo.reset();
+    blocks.resize(numBlockSlots + 1);
+
+    renderedMidiFifo.setTotalSize(numBlockSlots + 1);
+    renderedMidiFifo.reset();
+    renderedMidi.resize(numBlockSlots + 1);
+
+    for (auto& block : blocks) { block.midiMessages.ensureSize(midiBufferBytes); }
+    for (auto& rendered : renderedMidi) { rendered.midiMessages.ensureSize(midiBufferBytes); }
+
+    workBuffer.setSize(numChannels, maxBlockSize);
+    workMidi.ensureSize(midiBufferBytes);
+    delayedMidi.ensureSize(midiBufferBytes);
+    delayedMidiScratch.ensureSize(midiBufferBytes);
+
+    inputPosition = 0;
+    outputPosition = 0;
+    pendingSilence = 0;
+    samplesToDiscard = 0;
+    delayedMidi.clear();
+    deadlineMisses = 0;
+    blocksInFlight = 0;
+
+    // The first `latencySamples` of output are silence
+    int start1, size1, start2, size2;
+    outputFifo.prepareToWrite(latencySamples, start1, size1, start2, size2);
+    outputFifo.finishedWrite(size1 + size2);
+
+    startThread(juce::Thread::Priority::highest);
+}
+
+//==============================================================================
+// Audio thread
+//==============================================================================
+
+// Only used offline, where the host waits for every block anyway
+template <typename Predicate>
+void PipelinedRenderer::waitForWorker(Predicate isDone)
+{
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+
+    while (!isDone() && blocksInFlight > 0 && isThreadRunning())
+    {
+        if (juce::Time::getMillisecondCounterHiRes() - startMs > offlineWaitTimeoutMs) { return; }
+
+        blockRendered.wait(workerWaitTimeoutMs);
+    }
+}
+
+void PipelinedRenderer::process(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                                const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive)
+{
+    const auto numSamples = buffer.getNumSamples();
+    auto missedDeadline = false;
+
+    jassert(numSamples <= maxBlockSize);
+
+    collectRenderedMidi();
+
+    if (waitsForWorker)
+    {
+        waitForWorker([&] { return inputFifo.getFreeSpace() >= numSamples && blockFifo.getFreeSpace() >= 1; });
+    }
+
+    // Queue the block for the worker
+    if (numSamples <= maxBlockSize && inputFifo.getFreeSpace() >= numSamples && blockFifo.getFreeSpace() >= 1)
+    {
+        int start1, size1, start2, size2;
+        inputFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+        copyToRing(inputRing, start1, buffer, 0, size1);
+        copyToRing(inputRing, start2, buffer, size1, size2);
+        inputFifo.finishedWrite(size1 + size2);
+
+        blockFifo.prepareToWrite(1, start1, size1, start2, size2);
+        auto& block = blocks[(size_t) start1];
+        block.numSamples = numSamples;
+        block.leadingSilence = pendingSilence;
+        block.inputPosition = inputPosition;
+        block.isActive = isActive;
+        block.position = position;
+        block.midiMessages.clear();
+        block.midiMessages.addEvents(midiMessages, 0, numSamples, 0);
+        blockFifo.finishedWrite(1);
+
+        pendingSilence = 0;
+        ++blocksInFlight;
+        workAvailable.post();
+    }
+    else
+    {
+        pendingSilence += numSamples;
+        missedDeadline = true;
+    }
+
+    inputPosition += numSamples;
+
+    // Drop the output that arrived too late to be played
+    if (samplesToDiscard > 0)
+    {
+        const auto numToDiscard = juce::jmin(samplesToDiscard, outputFifo.getNumReady());
+        int start1, size1, start2, size2;
+        outputFifo.prepareToRead(numToDiscard, start1, size1, start2, size2);
+        outputFifo.finishedRead(size1 + size2);
+        samplesToDiscard -= size1 + size2;
+    }
+
+    if (waitsForWorker)
+    {
+        waitForWorker([&] { return outputFifo.getNumReady() >= numSamples; });
+        collectRenderedMidi();
+    }
+
+    // Replace the block with the rendered output
+    {
+        int start1, size1, start2, size2;
+        outputFifo.prepareToRead(numSamples, start1, size1, start2, size2);
+        copyFromRing(outputRing, start1, buffer, 0, size1);
+        copyFromRing(outputRing, start2, buffer, size1, size2);
+        outputFifo.finishedRead(size1 + size2);
+
+        const auto numRead = size1 + size2;
+
+        if (numRead < numSamples)
+        {
+            buffer.clear(numRead, numSamples - numRead);
+            samplesToDiscard += numSamples - numRead;
+            missedDeadline = true;
+        }
+
+        for (int i = numChannels; i < buffer.getNumChannels(); ++i)
+        {
+            buffer.clear(i, 0, numSamples);
+        }
+    }
+
+    if (missedDeadline)
+    {
+        ++deadlineMisses;
+    }
+
+    // Emit the MIDI rendered for this block's output range and keep the rest for later blocks
+    midiMessages.clear();
+    delayedMidiScratch.clear();
+
+    for (const auto metadata : delayedMidi)
+    {
+        if (metadata.samplePosition < numSamples)
+        {
+            midiMessages.addEvent(metadata.data, metadata.numBytes, juce::jmax(0, metadata.samplePosition));
+        }
+        else
+        {
+            delayedMidiScratch.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition - numSamples);
+        }
+    }
+
+    delayedMidi.swapWith(delayedMidiScratch);
+    outputPosition += numSamples;
+}
+
+void PipelinedRenderer::collectRenderedMidi()
+{
+    while (renderedMidiFifo.getNumReady() > 0)
+    {
+        int start1, size1, start2, size2;
+        renderedMidiFifo.prepareToRead(1, start1, size1, start2, size2);
+        const auto& rendered = renderedMidi[(size_t) start1];
+
+        // A block's output is played `latencySamples` after its input
+        const auto offset = (int) (rendered.inputPosition + latencySamples - outputPosition);
+
+        for (const auto metadata : rendered.midiMessages)
+        {
+            delayedMidi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition + offset);
+        }
+
+        renderedMidiFifo.finishedRead(1);
+    }
+}
+
+void PipelinedRenderer::copyToRing(juce::AudioBuffer<float>& ring, int ringStart, const juce::AudioBuffer<float>& source, int sourceStart, int numSamples)
+{
+    if (numSamples <= 0) { return; }
+
+    for (int i = 0; i < ring.getNumChannels(); ++i)
+    {
+        if (i < source.getNumChannels())
+            ring.copyFrom(i, ringStart, source, i, sourceStart, numSamples);
+        else
+            ring.clear(i, ringStart, numSamples);
+    }
+}
+
+void PipelinedRenderer::copyFromRing(const juce::AudioBuffer<float>& ring, int ringStart, juce::AudioBuffer<float>& destination, int destinationStart, int numSamples)
+{
+    if (numSamples <= 0) { return; }
+
+    for (int i = 0; i < juce::jmin(ring.getNumChannels(), destination.getNumChannels()); ++i)
+    {
+        destination.copyFrom(i, destinationStart, ring, i, ringStart, numSamples);
+    }
+}
+
+//==============================================================================
+// Worker thread
+//==============================================================================
+
+void PipelinedRenderer::run()
+{
+    while (!threadShouldExit())
+    {
+        workAvailable.wait(workerWaitTimeoutMs);
+
+        while (blockFifo.getNumReady() > 0 && !threadShouldExit())
+        {
+            renderNextBlock();
+        }
+    }
+}
+
+void PipelinedRenderer::renderNextBlock()
+{
+    int start1, size1, start2, size2;
+    blockFifo.prepareToRead(1, start1, size1, start2, size2);
+    auto& block = blocks[(size_t) start1];
+
+    const auto numSamples = block.numSamples;
+    const auto leadingSilence = block.leadingSilence;
+    const auto blockInputPosition = block.inputPosition;
+    const auto isActive = block.isActive;
+    const auto position = block.position;
+
+    workBuffer.setSize(numChannels, numSamples, false, false, true);
+    workMidi.clear();
+    workMidi.addEvents(block.midiMessages, 0, numSamples, 0);
+
+    blockFifo.finishedRead(1);
+
+    inputFifo.prepareToRead(numSamples, start1, size1, start2, size2);
+    copyFromRing(inputRing, start1, workBuffer, 0, size1);
+    copyFromRing(inputRing, start2, workBuffer, size1, size2);
+    inputFifo.finishedRead(size1 + size2);
+
+    render(workBuffer, workMidi, position, isActive);
+
+    // Silence in place of the blocks that weren't queued keeps the output aligned with the input
+    const auto numSilent = juce::jmin(leadingSilence, outputFifo.getFreeSpace() - numSamples);
+
+    if (numSilent > 0)
+    {
+        outputFifo.prepareToWrite(numSilent, start1, size1, start2, size2);
+        if (size1 > 0) { outputRing.clear(start1, size1); }
+        if (size2 > 0) { outputRing.clear(start2, size2); }
+        outputFifo.finishedWrite(size1 + size2);
+    }
+
+    outputFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+    copyToRing(outputRing, start1, workBuffer, 0, size1);
+    copyToRing(outputRing, start2, workBuffer, size1, size2);
+    outputFifo.finishedWrite(size1 + size2);
+
+    if (renderedMidiFifo.getFreeSpace() >= 1 && !workMidi.isEmpty())
+    {
+        renderedMidiFifo.prepareToWrite(1, start1, size1, start2, size2);
+        auto& rendered = renderedMidi[(size_t) start1];
+        rendered.inputPosition = blockInputPosition;
+        rendered.midiMessages.clear();
+        rendered.midiMessages.addEvents(workMidi, 0, -1, 0);
+        renderedMidiFifo.finishedWrite(1);
+    }
+
+    --blocksInFlight;
+    blockRendered.post();
+}
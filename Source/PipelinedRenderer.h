@@ -0,0 +1,163 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief Renders audio blocks on a dedicated high priority thread, one block behind the host.
+ *
+ * Logic renders a track's plugin chain on a single thread, so a heavy hosted plugin limits the whole track.
+ * `process` queues the host's block for the worker thread and returns the output the worker has already rendered,
+ * so the hosted plugin runs in parallel with the rest of the host's graph, at the cost of `getLatencySamples()` samples of latency.
+ *
+ * Audio, MIDI and block descriptions are exchanged through single-producer single-consumer FIFOs, so the audio thread never waits for the worker.
+ * If the worker misses a deadline, the missing samples are replaced with silence and the worker's late output is dropped later,
+ * so that the latency stays constant.
+ */
+class PipelinedRenderer : private juce::Thread
+{
+public:
+    /// Called on the worker thread. The buffer has `getNumChannels()` channels and the MIDI buffer contains the block's MIDI input.
+    using RenderCallback = std::function<void(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                                              const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive)>;
+
+    explicit PipelinedRenderer(RenderCallback renderCallback);
+    ~PipelinedRenderer() override;
+
+    /**
+     * @brief Allocates all the buffers and starts the worker thread.
+     *
+     * @warning Must not be called while `process` may be running on the audio thread.
+     */
+    void prepare(int numChannels, int maximumBlockSize);
+    
+    /// Stops the worker thread, waiting for the block it is currently rendering. `prepare` starts it again.
+    void stop();
+
+    /**
+     * @brief Hands the block to the worker thread and replaces its content with the audio and MIDI rendered `getLatencySamples()` samples ago.
+     *        Never blocks and never allocates.
+     */
+    void process(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                 const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive);
+
+    int getLatencySamples() const { return latencySamples; }
+
+    int getNumChannels() const { return numChannels; }
+
+    /// The number of host blocks which were (at least partially) replaced with silence because the worker was late.
+    int getNumDeadlineMisses() const { return deadlineMisses; }
+
+    /**
+     * @brief When set, `process` waits for the worker instead of replacing late output with silence. Meant for offline rendering,
+     *        where the host has no deadline, so the hosted plugin still renders in parallel with the host's graph but never drops a block.
+     */
+    void setWaitsForWorker(bool shouldWait) { waitsForWorker = shouldWait; }
+
+private:
+    struct Block
+    {
+        int numSamples = 0;
+        // Silence the worker writes before the block's output, in place of blocks the audio thread couldn't queue
+        int leadingSilence = 0;
+        juce::int64 inputPosition = 0;
+        bool isActive = true;
+        juce::Optional<juce::AudioPlayHead::PositionInfo> position;
+        juce::MidiBuffer midiMessages;
+    };
+
+    struct RenderedMidi
+    {
+        juce::int64 inputPosition = 0;
+        juce::MidiBuffer midiMessages;
+    };
+
+    /**
+     * A counting semaphore whose `post` never takes a lock, so that the audio thread can wake the worker up.
+     * `juce::WaitableEvent::signal` locks a mutex the woken thread may still hold. A dispatch semaphore (macOS)
+     * or a POSIX semaphore (Linux) only enters the kernel when a thread is actually waiting.
+     */
+    class WakeUpSemaphore
+    {
+    public:
+        WakeUpSemaphore();
+        ~WakeUpSemaphore();
+
+        void post();
+
+        /// Returns `false` if the timeout expired before `post` was called.
+        bool wait(int timeoutMs);
+
+    private:
+        void* semaphore = nullptr;
+
+        JUCE_DECLARE_NON_COPYABLE (WakeUpSemaphore)
+    };
+
+    void run() override;
+    void renderNextBlock();
+    void collectRenderedMidi();
+    template <typename Predicate>
+    void waitForWorker(Predicate isDone);
+
+    static void copyToRing(juce::AudioBuffer<float>& ring, int ringStart, const juce::AudioBuffer<float>& source, int sourceStart, int numSamples);
+    static void copyFromRing(const juce::AudioBuffer<float>& ring, int ringStart, juce::AudioBuffer<float>& destination, int destinationStart, int numSamples);
+
+    RenderCallback render;
+
+    int numChannels = 0;
+    int maxBlockSize = 0;
+    int latencySamples = 0;
+
+    // Audio thread -> worker
+    juce::AbstractFifo inputFifo { 1 };
+    juce::AudioBuffer<float> inputRing;
+    juce::AbstractFifo blockFifo { 1 };
+    std::vector<Block> blocks;
+
+    // Worker -> audio thread
+    juce::AbstractFifo outputFifo { 1 };
+    juce::AudioBuffer<float> outputRing;
+    juce::AbstractFifo renderedMidiFifo { 1 };
+    std::vector<RenderedMidi> renderedMidi;
+
+    // Owned by the worker
+    juce::AudioBuffer<float> workBuffer;
+    juce::MidiBuffer workMidi;
+    WakeUpSemaphore workAvailable;
+    WakeUpSemaphore blockRendered;
+    std::atomic<int> blocksInFlight { 0 };
+    std::atomic<bool> waitsForWorker { false };
+
+    // Owned by the audio thread
+    juce::int64 inputPosition = 0;
+    juce::int64 outputPosition = 0;
+    int pendingSilence = 0;
+    int samplesToDiscard = 0;
+    juce::MidiBuffer delayedMidi;
+    juce::MidiBuffer delayedMidiScratch;
+
+    std::atomic<int> deadlineMisses { 0 };
+
+    static constexpr int numBlockSlots = 8;
+    // Expected number of MIDI bytes per block; dense streams are preallocated for up front
+    static constexpr int midiBufferBytes = 64 * 1024;
+    static constexpr int workerWaitTimeoutMs = 100;
+    // A hosted plugin which hangs offline mustn't hang the host's bounce forever
+    static constexpr double offlineWaitTimeoutMs = 10000.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PipelinedRenderer)
+};
@@ -0,0 +1,551 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "PluginCatalog.h"
+
+//==============================================================================
+
+bool PluginCatalogEntry::isAcceptedByThisVariant() const
+{
+    // Without class information, only loading the plugin can tell
+    if (!hasClassInformation()) { return true; }
+
+#if JucePlugin_IsMidiEffect || JucePlugin_IsSynth
+    if (!hasInstrumentClass) { return false; }
+#else
+    if (!hasEffectClass) { return false; }
+#endif
+
+#if JucePlugin_IsMidiEffect
+    return acceptsMidi != Support::no && producesMidi != Support::no;
+#else
+    return true;
+#endif
+}
+
+//==============================================================================
+
+static bool isWordStart(const std::string& key, size_t position)
+{
+    return position == 0 || !juce::CharacterFunctions::isLetterOrDigit((juce::juce_wchar) (unsigned char) key[position - 1]);
+}
+
+// Returns a negative score if the word doesn't match the key
+static int scoreWord(const std::string& key, const std::string& word)
+{
+    // A contiguous match is always better than a scattered one
+    const auto substringPosition = key.find(word);
+
+    if (substringPosition != std::string::npos)
+    {
+        return 1000 + (substringPosition == 0 ? 200 : 0) + (isWordStart(key, substringPosition) ? 100 : 0) - (int) juce::jmin(substringPosition, (size_t) 99);
+    }
+
+    int score = 0;
+    size_t position = 0;
+    size_t previousMatch = std::string::npos;
+
+    for (const auto character : word)
+    {
+        position = key.find(character, position);
+
+        if (position == std::string::npos) { return -1; }
+
+        score += 1;
+        if (previousMatch != std::string::npos && position == previousMatch + 1) { score += 5; }
+        if (isWordStart(key, position)) { score += 8; }
+
+        previousMatch = position;
+        ++position;
+    }
+
+    return score;
+}
+
+std::vector<int> PluginCatalog::Snapshot::search(const juce::String& query) const
+{
+    std::vector<int> result;
+
+    juce::StringArray words;
+    words.addTokens(query.toLowerCase(), " \t", {});
+    words.removeEmptyStrings();
+
+    if (words.isEmpty())
+    {
+        result.resize(entries.size());
+        std::iota(result.begin(), result.end(), 0);
+        return result;
+    }
+
+    std::vector<std::string> queryWords;
+
+    for (const auto& word : words)
+    {
+        queryWords.push_back(word.toStdString());
+    }
+
+    std::vector<std::pair<int, int>> scored;
+
+    for (size_t i = 0; i < searchKeys.size(); ++i)
+    {
+        int score = 0;
+
+        for (const auto& word : queryWords)
+        {
+            const auto wordScore = scoreWord(searchKeys[i], word);
+
+            if (wordScore < 0)
+            {
+                score = -1;
+                break;
+            }
+
+            score += wordScore;
+        }
+
+        if (score >= 0)
+        {
+            scored.emplace_back(score, (int) i);
+        }
+    }
+
+    // Entries are already sorted by name, which breaks the ties
+    std::stable_sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    result.reserve(scored.size());
+
+    for (const auto& s : scored)
+    {
+        result.push_back(s.second);
+    }
+
+    return result;
+}
+
+//==============================================================================
+
+PluginCatalog::PluginCatalog()
+    : juce::Thread("VST3 Plugin Catalog"), snapshot(std::make_shared<Snapshot>())
+{
+}
+
+PluginCatalog::~PluginCatalog()
+{
+    stopThread(5000);
+
+    const juce::ScopedLock sl (lock);
+
+    // MIDI support learned since the last update
+    if (isIndexDirty)
+    {
+        writeIndex(getIndexFile(), allEntries);
+    }
+}
+
+std::shared_ptr<const PluginCatalog::Snapshot> PluginCatalog::getSnapshot() const
+{
+    const juce::ScopedLock sl (lock);
+    return snapshot;
+}
+
+void PluginCatalog::refresh()
+{
+    refreshing = true;
+
+    if (isThreadRunning())
+    {
+        notify();
+    }
+    else
+    {
+        startThread(juce::Thread::Priority::background);
+    }
+}
+
+void PluginCatalog::setMidiSupport(const juce::String& pluginPath, bool acceptsMidi, bool producesMidi)
+{
+    const auto toSupport = [](bool isSupported) { return isSupported ? PluginCatalogEntry::Support::yes : PluginCatalogEntry::Support::no; };
+
+    std::vector<PluginCatalogEntry> entries;
+
+    {
+        const juce::ScopedLock sl (lock);
+
+        auto entry = std::find_if(allEntries.begin(), allEntries.end(), [&](const auto& e) { return e.path == pluginPath; });
+
+        if (entry == allEntries.end()) { return; }
+        if (entry->acceptsMidi == toSupport(acceptsMidi) && entry->producesMidi == toSupport(producesMidi)) { return; }
+
+        entry->acceptsMidi = toSupport(acceptsMidi);
+        entry->producesMidi = toSupport(producesMidi);
+        isIndexDirty = true;
+        entries = allEntries;
+    }
+
+    publish(std::move(entries));
+}
+
+juce::Array<juce::File> PluginCatalog::getSearchFolders()
+{
+    return
+    {
+        juce::File("/Library/Audio/Plug-Ins/VST3"),
+        juce::File::getSpecialLocation(juce::File::userHomeDirectory).getChildFile("Library/Audio/Plug-Ins/VST3")
+    };
+}
+
+juce::File PluginCatalog::getIndexFile()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("Application Support/AU-VST3-Wrapper/plugin_catalog.index");
+}
+
+//==============================================================================
+
+void PluginCatalog::run()
+{
+    while (!threadShouldExit())
+    {
+        update();
+        refreshing = false;
+        // Lets the UI know that the update is over, even if nothing has changed
+        sendChangeMessage();
+
+        // `refresh` wakes us up for another update
+        wait(-1);
+    }
+}
+
+void PluginCatalog::update()
+{
+    std::vector<PluginCatalogEntry> previousEntries;
+    bool shouldPublishIndex = false;
+
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (!isIndexLoaded)
+        {
+            readIndex(getIndexFile(), allEntries);
+            isIndexLoaded = true;
+            shouldPublishIndex = true;
+        }
+
+        previousEntries = allEntries;
+    }
+
+    // The last known catalog is shown right away, while the folders are being searched
+    if (shouldPublishIndex)
+    {
+        publish(previousEntries);
+    }
+
+    std::map<juce::String, const PluginCatalogEntry*> previousByPath;
+
+    for (const auto& entry : previousEntries)
+    {
+        previousByPath[entry.path] = &entry;
+    }
+
+    juce::Array<juce::File> bundles;
+
+    for (const auto& folder : getSearchFolders())
+    {
+        findBundles(folder, bundles, 0);
+    }
+
+    std::vector<PluginCatalogEntry> entries;
+    entries.reserve((size_t) bundles.size());
+    auto hasChanged = (size_t) bundles.size() != previousEntries.size();
+    auto numRead = 0;
+
+    for (const auto& bundle : bundles)
+    {
+        if (threadShouldExit()) { return; }
+
+        const auto modificationTime = getBundleModificationTime(bundle);
+        const auto previous = previousByPath.find(bundle.getFullPathName());
+
+        if (previous != previousByPath.end() && previous->second->modificationTime == modificationTime)
+        {
+            entries.push_back(*previous->second);
+            continue;
+        }
+
+        entries.push_back(readBundle(bundle, modificationTime));
+        hasChanged = true;
+        ++numRead;
+    }
+
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (!hasChanged && !isIndexDirty) { return; }
+
+        // Keep the MIDI support learned by `setMidiSupport` while we were searching
+        for (auto& entry : entries)
+        {
+            const auto current = std::find_if(allEntries.begin(), allEntries.end(), [&](const auto& e) { return e.path == entry.path; });
+
+            if (current != allEntries.end() && current->modificationTime == entry.modificationTime)
+            {
+                entry.acceptsMidi = current->acceptsMidi;
+                entry.producesMidi = current->producesMidi;
+            }
+        }
+
+        allEntries = entries;
+        isIndexDirty = !writeIndex(getIndexFile(), allEntries);
+    }
+
+    juce::Logger::writeToLog("AU-VST3-Wrapper: plugin catalog updated, " + juce::String((int) entries.size()) + " bundles, "
+                             + juce::String(numRead) + " read");
+
+    publish(std::move(entries));
+}
+
+void PluginCatalog::findBundles(const juce::File& folder, juce::Array<juce::File>& bundles, int depth)
+{
+    for (const auto& child : folder.findChildFiles(juce::File::findDirectories, false))
+    {
+        if (child.hasFileExtension(vst3Extension))
+        {
+            bundles.add(child);
+        }
+        else if (depth < maxFolderDepth)
+        {
+            // Vendors often install into their own subfolder
+            findBundles(child, bundles, depth + 1);
+        }
+    }
+}
+
+void PluginCatalog::publish(std::vector<PluginCatalogEntry> newEntries)
+{
+    auto newSnapshot = std::make_shared<Snapshot>();
+
+    for (auto& entry : newEntries)
+    {
+        if (entry.isAcceptedByThisVariant())
+        {
+            newSnapshot->entries.push_back(std::move(entry));
+        }
+    }
+
+    std::sort(newSnapshot->entries.begin(), newSnapshot->entries.end(), [](const auto& a, const auto& b)
+    {
+        return a.name.compareNatural(b.name) < 0;
+    });
+
+    newSnapshot->searchKeys.reserve(newSnapshot->entries.size());
+
+    for (const auto& entry : newSnapshot->entries)
+    {
+        newSnapshot->searchKeys.push_back((entry.name + " " + entry.vendor + " " + entry.category).toLowerCase().toStdString());
+    }
+
+    {
+        const juce::ScopedLock sl (lock);
+        snapshot = std::move(newSnapshot);
+    }
+
+    sendChangeMessage();
+}
+
+//==============================================================================
+
+PluginCatalogEntry PluginCatalog::readBundle(const juce::File& bundle, juce::int64 modificationTime)
+{
+    PluginCatalogEntry entry;
+    entry.path = bundle.getFullPathName();
+    entry.name = bundle.getFileNameWithoutExtension();
+    entry.modificationTime = modificationTime;
+
+    if (!readModuleInfo(bundle, entry))
+    {
+        readInfoPlist(bundle, entry);
+    }
+
+    // A plugin's only class being an instrument makes its MIDI input certain
+    if (entry.hasInstrumentClass && !entry.hasEffectClass)
+    {
+        entry.acceptsMidi = PluginCatalogEntry::Support::yes;
+    }
+
+    return entry;
+}
+
+// See "VST 3 Module Info" in the VST3 SDK documentation
+bool PluginCatalog::readModuleInfo(const juce::File& bundle, PluginCatalogEntry& entry)
+{
+    const auto moduleInfoFile = bundle.getChildFile("Contents/Resources/moduleinfo.json");
+
+    if (!moduleInfoFile.existsAsFile()) { return false; }
+
+    const auto moduleInfo = juce::JSON::parse(moduleInfoFile);
+    const auto* classes = moduleInfo["Classes"].getArray();
+
+    if (classes == nullptr) { return false; }
+
+    auto hasAudioClass = false;
+
+    for (const auto& audioClass : *classes)
+    {
+        if (audioClass["Category"].toString() != "Audio Module Class") { continue; }
+
+        juce::StringArray subCategories;
+
+        if (const auto* subCategoryArray = audioClass["Sub Categories"].getArray())
+        {
+            for (const auto& subCategory : *subCategoryArray)
+            {
+                subCategories.add(subCategory.toString());
+            }
+        }
+
+        // The same rule `VST3PluginFormat` uses for `PluginDescription::isInstrument`
+        const auto isInstrument = subCategories.joinIntoString("|").contains("Instrument");
+        entry.hasInstrumentClass |= isInstrument;
+        entry.hasEffectClass |= !isInstrument;
+
+        // The first class names the bundle, as it's the one the wrapper prefers when valid
+        if (!hasAudioClass)
+        {
+            hasAudioClass = true;
+            entry.name = audioClass["Name"].toString().isNotEmpty() ? audioClass["Name"].toString() : entry.name;
+            entry.vendor = audioClass["Vendor"].toString();
+            entry.category = subCategories.joinIntoString("|");
+        }
+    }
+
+    if (entry.vendor.isEmpty())
+    {
+        entry.vendor = moduleInfo["Factory Info"]["Vendor"].toString();
+    }
+
+    return hasAudioClass;
+}
+
+void PluginCatalog::readInfoPlist(const juce::File& bundle, PluginCatalogEntry& entry)
+{
+    const auto plist = juce::parseXML(bundle.getChildFile("Contents/Info.plist"));
+
+    if (plist == nullptr) { return; }
+
+    const auto* dict = plist->getChildByName("dict");
+
+    if (dict == nullptr) { return; }
+
+    for (auto* key = dict->getChildByName("key"); key != nullptr; key = key->getNextElementWithTagName("key"))
+    {
+        const auto* value = key->getNextElement();
+
+        if (value == nullptr) { break; }
+
+        const auto keyName = key->getAllSubText();
+
+        if (keyName == "CFBundleName" && value->getAllSubText().isNotEmpty())
+        {
+            entry.name = value->getAllSubText();
+        }
+        else if (keyName == "CFBundleIdentifier" && entry.vendor.isEmpty())
+        {
+            // e.g. "com.vendor.plugin"
+            juce::StringArray components;
+            components.addTokens(value->getAllSubText(), ".", {});
+
+            if (components.size() > 2) { entry.vendor = components[1]; }
+        }
+    }
+}
+
+juce::int64 PluginCatalog::getBundleModificationTime(const juce::File& bundle)
+{
+    // A bundle's folder only changes when files are added or removed, so the files we read are checked too
+    return juce::jmax(bundle.getLastModificationTime().toMilliseconds(),
+                      bundle.getChildFile("Contents/Info.plist").getLastModificationTime().toMilliseconds(),
+                      bundle.getChildFile("Contents/Resources/moduleinfo.json").getLastModificationTime().toMilliseconds());
+}
+
+//==============================================================================
+
+bool PluginCatalog::readIndex(const juce::File& file, std::vector<PluginCatalogEntry>& entries)
+{
+    juce::MemoryBlock data;
+
+    if (!file.loadFileAsData(data)) { return false; }
+
+    juce::MemoryInputStream input (data, false);
+
+    if ((juce::uint32) input.readInt() != indexMagic || (juce::uint32) input.readInt() != indexVersion) { return false; }
+
+    const auto numEntries = input.readInt();
+
+    if (numEntries < 0 || numEntries > maxIndexEntries) { return false; }
+
+    std::vector<PluginCatalogEntry> result;
+    result.reserve((size_t) numEntries);
+
+    for (int i = 0; i < numEntries; ++i)
+    {
+        PluginCatalogEntry entry;
+        entry.path = input.readString();
+        entry.name = input.readString();
+        entry.vendor = input.readString();
+        entry.category = input.readString();
+        entry.modificationTime = input.readInt64();
+
+        const auto flags = input.readByte();
+        entry.hasInstrumentClass = (flags & 1) != 0;
+        entry.hasEffectClass = (flags & 2) != 0;
+        entry.acceptsMidi = (PluginCatalogEntry::Support) juce::jlimit(0, 2, (int) input.readByte());
+        entry.producesMidi = (PluginCatalogEntry::Support) juce::jlimit(0, 2, (int) input.readByte());
+
+        result.push_back(std::move(entry));
+    }
+
+    // A truncated index is rebuilt from scratch
+    if (input.getPosition() > (juce::int64) data.getSize()) { return false; }
+
+    entries = std::move(result);
+    return true;
+}
+
+bool PluginCatalog::writeIndex(const juce::File& file, const std::vector<PluginCatalogEntry>& entries)
+{
+    juce::MemoryOutputStream output;
+    output.writeInt((int) indexMagic);
+    output.writeInt((int) indexVersion);
+    output.writeInt((int) entries.size());
+
+    for (const auto& entry : entries)
+    {
+        output.writeString(entry.path);
+        output.writeString(entry.name);
+        output.writeString(entry.vendor);
+        output.writeString(entry.category);
+        output.writeInt64(entry.modificationTime);
+        output.writeByte((char) ((entry.hasInstrumentClass ? 1 : 0) | (entry.hasEffectClass ? 2 : 0)));
+        output.writeByte((char) entry.acceptsMidi);
+        output.writeByte((char) entry.producesMidi);
+    }
+
+    file.getParentDirectory().createDirectory();
+
+    // Other wrapper processes may be reading the index
+    juce::TemporaryFile temporaryFile (file);
+
+    return temporaryFile.getFile().replaceWithData(output.getData(), output.getDataSize())
+        && temporaryFile.overwriteTargetFileWithTemporary();
+}
@@ -0,0 +1,136 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/// What the catalog knows about a VST3 bundle without loading it.
+struct PluginCatalogEntry
+{
+    enum class Support : juce::uint8
+    {
+        unknown = 0,
+        no,
+        yes
+    };
+
+    juce::String path;
+    juce::String name;
+    juce::String vendor;
+    /// VST3 sub categories of the bundle's audio classes, e.g. "Fx|Delay"
+    juce::String category;
+    /// The bundle's modification time when it was indexed, in milliseconds since the epoch
+    juce::int64 modificationTime = 0;
+
+    /// Both `false` if the bundle has no readable class information (no `moduleinfo.json`)
+    bool hasInstrumentClass = false;
+    bool hasEffectClass = false;
+
+    /// Instruments are known to accept MIDI. Anything else is learned from loading the plugin (see `PluginCatalog::setMidiSupport`).
+    Support acceptsMidi = Support::unknown;
+    Support producesMidi = Support::unknown;
+
+    bool hasClassInformation() const
+    {
+        return hasInstrumentClass || hasEffectClass;
+    }
+
+    /// Returns `false` if the bundle is known to be rejected by this wrapper variant, e.g. an effect in the Instrument build.
+    bool isAcceptedByThisVariant() const;
+};
+
+/**
+ * @brief A process-wide catalog of the installed VST3 plugins, shared by all wrapper instances through `juce::SharedResourcePointer`.
+ *
+ * The catalog is built on a background thread from each bundle's `moduleinfo.json` (or `Info.plist`, if there is none), without loading any plugin binary.
+ * It is stored as a compact binary index in the wrapper's Application Support folder, and only bundles whose modification time has changed since are read again.
+ * A change message is sent on the message thread whenever the catalog has changed, and when an update has finished.
+ */
+class PluginCatalog : public juce::ChangeBroadcaster, private juce::Thread
+{
+public:
+    PluginCatalog();
+    ~PluginCatalog() override;
+
+    /// The entries accepted by this wrapper variant, sorted by name, together with their precomputed search keys.
+    class Snapshot
+    {
+    public:
+        const std::vector<PluginCatalogEntry>& getEntries() const { return entries; }
+
+        /**
+         * @brief Returns the indices of the entries matching the query, best match first.
+         *
+         * Each query word must appear, in order but not necessarily contiguously, in the entry's name, vendor or category (case insensitive).
+         * Matches at word starts and runs of consecutive characters rank higher. An empty query matches every entry, in name order.
+         */
+        std::vector<int> search(const juce::String& query) const;
+
+    private:
+        friend class PluginCatalog;
+
+        std::vector<PluginCatalogEntry> entries;
+        // Lowercase "name vendor category" of each entry
+        std::vector<std::string> searchKeys;
+    };
+
+    /// Returns the current catalog, which may still be empty if the index is being built. Can be called on any thread.
+    std::shared_ptr<const Snapshot> getSnapshot() const;
+
+    /// Starts an incremental update of the catalog on the background thread. The first call also reads the index from disk.
+    void refresh();
+
+    bool isRefreshing() const { return refreshing; }
+
+    /// Records what a loaded plugin has shown about its MIDI support, so that it is known before the bundle is loaded again.
+    void setMidiSupport(const juce::String& pluginPath, bool acceptsMidi, bool producesMidi);
+
+    static inline const juce::String vst3Extension = "vst3";
+
+    /// The folders searched for VST3 bundles, including subfolders.
+    static juce::Array<juce::File> getSearchFolders();
+
+    static juce::File getIndexFile();
+
+private:
+    void run() override;
+    void update();
+    void findBundles(const juce::File& folder, juce::Array<juce::File>& bundles, int depth);
+    void publish(std::vector<PluginCatalogEntry> newEntries);
+
+    static PluginCatalogEntry readBundle(const juce::File& bundle, juce::int64 modificationTime);
+    static bool readModuleInfo(const juce::File& bundle, PluginCatalogEntry& entry);
+    static void readInfoPlist(const juce::File& bundle, PluginCatalogEntry& entry);
+    static juce::int64 getBundleModificationTime(const juce::File& bundle);
+
+    static bool readIndex(const juce::File& file, std::vector<PluginCatalogEntry>& entries);
+    static bool writeIndex(const juce::File& file, const std::vector<PluginCatalogEntry>& entries);
+
+    mutable juce::CriticalSection lock;
+    // Every indexed bundle, including the ones this variant rejects, as last written to disk
+    std::vector<PluginCatalogEntry> allEntries;
+    std::shared_ptr<const Snapshot> snapshot;
+    bool isIndexLoaded = false;
+    bool isIndexDirty = false;
+    std::atomic<bool> refreshing { false };
+
+    static constexpr juce::uint32 indexMagic = 0x56334349; // "V3CI"
+    static constexpr juce::uint32 indexVersion = 1;
+    static constexpr int maxIndexEntries = 100000;
+    // Plugin folders are searched this many levels deep for vendor subfolders
+    static constexpr int maxFolderDepth = 4;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginCatalog)
+};
@@ -0,0 +1,179 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "PluginCatalogComponent.h"
+
+//==============================================================================
+
+PluginCatalogComponent::PluginCatalogComponent()
+{
+    searchBox.setTextToShowWhenEmpty("Search by name, vendor or category", juce::Colours::grey);
+    searchBox.addListener(this);
+    addAndMakeVisible(searchBox);
+
+    resultList.setRowHeight(rowHeight);
+    addAndMakeVisible(resultList);
+
+    catalog->addChangeListener(this);
+    snapshot = catalog->getSnapshot();
+    updateResults();
+
+    // Picks up plugins installed or removed since the catalog was last updated
+    catalog->refresh();
+}
+
+PluginCatalogComponent::~PluginCatalogComponent()
+{
+    catalog->removeChangeListener(this);
+}
+
+void PluginCatalogComponent::resized()
+{
+    auto bounds = getLocalBounds();
+    searchBox.setBounds(bounds.removeFromTop(searchBoxHeight).reduced(2));
+    resultList.setBounds(bounds);
+}
+
+void PluginCatalogComponent::paint(juce::Graphics& g)
+{
+    if (!results.empty()) { return; }
+
+    // The list is empty, so its area is used for a hint
+    const auto message = catalog->isRefreshing() ? "Searching for VST3 plugins..." : (searchBox.isEmpty() ? "No VST3 plugins found" : "No matching plugins");
+    g.setColour(juce::Colours::grey);
+    g.drawText(message, resultList.getBounds(), juce::Justification::centred);
+}
+
+//==============================================================================
+
+void PluginCatalogComponent::updateResults()
+{
+    results = snapshot->search(searchBox.getText());
+    resultList.updateContent();
+
+    // Reselect the selected plugin, wherever it is now
+    auto selectedRow = -1;
+
+    for (size_t row = 0; row < results.size(); ++row)
+    {
+        if (getEntry((int) row)->path == selectedPluginPath)
+        {
+            selectedRow = (int) row;
+            break;
+        }
+    }
+
+    if (selectedRow >= 0)
+    {
+        resultList.selectRow(selectedRow, false, true);
+    }
+    else
+    {
+        resultList.deselectAllRows();
+    }
+
+    resultList.setVisible(!results.empty());
+    repaint();
+}
+
+const PluginCatalogEntry* PluginCatalogComponent::getEntry(int row) const
+{
+    if (!juce::isPositiveAndBelow(row, (int) results.size())) { return nullptr; }
+
+    return &snapshot->getEntries()[(size_t) results[(size_t) row]];
+}
+
+//==============================================================================
+
+int PluginCatalogComponent::getNumRows()
+{
+    return (int) results.size();
+}
+
+void PluginCatalogComponent::paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    const auto* entry = getEntry(rowNumber);
+
+    if (entry == nullptr) { return; }
+
+    if (rowIsSelected)
+    {
+        g.fillAll(findColour(juce::TextEditor::highlightColourId));
+    }
+
+    const auto detailsWidth = width / 2;
+    const auto details = entry->vendor + (entry->vendor.isNotEmpty() && entry->category.isNotEmpty() ? " - " : "") + entry->category;
+
+    g.setColour(findColour(juce::ListBox::textColourId));
+    g.setFont(juce::Font((float) height * 0.6f));
+    g.drawText(entry->name, 6, 0, width - detailsWidth - 12, height, juce::Justification::centredLeft, true);
+
+    g.setColour(juce::Colours::grey);
+    g.setFont(juce::Font((float) height * 0.5f));
+    g.drawText(details, width - detailsWidth, 0, detailsWidth - 6, height, juce::Justification::centredRight, true);
+}
+
+void PluginCatalogComponent::selectedRowsChanged(int lastRowSelected)
+{
+    const auto* entry = getEntry(lastRowSelected);
+    const auto newPath = entry != nullptr ? entry->path : juce::String();
+
+    if (newPath == selectedPluginPath) { return; }
+
+    selectedPluginPath = newPath;
+    listeners.call([](auto& l) { l.catalogSelectionChanged(); });
+}
+
+void PluginCatalogComponent::listBoxItemDoubleClicked(int row, const juce::MouseEvent&)
+{
+    choosePlugin(row);
+}
+
+void PluginCatalogComponent::returnKeyPressed(int lastRowSelected)
+{
+    choosePlugin(lastRowSelected);
+}
+
+void PluginCatalogComponent::choosePlugin(int row)
+{
+    if (const auto* entry = getEntry(row))
+    {
+        const auto pluginPath = entry->path;
+        listeners.call([&](auto& l) { l.catalogPluginChosen(pluginPath); });
+    }
+}
+
+//==============================================================================
+
+void PluginCatalogComponent::textEditorTextChanged(juce::TextEditor&)
+{
+    updateResults();
+
+    // Typing narrows down to the best match, so that return loads it
+    if (!results.empty() && resultList.getSelectedRow() < 0)
+    {
+        resultList.selectRow(0);
+    }
+}
+
+void PluginCatalogComponent::textEditorReturnKeyPressed(juce::TextEditor&)
+{
+    choosePlugin(resultList.getSelectedRow());
+}
+
+void PluginCatalogComponent::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    snapshot = catalog->getSnapshot();
+    updateResults();
+}
@@ -0,0 +1,80 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginCatalog.h"
+
+/// A search box above the list of plugins in `PluginCatalog` which this wrapper variant can load.
+class PluginCatalogComponent : public juce::Component, private juce::ListBoxModel, private juce::TextEditor::Listener, private juce::ChangeListener
+{
+public:
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+
+        virtual void catalogSelectionChanged() = 0;
+
+        /// Called when a plugin is double clicked, or when return is pressed in the list or in the search box.
+        virtual void catalogPluginChosen(const juce::String& pluginPath) = 0;
+    };
+
+    PluginCatalogComponent();
+    ~PluginCatalogComponent() override;
+
+    void addListener(Listener* listener) { listeners.add(listener); }
+    void removeListener(Listener* listener) { listeners.remove(listener); }
+
+    bool isPluginSelected() const { return selectedPluginPath.isNotEmpty(); }
+
+    /// Returns an empty string if no plugin is selected.
+    juce::String getSelectedPluginPath() const { return selectedPluginPath; }
+
+    void resized() override;
+    void paint(juce::Graphics& g) override;
+
+private:
+    int getNumRows() override;
+    void paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
+    void selectedRowsChanged(int lastRowSelected) override;
+    void listBoxItemDoubleClicked(int row, const juce::MouseEvent&) override;
+    void returnKeyPressed(int lastRowSelected) override;
+
+    void textEditorTextChanged(juce::TextEditor&) override;
+    void textEditorReturnKeyPressed(juce::TextEditor&) override;
+
+    void changeListenerCallback(juce::ChangeBroadcaster*) override;
+
+    void choosePlugin(int row);
+    void updateResults();
+    const PluginCatalogEntry* getEntry(int row) const;
+
+    juce::SharedResourcePointer<PluginCatalog> catalog;
+    std::shared_ptr<const PluginCatalog::Snapshot> snapshot;
+    // Indices into the snapshot's entries, best match first
+    std::vector<int> results;
+    // Kept by path, so that the selection survives catalog updates and new searches
+    juce::String selectedPluginPath;
+
+    juce::TextEditor searchBox;
+    juce::ListBox resultList { {}, this };
+    juce::ListenerList<Listener> listeners;
+
+    static constexpr int searchBoxHeight = 28;
+    static constexpr int rowHeight = 24;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginCatalogComponent)
+};
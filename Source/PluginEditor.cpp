@@ -21,64 +21,86 @@
 VST3WrapperAudioProcessorEditor::VST3WrapperAudioProcessorEditor (VST3WrapperAudioProcessor& p)
 : AudioProcessorEditor (&p), audioProcessor (p)
 {
-    pluginFileBrowser.reset(new VST3FileBrowserComponent(juce::FileBrowserComponent::openMode
-                                               | juce::FileBrowserComponent::canSelectDirectories
-                                               | juce::FileBrowserComponent::filenameBoxIsReadOnly,
-                                               juce::File("/Library/Audio/Plug-Ins/VST3"),
-                                               nullptr,
-                                               nullptr));
-    
-    audioProcessor.addChangeListener(this);
-    
-    addAndMakeVisible(pluginFileBrowser.get());
-    pluginFileBrowser->addListener(this);
-    // setEnabled(false) doesn't work on FileBrowserComponent,
-    // so we use a cover view to disable it when needed
-    addAndMakeVisible(pluginFileBrowserCover);
-    
-    loadPluginButton.setButtonText("Load Plugin");
+    audioProcessor.addLoadListener(this);
+    
+    addAndMakeVisible(pluginCatalog);
+    pluginCatalog.addListener(this);
+    
+    loadPluginButton.setButtonText(loadPluginButtonText);
     loadPluginButton.addListener(this);
     
     closePluginButton.setButtonText("Close Plugin");
     closePluginButton.addListener(this);
     
+    optionsButton.setButtonText("Options");
+    optionsButton.addListener(this);
+    
+    sandboxButton.addListener(this);
+    
     statusLabel.setJustificationType(juce::Justification::centred);
     
     addAndMakeVisible(loadPluginButton);
     addAndMakeVisible(closePluginButton);
+    addAndMakeVisible(optionsButton);
+    addChildComponent(sandboxButton);
     addAndMakeVisible(statusLabel);
+#if ! JucePlugin_IsMidiEffect
+    addAndMakeVisible(busMeterStrip);
+#endif
 
+    // Opening the editor of a dormant instance (see `VST3WrapperAudioProcessor::setDeferredLoadingEnabled`) instantiates the hosted plugin
+    audioProcessor.wakeHostedPlugin();
+    
     setHostedPluginEditorIfNeeded();
     
-    processorStateChanged(false);
+    // An instance still dormant couldn't find its saved state, which the loading error explains
+    processorStateChanged(audioProcessor.isHostedPluginDormant());
+    
+    if (audioProcessor.isCurrentlyLoading())
+    {
+        setLoadingState();
+    }
     
     // A workaround for some AUs like Korg Triton,
     // that loose focus when their editor is reloaded
-    // (see the callback for details)
-    startTimer(500);
+    // (see `regainKeyboardFocus` for details)
+    juce::Timer::callAfterDelay(500, [safeThis = juce::Component::SafePointer<VST3WrapperAudioProcessorEditor>(this)]()
+    {
+        if (safeThis != nullptr) { safeThis->regainKeyboardFocus(); }
+    });
+    
+    startTimerHz(statusRefreshRateHz);
 }
 
 VST3WrapperAudioProcessorEditor::~VST3WrapperAudioProcessorEditor()
 {
-    audioProcessor.removeChangeListener (this);
+    audioProcessor.removeLoadListener (this);
     stopTimer();
+    
+    // Heavy plugin GUIs take a while to build, so the processor may keep the editor for the next time the window opens
+    if (hostedPluginEditor != nullptr)
+    {
+        hostedPluginEditor->removeComponentListener(this);
+        hostedPluginEditor->removeMouseListener(this);
+        removeChildComponent(hostedPluginEditor.get());
+        audioProcessor.retainHostedPluginEditor(std::move(hostedPluginEditor));
+    }
 }
 
 //==============================================================================
 
 void VST3WrapperAudioProcessorEditor::loadPlugin(const juce::String& filePath)
 {
-    // If present, the old hosted plugin editor is now deleted and set to nullptr so that
-    // the main audio processor can safely delete its processor
-    hostedPluginEditor.reset();
+    // The load is only queued here. The old hosted plugin editor is deleted in `hostedPluginAboutToBeRemoved`,
+    // right before the processor deletes its plugin.
     setLoadingState();
-    
-    threadPool.addJob([this, filePath]()
-    {
-        // Give UI some time to update
-        juce::Thread::sleep(5);
-        audioProcessor.loadPlugin(filePath);
-    });
+    audioProcessor.loadPlugin(filePath);
+}
+
+void VST3WrapperAudioProcessorEditor::reloadCrashedPlugin()
+{
+    setLoadingState();
+    audioProcessor.reloadCrashedPlugin();
 }
 
 void VST3WrapperAudioProcessorEditor::closePlugin()
@@ -90,9 +112,23 @@ void VST3WrapperAudioProcessorEditor::closePlugin()
     processorStateChanged(false);
 }
 
-void VST3WrapperAudioProcessorEditor::changeListenerCallback (juce::ChangeBroadcaster* source)
+void VST3WrapperAudioProcessorEditor::hostedPluginAboutToBeRemoved()
 {
+    // The hosted plugin's editor must be deleted before its processor
+    hostedPluginEditor.reset();
+}
+
+void VST3WrapperAudioProcessorEditor::hostedPluginLoadFinished(const VST3WrapperAudioProcessor::LoadResult& result)
+{
+    // A newer load may already be queued. Its own result will update the editor.
+    if (result.status != VST3WrapperAudioProcessor::LoadResult::Status::cancelled && audioProcessor.isCurrentlyLoading()) { return; }
+    
     setHostedPluginEditorIfNeeded();
+    processorStateChanged(result.status == VST3WrapperAudioProcessor::LoadResult::Status::failed);
+}
+
+void VST3WrapperAudioProcessorEditor::hostedPluginCrashed()
+{
     processorStateChanged(true);
 }
 
@@ -100,7 +136,14 @@ void VST3WrapperAudioProcessorEditor::setHostedPluginEditorIfNeeded()
 {
     if (!audioProcessor.isHostedPluginLoaded()) { return; }
     
-    const auto newEditor = audioProcessor.createHostedPluginEditorIfNeeded();
+    const auto openStartMs = juce::Time::getMillisecondCounterHiRes();
+    auto* newEditor = audioProcessor.takeRetainedHostedPluginEditor().release();
+    const auto wasRetained = newEditor != nullptr;
+    
+    if (!wasRetained)
+    {
+        newEditor = audioProcessor.createHostedPluginEditorIfNeeded();
+    }
     
     if (newEditor == nullptr) { return; }
     
@@ -111,41 +154,70 @@ void VST3WrapperAudioProcessorEditor::setHostedPluginEditorIfNeeded()
         hostedPluginEditor.reset(newEditor);
         addAndMakeVisible(hostedPluginEditor.get());
         hostedPluginEditor.get()->addComponentListener(this);
+        // Interaction with the hosted editor may change plugin's state
+        // without any parameter change (e.g. editing a sequencer pattern)
+        hostedPluginEditor.get()->addMouseListener(this, true);
+        
+        juce::Logger::writeToLog("AU-VST3-Wrapper editor: plugin=\"" + audioProcessor.getHostedPluginName() + "\""
+                                 + " retained=" + (wasRetained ? "1" : "0")
+                                 + " open_ms=" + juce::String(juce::Time::getMillisecondCounterHiRes() - openStartMs, 1));
     }
 }
 
 void VST3WrapperAudioProcessorEditor::setLoadingState()
 {
-    loadPluginButton.setEnabled(false);
-    pluginFileBrowserCover.setVisible(true);
+    loadPluginButton.setButtonText(cancelLoadingButtonText);
+    loadPluginButton.setEnabled(true);
     statusLabel.setColour(juce::Label::textColourId, juce::Colours::white);
-    statusLabel.setText("Loading...", juce::dontSendNotification);
+    statusLabel.setText(loadingMessage, juce::dontSendNotification);
 }
 
 void VST3WrapperAudioProcessorEditor::processorStateChanged(const bool shouldShowPluginLoadingError)
 {
     const auto isHostedPluginLoaded = audioProcessor.isHostedPluginLoaded();
     const auto pluginLoadingError = audioProcessor.getHostedPluginLoadingError();
+    const auto isSandboxed = isHostedPluginLoaded && audioProcessor.isHostedPluginSandboxed();
+    const auto hasCrashed = isSandboxed && audioProcessor.hasSandboxedPluginCrashed();
     
-    pluginFileBrowser.get()->setVisible(!isHostedPluginLoaded);
-    pluginFileBrowserCover.setVisible(false);
+    pluginCatalog.setVisible(!isHostedPluginLoaded);
+    loadPluginButton.setButtonText(loadPluginButtonText);
     loadPluginButton.setVisible(!isHostedPluginLoaded);
-    loadPluginButton.setEnabled(pluginFileBrowser->isVST3FileSelected());
+    loadPluginButton.setEnabled(pluginCatalog.isPluginSelected());
     closePluginButton.setVisible(isHostedPluginLoaded);
+    sandboxButton.setVisible(isSandboxed);
+    sandboxButton.setEnabled(true);
+    sandboxButton.setButtonText(hasCrashed ? "Reload Plugin" : "Open Plugin Window");
     
-    if (isHostedPluginLoaded)
+    if (hasCrashed)
+    {
+        statusLabel.setTooltip({});
+        statusLabel.setColour(juce::Label::textColourId, juce::Colours::red);
+        statusLabel.setText(audioProcessor.getHostedPluginName() + crashedMessage, juce::dontSendNotification);
+    }
+    else if (isHostedPluginLoaded)
     {
         juce::String labelText = audioProcessor.getHostedPluginName();
         
-        // This should never happen as `hostedPluginEditor` 
+        // A sandboxed plugin's editor opens in the helper process.
+        // Otherwise a missing editor should never happen as `hostedPluginEditor`
         // should at least be `GenericAudioProcessorEditor`, but just in case...
-        if (hostedPluginEditor == nullptr) { labelText += " (no editor)"; }
+        if (isSandboxed) { labelText += " (sandboxed)"; }
+        else if (hostedPluginEditor == nullptr) { labelText += " (no editor)"; }
+        
+        isShowingOverloadIndicator = audioProcessor.isHostedPluginOverloaded();
+        
+        if (isShowingOverloadIndicator)
+        {
+            labelText += overloadedMessage;
+        }
         
-        statusLabel.setColour(juce::Label::textColourId, juce::Colours::white);
+        statusLabel.setColour(juce::Label::textColourId, isShowingOverloadIndicator ? juce::Colours::orange : juce::Colours::white);
         statusLabel.setText(labelText, juce::dontSendNotification);
+        updateStatusTooltip();
     }
     else
     {
+        statusLabel.setTooltip({});
         const auto isShowingError = shouldShowPluginLoadingError && !pluginLoadingError.isEmpty();
         const auto labelText = isShowingError ? pluginLoadingError : noPluginLoadedMessage;
         statusLabel.setColour(juce::Label::textColourId, isShowingError ? juce::Colours::red : juce::Colours::white);
@@ -160,26 +232,21 @@ void VST3WrapperAudioProcessorEditor::processorStateChanged(const bool shouldSho
 //
 //==============================================================================
 
-void VST3WrapperAudioProcessorEditor::selectionChanged()
+void VST3WrapperAudioProcessorEditor::catalogSelectionChanged()
 {
-    loadPluginButton.setEnabled(pluginFileBrowser->isVST3FileSelected());
+    // During a load, a new selection can be loaded in its place
+    loadPluginButton.setButtonText(loadPluginButtonText);
+    loadPluginButton.setEnabled(pluginCatalog.isPluginSelected());
     statusLabel.setColour(juce::Label::textColourId, juce::Colours::white);
-    statusLabel.setText(noPluginLoadedMessage, juce::dontSendNotification);
+    statusLabel.setText(audioProcessor.isCurrentlyLoading() ? loadingMessage : noPluginLoadedMessage, juce::dontSendNotification);
 }
 
-void VST3WrapperAudioProcessorEditor::fileClicked (const juce::File& file, const juce::MouseEvent& e)
+void VST3WrapperAudioProcessorEditor::catalogPluginChosen(const juce::String& pluginPath)
 {
-    
-}
-
-void VST3WrapperAudioProcessorEditor::fileDoubleClicked (const juce::File& file)
-{
-    
-}
-
-void VST3WrapperAudioProcessorEditor::browserRootChanged (const juce::File& newRoot)
-{
-    
+    if (juce::File(pluginPath).exists())
+    {
+        loadPlugin(pluginPath);
+    }
 }
 
 //==============================================================================
@@ -188,17 +255,232 @@ void VST3WrapperAudioProcessorEditor::buttonClicked(juce::Button* button)
 {
     if (button == &loadPluginButton)
     {
-        const auto file = pluginFileBrowser->getSelectedFile(0);
+        if (loadPluginButton.getButtonText() == cancelLoadingButtonText)
+        {
+            audioProcessor.cancelPendingLoad();
+            return;
+        }
+        
+        const auto pluginPath = pluginCatalog.getSelectedPluginPath();
         
-        if (file.exists() && file.hasFileExtension(VST3FileBrowserComponent::vst3Extension))
+        if (pluginPath.isNotEmpty() && juce::File(pluginPath).exists())
         {
-            loadPlugin(file.getFullPathName());
+            loadPlugin(pluginPath);
         }
     }
     else if (button == &closePluginButton)
     {
         closePlugin();
     }
+    else if (button == &optionsButton)
+    {
+        showOptionsMenu();
+    }
+    else if (button == &sandboxButton)
+    {
+        if (audioProcessor.hasSandboxedPluginCrashed())
+        {
+            sandboxButton.setEnabled(false);
+            reloadCrashedPlugin();
+        }
+        else
+        {
+            audioProcessor.showSandboxedPluginEditor();
+        }
+    }
+}
+
+void VST3WrapperAudioProcessorEditor::showOptionsMenu()
+{
+    enum MenuItem
+    {
+        deferredLoading = 1,
+        backgroundScanning,
+        renderThread,
+        overrunsLogOnly,
+        overrunsBypass,
+        overrunsSilence,
+        sandbox,
+        editorRetention,
+        sidecarStore,
+        renderCache,
+        clearRenderCache,
+        hostSampleRate,
+        internalSampleRate44100,
+        internalSampleRate48000,
+        resamplingLow,
+        resamplingMedium,
+        resamplingHigh,
+        midiTransforms,
+        firstStoreProgram = 100,
+        firstSelectProgram = 200
+    };
+    
+    juce::PopupMenu menu;
+    menu.addItem(deferredLoading, "Instantiate plugin on demand after project load", true, audioProcessor.isDeferredLoadingEnabled());
+    menu.addItem(backgroundScanning, "Scan this plugin on a background thread", audioProcessor.isHostedPluginLoaded(), audioProcessor.isHostedPluginSafeForBackgroundScanning());
+    menu.addItem(renderThread, "Process on a dedicated render thread (adds one block of latency)", true, audioProcessor.isRenderThreadEnabled());
+    
+    const auto overrunAction = audioProcessor.getOverrunAction();
+    juce::PopupMenu overrunMenu;
+    overrunMenu.addItem(overrunsLogOnly, "Only log overruns", true, overrunAction == HostedPluginWatchdog::Action::none);
+    overrunMenu.addItem(overrunsBypass, "Bypass the plugin", true, overrunAction == HostedPluginWatchdog::Action::bypass);
+    overrunMenu.addItem(overrunsSilence, "Output silence", true, overrunAction == HostedPluginWatchdog::Action::silence);
+    menu.addSubMenu("When the plugin keeps overrunning its deadline", overrunMenu);
+    menu.addItem(sandbox, "Load plugins in a separate process (crash protection)", true, audioProcessor.isSandboxEnabled());
+    menu.addItem(editorRetention, "Keep the plugin window in memory when closed (faster reopening)", true, audioProcessor.isEditorRetentionEnabled());
+    menu.addItem(sidecarStore, "Store large plugin states outside the project (shared between projects)", true, audioProcessor.isSidecarStoreEnabled());
+    
+#if JucePlugin_IsSynth
+    // Blocks rendered on the render thread or in the sandbox bypass the cache
+    juce::PopupMenu renderCacheMenu;
+    renderCacheMenu.addItem(renderCache, "Reuse the audio rendered on earlier playbacks", true, audioProcessor.isRenderCacheEnabled());
+    renderCacheMenu.addItem(clearRenderCache, "Delete the cached audio of all instances");
+    menu.addSubMenu("Render cache (for deterministic instruments)", renderCacheMenu);
+#endif
+    
+#if ! JucePlugin_IsMidiEffect
+    const auto internalSampleRate = audioProcessor.getInternalSampleRate();
+    const auto resamplingQuality = audioProcessor.getResamplingQuality();
+    juce::PopupMenu sampleRateMenu;
+    sampleRateMenu.addItem(hostSampleRate, "The host's sample rate", true, internalSampleRate == 0.0);
+    sampleRateMenu.addItem(internalSampleRate44100, "44.1 kHz (resampled)", true, internalSampleRate == 44100.0);
+    sampleRateMenu.addItem(internalSampleRate48000, "48 kHz (resampled)", true, internalSampleRate == 48000.0);
+    sampleRateMenu.addSeparator();
+    sampleRateMenu.addItem(resamplingLow, "Low resampling quality (linear)", true, resamplingQuality == StreamingResampler::Quality::low);
+    sampleRateMenu.addItem(resamplingMedium, "Medium resampling quality", true, resamplingQuality == StreamingResampler::Quality::medium);
+    sampleRateMenu.addItem(resamplingHigh, "High resampling quality (more latency)", true, resamplingQuality == StreamingResampler::Quality::high);
+    menu.addSubMenu("Run the plugin at", sampleRateMenu);
+#endif
+    
+    menu.addItem(midiTransforms, "MIDI transforms (remap, filter, transpose, thin)...", true, audioProcessor.getMidiTransformRules().trim().isNotEmpty());
+    
+    // Program slots hold states of a plugin running in this process
+    const auto canUsePrograms = audioProcessor.isHostedPluginLoaded() && !audioProcessor.isHostedPluginSandboxed();
+    juce::PopupMenu storeProgramMenu;
+    juce::PopupMenu selectProgramMenu;
+    
+    for (int i = 0; i < audioProcessor.getNumPrograms(); ++i)
+    {
+        const auto isStored = audioProcessor.isProgramStored(i);
+        const auto lastSwitchMs = audioProcessor.getLastProgramSwitchMs(i);
+        auto programName = audioProcessor.getProgramName(i);
+        storeProgramMenu.addItem(firstStoreProgram + i, programName);
+        
+        if (lastSwitchMs > 0.0) { programName += " (last switch: " + juce::String(lastSwitchMs, 1) + " ms)"; }
+        
+        selectProgramMenu.addItem(firstSelectProgram + i, programName, isStored, isStored && audioProcessor.getCurrentProgram() == i);
+    }
+    
+    menu.addSubMenu("Store current sound as program", storeProgramMenu, canUsePrograms);
+    menu.addSubMenu("Switch to program", selectProgramMenu, canUsePrograms);
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&optionsButton),
+                       [safeThis = juce::Component::SafePointer<VST3WrapperAudioProcessorEditor>(this)](int result)
+    {
+        if (safeThis == nullptr) { return; }
+        
+        auto& processor = safeThis->audioProcessor;
+        
+        switch (result)
+        {
+            case deferredLoading:
+                processor.setDeferredLoadingEnabled(!processor.isDeferredLoadingEnabled());
+                break;
+            case backgroundScanning:
+                processor.setHostedPluginSafeForBackgroundScanning(!processor.isHostedPluginSafeForBackgroundScanning());
+                break;
+            case renderThread:
+                processor.setRenderThreadEnabled(!processor.isRenderThreadEnabled());
+                break;
+            case overrunsLogOnly:
+                processor.setOverrunAction(HostedPluginWatchdog::Action::none);
+                break;
+            case overrunsBypass:
+                processor.setOverrunAction(HostedPluginWatchdog::Action::bypass);
+                break;
+            case overrunsSilence:
+                processor.setOverrunAction(HostedPluginWatchdog::Action::silence);
+                break;
+            case sandbox:
+                processor.setSandboxEnabled(!processor.isSandboxEnabled());
+                break;
+            case editorRetention:
+                processor.setEditorRetentionEnabled(!processor.isEditorRetentionEnabled());
+                break;
+            case sidecarStore:
+                processor.setSidecarStoreEnabled(!processor.isSidecarStoreEnabled());
+                break;
+#if JucePlugin_IsSynth
+            case renderCache:
+                processor.setRenderCacheEnabled(!processor.isRenderCacheEnabled());
+                break;
+            case clearRenderCache:
+                RenderCache::clearAll();
+                break;
+#endif
+#if ! JucePlugin_IsMidiEffect
+            case hostSampleRate:
+                processor.setInternalSampleRate(0.0, processor.getResamplingQuality());
+                break;
+            case internalSampleRate44100:
+                processor.setInternalSampleRate(44100.0, processor.getResamplingQuality());
+                break;
+            case internalSampleRate48000:
+                processor.setInternalSampleRate(48000.0, processor.getResamplingQuality());
+                break;
+            case resamplingLow:
+                processor.setInternalSampleRate(processor.getInternalSampleRate(), StreamingResampler::Quality::low);
+                break;
+            case resamplingMedium:
+                processor.setInternalSampleRate(processor.getInternalSampleRate(), StreamingResampler::Quality::medium);
+                break;
+            case resamplingHigh:
+                processor.setInternalSampleRate(processor.getInternalSampleRate(), StreamingResampler::Quality::high);
+                break;
+#endif
+            case midiTransforms:
+                safeThis->showMidiTransformEditor();
+                break;
+            default:
+                if (result >= firstSelectProgram)
+                    processor.setCurrentProgram(result - firstSelectProgram);
+                else if (result >= firstStoreProgram)
+                    processor.storeProgram(result - firstStoreProgram);
+                break;
+        }
+    });
+}
+
+void VST3WrapperAudioProcessorEditor::showMidiTransformEditor()
+{
+    auto rulesEditor = std::make_shared<juce::TextEditor>();
+    rulesEditor->setMultiLine(true);
+    rulesEditor->setReturnKeyStartsNewLine(true);
+    rulesEditor->setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 13.0f, juce::Font::plain));
+    rulesEditor->setText(audioProcessor.getMidiTransformRules());
+    rulesEditor->setSize(420, 160);
+    
+    auto* window = new juce::AlertWindow("MIDI transforms",
+                                         "One rule per line, applied in order. \"in:\" rules change the MIDI sent to the plugin, \"out:\" rules the MIDI it sends.\n\n"
+                                         "in: channel 2 > 1\nin: drop channel 10\nin: notes 36-84\nin: transpose -12\nout: thin cc 1 10ms (or cc * for all controllers)",
+                                         juce::MessageBoxIconType::NoIcon, this);
+    window->addCustomComponent(rulesEditor.get());
+    window->addButton("Apply", 1);
+    window->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+    
+    window->enterModalState(true, juce::ModalCallbackFunction::create([safeThis = juce::Component::SafePointer<VST3WrapperAudioProcessorEditor>(this), rulesEditor](int result)
+    {
+        if (safeThis == nullptr || result != 1) { return; }
+        
+        // Invalid rules change nothing, so the user can fix them and apply them again
+        const auto error = safeThis->audioProcessor.setMidiTransformRules(rulesEditor->getText());
+        
+        if (error.isNotEmpty())
+        {
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "MIDI transforms", error);
+        }
+    }), true);
 }
 
 void VST3WrapperAudioProcessorEditor::drawSidechainArrow(juce::Graphics& g)
@@ -242,6 +524,14 @@ void VST3WrapperAudioProcessorEditor::componentMovedOrResized(Component &compone
     }
 }
 
+void VST3WrapperAudioProcessorEditor::mouseUp(const juce::MouseEvent& event)
+{
+    if (hostedPluginEditor != nullptr && (event.eventComponent == hostedPluginEditor.get() || hostedPluginEditor->isParentOf(event.eventComponent)))
+    {
+        audioProcessor.markStateDirty();
+    }
+}
+
 void VST3WrapperAudioProcessorEditor::resized()
 {
     if (hostedPluginEditor != nullptr)
@@ -249,14 +539,158 @@ void VST3WrapperAudioProcessorEditor::resized()
         hostedPluginEditor->setTopLeftPosition(0, 0);
     }
    
-    pluginFileBrowser->setBounds(0, 0, getEditorWidth(), browserHeight);
-    pluginFileBrowserCover.setBounds(0, 0, getEditorWidth(), browserHeight);
-    loadPluginButton.setBounds(margin, getButtonOriginY(), getBounds().getWidth() - 2 * margin, buttonHeight);
-    closePluginButton.setBounds(margin, getButtonOriginY(), getBounds().getWidth() - 2 * margin, buttonHeight);
+    pluginCatalog.setBounds(0, 0, getEditorWidth(), browserHeight);
+    const auto mainButtonWidth = getBounds().getWidth() - 3 * margin - optionsButtonWidth;
+    loadPluginButton.setBounds(margin, getButtonOriginY(), mainButtonWidth, buttonHeight);
+    closePluginButton.setBounds(margin, getButtonOriginY(), mainButtonWidth, buttonHeight);
+    optionsButton.setBounds(2 * margin + mainButtonWidth, getButtonOriginY(), optionsButtonWidth, buttonHeight);
+    sandboxButton.setBounds((getEditorWidth() - sandboxButtonWidth) / 2, (browserHeight - buttonHeight) / 2, sandboxButtonWidth, buttonHeight);
     statusLabel.setBounds(margin, getLabelriginY(), getBounds().getWidth() - 2 * margin, labelHeight);
+#if ! JucePlugin_IsMidiEffect
+    busMeterStrip.setBounds(margin, getMeterStripOriginY(), getBounds().getWidth() - 2 * margin, meterStripHeight - buttonTopspacing);
+#endif
 }
 
 void VST3WrapperAudioProcessorEditor::timerCallback()
+{
+    logOverrunEvents();
+    logPlaybackStart();
+    
+    if (!audioProcessor.isHostedPluginLoaded() || audioProcessor.hasSandboxedPluginCrashed()) { return; }
+    
+    if (audioProcessor.isHostedPluginOverloaded() != isShowingOverloadIndicator)
+    {
+        processorStateChanged(false);
+    }
+    
+    // The statistics change with every block, so they're refreshed while the plugin runs, not only when its status changes
+    updateStatusTooltip();
+}
+
+void VST3WrapperAudioProcessorEditor::logOverrunEvents()
+{
+    const auto pluginName = audioProcessor.getHostedPluginName();
+    
+    audioProcessor.readOverrunEvents([&pluginName](const auto& event)
+    {
+        juce::Logger::writeToLog("AU-VST3-Wrapper: " + pluginName + " overran its deadline: "
+                                 + juce::String(event.elapsedMs, 2) + " ms of " + juce::String(event.budgetMs, 2) + " ms"
+                                 + (event.hasTripped ? " (suspended)" : ""));
+    });
+}
+
+void VST3WrapperAudioProcessorEditor::logPlaybackStart()
+{
+    auto playbackStartMs = 0.0;
+    
+    if (audioProcessor.readPlaybackStart(playbackStartMs))
+    {
+        juce::Logger::writeToLog("AU-VST3-Wrapper playback_start: plugin=" + audioProcessor.getHostedPluginName()
+                                 + " first_audible_ms=" + juce::String(playbackStartMs, 1));
+    }
+}
+
+void VST3WrapperAudioProcessorEditor::updateStatusTooltip()
+{
+    const auto loadTimings = getLoadTimingsDescription();
+    const auto runtimeStatistics = getRuntimeStatisticsDescription();
+    
+    statusLabel.setTooltip(loadTimings.isNotEmpty() && runtimeStatistics.isNotEmpty() ? loadTimings + "\n\n" + runtimeStatistics
+                                                                                    : loadTimings + runtimeStatistics);
+}
+
+juce::String VST3WrapperAudioProcessorEditor::getLoadTimingsDescription()
+{
+    const auto lastLoad = audioProcessor.getLastLoadTimings();
+    
+    if (!lastLoad.succeeded) { return {}; }
+    
+    auto description = "Loaded " + lastLoad.loadTime.toString(false, true) + "\n" + lastLoad.toDisplayString();
+    
+    juce::StringArray previousLoads;
+    
+    for (const auto& load : audioProcessor.getLoadHistory())
+    {
+        previousLoads.add(juce::String(load.getTotalMs() / 1000.0, 2) + " s");
+    }
+    
+    if (previousLoads.size() > 1)
+    {
+        description += "\n\nRecent loads of this plugin: " + previousLoads.joinIntoString(", ");
+    }
+    
+    return description;
+}
+
+juce::String VST3WrapperAudioProcessorEditor::getRuntimeStatisticsDescription()
+{
+    juce::StringArray sections;
+    const auto playHeadStatistics = audioProcessor.getPlayHeadStatistics();
+    
+    if (playHeadStatistics.numBlocks > 0)
+    {
+        sections.add("Host play head query: " + juce::String(playHeadStatistics.hostQueryMicrosecondsPerBlock, 2) + " us per block"
+            + "\nPlugin play head queries per block: " + juce::String(playHeadStatistics.hostedQueriesPerBlock, 1));
+    }
+    
+    const auto reconfigurationStatistics = audioProcessor.getReconfigurationStatistics();
+    
+    if (reconfigurationStatistics.numPrepares > 0)
+    {
+        auto section = "Plugin prepared " + juce::String(reconfigurationStatistics.numPrepares) + " times (last: "
+            + juce::String(reconfigurationStatistics.lastPrepareMs, 1) + " ms), unchanged prepares skipped: "
+            + juce::String(reconfigurationStatistics.numSkippedPrepares);
+        
+        if (reconfigurationStatistics.lastPlaybackStartMs > 0.0)
+        {
+            section += "\nTime to first audible sample after play: " + juce::String(reconfigurationStatistics.lastPlaybackStartMs, 1) + " ms";
+        }
+        
+        sections.add(section);
+    }
+    
+    const auto midiTransformStatistics = audioProcessor.getMidiTransformStatistics();
+    
+    if (midiTransformStatistics.numEvents > 0)
+    {
+        sections.add("MIDI transforms: " + juce::String(midiTransformStatistics.numEvents) + " events, "
+            + juce::String(midiTransformStatistics.nanosecondsPerEvent, 1) + " ns per event");
+    }
+    
+    const auto stalls = audioProcessor.getAudioThreadStalls();
+    
+    if (stalls.numStalledBlocks > 0)
+    {
+        sections.add("Audio thread lock waits: " + juce::String(stalls.numStalledBlocks) + " of " + juce::String(stalls.numBlocks) + " blocks"
+            + "\nWorst wait per block: " + juce::String(stalls.p999Microseconds, 1) + " us (99.9th percentile), "
+            + juce::String(stalls.maxMicroseconds, 1) + " us (max)");
+    }
+    
+#if JucePlugin_IsSynth
+    const auto renderCacheStatistics = audioProcessor.getRenderCacheStatistics();
+    
+    if (renderCacheStatistics.hits + renderCacheStatistics.misses > 0)
+    {
+        sections.add("Render cache hit rate: " + juce::String(renderCacheStatistics.getHitRate() * 100.0, 1) + "%"
+            + "\nPlugin CPU time saved by the cache: " + juce::String(renderCacheStatistics.cpuSavedMs / 1000.0, 2) + " s");
+    }
+#endif
+    
+#if ! JucePlugin_IsMidiEffect
+    const auto resamplingStatistics = audioProcessor.getResamplingStatistics();
+    
+    if (resamplingStatistics.isActive)
+    {
+        sections.add("Plugin sample rate: " + juce::String(resamplingStatistics.internalSampleRate / 1000.0, 1) + " kHz"
+            + "\nResampling latency: " + juce::String(resamplingStatistics.latencySamples) + " samples"
+            + "\nResampling: " + juce::String(resamplingStatistics.microsecondsPerBlock, 1) + " us per block");
+    }
+#endif
+    
+    return sections.joinIntoString("\n\n");
+}
+
+void VST3WrapperAudioProcessorEditor::regainKeyboardFocus()
 {
     // A workaround for some AUs like Korg Triton, that loose focus when their editor is reloaded
     // This happens in Logic on Apple Silicon, not under Rosetta.
@@ -264,5 +698,4 @@ void VST3WrapperAudioProcessorEditor::timerCallback()
     // We focus the editor after a short delay, so that the user doesn't have to do it manually.
     setWantsKeyboardFocus(true);
     grabKeyboardFocus();
-    stopTimer();
 }
@@ -17,7 +17,8 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
-#include "VST3FileBrowser.h"
+#include "PluginCatalogComponent.h"
+#include "BusMeterComponent.h"
 
 //==============================================================================
 /**
@@ -25,9 +26,9 @@
 
 class VST3WrapperAudioProcessorEditor  : 
 public juce::AudioProcessorEditor,
-public juce::ChangeListener,
+public VST3WrapperAudioProcessor::LoadListener,
 public juce::Button::Listener,
-public juce::FileBrowserListener,
+public PluginCatalogComponent::Listener,
 public juce::ComponentListener,
 private juce::Timer
 {
@@ -38,60 +39,72 @@ public:
     //==============================================================================
     void paint (juce::Graphics&) override;
     void resized() override;
-    void changeListenerCallback (juce::ChangeBroadcaster* source) override;
+    void hostedPluginAboutToBeRemoved() override;
+    void hostedPluginLoadFinished(const VST3WrapperAudioProcessor::LoadResult& result) override;
+    void hostedPluginCrashed() override;
     void buttonClicked(juce::Button*) override;
-    void selectionChanged() override;
-    void fileClicked (const juce::File& file, const juce::MouseEvent& e) override;
-    void fileDoubleClicked (const juce::File& file) override;
-    void browserRootChanged (const juce::File& newRoot) override;
+    void catalogSelectionChanged() override;
+    void catalogPluginChosen(const juce::String& pluginPath) override;
     void componentMovedOrResized (Component& component, bool wasMoved, bool wasResized) override;
+    void mouseUp (const juce::MouseEvent& event) override;
 
 private:
-    class SemiTransparentComponent : public juce::Component
-    {
-    public:
-        
-        SemiTransparentComponent()
-        {
-        }
-        
-        ~SemiTransparentComponent()
-        {
-        }
-
-        void paint(juce::Graphics& g) override
-        {
-            g.fillAll(juce::Colours::white.withAlpha(0.1f));
-        }
-    };
-    
     void timerCallback() override;
+    void regainKeyboardFocus();
+    void logOverrunEvents();
+    void logPlaybackStart();
+    void updateStatusTooltip();
+    juce::String getLoadTimingsDescription();
+    juce::String getRuntimeStatisticsDescription();
     
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     VST3WrapperAudioProcessor& audioProcessor;
-    juce::ThreadPool threadPool {1};
     std::unique_ptr<juce::AudioProcessorEditor> hostedPluginEditor;
     void loadPlugin(const juce::String& filePath);
+    void reloadCrashedPlugin();
     void closePlugin();
     void setHostedPluginEditorIfNeeded();
     
-    std::unique_ptr<VST3FileBrowserComponent> pluginFileBrowser;
-    SemiTransparentComponent pluginFileBrowserCover;
+    PluginCatalogComponent pluginCatalog;
+    // While a load is in progress, this cancels it until another plugin is selected, which then supersedes the load
     juce::TextButton loadPluginButton;
     juce::TextButton closePluginButton;
+    juce::TextButton optionsButton;
+    // Shown instead of the hosted editor when the plugin runs in the sandbox helper process
+    juce::TextButton sandboxButton;
     juce::Label statusLabel;
+#if ! JucePlugin_IsMidiEffect
+    BusMeterComponent busMeterStrip { audioProcessor.getBusMeters() };
+#endif
+    juce::TooltipWindow tooltipWindow { this };
     void setLoadingState();
     void processorStateChanged(bool shouldShowPluginLoadingError);
     void drawSidechainArrow(juce::Graphics& g);
+    void showOptionsMenu();
+    void showMidiTransformEditor();
     
     static inline const juce::String noPluginLoadedMessage = "No plugin loaded";
+    static inline const juce::String loadingMessage = "Loading...";
+    static inline const juce::String loadPluginButtonText = "Load Plugin";
+    static inline const juce::String cancelLoadingButtonText = "Cancel Loading";
+    static inline const juce::String overloadedMessage = " (suspended: processing overruns)";
+    static inline const juce::String crashedMessage = " has crashed and is muted. Reload it to continue.";
+    static constexpr int statusRefreshRateHz = 10;
+    bool isShowingOverloadIndicator = false;
     static constexpr int defaultEditorWidth = 650;
     static constexpr int margin = 10;
     static constexpr int browserHeight = 400;
     static constexpr int labelHeight = 30;
     static constexpr int buttonHeight = 30;
     static constexpr int buttonTopspacing = 5;
+#if JucePlugin_IsMidiEffect
+    static constexpr int meterStripHeight = 0;
+#else
+    static constexpr int meterStripHeight = 12;
+#endif
+    static constexpr int optionsButtonWidth = 80;
+    static constexpr int sandboxButtonWidth = 200;
     
     int getEditorWidth()
     {
@@ -106,7 +119,7 @@ private:
     int getEditorHeight()
     {
         const auto buttonViewHeight = buttonHeight + buttonTopspacing;
-        return  getHostedPluginEditorOrPluginListHeight() + buttonViewHeight + labelHeight;
+        return  getHostedPluginEditorOrPluginListHeight() + buttonViewHeight + meterStripHeight + labelHeight;
     }
     
     int getButtonOriginY()
@@ -114,9 +127,14 @@ private:
         return getHostedPluginEditorOrPluginListHeight() + buttonTopspacing;
     }
     
+    int getMeterStripOriginY()
+    {
+        return getButtonOriginY() + buttonHeight + buttonTopspacing;
+    }
+    
     int getLabelriginY()
     {
-        return getButtonOriginY() + buttonHeight;
+        return getButtonOriginY() + buttonHeight + meterStripHeight;
     }
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VST3WrapperAudioProcessorEditor)
@@ -0,0 +1,313 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "PluginLoadScheduler.h"
+
+//==============================================================================
+
+PluginLoadScheduler::PluginLoadScheduler()
+: prefetchPool(juce::jlimit(1, 4, juce::SystemStats::getNumCpus() / 2))
+{
+    juce::PropertiesFile::Options options;
+    options.applicationName = "AU-VST3-Wrapper";
+    options.filenameSuffix = ".settings";
+    options.folderName = "AU-VST3-Wrapper";
+    options.osxLibrarySubFolder = "Application Support";
+    settings = std::make_unique<juce::PropertiesFile>(options);
+}
+
+PluginLoadScheduler::~PluginLoadScheduler()
+{
+    {
+        const juce::ScopedLock sl (lock);
+
+        for (auto& [pluginPath, prefetch] : prefetches)
+        {
+            prefetch->isCancelled = true;
+        }
+    }
+
+    prefetchPool.removeAllJobs(true, 10000);
+    cancelPendingUpdate();
+}
+
+//==============================================================================
+
+void PluginLoadScheduler::scheduleLoad(const void* owner, const juce::String& pluginPath, Priority priority, ScanCompletedCallback callback)
+{
+    auto job = std::make_shared<Job>();
+    job->owner = owner;
+    job->priority = priority;
+    job->callback = std::move(callback);
+    job->scheduledMs = juce::Time::getMillisecondCounterHiRes();
+
+    const auto shouldScanInBackground = isSafeForBackgroundScanning(pluginPath);
+    bool isNewPrefetch = false;
+
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (jobs.empty() && sessionLoadCount == 0)
+        {
+            sessionStartMs = juce::Time::getMillisecondCounterHiRes();
+        }
+
+        // Every instance of a plugin in a project requests the same bundle, which only has to be read (and scanned) once
+        auto& prefetch = prefetches[pluginPath];
+
+        if (prefetch == nullptr)
+        {
+            prefetch = std::make_shared<Prefetch>();
+            prefetch->pluginPath = pluginPath;
+            prefetch->shouldScanInBackground = shouldScanInBackground;
+            isNewPrefetch = true;
+        }
+
+        job->prefetch = prefetch;
+        job->sequenceNumber = nextSequenceNumber++;
+        jobs.push_back(job);
+    }
+
+    if (isNewPrefetch)
+    {
+        // Each pool job prefetches whichever bundle is the most urgent once a thread is free, not the one scheduled with it
+        prefetchPool.addJob([this]() { prefetchNext(); });
+    }
+    else if (job->prefetch->isDone)
+    {
+        triggerAsyncUpdate();
+    }
+}
+
+bool PluginLoadScheduler::cancel(const void* owner)
+{
+    const juce::ScopedLock sl (lock);
+
+    const auto numJobs = jobs.size();
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [owner](const auto& job) { return job->owner == owner; }), jobs.end());
+    releaseUnusedPrefetches();
+    return jobs.size() != numJobs;
+}
+
+void PluginLoadScheduler::promote(const void* owner, Priority priority)
+{
+    const juce::ScopedLock sl (lock);
+
+    for (auto& job : jobs)
+    {
+        if (job->owner == owner && priority < job->priority)
+        {
+            job->priority = priority;
+        }
+    }
+}
+
+void PluginLoadScheduler::setSafeForBackgroundScanning(const juce::String& pluginPath, bool isSafe)
+{
+    const juce::ScopedLock sl (lock);
+
+    auto safePaths = juce::StringArray::fromLines(settings->getValue(safeForBackgroundScanningKey));
+    safePaths.removeEmptyStrings();
+
+    if (isSafe)
+    {
+        safePaths.addIfNotAlreadyThere(pluginPath);
+    }
+    else
+    {
+        safePaths.removeString(pluginPath);
+    }
+
+    settings->setValue(safeForBackgroundScanningKey, safePaths.joinIntoString("\n"));
+    settings->saveIfNeeded();
+}
+
+bool PluginLoadScheduler::isSafeForBackgroundScanning(const juce::String& pluginPath)
+{
+    const juce::ScopedLock sl (lock);
+    return juce::StringArray::fromLines(settings->getValue(safeForBackgroundScanningKey)).contains(pluginPath);
+}
+
+//==============================================================================
+
+void PluginLoadScheduler::prefetchNext()
+{
+    std::shared_ptr<Prefetch> mostUrgent;
+    auto mostUrgentPriority = Priority::projectRestore;
+    juce::int64 mostUrgentSequenceNumber = 0;
+
+    {
+        const juce::ScopedLock sl (lock);
+
+        // The most urgent bundle is the one of the pending request which will be handed to the message thread first
+        for (const auto& job : jobs)
+        {
+            if (job->prefetch->isStarted) { continue; }
+
+            if (mostUrgent == nullptr
+                || job->priority < mostUrgentPriority
+                || (job->priority == mostUrgentPriority && job->sequenceNumber < mostUrgentSequenceNumber))
+            {
+                mostUrgent = job->prefetch;
+                mostUrgentPriority = job->priority;
+                mostUrgentSequenceNumber = job->sequenceNumber;
+            }
+        }
+
+        if (mostUrgent == nullptr) { return; }
+
+        mostUrgent->isStarted = true;
+    }
+
+    if (!mostUrgent->isCancelled)
+    {
+        prefetchAndScanIfSafe(*mostUrgent);
+    }
+
+    mostUrgent->isDone = true;
+    triggerAsyncUpdate();
+}
+
+void PluginLoadScheduler::prefetchAndScanIfSafe(Prefetch& prefetch)
+{
+    prefetchBundle(juce::File(prefetch.pluginPath));
+
+    if (prefetch.shouldScanInBackground && !prefetch.isCancelled)
+    {
+        const auto scanStartMs = juce::Time::getMillisecondCounterHiRes();
+        juce::VST3PluginFormat format;
+        format.findAllTypesForFile(prefetch.descriptions, prefetch.pluginPath);
+        prefetch.scanMs = juce::Time::getMillisecondCounterHiRes() - scanStartMs;
+        prefetch.isScanned = true;
+    }
+}
+
+void PluginLoadScheduler::releaseUnusedPrefetches()
+{
+    for (auto it = prefetches.begin(); it != prefetches.end();)
+    {
+        const auto isUsed = std::any_of(jobs.begin(), jobs.end(), [&](const auto& job) { return job->prefetch == it->second; });
+
+        if (isUsed)
+        {
+            ++it;
+            continue;
+        }
+
+        it->second->isCancelled = true;
+        it = prefetches.erase(it);
+    }
+}
+
+void PluginLoadScheduler::prefetchBundle(const juce::File& bundle)
+{
+    // We only read the files and throw the data away, so that the OS keeps them in its file cache
+    // and the actual scan and instantiation don't have to wait for the disk
+    const auto files = bundle.isDirectory() ? bundle.findChildFiles(juce::File::findFiles, true) : juce::Array<juce::File> { bundle };
+
+    juce::HeapBlock<char> chunk (prefetchChunkSize);
+    juce::int64 bytesRead = 0;
+
+    for (const auto& file : files)
+    {
+        juce::FileInputStream stream (file);
+
+        if (!stream.openedOk()) { continue; }
+
+        while (!stream.isExhausted() && bytesRead < maxPrefetchBytes)
+        {
+            const auto numRead = stream.read(chunk.get(), (int) prefetchChunkSize);
+
+            if (numRead <= 0) { break; }
+
+            bytesRead += numRead;
+        }
+
+        if (bytesRead >= maxPrefetchBytes) { return; }
+    }
+}
+
+//==============================================================================
+
+std::shared_ptr<PluginLoadScheduler::Job> PluginLoadScheduler::takeNextReadyJob()
+{
+    const juce::ScopedLock sl (lock);
+
+    auto next = jobs.end();
+
+    for (auto it = jobs.begin(); it != jobs.end(); ++it)
+    {
+        if (!(*it)->prefetch->isDone) { continue; }
+
+        if (next == jobs.end()
+            || (*it)->priority < (*next)->priority
+            || ((*it)->priority == (*next)->priority && (*it)->sequenceNumber < (*next)->sequenceNumber))
+        {
+            next = it;
+        }
+    }
+
+    if (next == jobs.end()) { return nullptr; }
+
+    auto job = *next;
+    jobs.erase(next);
+
+    // The scan result stays available to the remaining requests for the same plugin
+    releaseUnusedPrefetches();
+    return job;
+}
+
+void PluginLoadScheduler::handleAsyncUpdate()
+{
+    // Only one load is handled per message loop iteration, so that the UI (and Logic) stay responsive
+    // while a big project is being opened
+    auto job = takeNextReadyJob();
+
+    if (job == nullptr) { return; }
+
+    auto& prefetch = *job->prefetch;
+    ScanTimings timings;
+    const auto pickedUpMs = juce::Time::getMillisecondCounterHiRes();
+    const auto backgroundScanMs = prefetch.shouldScanInBackground && !prefetch.isScanReported ? prefetch.scanMs : 0.0;
+    timings.queuedMs = pickedUpMs - job->scheduledMs - backgroundScanMs;
+
+    if (!prefetch.isScanned)
+    {
+        prefetch.descriptions.clear();
+        juce::VST3PluginFormat format;
+        format.findAllTypesForFile(prefetch.descriptions, prefetch.pluginPath);
+        prefetch.scanMs = juce::Time::getMillisecondCounterHiRes() - pickedUpMs;
+        prefetch.isScanned = true;
+    }
+
+    // Only the first request of a plugin has to wait for its scan, the others reuse the result
+    timings.scanMs = prefetch.isScanReported ? 0.0 : prefetch.scanMs;
+    prefetch.isScanReported = true;
+    job->callback(prefetch.descriptions, timings);
+
+    const juce::ScopedLock sl (lock);
+
+    ++sessionLoadCount;
+
+    if (jobs.empty())
+    {
+        juce::Logger::writeToLog("AU-VST3-Wrapper: loaded " + juce::String(sessionLoadCount) + " plugin(s) in "
+                                 + juce::String(juce::Time::getMillisecondCounterHiRes() - sessionStartMs, 1) + " ms");
+        sessionLoadCount = 0;
+    }
+    else
+    {
+        triggerAsyncUpdate();
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief A process-wide queue of hosted plugin loads, shared by all wrapper instances through `juce::SharedResourcePointer`.
+ *
+ * When Logic opens a project, every wrapper instance requests its plugin at about the same time.
+ * The scheduler reads each VST3 bundle from disk on background threads, so that the OS file cache is warm by the time the plugin is scanned,
+ * and then hands the requests to the message thread one at a time, in priority order, so that the UI stays responsive in between.
+ * Bundles are prefetched in priority order too, and only once for all pending requests of the same plugin, which also share its scan result.
+ *
+ * VST3 files are scanned on the message thread, as some plugins crash when scanned from a background thread.
+ * Plugins marked as safe with `setSafeForBackgroundScanning` are scanned in parallel on the prefetch threads instead.
+ */
+class PluginLoadScheduler : private juce::AsyncUpdater
+{
+public:
+    /// Lower values are loaded first. Requests with the same priority are loaded in the order they were scheduled.
+    enum class Priority
+    {
+        userRequested = 0,
+        editorVisible,
+        projectRestore
+    };
+
+    struct ScanTimings
+    {
+        /// From `scheduleLoad` until the message thread picked up the request, excluding a background scan
+        double queuedMs = 0.0;
+        double scanMs = 0.0;
+    };
+
+    /// Called on the message thread with the result of scanning the requested VST3 file.
+    using ScanCompletedCallback = std::function<void(const juce::OwnedArray<juce::PluginDescription>& descriptions, const ScanTimings& timings)>;
+
+    PluginLoadScheduler();
+    ~PluginLoadScheduler() override;
+
+    /**
+     * @brief Schedules scanning of the VST3 file at provided path. The callback is called on the message thread once the file is scanned.
+     *
+     * @param owner An opaque identifier of the requesting wrapper instance, used for `cancel` and `promote`.
+     */
+    void scheduleLoad(const void* owner, const juce::String& pluginPath, Priority priority, ScanCompletedCallback callback);
+
+    /**
+     * @brief Removes all requests made by the owner which haven't been handed to the message thread yet. Their callbacks will never be called.
+     *
+     * @return `true` if any request was removed.
+     */
+    bool cancel(const void* owner);
+
+    /// Moves pending requests of the owner ahead in the queue, if the provided priority is higher than the current one.
+    void promote(const void* owner, Priority priority);
+
+    /// Marks the VST3 file as safe to scan from a background thread. The setting is shared by all wrapper instances and persisted.
+    void setSafeForBackgroundScanning(const juce::String& pluginPath, bool isSafe);
+
+    bool isSafeForBackgroundScanning(const juce::String& pluginPath);
+
+private:
+    /// Shared by all pending requests of the same VST3 file.
+    struct Prefetch
+    {
+        juce::String pluginPath;
+        bool shouldScanInBackground;
+        // Guarded by `lock`
+        bool isStarted = false;
+
+        // Written by a prefetch thread before `isDone` is set, and only by the message thread after that
+        juce::OwnedArray<juce::PluginDescription> descriptions;
+        bool isScanned = false;
+        double scanMs = 0.0;
+        bool isScanReported = false;
+
+        std::atomic<bool> isDone { false };
+        std::atomic<bool> isCancelled { false };
+    };
+
+    struct Job
+    {
+        const void* owner;
+        Priority priority;
+        juce::int64 sequenceNumber;
+        ScanCompletedCallback callback;
+        double scheduledMs = 0.0;
+        std::shared_ptr<Prefetch> prefetch;
+    };
+
+    void prefetchNext();
+    void prefetchAndScanIfSafe(Prefetch& prefetch);
+    void handleAsyncUpdate() override;
+    std::shared_ptr<Job> takeNextReadyJob();
+    /// Must be called with `lock` held. Forgets the prefetches no pending request is waiting for.
+    void releaseUnusedPrefetches();
+
+    static void prefetchBundle(const juce::File& bundle);
+
+    juce::CriticalSection lock;
+    std::vector<std::shared_ptr<Job>> jobs;
+    std::map<juce::String, std::shared_ptr<Prefetch>> prefetches;
+    juce::int64 nextSequenceNumber = 0;
+
+    // Project load statistics, reported when the queue becomes empty
+    double sessionStartMs = 0.0;
+    int sessionLoadCount = 0;
+
+    std::unique_ptr<juce::PropertiesFile> settings;
+    juce::ThreadPool prefetchPool;
+
+    static constexpr const char* safeForBackgroundScanningKey = "safe_for_background_scanning";
+    static constexpr size_t prefetchChunkSize = 1 << 20;
+    static constexpr juce::int64 maxPrefetchBytes = juce::int64 (256) << 20;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginLoadScheduler)
+};
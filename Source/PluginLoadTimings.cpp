@@ -0,0 +1,69 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "PluginLoadTimings.h"
+
+//==============================================================================
+
+juce::String PluginLoadTimings::toLogLine() const
+{
+    auto formatMs = [](double ms) { return juce::String(ms, 1); };
+
+    return "AU-VST3-Wrapper load: plugin=\"" + pluginName + "\""
+        + " path=\"" + pluginPath + "\""
+        + " succeeded=" + (succeeded ? "1" : "0")
+        + " queued_ms=" + formatMs(queuedMs)
+        + " scan_ms=" + formatMs(scanMs)
+        + " instantiate_ms=" + formatMs(instantiationMs)
+        + " layout_ms=" + formatMs(layoutMs)
+        + " prepare_ms=" + formatMs(prepareMs)
+        + " state_ms=" + formatMs(stateMs)
+        + " total_ms=" + formatMs(getTotalMs());
+}
+
+juce::String PluginLoadTimings::toDisplayString() const
+{
+    auto formatLine = [](const juce::String& phase, double ms) { return phase + ": " + juce::String(ms, 1) + " ms\n"; };
+
+    return formatLine("Waiting in load queue", queuedMs)
+        + formatLine("Scanning VST3 file", scanMs)
+        + formatLine("Creating plugin instance", instantiationMs)
+        + formatLine("Configuring channel layout", layoutMs)
+        + formatLine("Preparing for playback", prepareMs)
+        + formatLine("Restoring plugin state", stateMs)
+        + formatLine("Total", getTotalMs()).trimEnd();
+}
+
+//==============================================================================
+
+void PluginLoadHistory::add(const PluginLoadTimings& timings)
+{
+    const juce::ScopedLock sl (lock);
+
+    auto& loads = history[timings.pluginPath];
+    loads.add(timings);
+
+    if (loads.size() > maxLoadsPerPlugin)
+    {
+        loads.removeRange(0, loads.size() - maxLoadsPerPlugin);
+    }
+}
+
+juce::Array<PluginLoadTimings> PluginLoadHistory::getHistory(const juce::String& pluginPath) const
+{
+    const juce::ScopedLock sl (lock);
+
+    const auto loads = history.find(pluginPath);
+    return loads != history.end() ? loads->second : juce::Array<PluginLoadTimings>();
+}
@@ -0,0 +1,68 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/// The time spent in each phase of loading a hosted plugin, in milliseconds of the monotonic high resolution clock.
+struct PluginLoadTimings
+{
+    juce::String pluginPath;
+    juce::String pluginName;
+    juce::Time loadTime;
+    bool succeeded = false;
+
+    /// From the load request until the message thread picked it up (including the bundle prefetch)
+    double queuedMs = 0.0;
+    /// `findAllTypesForFile`
+    double scanMs = 0.0;
+    /// `createPluginInstanceAsync`
+    double instantiationMs = 0.0;
+    /// `setHostedPluginLayout`
+    double layoutMs = 0.0;
+    /// `prepareHostedPluginForPlaying`
+    double prepareMs = 0.0;
+    /// `setHostedPluginState`
+    double stateMs = 0.0;
+
+    double getTotalMs() const
+    {
+        return queuedMs + scanMs + instantiationMs + layoutMs + prepareMs + stateMs;
+    }
+
+    /// A single `key=value` line, easy to grep and parse from the log.
+    juce::String toLogLine() const;
+
+    /// A multi-line human readable breakdown.
+    juce::String toDisplayString() const;
+};
+
+/**
+ * @brief The last few load timings of every plugin loaded in this process, shared by all wrapper instances through `juce::SharedResourcePointer`.
+ */
+class PluginLoadHistory
+{
+public:
+    void add(const PluginLoadTimings& timings);
+
+    /// Returns the recorded loads of the VST3 file at provided path, oldest first.
+    juce::Array<PluginLoadTimings> getHistory(const juce::String& pluginPath) const;
+
+    static constexpr int maxLoadsPerPlugin = 10;
+
+private:
+    juce::CriticalSection lock;
+    std::map<juce::String, juce::Array<PluginLoadTimings>> history;
+};
@@ -56,10 +56,27 @@ VST3WrapperAudioProcessor::VST3WrapperAudioProcessor()
                   )
 #endif
 {
+    // Called on the helper connection's thread
+    sandboxedPluginHost.onLoaded = [this](const auto& result) { sandboxedPluginLoaded(result); };
+    sandboxedPluginHost.onStateChanged = [this]() { markStateDirty(); };
+    sandboxedPluginHost.onCrashed = [this]() { sandboxedPluginCrashed(); };
+    
+    programSlots.applyState = [this](const auto& state) { applyProgramState(state); };
+    
+#if JucePlugin_IsSynth
+    renderCache.computeStateKey = [this]() { return computeRenderCacheStateKey(); };
+#endif
 }
 
 VST3WrapperAudioProcessor::~VST3WrapperAudioProcessor()
 {
+    stopTimer();
+    cancelPendingUpdate();
+    loadScheduler->cancel(this);
+    sandboxedPluginHost.unload();
+    // The retained editor must be deleted before the hosted plugin
+    editorCache->release(this);
+    audioThreadStalls.logSummary(getHostedPluginName());
 }
 
 //==============================================================================
@@ -75,23 +92,163 @@ const juce::String VST3WrapperAudioProcessor::getName() const
 
 bool VST3WrapperAudioProcessor::isHostedPluginLoaded()
 {
+    // A crashed plugin is still loaded, so that it can be reloaded or closed
+    if (isSandboxed) { return sandboxedPluginHost.isLoaded() || sandboxedPluginHost.hasCrashed(); }
+    
     return safelyPerform<bool>([](auto& p) { return p != nullptr; });
 }
 
-void VST3WrapperAudioProcessor::loadPlugin(const juce::String& pluginPath)
+void VST3WrapperAudioProcessor::loadPlugin(const juce::String& pluginPath, PluginLoadScheduler::Priority priority)
 {
-    if (isCurrentlyLoading()) { return; }
+    {
+        const juce::ScopedLock sl (innerMutex);
+        
+        // A restored state is only ever applied to the plugin it was saved for. A superseded request for the
+        // same plugin keeps it, as it was never applied; a request for any other plugin starts from the defaults.
+        PluginStateData pluginState;
+        
+        if (pendingLoadRequest.has_value() && pendingLoadRequest->pluginPath == pluginPath)
+        {
+            pluginState = pendingLoadRequest->pluginState;
+        }
+        
+        if (!hostedPluginState.isEmpty() && hostedPluginStatePath == pluginPath)
+        {
+            pluginState = hostedPluginState;
+        }
+        
+        hostedPluginState.reset();
+        hostedPluginStatePath = {};
+        
+        pendingLoadRequest = LoadRequest { pluginPath, pluginState, priority };
+        ++loadGeneration;
+    }
     
-    removePrevioslyHostedPluginIfNeeded(true);
+    triggerAsyncUpdate();
+}
+
+void VST3WrapperAudioProcessor::cancelPendingLoad()
+{
+    juce::String pluginPath;
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        
+        if (!pendingLoadRequest.has_value() && !isLoading) { return; }
+        
+        pluginPath = pendingLoadRequest.has_value() ? pendingLoadRequest->pluginPath : currentLoadTimings.pluginPath;
+        pendingLoadRequest.reset();
+        // A cancelled load must not hand its restored state to whichever plugin is loaded next
+        hostedPluginState.reset();
+        hostedPluginStatePath = {};
+        ++loadGeneration;
+        
+        // A load which is still queued will never call back. One which is already instantiating will, and its plugin will be discarded
+        if (loadScheduler->cancel(this))
+        {
+            isLoading = false;
+        }
+    }
+    
+    juce::MessageManager::callAsync([this, pluginPath]()
+    {
+        loadListeners.call([&](auto& l) { l.hostedPluginLoadFinished({ LoadResult::Status::cancelled, pluginPath, {} }); });
+    });
+}
+
+void VST3WrapperAudioProcessor::addLoadListener(LoadListener* listener)
+{
+    loadListeners.add(listener);
+}
+
+void VST3WrapperAudioProcessor::removeLoadListener(LoadListener* listener)
+{
+    loadListeners.remove(listener);
+}
+
+bool VST3WrapperAudioProcessor::isCurrentLoad(juce::uint32 generation)
+{
+    const juce::ScopedLock sl (innerMutex);
+    return generation == loadGeneration;
+}
+
+void VST3WrapperAudioProcessor::handleAsyncUpdate()
+{
+    switchOfflineMode();
+    logOfflineThroughput();
+    
+    LoadRequest request;
+    juce::uint32 generation;
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        
+        if (!pendingLoadRequest.has_value()) { return; }
+        
+        // A load still waiting in the scheduler hasn't instantiated anything yet, so it can be dropped for free.
+        // Otherwise, `loadEnded` tries again once the load in progress is done.
+        if (isLoading && !loadScheduler->cancel(this)) { return; }
+        
+        request = std::move(*pendingLoadRequest);
+        pendingLoadRequest.reset();
+        generation = loadGeneration;
+    }
+    
+    startLoad(request, generation);
+}
+
+void VST3WrapperAudioProcessor::loadEnded(juce::uint32 generation, const LoadResult& result)
+{
+    setIsLoading(false);
+    
+    if (isCurrentLoad(generation))
+    {
+        juce::MessageManager::callAsync([this, result]()
+        {
+            loadListeners.call([&](auto& l) { l.hostedPluginLoadFinished(result); });
+        });
+    }
+    
+    // Start the request made while this load was in progress, if any
+    triggerAsyncUpdate();
+}
 
+void VST3WrapperAudioProcessor::startLoad(const LoadRequest& request, juce::uint32 generation)
+{
+    const auto pluginPath = request.pluginPath;
+    
+    removePrevioslyHostedPluginIfNeeded(true);
+    
+    setHostedPluginStateData(request.pluginState, pluginPath);
     setIsLoading(true);
+    
+    updateLoadTimings([&](auto& timings)
+    {
+        timings = PluginLoadTimings();
+        timings.pluginPath = pluginPath;
+        timings.loadTime = juce::Time::getCurrentTime();
+    });
+    
+    if (isSandboxEnabled())
+    {
+        loadPluginInSandbox(pluginPath, generation);
+        return;
+    }
             
-    auto callback = [&, pluginPath](auto pluginInstance)
+    auto callback = [&, pluginPath, generation](auto pluginInstance)
     {
+        // Superseded or cancelled while the plugin was being instantiated
+        if (!isCurrentLoad(generation))
+        {
+            pluginInstance.reset();
+            loadEnded(generation, { LoadResult::Status::cancelled, pluginPath, {} });
+            return;
+        }
+        
         if (pluginInstance == nullptr)
         {
-            setIsLoading(false);
-            juce::MessageManager::callAsync([&]() { sendChangeMessage(); });
+            finishLoadTimings(false, {});
+            loadEnded(generation, { LoadResult::Status::failed, pluginPath, getHostedPluginLoadingError() });
             return;
         }
         
@@ -100,37 +257,54 @@ void VST3WrapperAudioProcessor::loadPlugin(const juce::String& pluginPath)
         
         setHostedPluginInstance(std::move(pluginInstance));
         
-        auto successfullyConfigured = true;
-        successfullyConfigured &= setHostedPluginLayout();
+        auto phaseStartMs = juce::Time::getMillisecondCounterHiRes();
+        auto successfullyConfigured = setHostedPluginLayout();
+        const auto layoutMs = juce::Time::getMillisecondCounterHiRes() - phaseStartMs;
+        
+        phaseStartMs = juce::Time::getMillisecondCounterHiRes();
         successfullyConfigured &= prepareHostedPluginForPlaying();
+        const auto prepareMs = juce::Time::getMillisecondCounterHiRes() - phaseStartMs;
+        
+        phaseStartMs = juce::Time::getMillisecondCounterHiRes();
         setHostedPluginState();
+        const auto stateMs = juce::Time::getMillisecondCounterHiRes() - phaseStartMs;
+        
         setHostedPluginPath(pluginPath);
 
         setHostedPluginName(pluginName);
         
+        updateLoadTimings([&](auto& timings)
+        {
+            timings.layoutMs = layoutMs;
+            timings.prepareMs = prepareMs;
+            timings.stateMs = stateMs;
+        });
+        
+        finishLoadTimings(successfullyConfigured, pluginName);
+        
         if (!successfullyConfigured)
         {
             removePrevioslyHostedPluginIfNeeded(false);
         }
         
-        setIsLoading(false);
-        
-        juce::MessageManager::callAsync([&]() { sendChangeMessage(); });
+        if (successfullyConfigured)
+            loadEnded(generation, { LoadResult::Status::loaded, pluginPath, {} });
+        else
+            loadEnded(generation, { LoadResult::Status::failed, pluginPath, getHostedPluginLoadingError() });
     };
     
-    loadPluginFromFile(pluginPath, std::move(callback));
+    loadPluginFromFile(pluginPath, request.priority, generation, std::move(callback));
 }
 
 bool  VST3WrapperAudioProcessor::isCurrentlyLoading()
 {
     const juce::ScopedLock sl (innerMutex);
-    return isLoading;
+    return isLoading || pendingLoadRequest.has_value();
 }
 
 void VST3WrapperAudioProcessor::closeHostedPlugin()
 {
-    if (isCurrentlyLoading()) { return; }
-    
+    cancelPendingLoad();
     removePrevioslyHostedPluginIfNeeded(true);
 }
 
@@ -168,340 +342,1713 @@ juce::AudioProcessorEditor* VST3WrapperAudioProcessor::createHostedPluginEditorI
     });
 }
 
-//==============================================================================
-// Plugin loading
-//==============================================================================
-
-void VST3WrapperAudioProcessor::removePrevioslyHostedPluginIfNeeded(bool unsetError)
+PluginLoadTimings VST3WrapperAudioProcessor::getLastLoadTimings()
 {
-    safelyPerform<void>([](auto& p)
-    {
-        // Plugin's editor must be deleted before deleting its processor
-        jassert(p->getActiveEditor() == nullptr);
-    });
-   
-    setHostedPluginInstance(nullptr);
-    setHostedPluginPath("");
-    if (unsetError) { setHostedPluginLoadingError(""); }
-    setIsLoading(false);
-    setHostedPluginHasSidechainInput(false);
-    setHostedPluginName("");
+    const juce::ScopedLock sl (innerMutex);
+    return lastLoadTimings;
 }
 
-void VST3WrapperAudioProcessor::loadPluginFromFile(const juce::String& pluginPath, PluginLoadingCallback vst3FileLoadingCompleted)
+juce::Array<PluginLoadTimings> VST3WrapperAudioProcessor::getLoadHistory()
 {
-    // Some plugins crash if they are scanned from a background thread
-    juce::MessageManager::callAsync([=]() {
-        
-        juce::OwnedArray<juce::PluginDescription> descs;
-        vst3Format.findAllTypesForFile(descs, pluginPath);
-            
-        if (descs.isEmpty())
-        {
-            setHostedPluginLoadingError("No valid VST3 found in selected file");
-            vst3FileLoadingCompleted(nullptr);
-            return;
-        }
-        
-        auto descIndex = -1;
-        
-        auto validDescription = [](const juce::PluginDescription* d)
-        {
-    #if JucePlugin_IsMidiEffect || JucePlugin_IsSynth
-            return d->isInstrument;
-    #else
-            return !d->isInstrument;
-    #endif
-        };
-        
-        for (int i = 0; i < descs.size(); ++i)
-        {
-            if (validDescription(descs[i]))
-            {
-                descIndex = i;
-                break;
-            }
-        }
-        
-        if (descIndex == -1)
-        {
-    #if JucePlugin_IsMidiEffect || JucePlugin_IsSynth
-            setHostedPluginLoadingError("Selected VST3 is not an instrument");
-    #else
-            setHostedPluginLoadingError("Selected VST3 is not an effect");
-    #endif
-            vst3FileLoadingCompleted(nullptr);
-            return;
-        }
-        
-        const auto pluginDescription = *descs[descIndex];
-        
-        auto callback = [=](auto pluginInstance, const auto& errorMessage)
-        {
-            
-            if (pluginInstance == nullptr)
-            {
-                setHostedPluginLoadingError(errorMessage.isEmpty() ? unexpectedPluginLoadingError : errorMessage);
-                vst3FileLoadingCompleted(nullptr);
-                return;
-            }
-            
-        #if JucePlugin_IsMidiEffect
-            if (!pluginInstance->acceptsMidi())
-            {
-                setHostedPluginLoadingError("Selected VST3 Plugin Does Not Accept MIDI");
-                vst3FileLoadingCompleted(nullptr);
-                return;
-            }
-            
-            if (!pluginInstance->producesMidi())
-            {
-                setHostedPluginLoadingError("Selected VST3 Plugin Does Not Produce MIDI");
-                vst3FileLoadingCompleted(nullptr);
-                return;
-            }
-        #endif
-            
-            vst3FileLoadingCompleted(std::move(pluginInstance));
-        };
-        
-        vst3Format.createPluginInstanceAsync(pluginDescription, getSampleRate(), getBlockSize(), std::move(callback));
-    });
+    return loadHistory->getHistory(getLastLoadTimings().pluginPath);
 }
 
-bool VST3WrapperAudioProcessor::setHostedPluginLayout()
+void VST3WrapperAudioProcessor::markStateDirty()
 {
-    auto isMidiEffet = false;
-#if JucePlugin_IsMidiEffect
-    isMidiEffet = true;
-    const auto sideChainBusIndex = 0;
-#elif JucePlugin_IsSynth
-    const auto sideChainBusIndex = 0;
-#else
-    const auto sideChainBusIndex = 1;
-#endif
-    
-    const auto hostedPluginDefaultLayout = safelyPerform<juce::AudioProcessor::BusesLayout>([](auto& p) {
-        p -> enableAllBuses();
-        return p->getBusesLayout();
-    });
-
-    setHostedPluginHasSidechainInput(!isMidiEffet && hostedPluginDefaultLayout.inputBuses.size() == sideChainBusIndex + 1);
+    isStateDirty = true;
     
-    return true;
+#if JucePlugin_IsSynth
+    renderCache.invalidateStateKey();
+#endif
 }
 
-bool VST3WrapperAudioProcessor::prepareHostedPluginForPlaying()
+void VST3WrapperAudioProcessor::setDeferredLoadingEnabled(bool shouldBeEnabled)
 {
-    setLatencySamples(safelyPerform<int>([](auto& p) { return p->getLatencySamples(); }));
-    
-    safelyPerform<void>([&](auto& p)
-    {
-        p->setRateAndBufferSizeDetails(getSampleRate(), getBlockSize());
-        p->prepareToPlay(getSampleRate(), getBlockSize());
-    });
-    
-    return true;
+    const juce::ScopedLock sl (innerMutex);
+    deferredLoadingEnabled = shouldBeEnabled;
+    invalidateCachedState();
 }
 
-void VST3WrapperAudioProcessor::setHostedPluginState()
+bool VST3WrapperAudioProcessor::isDeferredLoadingEnabled()
 {
-    safelyPerform<void>([&](auto& p)
-    {
-        if (!getHostedPluginStateMemoryBlock().isEmpty())
-        {
-            p->setStateInformation (getHostedPluginStateMemoryBlock().getData(), (int) getHostedPluginStateMemoryBlock().getSize());
-        }
-    });
-    
-    setHostedPluginStateMemoryBlock(juce::MemoryBlock());
+    const juce::ScopedLock sl (innerMutex);
+    return deferredLoadingEnabled;
 }
 
-//==============================================================================
-// AudioProcessor Methods
-//==============================================================================
-
-bool VST3WrapperAudioProcessor::acceptsMidi() const
+bool VST3WrapperAudioProcessor::isHostedPluginDormant()
 {
-#if JucePlugin_WantsMidiInput
-    return true;
-#else
-    return false;
-#endif
+    return isDormant;
 }
 
-bool VST3WrapperAudioProcessor::producesMidi() const
+void VST3WrapperAudioProcessor::wakeHostedPlugin()
 {
-#if JucePlugin_ProducesMidiOutput
-    return true;
-#else
-    return false;
-#endif
+    const juce::ScopedLock sl (innerMutex);
+    
+    // Waking up without the state the project refers to would reset the plugin (see `keepMissingState`)
+    if (!isDormant || isDormantStateMissing) { return; }
+    
+    stopTimer();
+    isDormant = false;
+    wakeRequested = false;
+    dormantState.reset();
+    shouldMuteNextBlock = true;
+    
+    // `hostedPluginState` still holds the state stored by `setStateInformation`
+    loadPlugin(hostedPluginPath, PluginLoadScheduler::Priority::userRequested);
 }
 
-bool VST3WrapperAudioProcessor::isMidiEffect() const
+bool VST3WrapperAudioProcessor::isHostedPluginSafeForBackgroundScanning()
 {
-#if JucePlugin_IsMidiEffect
-    return true;
-#else
-    return false;
-#endif
+    const auto pluginPath = getHostedPluginPath();
+    return pluginPath.isNotEmpty() && loadScheduler->isSafeForBackgroundScanning(pluginPath);
 }
 
-double VST3WrapperAudioProcessor::getTailLengthSeconds() const
+void VST3WrapperAudioProcessor::setHostedPluginSafeForBackgroundScanning(bool isSafe)
 {
-    return safelyPerform<double>([](auto& p) { return p->getTailLengthSeconds(); });
+    const auto pluginPath = getHostedPluginPath();
+    
+    if (pluginPath.isNotEmpty())
+    {
+        loadScheduler->setSafeForBackgroundScanning(pluginPath, isSafe);
+    }
 }
 
-int VST3WrapperAudioProcessor::getNumPrograms()
+void VST3WrapperAudioProcessor::setSandboxEnabled(bool shouldBeEnabled)
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-    // so this should be at least 1, even if you're not really implementing programs.
+    const juce::ScopedLock sl (innerMutex);
+    sandboxEnabled = shouldBeEnabled;
+    invalidateCachedState();
 }
 
-int VST3WrapperAudioProcessor::getCurrentProgram()
+bool VST3WrapperAudioProcessor::isSandboxEnabled()
 {
-    return 0;
+    const juce::ScopedLock sl (innerMutex);
+    return sandboxEnabled;
 }
 
-void VST3WrapperAudioProcessor::setCurrentProgram (int index)
+bool VST3WrapperAudioProcessor::isHostedPluginSandboxed()
 {
+    return isSandboxed;
 }
 
-const juce::String VST3WrapperAudioProcessor::getProgramName (int index)
+bool VST3WrapperAudioProcessor::hasSandboxedPluginCrashed()
 {
-    return {};
+    return isSandboxed && sandboxedPluginHost.hasCrashed();
 }
 
-void VST3WrapperAudioProcessor::changeProgramName (int index, const juce::String& newName)
+void VST3WrapperAudioProcessor::reloadCrashedPlugin()
 {
+    if (!hasSandboxedPluginCrashed()) { return; }
+    
+    const auto pluginPath = getHostedPluginPath();
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        hostedPluginState = PluginStateData(sandboxedPluginState);
+        hostedPluginStatePath = pluginPath;
+    }
+    
+    loadPlugin(pluginPath);
 }
 
-int preparedCount;
-
+void VST3WrapperAudioProcessor::setEditorRetentionEnabled(bool shouldBeEnabled)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        editorRetentionEnabled = shouldBeEnabled;
+        invalidateCachedState();
+    }
+    
+    if (!shouldBeEnabled)
+    {
+        editorCache->release(this);
+    }
+}
+
+bool VST3WrapperAudioProcessor::isEditorRetentionEnabled()
+{
+    const juce::ScopedLock sl (innerMutex);
+    return editorRetentionEnabled;
+}
+
+void VST3WrapperAudioProcessor::setSidecarStoreEnabled(bool shouldBeEnabled)
+{
+    const juce::ScopedLock sl (innerMutex);
+    sidecarStoreEnabled = shouldBeEnabled;
+    invalidateCachedState();
+}
+
+bool VST3WrapperAudioProcessor::isSidecarStoreEnabled()
+{
+    const juce::ScopedLock sl (innerMutex);
+    return sidecarStoreEnabled;
+}
+
+#if JucePlugin_IsSynth
+void VST3WrapperAudioProcessor::setRenderCacheEnabled(bool shouldBeEnabled)
+{
+    {
+        const juce::ScopedLock sl (innerMutex);
+        renderCache.setEnabled(shouldBeEnabled);
+        invalidateCachedState();
+    }
+    
+    // The cache's chunks are allocated (or released) while the audio thread isn't using them
+    suspendProcessing(true);
+    prepareRenderCache();
+    suspendProcessing(false);
+}
+
+bool VST3WrapperAudioProcessor::isRenderCacheEnabled()
+{
+    return renderCache.isEnabled();
+}
+
+RenderCache::Statistics VST3WrapperAudioProcessor::getRenderCacheStatistics()
+{
+    return renderCache.getStatistics();
+}
+#endif
+
+#if ! JucePlugin_IsMidiEffect
+void VST3WrapperAudioProcessor::setInternalSampleRate(double rate, StreamingResampler::Quality quality)
+{
+    {
+        const juce::ScopedLock sl (innerMutex);
+        
+        if (rate == internalSampleRate && quality == resamplingQuality) { return; }
+        
+        internalSampleRate = rate;
+        resamplingQuality = quality;
+        invalidateCachedState();
+    }
+    
+    // The hosted plugin has to be prepared again at its new rate
+    if (getSampleRate() > 0.0)
+    {
+        suspendProcessing(true);
+        prepareToPlay(getSampleRate(), getBlockSize());
+        suspendProcessing(false);
+    }
+}
+
+double VST3WrapperAudioProcessor::getInternalSampleRate()
+{
+    const juce::ScopedLock sl (innerMutex);
+    return internalSampleRate;
+}
+
+StreamingResampler::Quality VST3WrapperAudioProcessor::getResamplingQuality()
+{
+    const juce::ScopedLock sl (innerMutex);
+    return resamplingQuality;
+}
+
+VST3WrapperAudioProcessor::ResamplingStatistics VST3WrapperAudioProcessor::getResamplingStatistics()
+{
+    ResamplingStatistics statistics;
+    statistics.isActive = sampleRateAdapter.isActive();
+    statistics.internalSampleRate = sampleRateAdapter.getInternalRate();
+    statistics.latencySamples = sampleRateAdapter.getLatencySamples();
+    statistics.microsecondsPerBlock = sampleRateAdapter.getMicrosecondsPerBlock();
+    return statistics;
+}
+
+void VST3WrapperAudioProcessor::prepareSampleRateAdapter(double sampleRate, int samplesPerBlock)
+{
+    auto rate = getInternalSampleRate();
+    
+    // Only in-process single precision rendering is resampled, which is what Logic uses
+    if (isSandboxed || isUsingDoublePrecision())
+    {
+        rate = 0.0;
+    }
+    
+    sampleRateAdapter.prepare(sampleRate, rate, getTotalNumInputChannels(), getTotalNumOutputChannels(), samplesPerBlock, getResamplingQuality());
+}
+#endif
+
+double VST3WrapperAudioProcessor::getHostedSampleRate() const
+{
+#if ! JucePlugin_IsMidiEffect
+    if (sampleRateAdapter.isActive()) { return sampleRateAdapter.getInternalRate(); }
+#endif
+    return getSampleRate();
+}
+
+int VST3WrapperAudioProcessor::getHostedBlockSize() const
+{
+#if ! JucePlugin_IsMidiEffect
+    if (sampleRateAdapter.isActive()) { return sampleRateAdapter.getMaximumInternalBlockSize(); }
+#endif
+    return getBlockSize();
+}
+
+void VST3WrapperAudioProcessor::retainHostedPluginEditor(std::unique_ptr<juce::AudioProcessorEditor> editor)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    if (editor == nullptr || !isEditorRetentionEnabled() || !isHostedPluginLoaded()) { return; }
+    
+    editorCache->retain(this, std::move(editor));
+}
+
+std::unique_ptr<juce::AudioProcessorEditor> VST3WrapperAudioProcessor::takeRetainedHostedPluginEditor()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    return editorCache->take(this);
+}
+
+void VST3WrapperAudioProcessor::showSandboxedPluginEditor()
+{
+    if (isSandboxed)
+    {
+        sandboxedPluginHost.showEditor();
+    }
+}
+
+void VST3WrapperAudioProcessor::timerCallback()
+{
+    if (wakeRequested)
+    {
+        wakeHostedPlugin();
+    }
+}
+
+//==============================================================================
+// Plugin loading
+//==============================================================================
+
+void VST3WrapperAudioProcessor::updateLoadTimings(const std::function<void(PluginLoadTimings&)>& update)
+{
+    const juce::ScopedLock sl (innerMutex);
+    update(currentLoadTimings);
+}
+
+void VST3WrapperAudioProcessor::finishLoadTimings(bool succeeded, const juce::String& pluginName)
+{
+    PluginLoadTimings timings;
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        currentLoadTimings.succeeded = succeeded;
+        currentLoadTimings.pluginName = pluginName;
+        lastLoadTimings = currentLoadTimings;
+        timings = currentLoadTimings;
+    }
+    
+    loadHistory->add(timings);
+    juce::Logger::writeToLog(timings.toLogLine());
+}
+
+void VST3WrapperAudioProcessor::removePrevioslyHostedPluginIfNeeded(bool unsetError)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    loadListeners.call([](auto& l) { l.hostedPluginAboutToBeRemoved(); });
+    editorCache->release(this);
+    
+    safelyPerform<void>([](auto& p)
+    {
+        // Plugin's editor must be deleted before deleting its processor
+        jassert(p->getActiveEditor() == nullptr);
+    });
+   
+    setHostedPluginInstance(nullptr);
+    
+    if (isSandboxed.exchange(false))
+    {
+        sandboxedPluginHost.unload();
+    }
+    
+    setHostedPluginPath("");
+    setIsDormant(false);
+    if (unsetError) { setHostedPluginLoadingError(""); }
+    setIsLoading(false);
+    setHostedPluginHasSidechainInput(false);
+    setHostedPluginName("");
+}
+
+void VST3WrapperAudioProcessor::loadPluginFromFile(const juce::String& pluginPath, PluginLoadScheduler::Priority priority, juce::uint32 generation, PluginLoadingCallback vst3FileLoadingCompleted)
+{
+    // Some plugins crash if they are scanned from a background thread,
+    // so the scheduler calls us back on the message thread with the scanned descriptions
+    loadScheduler->scheduleLoad(this, pluginPath, priority, [=](const auto& descs, const auto& scanTimings) {
+        
+        // Superseded after the scan, but before anything has been instantiated
+        if (!isCurrentLoad(generation))
+        {
+            vst3FileLoadingCompleted(nullptr);
+            return;
+        }
+        
+        updateLoadTimings([&](auto& timings)
+        {
+            timings.queuedMs = scanTimings.queuedMs;
+            timings.scanMs = scanTimings.scanMs;
+        });
+        
+        if (descs.isEmpty())
+        {
+            setHostedPluginLoadingError("No valid VST3 found in selected file");
+            vst3FileLoadingCompleted(nullptr);
+            return;
+        }
+        
+        auto descIndex = -1;
+        
+        auto validDescription = [](const juce::PluginDescription* d)
+        {
+    #if JucePlugin_IsMidiEffect || JucePlugin_IsSynth
+            return d->isInstrument;
+    #else
+            return !d->isInstrument;
+    #endif
+        };
+        
+        for (int i = 0; i < descs.size(); ++i)
+        {
+            if (validDescription(descs[i]))
+            {
+                descIndex = i;
+                break;
+            }
+        }
+        
+        if (descIndex == -1)
+        {
+    #if JucePlugin_IsMidiEffect || JucePlugin_IsSynth
+            setHostedPluginLoadingError("Selected VST3 is not an instrument");
+    #else
+            setHostedPluginLoadingError("Selected VST3 is not an effect");
+    #endif
+            vst3FileLoadingCompleted(nullptr);
+            return;
+        }
+        
+        const auto pluginDescription = *descs[descIndex];
+        const auto instantiationStartMs = juce::Time::getMillisecondCounterHiRes();
+        
+        auto callback = [=](auto pluginInstance, const auto& errorMessage)
+        {
+            updateLoadTimings([&](auto& timings)
+            {
+                timings.instantiationMs = juce::Time::getMillisecondCounterHiRes() - instantiationStartMs;
+            });
+            
+            if (pluginInstance == nullptr)
+            {
+                setHostedPluginLoadingError(errorMessage.isEmpty() ? unexpectedPluginLoadingError : errorMessage);
+                vst3FileLoadingCompleted(nullptr);
+                return;
+            }
+            
+            // Lets the catalog hide plugins the MIDI FX variant can't host without loading them again
+            pluginCatalog->setMidiSupport(pluginPath, pluginInstance->acceptsMidi(), pluginInstance->producesMidi());
+            
+        #if JucePlugin_IsMidiEffect
+            if (!pluginInstance->acceptsMidi())
+            {
+                setHostedPluginLoadingError("Selected VST3 Plugin Does Not Accept MIDI");
+                vst3FileLoadingCompleted(nullptr);
+                return;
+            }
+            
+            if (!pluginInstance->producesMidi())
+            {
+                setHostedPluginLoadingError("Selected VST3 Plugin Does Not Produce MIDI");
+                vst3FileLoadingCompleted(nullptr);
+                return;
+            }
+        #endif
+            
+            vst3FileLoadingCompleted(std::move(pluginInstance));
+        };
+        
+        vst3Format.createPluginInstanceAsync(pluginDescription, getSampleRate(), getBlockSize(), std::move(callback));
+    });
+}
+
+void VST3WrapperAudioProcessor::loadPluginInSandbox(const juce::String& pluginPath, juce::uint32 generation)
+{
+    // The helper scans and instantiates the plugin itself, so the load doesn't go through `loadScheduler`
+    SandboxedPluginHost::LoadRequest request;
+    request.pluginPath = pluginPath;
+    request.pluginState = getHostedPluginStateData().toMemoryBlock();
+    request.sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 44100.0;
+    request.blockSize = getBlockSize() > 0 ? getBlockSize() : 512;
+#if JucePlugin_IsMidiEffect || JucePlugin_IsSynth
+    request.wantsInstrument = true;
+#endif
+#if JucePlugin_IsMidiEffect
+    request.requiresMidiInputAndOutput = true;
+#endif
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        sandboxedPluginState = request.pluginState;
+        hostedPluginState.reset();
+        hostedPluginStatePath = {};
+        hostedPluginPath = pluginPath;
+        sandboxedLoadStartMs = juce::Time::getMillisecondCounterHiRes();
+        sandboxedLoadGeneration = generation;
+    }
+    
+    isSandboxed = true;
+    sandboxedPluginHost.load(request);
+}
+
+void VST3WrapperAudioProcessor::sandboxedPluginLoaded(const SandboxedPluginHost::LoadResult& result)
+{
+    juce::uint32 generation;
+    
+    updateLoadTimings([&](auto& timings)
+    {
+        // Scanning, instantiation, layout, preparation and state restoration all happen in the helper
+        timings.instantiationMs = juce::Time::getMillisecondCounterHiRes() - sandboxedLoadStartMs;
+        generation = sandboxedLoadGeneration;
+    });
+    
+    const auto pluginPath = getHostedPluginPath();
+    
+    if (!result.succeeded)
+    {
+        // The helper is left running, as it can't be quit from its own connection's thread
+        isSandboxed = false;
+        setHostedPluginPath("");
+        setHostedPluginLoadingError(result.error.isEmpty() ? unexpectedPluginLoadingError : result.error);
+        finishLoadTimings(false, {});
+        loadEnded(generation, { LoadResult::Status::failed, pluginPath, getHostedPluginLoadingError() });
+        return;
+    }
+    
+    setHostedPluginName(result.pluginName);
+    setHostedPluginHasSidechainInput(result.hasSidechainInput);
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        invalidateCachedState();
+    }
+    
+    updateLatency();
+    finishLoadTimings(true, result.pluginName);
+    
+    loadEnded(generation, { LoadResult::Status::loaded, pluginPath, {} });
+    
+    // The helper can't be quit from its own connection's thread, so a cancelled load is discarded from the message thread.
+    // A superseded one is simply replaced by the newer load.
+    if (!isCurrentLoad(generation))
+    {
+        juce::MessageManager::callAsync([this]()
+        {
+            if (isSandboxed && !isCurrentlyLoading())
+            {
+                removePrevioslyHostedPluginIfNeeded(true);
+            }
+        });
+    }
+}
+
+void VST3WrapperAudioProcessor::sandboxedPluginCrashed()
+{
+    juce::Logger::writeToLog("AU-VST3-Wrapper: " + getHostedPluginName() + " has crashed in the sandbox helper process");
+    
+    juce::MessageManager::callAsync([this]()
+    {
+        loadListeners.call([](auto& l) { l.hostedPluginCrashed(); });
+    });
+}
+
+bool VST3WrapperAudioProcessor::setHostedPluginLayout()
+{
+    auto isMidiEffet = false;
+#if JucePlugin_IsMidiEffect
+    isMidiEffet = true;
+    const auto sideChainBusIndex = 0;
+#elif JucePlugin_IsSynth
+    const auto sideChainBusIndex = 0;
+#else
+    const auto sideChainBusIndex = 1;
+#endif
+    
+    const auto hostedPluginDefaultLayout = safelyPerform<juce::AudioProcessor::BusesLayout>([](auto& p) {
+        p -> enableAllBuses();
+        return p->getBusesLayout();
+    });
+
+    setHostedPluginHasSidechainInput(!isMidiEffet && hostedPluginDefaultLayout.inputBuses.size() == sideChainBusIndex + 1);
+    
+    return true;
+}
+
+bool VST3WrapperAudioProcessor::prepareHostedPluginForPlaying()
+{
+#if ! JucePlugin_IsMidiEffect
+    // The host keeps processing while a plugin is being loaded, and a restored state may run the plugin at another rate.
+    // The adapter is used by both the audio thread and the render thread, so processing is suspended and the render thread
+    // stopped until the adapter, the plugin and the render thread have all been prepared again.
+    suspendProcessing(true);
+    stopPipelinedRenderer();
+    
+    if (getSampleRate() > 0.0)
+    {
+        prepareSampleRateAdapter(getSampleRate(), getBlockSize());
+    }
+    
+    prepareHostedPlugin();
+    configurePipelinedRenderer();
+    suspendProcessing(false);
+#else
+    prepareHostedPlugin();
+    
+    // The host keeps processing while a plugin is being loaded,
+    // so the render thread has to be reconfigured with processing suspended
+    suspendProcessing(true);
+    configurePipelinedRenderer();
+    suspendProcessing(false);
+#endif
+    
+    return true;
+}
+
+//==============================================================================
+// Telemetry
+//==============================================================================
+
+TelemetryTable::Status VST3WrapperAudioProcessor::getTelemetryStatus()
+{
+    using LoadState = TelemetryEntry::LoadState;
+    
+    TelemetryTable::Status status;
+    status.pluginName = getHostedPluginName();
+    status.isSandboxed = isSandboxed;
+    status.latencySamples = getLatencySamples();
+    
+    if (status.pluginName.isEmpty())
+    {
+        status.pluginName = juce::File(getHostedPluginPath()).getFileNameWithoutExtension();
+    }
+    
+    if (isCurrentlyLoading())
+    {
+        status.loadState = LoadState::loading;
+    }
+    else if (hasSandboxedPluginCrashed())
+    {
+        status.loadState = LoadState::crashed;
+    }
+    else if (isDormant)
+    {
+        status.loadState = LoadState::dormant;
+    }
+    else if (isHostedPluginLoaded())
+    {
+        status.loadState = LoadState::loaded;
+    }
+    else if (getHostedPluginLoadingError().isNotEmpty())
+    {
+        status.loadState = LoadState::failed;
+    }
+    
+    return status;
+}
+
+//==============================================================================
+// Render thread
+//==============================================================================
+
+void VST3WrapperAudioProcessor::setRenderThreadEnabled(bool shouldBeEnabled)
+{
+    {
+        const juce::ScopedLock sl (innerMutex);
+        renderThreadEnabled = shouldBeEnabled;
+        invalidateCachedState();
+    }
+    
+    suspendProcessing(true);
+    configurePipelinedRenderer();
+    suspendProcessing(false);
+}
+
+bool VST3WrapperAudioProcessor::isRenderThreadEnabled()
+{
+    const juce::ScopedLock sl (innerMutex);
+    return renderThreadEnabled;
+}
+
+int VST3WrapperAudioProcessor::getRenderThreadDeadlineMisses()
+{
+    const auto* renderer = pipelinedRenderer.get();
+    return renderer != nullptr ? renderer->getNumDeadlineMisses() : 0;
+}
+
+void VST3WrapperAudioProcessor::setOverrunAction(HostedPluginWatchdog::Action action)
+{
+    const juce::ScopedLock sl (innerMutex);
+    auto policy = watchdog.getPolicy();
+    policy.action = action;
+    watchdog.setPolicy(policy);
+    invalidateCachedState();
+}
+
+HostedPluginWatchdog::Action VST3WrapperAudioProcessor::getOverrunAction()
+{
+    return watchdog.getPolicy().action;
+}
+
+bool VST3WrapperAudioProcessor::isHostedPluginOverloaded()
+{
+    return watchdog.isTripped();
+}
+
+void VST3WrapperAudioProcessor::readOverrunEvents(const std::function<void(const HostedPluginWatchdog::OverrunEvent&)>& callback)
+{
+    watchdog.readOverrunEvents(callback);
+}
+
+void VST3WrapperAudioProcessor::configurePipelinedRenderer()
+{
+    // The worker thread locks `innerMutex` while rendering, so the renderer
+    // must not be stopped or destroyed while `innerMutex` is held
+    
+    const auto hostedPluginChannels = safelyPerform<int>([](auto& p)
+    {
+        return jmax(p->getTotalNumInputChannels(), p->getTotalNumOutputChannels());
+    });
+    
+    stopPipelinedRenderer();
+    prepareRenderingState();
+    
+    if (isRenderThreadEnabled() && hostedPluginChannels > 0)
+    {
+        if (pipelinedRenderer == nullptr)
+        {
+            pipelinedRenderer = std::make_unique<PipelinedRenderer>([this](auto& buffer, auto& midiMessages, const auto& position, bool isActive)
+            {
+                const RealtimeSafetyChecker::ScopedCheck realtimeSafetyCheck;
+                
+                safelyPerform<void>([&](auto& p)
+                {
+                    p->setPlayHead(&hostedPlayHead);
+                    renderAtHostedRate(buffer, midiMessages, position, [&](auto& hostedBuffer, auto& hostedMidiMessages, const auto&)
+                    {
+                        renderHostedBlock(p, hostedBuffer, hostedMidiMessages, isActive);
+                    });
+                });
+            });
+        }
+        
+        const auto wrapperChannels = jmax(getTotalNumInputChannels(), getTotalNumOutputChannels());
+        pipelinedRenderer->prepare(jmax(hostedPluginChannels, wrapperChannels), getBlockSize());
+    }
+    else
+    {
+        pipelinedRenderer.reset();
+    }
+    
+    applyOfflineMode();
+    updateLatency();
+}
+
+void VST3WrapperAudioProcessor::stopPipelinedRenderer()
+{
+    // `prepare` starts the worker again
+    if (pipelinedRenderer != nullptr)
+    {
+        pipelinedRenderer->stop();
+    }
+}
+
+void VST3WrapperAudioProcessor::prepareRenderingState()
+{
+    const auto hostedPluginLatency = safelyPerform<int>([](auto& p) { return p->getLatencySamples(); });
+    
+#if JucePlugin_IsSynth || JucePlugin_IsMidiEffect
+    // Instruments have no input to pass through, so bypassing them means silence
+    const auto bypassChannels = 0;
+#else
+    const auto bypassChannels = getBusCount(true) > 0 ? getChannelCountOfBus(true, 0) : 0;
+#endif
+    
+    // The hosted plugin's blocks are timed and bypassed at its own rate
+    watchdog.prepare(getHostedSampleRate());
+    watchdogSkippedLastBlock = false;
+    floatBypass.prepare(bypassChannels, hostedPluginLatency, getHostedBlockSize());
+    doubleBypass.prepare(bypassChannels, hostedPluginLatency, getHostedBlockSize());
+    
+#if JucePlugin_IsSynth
+    prepareRenderCache();
+#endif
+    
+    prepareMidiTransform();
+}
+
+void VST3WrapperAudioProcessor::updateLatency()
+{
+    const auto hostedPluginLatency = safelyPerform<int>([](auto& p) { return p->getLatencySamples(); });
+    const auto renderThreadLatency = pipelinedRenderer != nullptr ? pipelinedRenderer->getLatencySamples() : 0;
+    const auto sandboxedPluginLatency = isSandboxed ? sandboxedPluginHost.getLatencySamples() : 0;
+    
+#if ! JucePlugin_IsMidiEffect
+    // The hosted plugin reports its latency at its own rate
+    const auto adaptedPluginLatency = sampleRateAdapter.toHostSamples(hostedPluginLatency) + sampleRateAdapter.getLatencySamples();
+    setLatencySamples(adaptedPluginLatency + renderThreadLatency + sandboxedPluginLatency);
+#else
+    setLatencySamples(hostedPluginLatency + renderThreadLatency + sandboxedPluginLatency);
+#endif
+}
+
+void VST3WrapperAudioProcessor::setHostedPluginState()
+{
+    // A state restored from the sidecar store is read straight from its mapping
+    const auto state = getHostedPluginStateData();
+    
+    safelyPerform<void>([&](auto& p)
+    {
+        if (!state.isEmpty())
+        {
+            p->setStateInformation (state.getData(), (int) state.getSize());
+        }
+    });
+    
+    setHostedPluginStateData(PluginStateData());
+}
+
+//==============================================================================
+// AudioProcessor Methods
+//==============================================================================
+
+bool VST3WrapperAudioProcessor::acceptsMidi() const
+{
+#if JucePlugin_WantsMidiInput
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool VST3WrapperAudioProcessor::producesMidi() const
+{
+#if JucePlugin_ProducesMidiOutput
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool VST3WrapperAudioProcessor::isMidiEffect() const
+{
+#if JucePlugin_IsMidiEffect
+    return true;
+#else
+    return false;
+#endif
+}
+
+double VST3WrapperAudioProcessor::getTailLengthSeconds() const
+{
+    return safelyPerform<double>([](auto& p) { return p->getTailLengthSeconds(); });
+}
+
+int VST3WrapperAudioProcessor::getNumPrograms()
+{
+    return ProgramSlots::numSlots;
+}
+
+int VST3WrapperAudioProcessor::getCurrentProgram()
+{
+    return programSlots.getCurrent();
+}
+
+void VST3WrapperAudioProcessor::setCurrentProgram (int index)
+{
+    // The slots hold states of a particular plugin, which must be running in this process
+    if (isSandboxed || !isProgramStored(index)) { return; }
+    
+    programSlots.select(index);
+}
+
+const juce::String VST3WrapperAudioProcessor::getProgramName (int index)
+{
+    return programSlots.getName(index);
+}
+
+void VST3WrapperAudioProcessor::changeProgramName (int index, const juce::String& newName)
+{
+    programSlots.setName(index, newName);
+    
+    const juce::ScopedLock sl (innerMutex);
+    invalidateCachedState();
+}
+
+void VST3WrapperAudioProcessor::storeProgram(int index)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    if (isSandboxed) { return; }
+    
+    juce::MemoryBlock state;
+    
+    if (!safelyPerform<bool>([&](auto& p) { p->getStateInformation(state); return true; })) { return; }
+    
+    programSlots.store(index, state, getHostedPluginPath());
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        invalidateCachedState();
+    }
+    
+    updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+}
+
+bool VST3WrapperAudioProcessor::isProgramStored(int index)
+{
+    return !programSlots.isEmpty(index) && programSlots.getPluginPath() == getHostedPluginPath();
+}
+
+double VST3WrapperAudioProcessor::getLastProgramSwitchMs(int index)
+{
+    return programSlots.getLastSwitchMs(index);
+}
+
+void VST3WrapperAudioProcessor::applyProgramState(const juce::MemoryBlock& state)
+{
+    // A plugin loaded since the program was selected doesn't get another plugin's state
+    if (isSandboxed || programSlots.getPluginPath() != getHostedPluginPath()) { return; }
+    
+    safelyPerform<void>([&](auto& p)
+    {
+        p->setStateInformation(state.getData(), (int) state.getSize());
+    });
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        invalidateCachedState();
+    }
+    
+    updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+}
+
+#if JucePlugin_IsSynth
+//==============================================================================
+// Render cache
+//==============================================================================
+
+juce::uint64 VST3WrapperAudioProcessor::computeRenderCacheStateKey()
+{
+    // The key is the same across sessions, so the cache outlives the project being closed
+    const auto pluginPath = getHostedPluginPath();
+    juce::MemoryBlock state;
+    
+    const auto isLoaded = safelyPerform<bool>([&](auto& p)
+    {
+        p->getStateInformation(state);
+        return true;
+    });
+    
+    if (!isLoaded) { return 0; }
+    
+    RenderCache::BlockHash hash;
+    hash.add(pluginPath.toRawUTF8(), pluginPath.getNumBytesAsUTF8());
+    hash.add(state.getData(), state.getSize());
+    return hash.get();
+}
+
+void VST3WrapperAudioProcessor::prepareRenderCache()
+{
+    renderCache.prepare(getHostedSampleRate(), getHostedBlockSize(), getTotalNumOutputChannels());
+    renderCacheNextTimeInSamples = -1;
+    renderCacheServedLastBlock = false;
+}
+
+juce::uint64 VST3WrapperAudioProcessor::hashRenderCacheBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, const juce::AudioBuffer<float>& buffer,
+                                                             const juce::MidiBuffer& midiMessages, const juce::AudioPlayHead::PositionInfo& position)
+{
+    RenderCache::BlockHash hash;
+    hash.add(renderCache.getStateKey());
+    hash.add(buffer.getNumSamples());
+    hash.add(position.getTimeInSamples().orFallback(0));
+    hash.add(position.getPpqPosition().orFallback(0.0));
+    hash.add(position.getBpm().orFallback(0.0));
+    
+    for (const auto metadata : midiMessages)
+    {
+        hash.add(metadata.samplePosition);
+        hash.add(metadata.data, (size_t) metadata.numBytes);
+    }
+    
+    // The state key sees parameter changes too, but only once it has been computed again
+    for (const auto* parameter : p->getParameters())
+    {
+        hash.add(parameter->getValue());
+    }
+    
+    // The sidechain input, if it's enabled
+    for (int channel = 0; channel < getTotalNumInputChannels(); ++channel)
+    {
+        hash.add(buffer.getReadPointer(channel), (size_t) buffer.getNumSamples() * sizeof(float));
+    }
+    
+    return hash.get();
+}
+#endif
+
+void VST3WrapperAudioProcessor::prependAllNotesOff(juce::MidiBuffer& midiMessages)
+{
+    // `juce::MidiBuffer` stores every event as its sample position, its size and its bytes. The events are
+    // inserted in front of the block's own, rather than copying the whole block into another buffer.
+    constexpr int eventBytes = (int) (sizeof (juce::int32) + sizeof (juce::uint16)) + 3;
+    std::array<juce::uint8, 16 * eventBytes> events;
+    
+    for (int channel = 0; channel < 16; ++channel)
+    {
+        auto* const event = events.data() + channel * eventBytes;
+        juce::writeUnaligned<juce::int32>(event, 0);
+        juce::writeUnaligned<juce::uint16>(event + sizeof (juce::int32), 3);
+        event[6] = (juce::uint8) (0xb0 | channel);
+        event[7] = 123;
+        event[8] = 0;
+    }
+    
+    midiMessages.data.insertArray(0, events.data(), (int) events.size());
+}
+
+void VST3WrapperAudioProcessor::releaseNotesHeldWhileTripped(juce::MidiBuffer& midiMessages)
+{
+    if (!watchdogSkippedLastBlock) { return; }
+    
+    watchdogSkippedLastBlock = false;
+    
+    // The hosted plugin didn't see the note offs of the skipped blocks, so the notes it still holds
+    // are released before the block's own events
+    prependAllNotesOff(midiMessages);
+}
+
+#if JucePlugin_IsSynth
+void VST3WrapperAudioProcessor::releaseNotesHeldDuringCachedBlocks(juce::MidiBuffer& midiMessages)
+{
+    if (!renderCacheServedLastBlock) { return; }
+    
+    renderCacheServedLastBlock = false;
+    
+    // The hosted plugin hasn't seen the note offs of the cached blocks, so the notes it still holds
+    // are released before the block's own events
+    prependAllNotesOff(midiMessages);
+}
+#endif
+
+int preparedCount;
+
 void VST3WrapperAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
+{
+    reconfiguration.prepareStarted();
+    
+    // Preparing applies the current mode, including a change `setNonRealtime` hasn't switched to yet
+    isOfflineModeChangePending = false;
+    
+#if ! JucePlugin_IsMidiEffect
+    // The render thread resamples through the adapter too, so it's stopped first
+    stopPipelinedRenderer();
+    prepareSampleRateAdapter(sampleRate, samplesPerBlock);
+#endif
+    
+    prepareHostedPlugin();
+    
+    if (isSandboxed)
+    {
+        sandboxedPluginHost.prepare(sampleRate, samplesPerBlock);
+    }
+    
+    programSlots.prepare(sampleRate);
+    
+#if ! JucePlugin_IsMidiEffect
+    prepareBusMeters(sampleRate);
+#endif
+    
+#if JucePlugin_IsMidiEffect
+    floatMidiEffectScratch.setSize(midiEffectScratchChannels, samplesPerBlock, false, false, true);
+    if (isUsingDoublePrecision())
+        doubleMidiEffectScratch.setSize(midiEffectScratchChannels, samplesPerBlock, false, false, true);
+    midiEffectMidi.ensureSize((size_t) midiEffectMidiBufferBytes);
+#endif
+    
+    // The host doesn't process while preparing, so there is no need to suspend processing here
+    configurePipelinedRenderer();
+}
+
+void VST3WrapperAudioProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    const auto wasNonRealtime = this->isNonRealtime();
+    AudioProcessor::setNonRealtime(isNonRealtime);
+    
+    if (isNonRealtime == wasNonRealtime) { return; }
+    
+    // Hosts call this from any thread, the audio thread included, so only the change is recorded here.
+    // The hosted plugin and the render thread switch on the message thread, or in the next `prepareToPlay`.
+    const auto nowMs = juce::Time::getMillisecondCounterHiRes();
+    
+    if (isNonRealtime)
+    {
+        offlineSamples = 0;
+        offlineStartMs = nowMs;
+    }
+    else
+    {
+        offlineEndMs = nowMs;
+        isOfflineReportPending = true;
+    }
+    
+    isOfflineModeChangePending = true;
+    triggerAsyncUpdate();
+}
+
+void VST3WrapperAudioProcessor::switchOfflineMode()
+{
+    if (!isOfflineModeChangePending.exchange(false)) { return; }
+    
+    if (getSampleRate() > 0.0)
+    {
+        // The hosted plugin only switches modes when it's prepared again, and the render thread
+        // is reconfigured along with it. Hosts may keep processing meanwhile, so processing is suspended.
+        suspendProcessing(true);
+        stopPipelinedRenderer();
+        prepareHostedPlugin();
+        configurePipelinedRenderer();
+        suspendProcessing(false);
+    }
+    else
+    {
+        applyOfflineMode();
+    }
+}
+
+void VST3WrapperAudioProcessor::logOfflineThroughput()
+{
+    if (!isOfflineReportPending.exchange(false)) { return; }
+    
+    const auto renderedSeconds = getSampleRate() > 0.0 ? (double) offlineSamples.load() / getSampleRate() : 0.0;
+    const auto elapsedSeconds = (offlineEndMs.load() - offlineStartMs.load()) / 1000.0;
+    
+    juce::Logger::writeToLog("AU-VST3-Wrapper offline: plugin=" + getHostedPluginName()
+                             + " render_thread=" + juce::String((int) (pipelinedRenderer != nullptr))
+                             + " rendered_s=" + juce::String(renderedSeconds, 2)
+                             + " elapsed_s=" + juce::String(elapsedSeconds, 2)
+                             + " realtime_factor=" + juce::String(elapsedSeconds > 0.0 ? renderedSeconds / elapsedSeconds : 0.0, 2));
+}
+
+void VST3WrapperAudioProcessor::applyOfflineMode()
+{
+    const auto isOffline = isNonRealtime();
+    
+    safelyPerform<void>([&](auto& p)
+    {
+        p->setNonRealtime(isOffline);
+    });
+    
+    watchdog.setOffline(isOffline);
+    
+    // Offline, the render thread still runs the hosted plugin in parallel with the host's graph, but never drops a late block
+    if (pipelinedRenderer != nullptr)
+    {
+        pipelinedRenderer->setWaitsForWorker(isOffline);
+    }
+}
+
+void VST3WrapperAudioProcessor::reset()
 {
     safelyPerform<void>([&](auto& p)
     {
-        p->releaseResources();
+        p->reset();
+    });
+}
+
+void VST3WrapperAudioProcessor::releaseResources()
+{
+    // The hosted plugin stays prepared, as hosts often prepare again with the same configuration, which would otherwise make
+    // heavy plugins reallocate their voices or reload their samples. It's released once the configuration changes, or when it's unloaded.
+}
+
+//==============================================================================
+// Reconfiguration
+//==============================================================================
+
+ReconfigurationManager::Configuration VST3WrapperAudioProcessor::getHostedPluginConfiguration()
+{
+    ReconfigurationManager::Configuration configuration;
+    configuration.sampleRate = getHostedSampleRate();
+    configuration.blockSize = getHostedBlockSize();
+    configuration.layout = safelyPerform<juce::AudioProcessor::BusesLayout>([](auto& p) { return p->getBusesLayout(); });
+    configuration.isNonRealtime = isNonRealtime();
+    return configuration;
+}
+
+void VST3WrapperAudioProcessor::prepareHostedPlugin()
+{
+    auto configuration = getHostedPluginConfiguration();
+    const auto pluginName = getHostedPluginName();
+    
+    if (!reconfiguration.needsPrepare(configuration))
+    {
+        reconfiguration.prepareSkipped();
+        juce::Logger::writeToLog("AU-VST3-Wrapper prepare: plugin=" + pluginName
+                                 + " sample_rate=" + juce::String(configuration.sampleRate, 0)
+                                 + " block_size=" + juce::String(configuration.blockSize)
+                                 + " non_realtime=" + juce::String((int) configuration.isNonRealtime)
+                                 + " skipped=1");
+        return;
+    }
+    
+    const auto wasPrepared = reconfiguration.isPrepared();
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+    
+    const auto isLoaded = safelyPerform<bool>([&](auto& p)
+    {
+        if (wasPrepared)
+        {
+            p->releaseResources();
+        }
+        
 #if JucePlugin_IsMidiEffect
-        p->setPlayConfigDetails(0, 2, sampleRate, samplesPerBlock);
+        p->setPlayConfigDetails(0, 2, configuration.sampleRate, configuration.blockSize);
 #else
-        p->setRateAndBufferSizeDetails(sampleRate, samplesPerBlock);
+        p->setRateAndBufferSizeDetails(configuration.sampleRate, configuration.blockSize);
 #endif
-        p->prepareToPlay(sampleRate, samplesPerBlock);
+        p->setNonRealtime(configuration.isNonRealtime);
+        p->prepareToPlay(configuration.sampleRate, configuration.blockSize);
+        
+        // Preparing may change the layout (e.g. in a MIDI FX slot), and the next prepare is compared with the layout it leaves
+        configuration.layout = p->getBusesLayout();
+        return true;
     });
+    
+    if (!isLoaded) { return; }
+    
+    const auto prepareMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+    reconfiguration.prepared(configuration, prepareMs);
+    
+    juce::Logger::writeToLog("AU-VST3-Wrapper prepare: plugin=" + pluginName
+                             + " sample_rate=" + juce::String(configuration.sampleRate, 0)
+                             + " block_size=" + juce::String(configuration.blockSize)
+                             + " non_realtime=" + juce::String((int) configuration.isNonRealtime)
+                             + " skipped=0 prepare_ms=" + juce::String(prepareMs, 1));
+}
+
+ReconfigurationManager::Statistics VST3WrapperAudioProcessor::getReconfigurationStatistics()
+{
+    return reconfiguration.getStatistics();
+}
+
+bool VST3WrapperAudioProcessor::readPlaybackStart(double& ms)
+{
+    return reconfiguration.readPlaybackStart(ms);
+}
+
+AudioThreadStalls::Summary VST3WrapperAudioProcessor::getAudioThreadStalls()
+{
+    return audioThreadStalls.getSummary();
+}
+
+//==============================================================================
+// MIDI transforms
+//==============================================================================
+
+juce::String VST3WrapperAudioProcessor::setMidiTransformRules(const juce::String& rules)
+{
+    MidiTransformStage::Tables tables;
+    const auto error = MidiTransformStage::compile(rules, tables);
+    
+    if (error.isNotEmpty()) { return error; }
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        midiTransformRules = rules;
+        invalidateCachedState();
+    }
+    
+    suspendProcessing(true);
+    midiTransform.setTables(tables);
+    suspendProcessing(false);
+    
+    return {};
+}
+
+juce::String VST3WrapperAudioProcessor::getMidiTransformRules()
+{
+    const juce::ScopedLock sl (innerMutex);
+    return midiTransformRules;
+}
+
+MidiTransformStage::Statistics VST3WrapperAudioProcessor::getMidiTransformStatistics()
+{
+    return midiTransform.getStatistics();
+}
+
+void VST3WrapperAudioProcessor::prepareMidiTransform()
+{
+    // Rules restored from a state were validated when they were set, so an error here only leaves them out
+    MidiTransformStage::Tables tables;
+    MidiTransformStage::compile(getMidiTransformRules(), tables);
+    midiTransform.setTables(tables);
+    midiTransform.prepare(getSampleRate());
+}
+
+template<typename FloatType>
+bool VST3WrapperAudioProcessor::isAudible(const juce::AudioBuffer<FloatType>& buffer, const juce::MidiBuffer& midiMessages)
+{
+#if JucePlugin_IsMidiEffect
+    // A MIDI FX is heard through the instrument it plays
+    juce::ignoreUnused(buffer);
+    return !midiMessages.isEmpty();
+#else
+    juce::ignoreUnused(midiMessages);
+    return buffer.getMagnitude(0, buffer.getNumSamples()) > (FloatType) audibleLevel;
+#endif
+}
+
+#ifndef JucePlugin_PreferredChannelConfigurations
+
+bool VST3WrapperAudioProcessor::canAddBus(bool isInput) const
+{
+    return true;
+}
+
+bool VST3WrapperAudioProcessor::canRemoveBus(bool isInput) const
+{
+    return true;
+}
+
+bool VST3WrapperAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
+{
+#if JucePlugin_IsMidiEffect
+    return true;
+#else
+    // As we want to host any VST3, we allow Logic to instantiate us
+    // with any layout it supports, and then we check if the hosted plugin supports
+    // current layout after it gets loaded
+    
+    // Logic doesn't always show all the possible layout options supported in this method.
+    // If some of the layout options are missing in Logic, try increasing plugin version
+    // or changing manufacturer code in the Projucer project, and rebuild the plugin after that
+    return true;
+#endif
+}
+#endif
+
+void VST3WrapperAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processBlockInternal(buffer, midiMessages, true);
+}
+
+void VST3WrapperAudioProcessor::processBlockBypassed(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processBlockInternal(buffer, midiMessages, false);
+}
+
+void VST3WrapperAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processBlockInternal(buffer, midiMessages, true);
+}
+
+void VST3WrapperAudioProcessor::processBlockBypassed(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processBlockInternal(buffer, midiMessages, false);
+}
+
+void VST3WrapperAudioProcessor::markStateDirtyIfProgramChanged(const juce::MidiBuffer& midiMessages)
+{
+    for (const auto metadata : midiMessages)
+    {
+        if (metadata.getMessage().isProgramChange())
+        {
+            markStateDirty();
+            return;
+        }
+    }
+}
+
+template<typename FloatType>
+void VST3WrapperAudioProcessor::processDormantBlock(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages)
+{
+    auto hasActivity = !midiMessages.isEmpty();
+    
+    for (int i = 0; i < getTotalNumInputChannels() && !hasActivity; ++i)
+    {
+        hasActivity = buffer.getMagnitude(i, 0, buffer.getNumSamples()) > FloatType(0);
+    }
+    
+    // The plugin can't be instantiated on the audio thread,
+    // so we only raise a flag that the message thread polls
+    if (hasActivity)
+    {
+        wakeRequested = true;
+    }
+    
+    buffer.clear();
+    midiMessages.clear();
+}
+
+juce::Optional<juce::AudioPlayHead::PositionInfo> VST3WrapperAudioProcessor::getHostPosition()
+{
+    if (auto* playHead = getPlayHead())
+    {
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        auto position = playHead->getPosition();
+        hostPlayHeadQueryTicks.fetch_add(juce::Time::getHighResolutionTicks() - startTicks, std::memory_order_relaxed);
+        numHostPlayHeadQueries.fetch_add(1, std::memory_order_relaxed);
+        return position;
+    }
+    
+    return {};
+}
+
+VST3WrapperAudioProcessor::PlayHeadStatistics VST3WrapperAudioProcessor::getPlayHeadStatistics()
+{
+    PlayHeadStatistics statistics;
+    statistics.numBlocks = numHostPlayHeadQueries.load(std::memory_order_relaxed);
+    
+    if (statistics.numBlocks > 0)
+    {
+        const auto totalSeconds = juce::Time::highResolutionTicksToSeconds(hostPlayHeadQueryTicks.load(std::memory_order_relaxed));
+        statistics.hostQueryMicrosecondsPerBlock = totalSeconds * 1.0e6 / (double) statistics.numBlocks;
+        statistics.hostedQueriesPerBlock = (double) hostedPlayHead.getNumQueries() / (double) statistics.numBlocks;
+    }
+    
+    return statistics;
 }
 
-void VST3WrapperAudioProcessor::reset()
+template<typename FloatType>
+void VST3WrapperAudioProcessor::processBlockInternal(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, bool isActive)
 {
-    safelyPerform<void>([&](auto& p)
+    const RealtimeSafetyChecker::ScopedCheck realtimeSafetyCheck;
+    const AudioThreadStalls::ScopedBlock stallMeasurement (audioThreadStalls);
+    
+    if (isDormant)
     {
-        p->reset();
-    });
+        processDormantBlock(buffer, midiMessages);
+        return;
+    }
+    
+    markStateDirtyIfProgramChanged(midiMessages);
+    
+    if (isNonRealtime())
+    {
+        offlineSamples.fetch_add(buffer.getNumSamples(), std::memory_order_relaxed);
+    }
+    
+    // The host is queried once per block, however often the hosted plugin asks for the position
+    const auto position = getHostPosition();
+    
+    midiTransform.process(MidiTransformStage::Stage::input, midiMessages);
+    
+    if (isSandboxed)
+    {
+        sandboxedPluginHost.process(buffer, midiMessages, position, isActive);
+    }
+    else
+    {
+        renderInProcessBlock(buffer, midiMessages, position, isActive);
+        programSlots.applyFade(buffer);
+    }
+    
+    midiTransform.process(MidiTransformStage::Stage::output, midiMessages);
+    midiTransform.advance(buffer.getNumSamples());
+    
+#if ! JucePlugin_IsMidiEffect
+    // The buffer is still in cache right after rendering, so metering it here is cheap
+    busMeters.process(buffer);
+#endif
+    
+    // Only the first blocks of a playback are checked for being audible
+    const auto isPlaying = position.hasValue() && position->getIsPlaying();
+    reconfiguration.blockProcessed(isPlaying, reconfiguration.needsAudibilityCheck(isPlaying) && isAudible(buffer, midiMessages));
+    
+    telemetry.publishBlock(watchdog.getCpuLoad(), watchdog.getTotalOverruns(), watchdog.isTripped());
 }
 
-void VST3WrapperAudioProcessor::releaseResources()
+template<typename FloatType>
+void VST3WrapperAudioProcessor::renderInProcessBlock(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages,
+                                                     const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive)
 {
+    if constexpr (std::is_same_v<FloatType, float>)
+    {
+        // The render thread only handles single precision, which is what Logic uses
+        if (pipelinedRenderer != nullptr)
+        {
+            pipelinedRenderer->process(buffer, midiMessages, position, isActive);
+            return;
+        }
+    }
+    
     safelyPerform<void>([&](auto& p)
     {
-        p->releaseResources();
+        p->setPlayHead(&hostedPlayHead);
+        renderAtHostedRate(buffer, midiMessages, position, [&](auto& hostedBuffer, auto& hostedMidiMessages, const auto& hostedPosition)
+        {
+        #if JucePlugin_IsSynth
+            renderCachedHostedBlock(p, hostedBuffer, hostedMidiMessages, hostedPosition, isActive);
+        #else
+            juce::ignoreUnused(hostedPosition);
+            renderHostedBlock(p, hostedBuffer, hostedMidiMessages, isActive);
+        #endif
+        });
     });
 }
 
-#ifndef JucePlugin_PreferredChannelConfigurations
-
-bool VST3WrapperAudioProcessor::canAddBus(bool isInput) const
+template<typename FloatType, typename RenderCallback>
+void VST3WrapperAudioProcessor::renderAtHostedRate(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages,
+                                                   const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, RenderCallback&& render)
 {
-    return true;
+#if ! JucePlugin_IsMidiEffect
+    // Only single precision is resampled, so a double precision block never gets here with the adapter active
+    if constexpr (std::is_same_v<FloatType, float>)
+    {
+        if (sampleRateAdapter.isActive())
+        {
+            sampleRateAdapter.process(buffer, midiMessages, position, [&](auto& internalBuffer, auto& internalMidiMessages, const auto& internalPosition)
+            {
+                hostedPlayHead.setPosition(internalPosition);
+                render(internalBuffer, internalMidiMessages, internalPosition);
+            });
+            
+            return;
+        }
+    }
+#endif
+    
+    hostedPlayHead.setPosition(position);
+    render(buffer, midiMessages, position);
 }
 
-bool VST3WrapperAudioProcessor::canRemoveBus(bool isInput) const
+#if JucePlugin_IsSynth
+template<typename FloatType>
+void VST3WrapperAudioProcessor::renderCachedHostedBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages,
+                                                        const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive)
 {
-    return true;
+    // Only single precision blocks are cached, which is what Logic uses
+    if constexpr (std::is_same_v<FloatType, float>)
+    {
+        // Only playback repeats, so nothing is cached while the transport is stopped, while the watchdog has taken the plugin
+        // out of the signal path, or while the state key is being computed again
+        const auto timeInSamples = position.hasValue() && position->getIsPlaying() ? position->getTimeInSamples() : juce::Optional<juce::int64>();
+        
+        if (renderCache.isActive() && isActive && timeInSamples.hasValue() && renderCache.getStateKey() != 0 && !watchdog.isTripped())
+        {
+            // A jump (e.g. a cycle or a locate) starts a new run
+            const auto startsRun = *timeInSamples != renderCacheNextTimeInSamples;
+            renderCacheNextTimeInSamples = *timeInSamples + buffer.getNumSamples();
+            
+            if (renderCache.read(hashRenderCacheBlock(p, buffer, midiMessages, *position), startsRun, buffer))
+            {
+                // The hosted plugin doesn't see the cached blocks, so its MIDI output (if any) isn't reproduced
+                midiMessages.clear();
+                renderCacheServedLastBlock = true;
+                return;
+            }
+            
+            releaseNotesHeldDuringCachedBlocks(midiMessages);
+            
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            renderHostedBlock(p, buffer, midiMessages, isActive);
+            const auto renderMs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1000.0;
+            
+            if (!watchdog.isTripped())
+            {
+                renderCache.write(buffer, renderMs);
+            }
+            
+            return;
+        }
+        
+        renderCache.endRun();
+        renderCacheNextTimeInSamples = -1;
+        releaseNotesHeldDuringCachedBlocks(midiMessages);
+    }
+    
+    renderHostedBlock(p, buffer, midiMessages, isActive);
 }
+#endif
 
-bool VST3WrapperAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
+#if ! JucePlugin_IsMidiEffect
+void VST3WrapperAudioProcessor::prepareBusMeters(double sampleRate)
 {
-#if JucePlugin_IsMidiEffect
-    return true;
-#else
-    // As we want to host any VST3, we allow Logic to instantiate us
-    // with any layout it supports, and then we check if the hosted plugin supports
-    // current layout after it gets loaded
+    // Disabled buses have no channels in the process buffer, so they are skipped altogether
+    juce::Array<BusMeters::Bus> buses;
     
-    // Logic doesn't always show all the possible layout options supported in this method.
-    // If some of the layout options are missing in Logic, try increasing plugin version
-    // or changing manufacturer code in the Projucer project, and rebuild the plugin after that
-    return true;
-#endif
+    for (int i = 0; i < getBusCount(false); ++i)
+    {
+        const auto* bus = getBus(false, i);
+        
+        if (bus == nullptr || !bus->isEnabled() || bus->getNumberOfChannels() == 0) { continue; }
+        
+        buses.add({ bus->getName(), getChannelIndexInProcessBlockBuffer(false, i, 0), bus->getNumberOfChannels() });
+    }
+    
+    busMeters.prepare(buses, sampleRate);
 }
 #endif
 
-void VST3WrapperAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+template<typename FloatType>
+LatencyCompensatedBypass<FloatType>& VST3WrapperAudioProcessor::getLatencyCompensatedBypass()
 {
-    processBlockInternal(buffer, midiMessages, true);
+    if constexpr (std::is_same_v<FloatType, float>)
+        return floatBypass;
+    else
+        return doubleBypass;
 }
 
-void VST3WrapperAudioProcessor::processBlockBypassed(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+#if JucePlugin_IsMidiEffect
+template<typename FloatType>
+juce::AudioBuffer<FloatType>& VST3WrapperAudioProcessor::getMidiEffectScratchBuffer()
 {
-    processBlockInternal(buffer, midiMessages, false);
+    if constexpr (std::is_same_v<FloatType, float>)
+        return floatMidiEffectScratch;
+    else
+        return doubleMidiEffectScratch;
 }
 
-void VST3WrapperAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+// Returns `false` if the block doesn't fit the scratch buffer, in which case it must be rendered the usual way.
+template<typename FloatType>
+bool VST3WrapperAudioProcessor::renderMidiEffectBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, int numSamples, juce::MidiBuffer& midiMessages, bool isActive)
 {
-    processBlockInternal(buffer, midiMessages, true);
+    auto& scratch = getMidiEffectScratchBuffer<FloatType>();
+    const auto hostedPluginChannels = jmax(p->getTotalNumInputChannels(), p->getTotalNumOutputChannels());
+    
+    if (hostedPluginChannels > scratch.getNumChannels() || numSamples > scratch.getNumSamples()) { return false; }
+    
+    // Refers to the scratch memory, so nothing is allocated. Whatever audio the plugin renders is ignored,
+    // but it starts from silence, as some plugins read their input (e.g. for audio-triggered arpeggiators)
+    juce::AudioBuffer<FloatType> audio (scratch.getArrayOfWritePointers(), hostedPluginChannels, numSamples);
+    audio.clear();
+    
+    // The hosted plugin's output must not grow the host's buffer on the audio thread. Hosts reuse their buffer between blocks,
+    // so a small one is swapped with the buffer reserved in `prepareToPlay` once, and keeps its room from then on.
+    if (midiMessages.data.getNumAllocated() < midiEffectMidiBufferBytes)
+    {
+        midiEffectMidi.clear();
+        midiEffectMidi.addEvents(midiMessages, 0, -1, 0);
+        midiMessages.swapWith(midiEffectMidi);
+    }
+    
+    callHostedProcessBlock(p, audio, midiMessages, isActive);
+    
+    return true;
 }
+#endif
 
-void VST3WrapperAudioProcessor::processBlockBypassed(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+template<typename FloatType>
+void VST3WrapperAudioProcessor::callHostedProcessBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, bool isActive)
 {
-    processBlockInternal(buffer, midiMessages, false);
+    const RealtimeSafetyChecker::ScopedHostedPlugin hostedPluginScope;
+    
+    if (isActive)
+        p->processBlock(buffer, midiMessages);
+    else
+        p->processBlockBypassed(buffer, midiMessages);
 }
 
 template<typename FloatType>
-void VST3WrapperAudioProcessor::processBlockInternal(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, bool isActive)
+void VST3WrapperAudioProcessor::renderHostedBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, bool isActive)
 {
-    safelyPerform<void>([&](auto& p)
+    const auto numSamples = buffer.getNumSamples();
+    const auto overrunAction = watchdog.getPolicy().action;
+    auto& bypass = getLatencyCompensatedBypass<FloatType>();
+    
+    if (!watchdog.shouldProcess(numSamples))
     {
-        if (isActive) {
-            p->setPlayHead(getPlayHead());
-        }
-        
-        // Some plugins (e.g. Halion 7) crash if the number of channels in the buffer is less than the number of channels in the plugin,
-        // even if we disable extra buses in the plugin's layout.
-        // So we need to make sure the buffer has the same number of channels as the plugin
-        
-        const auto hostedPluginChannels = jmax(p->getTotalNumInputChannels(), p->getTotalNumOutputChannels());
-        const auto currentChannels = buffer.getNumChannels();
+        const auto isFirstSkippedBlock = !watchdogSkippedLastBlock;
+        watchdogSkippedLastBlock = true;
         
-        if (hostedPluginChannels > currentChannels)
+        if (overrunAction == HostedPluginWatchdog::Action::bypass)
         {
-            juce::AudioBuffer<FloatType> innerBuffer(hostedPluginChannels, buffer.getNumSamples());
-
-            for (int i = 0; i < hostedPluginChannels; ++i)
+            bypass.process(buffer, true);
+        #if ! JucePlugin_IsMidiEffect
+            midiMessages.clear();
+        #endif
+        }
+        else
+        {
+            buffer.clear();
+            midiMessages.clear();
+            
+        #if JucePlugin_IsMidiEffect
+            // The note offs the hosted plugin would have sent are lost too, so the instrument after us releases its notes now
+            if (isFirstSkippedBlock)
             {
-                if (i < currentChannels)
-                    innerBuffer.copyFrom(i, 0, buffer.getReadPointer(i), buffer.getNumSamples());
-                else
-                    innerBuffer.clear(i, 0, buffer.getNumSamples());
+                for (int channel = 1; channel <= 16; ++channel)
+                {
+                    midiMessages.addEvent(juce::MidiMessage::allNotesOff(channel), 0);
+                }
             }
-
-            if (isActive)
-                p->processBlock(innerBuffer, midiMessages);
-            else
-                p->processBlockBypassed(innerBuffer, midiMessages);
-
-            for (int i = 0; i < currentChannels; ++i)
-                buffer.copyFrom(i, 0, innerBuffer.getReadPointer(i), buffer.getNumSamples());
+        #else
+            juce::ignoreUnused(isFirstSkippedBlock);
+        #endif
         }
-        else
+        
+        return;
+    }
+    
+    releaseNotesHeldWhileTripped(midiMessages);
+    
+    // The delay line must always be fed, so that the bypassed signal is continuous when the watchdog trips
+    if (overrunAction == HostedPluginWatchdog::Action::bypass)
+    {
+        bypass.process(buffer, false);
+    }
+    
+    watchdog.blockStarted();
+    
+#if JucePlugin_IsMidiEffect
+    if (renderMidiEffectBlock<FloatType>(p, numSamples, midiMessages, isActive))
+    {
+        watchdog.blockFinished(numSamples);
+        
+        // A MIDI FX's audio is always silent, so its first block after an instantiation on demand is muted already.
+        // The flag is still consumed, so that it can't mute a later block rendered the usual way.
+        shouldMuteNextBlock = false;
+        buffer.clear();
+        return;
+    }
+#endif
+    
+    // Some plugins (e.g. Halion 7) crash if the number of channels in the buffer is less than the number of channels in the plugin,
+    // even if we disable extra buses in the plugin's layout.
+    // So we need to make sure the buffer has the same number of channels as the plugin
+    
+    const auto hostedPluginChannels = jmax(p->getTotalNumInputChannels(), p->getTotalNumOutputChannels());
+    const auto currentChannels = buffer.getNumChannels();
+    
+    if (hostedPluginChannels > currentChannels)
+    {
+        juce::AudioBuffer<FloatType> innerBuffer(hostedPluginChannels, buffer.getNumSamples());
+
+        for (int i = 0; i < hostedPluginChannels; ++i)
         {
-            if (isActive)
-                p->processBlock(buffer, midiMessages);
+            if (i < currentChannels)
+                innerBuffer.copyFrom(i, 0, buffer.getReadPointer(i), buffer.getNumSamples());
             else
-                p->processBlockBypassed(buffer, midiMessages);
+                innerBuffer.clear(i, 0, buffer.getNumSamples());
         }
-    });
+
+        callHostedProcessBlock(p, innerBuffer, midiMessages, isActive);
+
+        for (int i = 0; i < currentChannels; ++i)
+            buffer.copyFrom(i, 0, innerBuffer.getReadPointer(i), buffer.getNumSamples());
+    }
+    else
+    {
+        callHostedProcessBlock(p, buffer, midiMessages, isActive);
+    }
+    
+    watchdog.blockFinished(numSamples);
+    
+    // The first block of a plugin instantiated on demand may contain initialization noise
+    if (shouldMuteNextBlock.exchange(false))
+    {
+        buffer.clear();
+    }
 }
 
 bool VST3WrapperAudioProcessor::hasEditor() const
@@ -511,31 +2058,152 @@ bool VST3WrapperAudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* VST3WrapperAudioProcessor::createEditor()
 {
+    // The user is looking at this instance, so its pending load (if any) should not wait for the rest of the project
+    loadScheduler->promote(this, PluginLoadScheduler::Priority::editorVisible);
+    
     return new VST3WrapperAudioProcessorEditor (*this);
 }
 
 void VST3WrapperAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    safelyPerform<void>([&](auto& p)
+    MemoryBlock innerState;
+    bool shouldAskSandbox;
+    
     {
-        XmlElement xml ("state");
+        const juce::ScopedLock sl (innerMutex);
         
-        auto filePathElement = std::make_unique<XmlElement> (pluginPathTag);
-        filePathElement->addTextElement (getHostedPluginPath());
-        xml.addChildElement (filePathElement.release());
+        if (isDormant)
+        {
+            destData = dormantState;
+            return;
+        }
+        
+        if (!isSandboxed && hostedPluginInstance == nullptr) { return; }
         
-        xml.addChildElement ([&]
+        // Nothing has touched the hosted plugin since the last call, so the previous snapshot is still valid.
+        // The flag is cleared before the hosted state is read, so a change made while serializing will mark it dirty again.
+        const auto wasStateDirty = isStateDirty.exchange(false);
+        
+        if (isStateCacheEnabled() && !wasStateDirty && !cachedState.isEmpty())
         {
-            MemoryBlock innerState;
-            p->getStateInformation (innerState);
-            auto stateNode = std::make_unique<XmlElement> (innerStateTag);
-            stateNode->addTextElement (innerState.toBase64Encoding());
-            return stateNode.release();
-        }());
-    
-        const auto text = xml.toString();
-        destData.replaceAll (text.toRawUTF8(), text.getNumBytesAsUTF8());
-    });
+            destData = cachedState;
+            return;
+        }
+        
+        shouldAskSandbox = isSandboxed;
+        
+        if (!shouldAskSandbox)
+        {
+            hostedPluginInstance->getStateInformation (innerState);
+        }
+    }
+    
+    if (shouldAskSandbox)
+    {
+        // The helper may take up to `sandboxStateTimeoutMs` to answer, which the audio thread must not wait for
+        const auto hasState = sandboxedPluginHost.getState (innerState, sandboxStateTimeoutMs);
+        
+        const juce::ScopedLock sl (innerMutex);
+        
+        // A crashed or unresponsive helper can't lose the project's copy of the plugin state
+        if (hasState)
+            sandboxedPluginState = innerState;
+        else
+            innerState = sandboxedPluginState;
+    }
+    
+    // Hashing, storing and encoding a big state takes long enough to stall the audio thread and the render thread,
+    // which lock `innerMutex` too, so only the wrapper's own settings are read with it held
+    const auto innerStateHash = hashStateBlock(innerState);
+    std::unique_ptr<XmlElement> xml;
+    bool shouldUseSidecarStore;
+    juce::uint32 generation;
+    
+    {
+        const juce::ScopedLock sl (innerMutex);
+        
+        // Some notifications (e.g. a click in the editor) don't necessarily change the state,
+        // in which case we can skip the base64 encoding and XML serialization
+        if (isStateCacheEnabled() && !cachedState.isEmpty() && innerStateHash == cachedInnerStateHash)
+        {
+            destData = cachedState;
+            return;
+        }
+        
+        xml = std::make_unique<XmlElement> ("state");
+        xml->setAttribute (deferredLoadingTag, deferredLoadingEnabled);
+        xml->setAttribute (renderThreadTag, renderThreadEnabled);
+        xml->setAttribute (overrunActionTag, (int) watchdog.getPolicy().action);
+        xml->setAttribute (sandboxTag, sandboxEnabled);
+        xml->setAttribute (editorRetentionTag, editorRetentionEnabled);
+        xml->setAttribute (sidecarStoreTag, sidecarStoreEnabled);
+#if JucePlugin_IsSynth
+        xml->setAttribute (renderCacheTag, renderCache.isEnabled());
+#endif
+        xml->setAttribute (midiTransformsTag, midiTransformRules);
+#if ! JucePlugin_IsMidiEffect
+        xml->setAttribute (internalSampleRateTag, internalSampleRate);
+        xml->setAttribute (resamplingQualityTag, (int) resamplingQuality);
+#endif
+        
+        if (!programSlots.getPluginPath().isEmpty())
+        {
+            xml->addChildElement (programSlots.createXml().release());
+        }
+        
+        auto filePathElement = std::make_unique<XmlElement> (pluginPathTag);
+        filePathElement->addTextElement (hostedPluginPath);
+        xml->addChildElement (filePathElement.release());
+        
+        shouldUseSidecarStore = sidecarStoreEnabled && innerState.getSize() >= SidecarStateStore::minimumStoredBytes;
+        generation = cachedStateGeneration;
+    }
+    
+    auto stateNode = std::make_unique<XmlElement> (innerStateTag);
+    
+    // Written to the store only when the state has changed, and only once for all instances sharing it
+    const auto sidecarReference = shouldUseSidecarStore ? sidecarStore->store (innerState.getData(), innerState.getSize()) : String();
+    
+    if (sidecarReference.isNotEmpty())
+    {
+        stateNode->setAttribute (sidecarReferenceTag, sidecarReference);
+        stateNode->setAttribute (sidecarSizeTag, String ((juce::int64) innerState.getSize()));
+    }
+    else
+    {
+        stateNode->addTextElement (innerState.toBase64Encoding());
+    }
+    
+    xml->addChildElement (stateNode.release());
+    
+    const auto text = xml->toString();
+    destData.replaceAll (text.toRawUTF8(), text.getNumBytesAsUTF8());
+    
+    const juce::ScopedLock sl (innerMutex);
+    
+    // A setting changed meanwhile isn't in this snapshot, so it mustn't be served from the cache
+    if (generation == cachedStateGeneration)
+    {
+        cachedState = destData;
+        cachedInnerStateHash = innerStateHash;
+    }
+}
+
+juce::uint64 VST3WrapperAudioProcessor::hashStateBlock(const juce::MemoryBlock& block)
+{
+    constexpr juce::uint64 fnvOffsetBasis = 14695981039346656037ULL;
+    constexpr juce::uint64 fnvPrime = 1099511628211ULL;
+    
+    auto hash = fnvOffsetBasis;
+    const auto* bytes = static_cast<const juce::uint8*>(block.getData());
+    
+    for (size_t i = 0; i < block.getSize(); ++i)
+    {
+        hash ^= bytes[i];
+        hash *= fnvPrime;
+    }
+    
+    return hash;
 }
 
 void VST3WrapperAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
@@ -543,19 +2211,109 @@ void VST3WrapperAudioProcessor::setStateInformation (const void* data, int sizeI
     const ScopedLock sl (innerMutex);
     
     auto xml = XmlDocument::parse (String (CharPointer_UTF8 (static_cast<const char*> (data)), (size_t) sizeInBytes));
+    
+    if (xml == nullptr) { return; }
 
     if (auto* pluginPathNode = xml->getChildByName (pluginPathTag))
     {
         auto pluginPath = pluginPathNode->getAllSubText();
 
-        MemoryBlock innerState;
-        auto base64String = xml->getChildElementAllSubText(innerStateTag, {});
-        innerState.fromBase64Encoding (base64String);
-        hostedPluginState = innerState;
-        loadPlugin(pluginPath);
+        auto* stateNode = xml->getChildByName (innerStateTag);
+        auto isStateMissing = false;
+        
+        if (stateNode != nullptr && stateNode->hasAttribute (sidecarReferenceTag))
+        {
+            hostedPluginState = sidecarStore->open (stateNode->getStringAttribute (sidecarReferenceTag),
+                                                    (size_t) stateNode->getStringAttribute (sidecarSizeTag).getLargeIntValue());
+            isStateMissing = hostedPluginState.isEmpty();
+        }
+        else
+        {
+            MemoryBlock innerState;
+            auto base64String = xml->getChildElementAllSubText(innerStateTag, {});
+            innerState.fromBase64Encoding (base64String);
+            hostedPluginState = PluginStateData (innerState);
+        }
+        
+        hostedPluginStatePath = pluginPath;
+        
+        sidecarStoreEnabled = xml->getBoolAttribute (sidecarStoreTag, false);
+        deferredLoadingEnabled = xml->getBoolAttribute (deferredLoadingTag, false);
+        // Applied when the plugin is prepared for playing
+        renderThreadEnabled = xml->getBoolAttribute (renderThreadTag, false);
+        setOverrunAction ((HostedPluginWatchdog::Action) xml->getIntAttribute (overrunActionTag, (int) HostedPluginWatchdog::Action::none));
+        sandboxEnabled = xml->getBoolAttribute (sandboxTag, false);
+        editorRetentionEnabled = xml->getBoolAttribute (editorRetentionTag, false);
+#if JucePlugin_IsSynth
+        // Applied when the plugin is prepared for playing
+        renderCache.setEnabled (xml->getBoolAttribute (renderCacheTag, false));
+#endif
+        // Applied when the plugin is prepared for playing
+        midiTransformRules = xml->getStringAttribute (midiTransformsTag);
+#if ! JucePlugin_IsMidiEffect
+        // Applied when the plugin is prepared for playing
+        internalSampleRate = xml->getDoubleAttribute (internalSampleRateTag, 0.0);
+        resamplingQuality = (StreamingResampler::Quality) juce::jlimit (0, 2, xml->getIntAttribute (resamplingQualityTag, (int) StreamingResampler::Quality::medium));
+#endif
+        programSlots.restoreFromXml (xml->getChildByName (ProgramSlots::xmlTag));
+        
+        if (isStateMissing)
+        {
+            // Loading the plugin would reset it to its default state, and the next save would drop the reference for good
+            const MemoryBlock restoredState (data, (size_t) sizeInBytes);
+            const auto hasPluginToRemove = isHostedPluginLoaded() || isCurrentlyLoading();
+            
+            if (!hasPluginToRemove)
+            {
+                keepMissingState (pluginPath, restoredState);
+            }
+            
+            // The plugin loaded so far can only be removed on the message thread, where the editor learns about the error too
+            juce::MessageManager::callAsync([this, pluginPath, restoredState, hasPluginToRemove]()
+            {
+                if (hasPluginToRemove)
+                {
+                    closeHostedPlugin();
+                    
+                    const ScopedLock asyncLock (innerMutex);
+                    keepMissingState (pluginPath, restoredState);
+                }
+                
+                loadListeners.call([&](auto& l) { l.hostedPluginLoadFinished({ LoadResult::Status::failed, pluginPath, getHostedPluginLoadingError() }); });
+            });
+            
+            return;
+        }
+        
+        if (deferredLoadingEnabled && !isHostedPluginLoaded() && !isCurrentlyLoading())
+        {
+            hostedPluginPath = pluginPath;
+            dormantState.replaceAll (data, (size_t) sizeInBytes);
+            isDormant = true;
+            startTimer (wakeRequestPollingIntervalMs);
+            return;
+        }
+        
+        loadPlugin(pluginPath, PluginLoadScheduler::Priority::projectRestore);
     }
 }
 
+void VST3WrapperAudioProcessor::keepMissingState (const juce::String& pluginPath, const juce::MemoryBlock& restoredState)
+{
+    // Dormant, the wrapper saves the restored bytes unchanged, so the project still refers to the blob once it's back.
+    // The instance stays dormant until the user loads a plugin.
+    hostedPluginPath = pluginPath;
+    hostedPluginState.reset();
+    hostedPluginStatePath = {};
+    dormantState = restoredState;
+    isDormant = true;
+    isDormantStateMissing = true;
+    hostedPluginLoadingError = "The saved state of " + File (pluginPath).getFileNameWithoutExtension()
+                             + " is missing from " + SidecarStateStore::getDefaultDirectory().getFullPathName();
+    
+    Logger::writeToLog ("AU-VST3-Wrapper sidecar: error=state_missing plugin_path=" + pluginPath + " action=kept_dormant");
+}
+
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
@@ -15,10 +15,58 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "PluginLoadScheduler.h"
+#include "PipelinedRenderer.h"
+#include "HostedPlayHead.h"
+#include "HostedPluginWatchdog.h"
+#include "PluginLoadTimings.h"
+#include "PluginCatalog.h"
+#include "HostedEditorCache.h"
+#include "ProgramSlots.h"
+#include "BusMeters.h"
+#include "TelemetryTable.h"
+#include "RealtimeSafetyChecker.h"
+#include "SidecarStateStore.h"
+#include "RenderCache.h"
+#include "SampleRateAdapter.h"
+#include "ReconfigurationManager.h"
+#include "MidiTransformStage.h"
+#include "SandboxedPluginHost.h"
 
-class VST3WrapperAudioProcessor  : public juce::AudioProcessor, public juce::ChangeBroadcaster
+class VST3WrapperAudioProcessor  : public juce::AudioProcessor, private juce::AudioProcessorListener, private juce::Timer, private juce::AsyncUpdater
 {
 public:
+    struct LoadResult
+    {
+        enum class Status
+        {
+            loaded,
+            failed,
+            cancelled
+        };
+        
+        Status status;
+        juce::String pluginPath;
+        /// The loading error if the load has failed, empty otherwise
+        juce::String error;
+    };
+    
+    /// Receives hosted plugin notifications. All the methods are called on the message thread.
+    class LoadListener
+    {
+    public:
+        virtual ~LoadListener() = default;
+        
+        /// Called right before the hosted plugin is deleted. Its editor must be deleted here, if it still exists.
+        virtual void hostedPluginAboutToBeRemoved() {}
+        
+        /// Called when the last requested load has finished, failed or has been cancelled. Superseded loads aren't reported.
+        virtual void hostedPluginLoadFinished(const LoadResult& result) = 0;
+        
+        /// Called when the sandbox helper process of the hosted plugin has died (see `setSandboxEnabled`).
+        virtual void hostedPluginCrashed() {}
+    };
+    
     //==============================================================================
     VST3WrapperAudioProcessor();
     ~VST3WrapperAudioProcessor() override;
@@ -27,6 +75,10 @@ public:
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
     void reset() override;
+    
+    /// Records the host's switch to or from offline rendering while it bounces. The hosted plugin, the watchdog
+    /// and the render thread follow on the message thread, or in the next `prepareToPlay` if that comes first.
+    void setNonRealtime(bool isNonRealtime) noexcept override;
 
    #ifndef JucePlugin_PreferredChannelConfigurations
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
@@ -66,30 +118,39 @@ public:
     // Public interface of VST3MIDIEffectAudioProcessor
     //==============================================================================
     
-    /// Returns `true` if the callee is currently trying to load the plugin asynchronously.
+    /// Returns `true` if a load has been requested and hasn't finished yet.
     bool isCurrentlyLoading();
     
     /// Returns `true` if a plugin is currently loaded and `false` otherwise
     bool isHostedPluginLoaded();
     
     /**
-     * @brief This method tries to load a VST3 plugin instance from file at provided path.
-     *        A change broadcaster message is sent on the main thread when the method finishes.
+     * @brief Requests loading of a VST3 plugin instance from file at provided path. Can be called on any thread.
+     *        The load starts on the message thread, and `LoadListener::hostedPluginLoadFinished` is called when it finishes.
      *        If loading is successful, `isHostedPluginLoaded()` will return `true`.
      *        If loading fails, `isHostedPluginLoaded()` will return `false` and `getHostedPluginLoadingError()` will contain the loading error.
-     *        VST3 instance is created asynchronously, but VST3 file scanning is done on the main thread as some plugins crash when scanned from a background thread. 
+     *        VST3 instance is created asynchronously, but VST3 file scanning is done on the main thread as some plugins crash when scanned from a background thread.
      *
-     * @warning The method will delete previously hosted plugin, if any.
-     *          Make sure that the editor of previously hosted plugin is deleted before calling this method.
+     *        A request supersedes the previous one if that one hasn't started yet, or is still waiting in `PluginLoadScheduler`.
+     *        A load which is already instantiating the plugin can't be interrupted, so the newest request starts after it, and its plugin is discarded.
+     *        The state restored by `setStateInformation` (if any) travels with the request.
+     *
+     * @note The previously hosted plugin, if any, is deleted when the load starts, after `LoadListener::hostedPluginAboutToBeRemoved` is called.
      *
      * @param pluginPath The path of a VST3 file.
+     * @param priority The priority of the request in the process-wide load queue shared with other wrapper instances.
      */
-    void loadPlugin(const juce::String& pluginPath);
+    void loadPlugin(const juce::String& pluginPath, PluginLoadScheduler::Priority priority = PluginLoadScheduler::Priority::userRequested);
+    
+    /// Cancels the pending load request and the load in progress, if any. Listeners are notified with `LoadResult::Status::cancelled`.
+    void cancelPendingLoad();
+    
+    void addLoadListener(LoadListener* listener);
+    void removeLoadListener(LoadListener* listener);
     
     /**
-     * @brief This method closes currently loaded plugin (if there is one) and resets processor's state.
-     *
-     * @warning Make sure that the editor of the currently loaded plugin is deleted before calling this method.
+     * @brief This method cancels any pending load, closes currently loaded plugin (if there is one) and resets processor's state.
+     *        Must be called on the message thread.
      */
     void closeHostedPlugin();
     
@@ -110,11 +171,228 @@ public:
      * @return A pointer to `AudioProcessorEditor` of the hosted plugin or `nullptr` if no plugin is loaded. If the loaded plugin doesn't have its own editor, a `GenericAudioProcessorEditor` is returned.
      */
     juce::AudioProcessorEditor* createHostedPluginEditorIfNeeded();
+    
+    /**
+     * @brief Marks the cached state of the hosted plugin as stale, so that the next `getStateInformation` call reads it again.
+     *        Parameter changes, program changes and hosted plugin's own change notifications do this automatically.
+     *        The editor calls this method when the user interacts with the hosted plugin's editor.
+     */
+    void markStateDirty();
+    
+    /**
+     * @brief When disabled, every `getStateInformation` call reads and serializes the hosted plugin's state again.
+     *        Enabled by default. Only meant for measuring what the cache saves, so the setting isn't saved with the wrapper state.
+     */
+    void setStateCacheEnabled(bool shouldBeEnabled) { stateCacheEnabled = shouldBeEnabled; }
+    
+    bool isStateCacheEnabled() const { return stateCacheEnabled; }
+    
+    /// Returns the phase-by-phase timings of the last (successful or failed) plugin load.
+    PluginLoadTimings getLastLoadTimings();
+    
+    /// Returns the timings of the last few loads of the last loaded VST3 file, by any wrapper instance in this process.
+    juce::Array<PluginLoadTimings> getLoadHistory();
+    
+    /**
+     * @brief When enabled, restoring the wrapper state only stores the plugin path and the hosted plugin's state.
+     *        The plugin is instantiated on the first MIDI or audio input, when the editor is opened or when `wakeHostedPlugin` is called.
+     *        The setting is saved with the wrapper state.
+     */
+    void setDeferredLoadingEnabled(bool shouldBeEnabled);
+    
+    bool isDeferredLoadingEnabled();
+    
+    /// Returns `true` if the wrapper state has been restored, but the hosted plugin hasn't been instantiated yet.
+    bool isHostedPluginDormant();
+    
+    /// Instantiates the hosted plugin if it is dormant. Does nothing otherwise.
+    void wakeHostedPlugin();
+    
+    /// Returns `true` if the VST3 file of the currently hosted plugin is scanned on a background thread when loaded (see `PluginLoadScheduler`).
+    bool isHostedPluginSafeForBackgroundScanning();
+    
+    void setHostedPluginSafeForBackgroundScanning(bool isSafe);
+    
+    /**
+     * @brief When enabled, the hosted plugin renders on a dedicated thread, one block behind the host (see `PipelinedRenderer`).
+     *        This adds one block of latency, which is reported to the host. The setting is saved with the wrapper state.
+     *
+     * @warning Must be called on the message thread.
+     */
+    void setRenderThreadEnabled(bool shouldBeEnabled);
+    
+    bool isRenderThreadEnabled();
+    
+    /// Returns the number of blocks for which the render thread was late, so silence was played instead.
+    int getRenderThreadDeadlineMisses();
+    
+    /**
+     * @brief Sets what happens when the hosted plugin keeps overrunning the real-time budget of its blocks (see `HostedPluginWatchdog`).
+     *        The action is saved with the wrapper state.
+     */
+    void setOverrunAction(HostedPluginWatchdog::Action action);
+    
+    HostedPluginWatchdog::Action getOverrunAction();
+    
+    /// Returns `true` while the hosted plugin is taken out of the signal path because of overruns.
+    bool isHostedPluginOverloaded();
+    
+    /// Passes the overrun events logged since the last call to the callback. Call this on the message thread only.
+    void readOverrunEvents(const std::function<void(const HostedPluginWatchdog::OverrunEvent&)>& callback);
+    
+    /**
+     * @brief When enabled, plugins are loaded in a separate helper process (see `SandboxedPluginHost`),
+     *        so that a crashing or hanging plugin only silences this wrapper. The hosted editor then opens in its own window.
+     *        Takes effect the next time a plugin is loaded. The setting is saved with the wrapper state.
+     */
+    void setSandboxEnabled(bool shouldBeEnabled);
+    
+    bool isSandboxEnabled();
+    
+    /// Returns `true` if the current plugin is hosted in the sandbox helper process.
+    bool isHostedPluginSandboxed();
+    
+    /// Returns `true` if the sandbox helper process of the current plugin has died. The wrapper outputs silence until the plugin is reloaded.
+    bool hasSandboxedPluginCrashed();
+    
+    /// Loads the crashed plugin again, with the last state the wrapper got from it.
+    void reloadCrashedPlugin();
+    
+    /// Opens the editor window of the sandboxed plugin in the helper process.
+    void showSandboxedPluginEditor();
+    
+    /**
+     * @brief When enabled, closing the wrapper window keeps the hosted plugin's editor in memory (see `HostedEditorCache`),
+     *        so that reopening the window doesn't rebuild the plugin's GUI. The setting is saved with the wrapper state.
+     *
+     * @warning Must be called on the message thread.
+     */
+    void setEditorRetentionEnabled(bool shouldBeEnabled);
+    
+    bool isEditorRetentionEnabled();
+    
+    /**
+     * @brief When enabled, large hosted states are written to `SidecarStateStore`, and the wrapper state only refers to them.
+     *        If the store can't be written, the state is embedded as usual. The setting is saved with the wrapper state.
+     */
+    void setSidecarStoreEnabled(bool shouldBeEnabled);
+    
+    bool isSidecarStoreEnabled();
+    
+#if JucePlugin_IsSynth
+    /**
+     * @brief When enabled, the output of the hosted instrument during playback is cached on disk and played back from the cache
+     *        whenever the same region is played again with the same MIDI, parameters and state (see `RenderCache`).
+     *        Blocks rendered on the render thread or in the sandbox aren't cached. The setting is saved with the wrapper state.
+     *
+     * @warning Must be called on the message thread.
+     */
+    void setRenderCacheEnabled(bool shouldBeEnabled);
+    
+    bool isRenderCacheEnabled();
+    
+    /// Returns the render cache's hit rate and the hosted plugin's CPU time it has saved. Can be called on any thread.
+    RenderCache::Statistics getRenderCacheStatistics();
+#endif
+    
+#if ! JucePlugin_IsMidiEffect
+    /**
+     * @brief Runs the hosted plugin at a fixed sample rate whatever the host's rate is, for plugins which only support some rates
+     *        (see `SampleRateAdapter`). A rate of 0 runs it at the host's rate. Sandboxed plugins and double precision processing
+     *        always run at the host's rate. The settings are saved with the wrapper state.
+     *
+     * @warning Must be called on the message thread.
+     */
+    void setInternalSampleRate(double rate, StreamingResampler::Quality quality);
+    
+    /// The rate set by `setInternalSampleRate`, or 0 if the hosted plugin runs at the host's rate.
+    double getInternalSampleRate();
+    
+    StreamingResampler::Quality getResamplingQuality();
+    
+    struct ResamplingStatistics
+    {
+        bool isActive = false;
+        double internalSampleRate = 0.0;
+        /// The latency added by resampling, in samples at the host rate
+        int latencySamples = 0;
+        /// The average time spent resampling (without rendering) per block
+        double microsecondsPerBlock = 0.0;
+    };
+    
+    /// Returns the state and cost of the sample rate adapter. Can be called on any thread.
+    ResamplingStatistics getResamplingStatistics();
+#endif
+    
+    /// Keeps the detached hosted editor for the next wrapper editor if retention is enabled, deletes it otherwise. Call this on the message thread only.
+    void retainHostedPluginEditor(std::unique_ptr<juce::AudioProcessorEditor> editor);
+    
+    /// Returns the hosted editor kept by `retainHostedPluginEditor`, or `nullptr` if there is none. Call this on the message thread only.
+    std::unique_ptr<juce::AudioProcessorEditor> takeRetainedHostedPluginEditor();
+    
+    /**
+     * @brief Stores the current state of the hosted plugin in a program slot (see `ProgramSlots`), which the host can then select as a program.
+     *        Program slots aren't available for sandboxed plugins. Call this on the message thread only.
+     */
+    void storeProgram(int index);
+    
+    /// Returns `true` if the program slot holds a state of the currently hosted plugin.
+    bool isProgramStored(int index);
+    
+    /// Returns the time it took the last switch to the program to apply its state, in milliseconds.
+    double getLastProgramSwitchMs(int index);
+    
+    struct PlayHeadStatistics
+    {
+        juce::int64 numBlocks = 0;
+        /// The average time it took to query the host's play head once per block
+        double hostQueryMicrosecondsPerBlock = 0.0;
+        /// How often the hosted plugin asks `HostedPlayHead` for the position, on average
+        double hostedQueriesPerBlock = 0.0;
+    };
+    
+    /// Returns the play head query statistics since the wrapper was created. Can be called on any thread.
+    PlayHeadStatistics getPlayHeadStatistics();
+    
+    /// Returns how often the hosted plugin was prepared again or left as it was, and how long playback took to start. Can be called on any thread.
+    ReconfigurationManager::Statistics getReconfigurationStatistics();
+    
+    /// Returns `true` and sets `ms` if a playback start has been measured since the last call. Call this on the message thread only.
+    bool readPlaybackStart(double& ms);
+    
+    /// Returns the percentiles of the worst lock wait per audio thread block (see `AudioThreadStalls`). Can be called on any thread.
+    AudioThreadStalls::Summary getAudioThreadStalls();
+    
+    /**
+     * @brief Sets the rules which transform the MIDI before and after the hosted plugin (see `MidiTransformStage` for the syntax).
+     *        The rules are saved with the wrapper state.
+     *
+     * @return An error naming the first invalid rule, in which case nothing changes, or an empty string.
+     * @warning Must be called on the message thread.
+     */
+    juce::String setMidiTransformRules(const juce::String& rules);
+    
+    juce::String getMidiTransformRules();
+    
+    /// Returns how many events the MIDI transform stage has processed, and how long an event took on average. Can be called on any thread.
+    MidiTransformStage::Statistics getMidiTransformStatistics();
+    
+#if ! JucePlugin_IsMidiEffect
+    /// Returns the meters of the active output buses, which the editor reads on the message thread (see `BusMeters`).
+    BusMeters& getBusMeters() { return busMeters; }
+#endif
 
 private:
     juce::CriticalSection innerMutex;
     //==============================================================================
     juce::VST3PluginFormat vst3Format;
+    juce::SharedResourcePointer<PluginLoadScheduler> loadScheduler;
+    juce::SharedResourcePointer<PluginLoadHistory> loadHistory;
+    juce::SharedResourcePointer<PluginCatalog> pluginCatalog;
+    juce::SharedResourcePointer<HostedEditorCache> editorCache;
+    bool editorRetentionEnabled = false;
+    juce::SharedResourcePointer<SidecarStateStore> sidecarStore;
+    bool sidecarStoreEnabled = false;
     //==============================================================================
     std::unique_ptr<juce::AudioPluginInstance> hostedPluginInstance;
     
@@ -122,11 +400,19 @@ private:
     {
         const juce::ScopedLock sl (innerMutex);
         
+        if (hostedPluginInstance != nullptr)
+        {
+            hostedPluginInstance->removeListener(this);
+        }
+        
         hostedPluginInstance.reset();
+        invalidateCachedState();
+        reconfiguration.invalidate();
         
         if (pluginInstance != nullptr)
         {
             hostedPluginInstance = std::move(pluginInstance);
+            hostedPluginInstance->addListener(this);
         }
     }
     
@@ -134,7 +420,7 @@ private:
     /// If the hosted plugin is nullptr, the method will not call provided operation and will return the default value of `T`.
     T safelyPerform(std::function<T(const std::unique_ptr<juce::AudioPluginInstance>&)> operation) const
     {
-        const juce::ScopedLock sl (innerMutex);
+        const CheckedScopedLock sl (innerMutex, "innerMutex");
         
         if (hostedPluginInstance == nullptr) { return T(); }
         
@@ -144,24 +430,329 @@ private:
     //==============================================================================
     using PluginLoadingCallback = std::function<void(std::unique_ptr<juce::AudioPluginInstance> pluginInstance)>;
     
+    //==============================================================================
+    // Load queue
+    //==============================================================================
+    
+    struct LoadRequest
+    {
+        juce::String pluginPath;
+        PluginStateData pluginState;
+        PluginLoadScheduler::Priority priority;
+    };
+    
+    // Both guarded by `innerMutex`. Every request and cancellation starts a new generation,
+    // so that the callbacks of a superseded load can tell that their result is no longer wanted.
+    std::optional<LoadRequest> pendingLoadRequest;
+    juce::uint32 loadGeneration = 0;
+    juce::ListenerList<LoadListener> loadListeners;
+    
+    bool isCurrentLoad(juce::uint32 generation);
+    void handleAsyncUpdate() override;
+    void startLoad(const LoadRequest& request, juce::uint32 generation);
+    /// Called on any thread when a load (current or superseded) has ended.
+    void loadEnded(juce::uint32 generation, const LoadResult& result);
+    
     void removePrevioslyHostedPluginIfNeeded(bool unsetError);
-    void loadPluginFromFile(const juce::String& pluginPath, PluginLoadingCallback callback);
+    void updateLoadTimings(const std::function<void(PluginLoadTimings&)>& update);
+    void finishLoadTimings(bool succeeded, const juce::String& pluginName);
+    void loadPluginFromFile(const juce::String& pluginPath, PluginLoadScheduler::Priority priority, juce::uint32 generation, PluginLoadingCallback callback);
     bool setHostedPluginLayout();
     bool prepareHostedPluginForPlaying();
     void setHostedPluginState();
+    /// Must be called with `innerMutex` held.
+    void keepMissingState(const juce::String& pluginPath, const juce::MemoryBlock& restoredState);
+    void markStateDirtyIfProgramChanged(const juce::MidiBuffer& midiMessages);
+    template<typename FloatType>
+    void processDormantBlock(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages);
+    template<typename FloatType>
+    LatencyCompensatedBypass<FloatType>& getLatencyCompensatedBypass();
+#if JucePlugin_IsMidiEffect
+    template<typename FloatType>
+    juce::AudioBuffer<FloatType>& getMidiEffectScratchBuffer();
+    template<typename FloatType>
+    bool renderMidiEffectBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, int numSamples, juce::MidiBuffer& midiMessages, bool isActive);
+#endif
+    template<typename FloatType>
+    void callHostedProcessBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, bool isActive);
+    template<typename FloatType>
+    void renderHostedBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, bool isActive);
+    /// Prepends an all notes off on every channel, as the note offs of the blocks the watchdog skipped were never delivered.
+    void releaseNotesHeldWhileTripped(juce::MidiBuffer& midiMessages);
+    /// Inserts an all notes off on every channel in front of the block's events, in place.
+    static void prependAllNotesOff(juce::MidiBuffer& midiMessages);
+    juce::Optional<juce::AudioPlayHead::PositionInfo> getHostPosition();
     template<typename FloatType>
     void processBlockInternal(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, bool setPlayhead);
+    template<typename FloatType>
+    void renderInProcessBlock(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages,
+                              const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive);
     //==============================================================================
     static constexpr const char* innerStateTag = "inner_state";
     static constexpr const char* pluginPathTag = "plugin_path";
+    static constexpr const char* deferredLoadingTag = "deferred_loading";
+    static constexpr const char* renderThreadTag = "render_thread";
+    static constexpr const char* overrunActionTag = "overrun_action";
+    static constexpr const char* sandboxTag = "sandbox";
+    static constexpr const char* editorRetentionTag = "retain_editor";
+    static constexpr const char* sidecarStoreTag = "sidecar_store";
+    static constexpr const char* sidecarReferenceTag = "sidecar";
+    static constexpr const char* sidecarSizeTag = "size";
+    static constexpr const char* renderCacheTag = "render_cache";
+    static constexpr const char* internalSampleRateTag = "internal_sample_rate";
+    static constexpr const char* resamplingQualityTag = "resampling_quality";
+    static constexpr const char* midiTransformsTag = "midi_transforms";
     static inline const juce::String unexpectedPluginLoadingError = "An unexpected error has occurred while loading the plugin";
-    bool isLoading;
+    bool isLoading = false;
     juce::String hostedPluginLoadingError;
     juce::String hostedPluginPath;
     bool hostedPluginHasSidechainInput;
     juce::String hostedPluginName;
     juce::String targetLayoutDescription;
-    juce::MemoryBlock hostedPluginState;
+    PluginStateData hostedPluginState;
+    // The plugin `hostedPluginState` was saved for. `loadPlugin` never carries the state over to any other plugin.
+    juce::String hostedPluginStatePath;
+    PluginLoadTimings currentLoadTimings;
+    PluginLoadTimings lastLoadTimings;
+    
+    //==============================================================================
+    // State snapshot cache
+    //==============================================================================
+    
+    // Hosts like Logic call `getStateInformation` on every save and autosave.
+    // Serializing big plugins (e.g. samplers) every time is expensive, so we keep
+    // the last serialized wrapper state and only rebuild it when something has changed.
+    // As a notification doesn't always mean a change, the hosted state's hash decides whether it has to be encoded again.
+    std::atomic<bool> isStateDirty { true };
+    std::atomic<bool> stateCacheEnabled { true };
+    juce::MemoryBlock cachedState;
+    juce::uint64 cachedInnerStateHash = 0;
+    // Incremented whenever the cache is invalidated, so that a snapshot built without `innerMutex` held can tell it's stale
+    juce::uint32 cachedStateGeneration = 0;
+    
+    /// Must be called with `innerMutex` held.
+    void invalidateCachedState()
+    {
+        cachedState.reset();
+        cachedInnerStateHash = 0;
+        ++cachedStateGeneration;
+        isStateDirty = true;
+        
+    #if JucePlugin_IsSynth
+        renderCache.invalidateStateKey();
+    #endif
+    }
+    
+    /// A fast non-cryptographic (FNV-1a) hash, used only to detect whether the hosted plugin's state has changed.
+    static juce::uint64 hashStateBlock(const juce::MemoryBlock& block);
+    
+    //==============================================================================
+    // Deferred loading
+    //==============================================================================
+    
+    bool deferredLoadingEnabled = false;
+    std::atomic<bool> isDormant { false };
+    std::atomic<bool> wakeRequested { false };
+    std::atomic<bool> shouldMuteNextBlock { false };
+    // The exact bytes passed to `setStateInformation`, returned unchanged while the plugin is dormant
+    juce::MemoryBlock dormantState;
+    // Dormant because the sidecar blob the restored state refers to is missing, rather than for deferred loading
+    bool isDormantStateMissing = false;
+    // How often the message thread checks whether the audio thread has asked for the plugin to be instantiated
+    static constexpr int wakeRequestPollingIntervalMs = 20;
+    
+    void timerCallback() override;
+    
+    //==============================================================================
+    // Render thread
+    //==============================================================================
+    
+    bool renderThreadEnabled = false;
+    // Only accessed on the audio thread, or while processing is suspended
+    std::unique_ptr<PipelinedRenderer> pipelinedRenderer;
+    // Serves the hosted plugin the position captured once per block, on the audio thread or the render thread
+    HostedPlayHead hostedPlayHead;
+    std::atomic<juce::int64> hostPlayHeadQueryTicks { 0 };
+    std::atomic<juce::int64> numHostPlayHeadQueries { 0 };
+    
+    void configurePipelinedRenderer();
+    void stopPipelinedRenderer();
+    void updateLatency();
+    
+    //==============================================================================
+    // Sandbox
+    //==============================================================================
+    
+    bool sandboxEnabled = false;
+    // `true` from the start of a sandboxed load until the plugin is closed, including after a crash
+    std::atomic<bool> isSandboxed { false };
+    SandboxedPluginHost sandboxedPluginHost;
+    // The last state the sandboxed plugin was loaded with or reported, used to reload it after a crash
+    juce::MemoryBlock sandboxedPluginState;
+    double sandboxedLoadStartMs = 0.0;
+    juce::uint32 sandboxedLoadGeneration = 0;
+    // How long `getStateInformation` waits for the helper before saving the last known state instead
+    static constexpr int sandboxStateTimeoutMs = 2000;
+    
+    void loadPluginInSandbox(const juce::String& pluginPath, juce::uint32 generation);
+    void sandboxedPluginLoaded(const SandboxedPluginHost::LoadResult& result);
+    void sandboxedPluginCrashed();
+    
+    //==============================================================================
+    // Program slots
+    //==============================================================================
+    
+    ProgramSlots programSlots;
+    
+    /// Called on the message thread while the output is faded out.
+    void applyProgramState(const juce::MemoryBlock& state);
+    
+#if JucePlugin_IsSynth
+    //==============================================================================
+    // Render cache
+    //==============================================================================
+    
+    RenderCache renderCache;
+    // Rendering thread state
+    juce::int64 renderCacheNextTimeInSamples = -1;
+    bool renderCacheServedLastBlock = false;
+    
+    /// Called on the message thread to hash the hosted plugin's path and state.
+    juce::uint64 computeRenderCacheStateKey();
+    void prepareRenderCache();
+    juce::uint64 hashRenderCacheBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, const juce::AudioBuffer<float>& buffer,
+                                      const juce::MidiBuffer& midiMessages, const juce::AudioPlayHead::PositionInfo& position);
+    void releaseNotesHeldDuringCachedBlocks(juce::MidiBuffer& midiMessages);
+    template<typename FloatType>
+    void renderCachedHostedBlock(const std::unique_ptr<juce::AudioPluginInstance>& p, juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages,
+                                 const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive);
+#endif
+    
+#if ! JucePlugin_IsMidiEffect
+    //==============================================================================
+    // Output metering
+    //==============================================================================
+    
+    BusMeters busMeters;
+    
+    void prepareBusMeters(double sampleRate);
+    
+    //==============================================================================
+    // Internal sample rate
+    //==============================================================================
+    
+    double internalSampleRate = 0.0;
+    StreamingResampler::Quality resamplingQuality = StreamingResampler::Quality::medium;
+    // Only accessed on the rendering thread, or while processing is suspended
+    SampleRateAdapter sampleRateAdapter;
+    
+    void prepareSampleRateAdapter(double sampleRate, int samplesPerBlock);
+#endif
+    
+    /// The rate and maximum block size the hosted plugin runs at, which differ from the host's while the sample rate adapter is active.
+    double getHostedSampleRate() const;
+    int getHostedBlockSize() const;
+    
+    /// Calls `render(buffer, midiMessages, position)` at the hosted plugin's rate, and serves `hostedPlayHead` the position it renders at.
+    template<typename FloatType, typename RenderCallback>
+    void renderAtHostedRate(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages,
+                            const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, RenderCallback&& render);
+    
+    //==============================================================================
+    // Overrun watchdog
+    //==============================================================================
+    
+    // Only used by the thread that renders the hosted plugin (the audio thread or the render thread)
+    HostedPluginWatchdog watchdog;
+    LatencyCompensatedBypass<float> floatBypass;
+    LatencyCompensatedBypass<double> doubleBypass;
+    bool watchdogSkippedLastBlock = false;
+    // The worst wait for `innerMutex` in every block the audio thread processes
+    AudioThreadStalls audioThreadStalls;
+    
+    //==============================================================================
+    // MIDI transforms
+    //==============================================================================
+    
+    juce::String midiTransformRules;
+    // Only accessed on the audio thread, or while processing is suspended
+    MidiTransformStage midiTransform;
+    
+    /// Compiles the current rules into the stage. Must be called while the audio thread isn't processing.
+    void prepareMidiTransform();
+    
+    //==============================================================================
+    // Offline rendering
+    //==============================================================================
+    
+    /// Applies the host's realtime or offline mode to the hosted plugin and the rendering state.
+    void applyOfflineMode();
+    /// Called on the message thread to apply a mode change recorded by `setNonRealtime`, if it's still pending.
+    void switchOfflineMode();
+    /// Called on the message thread to log the throughput of a bounce that has just ended.
+    void logOfflineThroughput();
+    
+    // Set by `setNonRealtime` on the host's thread and consumed on the message thread
+    std::atomic<bool> isOfflineModeChangePending { false };
+    std::atomic<bool> isOfflineReportPending { false };
+    
+    // Counted by the rendering thread while offline, for the bounce's throughput report
+    std::atomic<juce::int64> offlineSamples { 0 };
+    std::atomic<double> offlineStartMs { 0.0 };
+    std::atomic<double> offlineEndMs { 0.0 };
+    
+#if VST3WRAPPER_RT_CHECKS
+    // Keeps reporting violations while any wrapper instance exists
+    juce::SharedResourcePointer<RealtimeSafetyChecker> realtimeSafetyChecker;
+#endif
+    
+#if JucePlugin_IsMidiEffect
+    //==============================================================================
+    // MIDI FX fast path
+    //==============================================================================
+    
+    // Only MIDI matters in a MIDI FX slot, so the hosted plugin renders its audio into these buffers,
+    // which are allocated in `prepareToPlay` and never copied
+    juce::AudioBuffer<float> floatMidiEffectScratch;
+    juce::AudioBuffer<double> doubleMidiEffectScratch;
+    static constexpr int midiEffectScratchChannels = 32;
+    // Reserved in `prepareToPlay`, and swapped with a host's buffer too small for the hosted plugin's output
+    juce::MidiBuffer midiEffectMidi;
+    // Enough for about 16k three-byte events per block, so that dense arpeggiator and sequencer output doesn't grow the buffer
+    static constexpr int midiEffectMidiBufferBytes = 16384 * 12;
+#endif
+    
+    /// Prepares the state used by the rendering thread. Must be called while the hosted plugin isn't rendering.
+    void prepareRenderingState();
+    
+    //==============================================================================
+    // Reconfiguration
+    //==============================================================================
+    
+    ReconfigurationManager reconfiguration;
+    // Quieter blocks don't count as the first audible block of a playback (-100 dBFS)
+    static constexpr double audibleLevel = 1.0e-5;
+    
+    ReconfigurationManager::Configuration getHostedPluginConfiguration();
+    /// Prepares the hosted plugin for `getHostedPluginConfiguration()`, unless it's already prepared for it.
+    void prepareHostedPlugin();
+    template<typename FloatType>
+    static bool isAudible(const juce::AudioBuffer<FloatType>& buffer, const juce::MidiBuffer& midiMessages);
+    
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override { markStateDirty(); }
+    void audioProcessorChanged(juce::AudioProcessor*, const juce::AudioProcessorListener::ChangeDetails&) override { markStateDirty(); }
+    
+    void setIsDormant(bool value)
+    {
+        const juce::ScopedLock sl(innerMutex);
+        isDormant = value;
+        
+        if (!value)
+        {
+            dormantState.reset();
+            isDormantStateMissing = false;
+        }
+    }
     
     void setIsLoading(bool value)
     {
@@ -187,13 +778,14 @@ private:
         return hostedPluginPath;
     }
     
-    void setHostedPluginStateMemoryBlock(juce::MemoryBlock value)
+    void setHostedPluginStateData(PluginStateData value, const juce::String& pluginPath = {})
     {
         const juce::ScopedLock sl(innerMutex);
         hostedPluginState = value;
+        hostedPluginStatePath = pluginPath;
     }
     
-    juce::MemoryBlock getHostedPluginStateMemoryBlock()
+    PluginStateData getHostedPluginStateData()
     {
         const juce::ScopedLock sl(innerMutex);
         return hostedPluginState;
@@ -211,6 +803,16 @@ private:
         hostedPluginName = value;
     }
     
+    //==============================================================================
+    // Telemetry
+    //==============================================================================
+    
+    /// Called on the message thread by the telemetry table.
+    TelemetryTable::Status getTelemetryStatus();
+    
+    // Declared last, so that it's unregistered before anything `getTelemetryStatus` reads is destroyed
+    TelemetryTable::Registration telemetry { [this] { return getTelemetryStatus(); } };
+    
     //==============================================================================
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VST3WrapperAudioProcessor)
@@ -0,0 +1,224 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "ProgramSlots.h"
+
+//==============================================================================
+
+ProgramSlots::ProgramSlots()
+{
+    for (int i = 0; i < numSlots; ++i)
+    {
+        slots[(size_t) i].name = "Program " + juce::String(i + 1);
+    }
+}
+
+ProgramSlots::~ProgramSlots()
+{
+    stopTimer();
+    cancelPendingUpdate();
+}
+
+void ProgramSlots::prepare(double sampleRate)
+{
+    fadeSamples = juce::jmax(1, juce::roundToInt(sampleRate * fadeMs / 1000.0));
+}
+
+void ProgramSlots::store(int index, const juce::MemoryBlock& state, const juce::String& newPluginPath)
+{
+    if (!juce::isPositiveAndBelow(index, numSlots)) { return; }
+
+    const juce::ScopedLock sl (lock);
+
+    if (newPluginPath != pluginPath)
+    {
+        for (auto& slot : slots)
+        {
+            slot.state.reset();
+            slot.lastSwitchMs = 0.0;
+        }
+
+        pluginPath = newPluginPath;
+    }
+
+    slots[(size_t) index].state = state;
+    currentProgram = index;
+}
+
+void ProgramSlots::clear()
+{
+    const juce::ScopedLock sl (lock);
+
+    for (int i = 0; i < numSlots; ++i)
+    {
+        slots[(size_t) i] = Slot();
+        slots[(size_t) i].name = "Program " + juce::String(i + 1);
+    }
+
+    pluginPath.clear();
+    currentProgram = 0;
+}
+
+bool ProgramSlots::isEmpty(int index) const
+{
+    const juce::ScopedLock sl (lock);
+    return !juce::isPositiveAndBelow(index, numSlots) || slots[(size_t) index].state.isEmpty();
+}
+
+juce::String ProgramSlots::getPluginPath() const
+{
+    const juce::ScopedLock sl (lock);
+    return pluginPath;
+}
+
+juce::String ProgramSlots::getName(int index) const
+{
+    const juce::ScopedLock sl (lock);
+    return juce::isPositiveAndBelow(index, numSlots) ? slots[(size_t) index].name : juce::String();
+}
+
+void ProgramSlots::setName(int index, const juce::String& newName)
+{
+    if (!juce::isPositiveAndBelow(index, numSlots)) { return; }
+
+    const juce::ScopedLock sl (lock);
+    slots[(size_t) index].name = newName;
+}
+
+double ProgramSlots::getLastSwitchMs(int index) const
+{
+    const juce::ScopedLock sl (lock);
+    return juce::isPositiveAndBelow(index, numSlots) ? slots[(size_t) index].lastSwitchMs : 0.0;
+}
+
+//==============================================================================
+
+void ProgramSlots::select(int index)
+{
+    // Hosts often select the current program again after restoring the state, which mustn't undo later edits
+    if (isEmpty(index) || (index == currentProgram && pendingProgram == -1)) { return; }
+
+    switchStartMs = juce::Time::getMillisecondCounterHiRes();
+    pendingProgram = index;
+
+    // A switch in progress keeps its phase, and simply applies the newest program
+    auto expected = FadePhase::idle;
+    if (!phase.compare_exchange_strong(expected, FadePhase::fadingOut))
+    {
+        expected = FadePhase::fadingIn;
+        phase.compare_exchange_strong(expected, FadePhase::fadingOut);
+    }
+
+    // The host may select programs on any thread, so the timer is started from the message thread
+    triggerAsyncUpdate();
+}
+
+void ProgramSlots::handleAsyncUpdate()
+{
+    startTimer(pollingIntervalMs);
+}
+
+void ProgramSlots::timerCallback()
+{
+    const auto elapsedMs = juce::Time::getMillisecondCounterHiRes() - switchStartMs;
+
+    if (phase != FadePhase::silent && elapsedMs < fadeTimeoutMs) { return; }
+
+    const auto index = pendingProgram.exchange(-1);
+
+    if (index >= 0)
+    {
+        juce::MemoryBlock state;
+
+        {
+            const juce::ScopedLock sl (lock);
+            state = slots[(size_t) index].state;
+        }
+
+        const auto applyStartMs = juce::Time::getMillisecondCounterHiRes();
+
+        if (applyState != nullptr && !state.isEmpty())
+        {
+            applyState(state);
+        }
+
+        const auto applyEndMs = juce::Time::getMillisecondCounterHiRes();
+        currentProgram = index;
+
+        {
+            const juce::ScopedLock sl (lock);
+            slots[(size_t) index].lastSwitchMs = applyEndMs - switchStartMs;
+        }
+
+        juce::Logger::writeToLog("AU-VST3-Wrapper program: slot=" + juce::String(index + 1)
+                                 + " fade_out_ms=" + juce::String(applyStartMs - switchStartMs, 1)
+                                 + " apply_ms=" + juce::String(applyEndMs - applyStartMs, 1)
+                                 + " total_ms=" + juce::String(applyEndMs - switchStartMs, 1));
+    }
+
+    // Another program was selected while this one was being applied, so we stay silent and apply it next
+    if (pendingProgram != -1) { return; }
+
+    phase = FadePhase::fadingIn;
+    stopTimer();
+}
+
+//==============================================================================
+
+std::unique_ptr<juce::XmlElement> ProgramSlots::createXml() const
+{
+    const juce::ScopedLock sl (lock);
+
+    auto xml = std::make_unique<juce::XmlElement>(xmlTag);
+    xml->setAttribute("current", currentProgram.load());
+    xml->setAttribute("plugin_path", pluginPath);
+
+    for (int i = 0; i < numSlots; ++i)
+    {
+        const auto& slot = slots[(size_t) i];
+        auto* slotElement = xml->createNewChildElement("program");
+        slotElement->setAttribute("name", slot.name);
+
+        if (!slot.state.isEmpty())
+        {
+            slotElement->addTextElement(slot.state.toBase64Encoding());
+        }
+    }
+
+    return xml;
+}
+
+void ProgramSlots::restoreFromXml(const juce::XmlElement* xml)
+{
+    clear();
+
+    if (xml == nullptr) { return; }
+
+    const juce::ScopedLock sl (lock);
+
+    // The states are decoded once here, so that switching programs only copies them
+    auto index = 0;
+
+    for (auto* slotElement : xml->getChildWithTagNameIterator("program"))
+    {
+        if (index >= numSlots) { break; }
+
+        auto& slot = slots[(size_t) index++];
+        slot.name = slotElement->getStringAttribute("name", slot.name);
+        slot.state.fromBase64Encoding(slotElement->getAllSubText());
+    }
+
+    pluginPath = xml->getStringAttribute("plugin_path");
+    currentProgram = juce::jlimit(0, numSlots - 1, xml->getIntAttribute("current", 0));
+}
@@ -0,0 +1,143 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief A bank of program slots, each holding a decoded state of the hosted plugin, exposed to the host as the wrapper's programs.
+ *
+ * Selecting a program fades the output out on the rendering thread, applies the slot's state to the live plugin instance
+ * on the message thread while the output is silent, and fades the output back in.
+ * If the host isn't processing, the state is applied after `fadeTimeoutMs` anyway.
+ *
+ * `applyFade` is called on the rendering thread and never blocks or allocates. Everything else can be called on any thread,
+ * except `applyState`, which is always called on the message thread.
+ */
+class ProgramSlots : private juce::Timer, private juce::AsyncUpdater
+{
+public:
+    ProgramSlots();
+    ~ProgramSlots() override;
+
+    /// Applies the state of the selected slot to the hosted plugin. Called on the message thread while the output is silent.
+    std::function<void(const juce::MemoryBlock& state)> applyState;
+
+    void prepare(double sampleRate);
+
+    /// Stores the state in the slot. The slots belong to the plugin at provided path, and storing a state of another plugin clears the others.
+    void store(int index, const juce::MemoryBlock& state, const juce::String& pluginPath);
+
+    void clear();
+
+    bool isEmpty(int index) const;
+
+    /// The VST3 file whose states the slots hold, or an empty string if all the slots are empty.
+    juce::String getPluginPath() const;
+
+    juce::String getName(int index) const;
+    void setName(int index, const juce::String& newName);
+
+    int getCurrent() const { return currentProgram; }
+
+    /**
+     * @brief Switches to the program in the slot. Does nothing if the slot is empty or already current.
+     *        A program selected while another switch is in progress replaces it.
+     */
+    void select(int index);
+
+    /// Returns the time from the last `select` call of the slot until its state was applied, in milliseconds.
+    double getLastSwitchMs(int index) const;
+
+    /// Fades the output in or out while a switch is in progress.
+    template <typename FloatType>
+    void applyFade(juce::AudioBuffer<FloatType>& buffer);
+
+    std::unique_ptr<juce::XmlElement> createXml() const;
+    void restoreFromXml(const juce::XmlElement* xml);
+
+    static constexpr int numSlots = 8;
+    static constexpr double fadeMs = 10.0;
+    static constexpr int fadeTimeoutMs = 200;
+    static inline const juce::String xmlTag = "programs";
+
+private:
+    enum class FadePhase
+    {
+        idle = 0,
+        fadingOut,
+        silent,
+        fadingIn
+    };
+
+    struct Slot
+    {
+        juce::String name;
+        juce::MemoryBlock state;
+        double lastSwitchMs = 0.0;
+    };
+
+    void handleAsyncUpdate() override;
+    void timerCallback() override;
+
+    mutable juce::CriticalSection lock;
+    std::array<Slot, numSlots> slots;
+    juce::String pluginPath;
+
+    std::atomic<int> currentProgram { 0 };
+    std::atomic<int> pendingProgram { -1 };
+    std::atomic<FadePhase> phase { FadePhase::idle };
+    std::atomic<double> switchStartMs { 0.0 };
+    std::atomic<int> fadeSamples { 441 };
+
+    // Rendering thread state
+    float gain = 1.0f;
+
+    static constexpr int pollingIntervalMs = 2;
+};
+
+//==============================================================================
+
+template <typename FloatType>
+void ProgramSlots::applyFade(juce::AudioBuffer<FloatType>& buffer)
+{
+    auto currentPhase = phase.load();
+
+    if (currentPhase == FadePhase::idle) { return; }
+
+    if (currentPhase == FadePhase::silent)
+    {
+        buffer.clear();
+        return;
+    }
+
+    const auto numSamples = buffer.getNumSamples();
+    const auto step = (float) numSamples / (float) juce::jmax(1, fadeSamples.load());
+    const auto isFadingOut = currentPhase == FadePhase::fadingOut;
+    const auto newGain = isFadingOut ? juce::jmax(0.0f, gain - step) : juce::jmin(1.0f, gain + step);
+
+    buffer.applyGainRamp(0, numSamples, (FloatType) gain, (FloatType) newGain);
+    gain = newGain;
+
+    // The message thread may have changed the phase in the meantime, in which case its change wins
+    if (isFadingOut && gain == 0.0f)
+    {
+        phase.compare_exchange_strong(currentPhase, FadePhase::silent);
+    }
+    else if (!isFadingOut && gain == 1.0f)
+    {
+        phase.compare_exchange_strong(currentPhase, FadePhase::idle);
+    }
+}
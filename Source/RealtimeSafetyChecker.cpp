@@ -0,0 +1,397 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "RealtimeSafetyChecker.h"
+
+#if VST3WRAPPER_RT_CHECKS
+
+#include <execinfo.h>
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <poll.h>
+ #include <pthread.h>
+ #include <semaphore.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+
+namespace
+{
+    // Trivially initialized, so that accessing it from an interposed `malloc` never allocates.
+    // The initial-exec model keeps glibc from allocating the thread's block lazily on first access.
+    struct ThreadState
+    {
+        bool isChecking;
+        bool isRecording;
+        RealtimeSafetyChecker::Origin origin;
+    };
+
+   #if JUCE_LINUX
+    thread_local ThreadState threadState __attribute__((tls_model("initial-exec")));
+   #else
+    thread_local ThreadState threadState;
+   #endif
+
+    /// A bounded multi-producer queue (after Dmitry Vyukov's), as every host thread rendering a wrapper may report violations.
+    /// Consumed by the reporter on the message thread.
+    class ViolationLog
+    {
+    public:
+        ViolationLog()
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool push(const RealtimeSafetyChecker::Violation& violation)
+        {
+            auto position = enqueuePosition.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                auto& cell = cells[position & mask];
+                const auto difference = (std::ptrdiff_t) cell.sequence.load(std::memory_order_acquire) - (std::ptrdiff_t) position;
+
+                if (difference == 0)
+                {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        cell.violation = violation;
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    ++numDropped;
+                    return false;
+                }
+                else
+                {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool pop(RealtimeSafetyChecker::Violation& violation)
+        {
+            auto& cell = cells[dequeuePosition & mask];
+
+            if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) { return false; }
+
+            violation = cell.violation;
+            cell.sequence.store(dequeuePosition + size, std::memory_order_release);
+            ++dequeuePosition;
+            return true;
+        }
+
+        int getNumDropped() const { return numDropped; }
+
+    private:
+        static constexpr size_t size = 1024;
+        static constexpr size_t mask = size - 1;
+
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            RealtimeSafetyChecker::Violation violation;
+        };
+
+        std::array<Cell, size> cells;
+        std::atomic<size_t> enqueuePosition { 0 };
+        size_t dequeuePosition = 0;
+        std::atomic<int> numDropped { 0 };
+    };
+
+    ViolationLog violationLog;
+
+    // Counted per kind and origin, including the violations the log had no room for
+    std::atomic<juce::int64> violationCounts[3][2] {};
+
+    // While no checker exists, nothing is recorded, so that threads of other hosts' wrapper builds stay untouched
+    std::atomic<int> numCheckers { 0 };
+
+    const char* getKindName(RealtimeSafetyChecker::Kind kind)
+    {
+        switch (kind)
+        {
+            case RealtimeSafetyChecker::Kind::allocation:   return "allocation";
+            case RealtimeSafetyChecker::Kind::lockWait:     return "lock_wait";
+            case RealtimeSafetyChecker::Kind::blockingCall: return "blocking_call";
+        }
+
+        return "unknown";
+    }
+
+    const char* getOriginName(RealtimeSafetyChecker::Origin origin)
+    {
+        return origin == RealtimeSafetyChecker::Origin::hostedPlugin ? "hosted_plugin" : "wrapper";
+    }
+}
+
+//==============================================================================
+
+RealtimeSafetyChecker::ScopedCheck::ScopedCheck()
+: wasChecking(threadState.isChecking), previousOrigin(threadState.origin)
+{
+    threadState.isChecking = true;
+    threadState.origin = Origin::wrapper;
+}
+
+RealtimeSafetyChecker::ScopedCheck::~ScopedCheck()
+{
+    threadState.isChecking = wasChecking;
+    threadState.origin = previousOrigin;
+}
+
+RealtimeSafetyChecker::ScopedHostedPlugin::ScopedHostedPlugin()
+: previousOrigin(threadState.origin)
+{
+    threadState.origin = Origin::hostedPlugin;
+}
+
+RealtimeSafetyChecker::ScopedHostedPlugin::~ScopedHostedPlugin()
+{
+    threadState.origin = previousOrigin;
+}
+
+bool RealtimeSafetyChecker::isChecking()
+{
+    return threadState.isChecking && !threadState.isRecording && numCheckers.load(std::memory_order_relaxed) > 0;
+}
+
+juce::int64 RealtimeSafetyChecker::getNumViolations(Kind kind, Origin origin)
+{
+    return violationCounts[(int) kind][(int) origin].load(std::memory_order_relaxed);
+}
+
+void RealtimeSafetyChecker::record(Kind kind, const char* function, juce::int64 amount)
+{
+    if (!isChecking()) { return; }
+
+    // Anything called from here (e.g. by `backtrace`) isn't reported again
+    threadState.isRecording = true;
+
+    Violation violation;
+    violation.kind = kind;
+    violation.origin = threadState.origin;
+    violation.function = function;
+    violation.amount = amount;
+    violation.timeMs = juce::Time::getMillisecondCounter();
+    violation.numFrames = backtrace(violation.frames, Violation::maxFrames);
+
+    violationCounts[(int) kind][(int) violation.origin].fetch_add(1, std::memory_order_relaxed);
+    violationLog.push(violation);
+
+    threadState.isRecording = false;
+}
+
+//==============================================================================
+
+class RealtimeSafetyChecker::Reporter : private juce::Timer
+{
+public:
+    Reporter()
+    {
+        startTimer(reportingIntervalMs);
+    }
+
+    ~Reporter() override
+    {
+        stopTimer();
+        reportViolations();
+        reportSummary();
+    }
+
+private:
+    void timerCallback() override
+    {
+        reportViolations();
+    }
+
+    void reportViolations()
+    {
+        Violation violation;
+
+        while (violationLog.pop(violation))
+        {
+            juce::String line;
+            line << "AU-VST3-Wrapper rt_violation: kind=" << getKindName(violation.kind)
+                 << " origin=" << getOriginName(violation.origin)
+                 << " function=" << violation.function
+                 << (violation.kind == Kind::allocation ? " bytes=" : " wait_us=") << violation.amount
+                 << " time_ms=" << (juce::int64) violation.timeMs;
+
+            // The first frames are `record` and the interposed function
+            if (auto** symbols = backtrace_symbols(violation.frames, violation.numFrames))
+            {
+                for (int i = framesToSkip; i < violation.numFrames; ++i)
+                {
+                    line << juce::newLine << "    " << symbols[i];
+                }
+
+                ::free(symbols);
+            }
+
+            juce::Logger::writeToLog(line);
+        }
+    }
+
+    void reportSummary()
+    {
+        juce::String line ("AU-VST3-Wrapper rt_summary:");
+
+        for (const auto kind : { Kind::allocation, Kind::lockWait, Kind::blockingCall })
+        {
+            for (const auto origin : { Origin::wrapper, Origin::hostedPlugin })
+            {
+                line << " " << getKindName(kind) << "_" << getOriginName(origin) << "="
+                     << violationCounts[(int) kind][(int) origin].load();
+            }
+        }
+
+        line << " dropped=" << violationLog.getNumDropped();
+        juce::Logger::writeToLog(line);
+    }
+
+    static constexpr int reportingIntervalMs = 1000;
+    static constexpr int framesToSkip = 2;
+};
+
+RealtimeSafetyChecker::RealtimeSafetyChecker()
+{
+    // The first `backtrace` call loads the unwinder, which allocates, so it mustn't happen on a rendering thread
+    void* frames[1];
+    backtrace(frames, 1);
+
+    reporter = std::make_unique<Reporter>();
+    ++numCheckers;
+}
+
+RealtimeSafetyChecker::~RealtimeSafetyChecker()
+{
+    --numCheckers;
+    reporter.reset();
+}
+
+//==============================================================================
+// Interposed C library functions
+//==============================================================================
+
+#if JUCE_LINUX
+
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void __libc_free(void* pointer);
+}
+
+namespace
+{
+    template <typename Function>
+    Function getNextFunction(std::atomic<Function>& cached, const char* name)
+    {
+        auto function = cached.load(std::memory_order_relaxed);
+
+        if (function == nullptr)
+        {
+            function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+            cached.store(function, std::memory_order_relaxed);
+        }
+
+        return function;
+    }
+
+    void recordBlockingCall(const char* function)
+    {
+        RealtimeSafetyChecker::record(RealtimeSafetyChecker::Kind::blockingCall, function, 0);
+    }
+}
+
+// Calls the next definition of the function, after reporting the call if the calling thread is being checked
+#define VST3WRAPPER_INTERPOSE_BLOCKING_CALL(returnType, name, parameters, arguments) \
+    extern "C" returnType name parameters \
+    { \
+        static std::atomic<returnType (*) parameters> next { nullptr }; \
+        recordBlockingCall(#name); \
+        return getNextFunction(next, #name) arguments; \
+    }
+
+extern "C" void* malloc(size_t size) __THROW
+{
+    RealtimeSafetyChecker::record(RealtimeSafetyChecker::Kind::allocation, "malloc", (juce::int64) size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) __THROW
+{
+    RealtimeSafetyChecker::record(RealtimeSafetyChecker::Kind::allocation, "calloc", (juce::int64) (count * size));
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) __THROW
+{
+    RealtimeSafetyChecker::record(RealtimeSafetyChecker::Kind::allocation, "realloc", (juce::int64) size);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void* pointer) __THROW
+{
+    if (pointer != nullptr)
+    {
+        RealtimeSafetyChecker::record(RealtimeSafetyChecker::Kind::allocation, "free", 0);
+    }
+
+    __libc_free(pointer);
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) __THROWNL
+{
+    static std::atomic<int (*)(pthread_mutex_t*)> next { nullptr };
+    const auto lock = getNextFunction(next, "pthread_mutex_lock");
+
+    if (!RealtimeSafetyChecker::isChecking()) { return lock(mutex); }
+
+    // An uncontended lock doesn't wait, so only the time spent waiting for another thread is reported
+    const auto tryLockResult = pthread_mutex_trylock(mutex);
+
+    if (tryLockResult != EBUSY) { return tryLockResult; }
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    const auto result = lock(mutex);
+    const auto waitSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    RealtimeSafetyChecker::record(RealtimeSafetyChecker::Kind::lockWait, "pthread_mutex_lock", (juce::int64) (waitSeconds * 1.0e6));
+    return result;
+}
+
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(ssize_t, read, (int fd, void* buffer, size_t count), (fd, buffer, count))
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(ssize_t, write, (int fd, const void* buffer, size_t count), (fd, buffer, count))
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(int, fsync, (int fd), (fd))
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(int, poll, (struct pollfd* fds, nfds_t numFds, int timeout), (fds, numFds, timeout))
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(int, nanosleep, (const struct timespec* duration, struct timespec* remaining), (duration, remaining))
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(int, usleep, (useconds_t microseconds), (microseconds))
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(int, sem_wait, (sem_t* semaphore), (semaphore))
+VST3WRAPPER_INTERPOSE_BLOCKING_CALL(int, pthread_cond_wait, (pthread_cond_t* condition, pthread_mutex_t* mutex), (condition, mutex))
+
+#undef VST3WRAPPER_INTERPOSE_BLOCKING_CALL
+
+#endif // JUCE_LINUX
+
+#endif // VST3WRAPPER_RT_CHECKS
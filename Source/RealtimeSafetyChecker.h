@@ -0,0 +1,166 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioThreadStalls.h"
+
+/// Builds the wrapper with the real-time safety checker (see `RealtimeSafetyChecker`). Meant for diagnostic builds only.
+#ifndef VST3WRAPPER_RT_CHECKS
+ #define VST3WRAPPER_RT_CHECKS 0
+#endif
+
+/**
+ * @brief Reports everything on the rendering threads that may block: heap allocations, lock waits and blocking system calls.
+ *
+ * The checking starts when a rendering thread enters a `ScopedCheck` and stops when it leaves it. Each violation is attributed to
+ * the wrapper or to the hosted plugin (see `ScopedHostedPlugin`), recorded with a sample of the call stack into a lock-free log,
+ * and written to the log on the message thread as an "AU-VST3-Wrapper rt_violation" line, with the symbolized stack.
+ * A summary of all violations is logged when the last wrapper instance is deleted.
+ *
+ * Waits for `innerMutex` are measured on every platform. On Linux, `malloc`, `calloc`, `realloc`, `free`, `pthread_mutex_lock`
+ * and common blocking system calls are interposed too. They only see the calls made by the hosted plugin and the rest of the process
+ * when the wrapper's binary is loaded with `LD_PRELOAD`, otherwise the host's C library resolves them first.
+ *
+ * Everything compiles to nothing unless `VST3WRAPPER_RT_CHECKS` is set to 1.
+ */
+class RealtimeSafetyChecker
+{
+public:
+    enum class Kind
+    {
+        allocation = 0,
+        lockWait,
+        blockingCall
+    };
+
+    enum class Origin
+    {
+        wrapper = 0,
+        hostedPlugin
+    };
+
+#if VST3WRAPPER_RT_CHECKS
+    struct Violation
+    {
+        static constexpr int maxFrames = 24;
+
+        Kind kind;
+        Origin origin;
+        /// The function which was called, e.g. "malloc" or "innerMutex"
+        const char* function;
+        /// The allocated bytes, or the time spent waiting in microseconds
+        juce::int64 amount;
+        juce::uint32 timeMs;
+        int numFrames;
+        void* frames[maxFrames];
+    };
+
+    /// Checks the calling thread until the object is deleted. Violations are only reported while a `RealtimeSafetyChecker` exists.
+    class ScopedCheck
+    {
+    public:
+        ScopedCheck();
+        ~ScopedCheck();
+
+    private:
+        bool wasChecking;
+        Origin previousOrigin;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedCheck)
+    };
+
+    /// Attributes the violations of the calling thread to the hosted plugin until the object is deleted.
+    class ScopedHostedPlugin
+    {
+    public:
+        ScopedHostedPlugin();
+        ~ScopedHostedPlugin();
+
+    private:
+        Origin previousOrigin;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedHostedPlugin)
+    };
+
+    /// Records a violation if the calling thread is being checked. Never blocks or allocates.
+    static void record(Kind kind, const char* function, juce::int64 amount);
+
+    /// Returns `true` if the calling thread is being checked and isn't recording a violation already.
+    static bool isChecking();
+
+    /// The number of violations recorded so far in this process, including those the log had no room for.
+    static juce::int64 getNumViolations(Kind kind, Origin origin);
+
+    RealtimeSafetyChecker();
+    ~RealtimeSafetyChecker();
+
+private:
+    class Reporter;
+    std::unique_ptr<Reporter> reporter;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RealtimeSafetyChecker)
+#else
+    struct ScopedCheck { ScopedCheck() {} };
+    struct ScopedHostedPlugin { ScopedHostedPlugin() {} };
+
+    static void record(Kind, const char*, juce::int64) {}
+    static bool isChecking() { return false; }
+    static juce::int64 getNumViolations(Kind, Origin) { return 0; }
+#endif
+};
+
+/**
+ * @brief Locks a critical section like `juce::ScopedLock`. The time a rendering thread spends waiting for it is recorded
+ *        in `AudioThreadStalls`, and reported as a violation in checked builds.
+ */
+class CheckedScopedLock
+{
+public:
+    CheckedScopedLock(const juce::CriticalSection& lockToUse, const char* name)
+    : lock(lockToUse)
+    {
+        // Only a contended lock is timed, so an uncontended one costs a single `tryEnter`
+        if (AudioThreadStalls::isMeasuring() || RealtimeSafetyChecker::isChecking())
+        {
+            if (lock.tryEnter()) { return; }
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            lock.enter();
+            const auto waitMicroseconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1.0e6;
+            AudioThreadStalls::recordWait(waitMicroseconds);
+
+            if (RealtimeSafetyChecker::isChecking())
+            {
+                RealtimeSafetyChecker::record(RealtimeSafetyChecker::Kind::lockWait, name, (juce::int64) waitMicroseconds);
+            }
+
+            return;
+        }
+
+        juce::ignoreUnused(name);
+        lock.enter();
+    }
+
+    ~CheckedScopedLock()
+    {
+        lock.exit();
+    }
+
+private:
+    const juce::CriticalSection& lock;
+
+    JUCE_DECLARE_NON_COPYABLE (CheckedScopedLock)
+};
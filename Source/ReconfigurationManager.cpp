@@ -0,0 +1,100 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "ReconfigurationManager.h"
+
+//==============================================================================
+
+bool ReconfigurationManager::Configuration::operator== (const Configuration& other) const
+{
+    return sampleRate == other.sampleRate && blockSize == other.blockSize && layout == other.layout
+        && isNonRealtime == other.isNonRealtime;
+}
+
+bool ReconfigurationManager::needsPrepare(const Configuration& configuration) const
+{
+    return !preparedConfiguration.has_value() || *preparedConfiguration != configuration;
+}
+
+void ReconfigurationManager::prepareStarted()
+{
+    prepareStartMs = juce::Time::getMillisecondCounterHiRes();
+    ++prepareGeneration;
+}
+
+void ReconfigurationManager::prepared(const Configuration& configuration, double prepareMs)
+{
+    preparedConfiguration = configuration;
+    lastPrepareMs = prepareMs;
+    ++numPrepares;
+}
+
+void ReconfigurationManager::prepareSkipped()
+{
+    ++numSkippedPrepares;
+}
+
+void ReconfigurationManager::invalidate()
+{
+    preparedConfiguration.reset();
+}
+
+//==============================================================================
+
+void ReconfigurationManager::blockProcessed(bool isPlaying, bool isAudible)
+{
+    if (!isPlaying)
+    {
+        wasPlaying = false;
+        awaitingAudibleBlock = false;
+        prepareGenerationWhenStopped = prepareGeneration.load(std::memory_order_relaxed);
+        return;
+    }
+    
+    const auto nowMs = juce::Time::getMillisecondCounterHiRes();
+    
+    if (!wasPlaying)
+    {
+        wasPlaying = true;
+        awaitingAudibleBlock = true;
+        
+        // A prepare since the last stopped block delayed this playback, so it's included
+        const auto wasPreparedForPlayback = prepareGeneration.load(std::memory_order_relaxed) != prepareGenerationWhenStopped;
+        playbackStartMs = wasPreparedForPlayback ? prepareStartMs.load(std::memory_order_relaxed) : nowMs;
+    }
+    
+    if (!awaitingAudibleBlock || !isAudible) { return; }
+    
+    awaitingAudibleBlock = false;
+    lastPlaybackStartMs.store(nowMs - playbackStartMs, std::memory_order_relaxed);
+    hasUnreadPlaybackStart.store(true, std::memory_order_release);
+}
+
+ReconfigurationManager::Statistics ReconfigurationManager::getStatistics() const
+{
+    Statistics statistics;
+    statistics.numPrepares = numPrepares.load();
+    statistics.numSkippedPrepares = numSkippedPrepares.load();
+    statistics.lastPrepareMs = lastPrepareMs.load();
+    statistics.lastPlaybackStartMs = lastPlaybackStartMs.load();
+    return statistics;
+}
+
+bool ReconfigurationManager::readPlaybackStart(double& ms)
+{
+    if (!hasUnreadPlaybackStart.exchange(false, std::memory_order_acquire)) { return false; }
+    
+    ms = lastPlaybackStartMs.load(std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,103 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief Decides whether the hosted plugin has to be prepared again, and measures how long playback takes to start.
+ *
+ * Hosts (e.g. Logic) prepare and release their plugins much more often than the configuration actually changes,
+ * and heavy plugins reallocate their voices or reload their samples on every prepare. The configuration the hosted plugin
+ * was last prepared with is kept, so that preparing it again with the same configuration can be skipped.
+ *
+ * The time to the first audible block is measured from the start of playback, or from the last prepare if the host
+ * didn't process any stopped block in between (i.e. if pressing play made the host prepare the plugin).
+ *
+ * `blockProcessed` and `needsAudibilityCheck` are called on the rendering thread and never block or allocate.
+ * Everything else is called on the message thread, or while the host isn't processing.
+ */
+class ReconfigurationManager
+{
+public:
+    struct Configuration
+    {
+        double sampleRate = 0.0;
+        int blockSize = 0;
+        juce::AudioProcessor::BusesLayout layout;
+        /// Plugins only switch to (or from) their offline rendering quality when they're prepared.
+        bool isNonRealtime = false;
+        
+        bool operator== (const Configuration& other) const;
+        bool operator!= (const Configuration& other) const { return !(*this == other); }
+    };
+    
+    /// Returns `true` unless the hosted plugin is already prepared with exactly this configuration.
+    bool needsPrepare(const Configuration& configuration) const;
+    
+    /// Returns `true` if the hosted plugin has been prepared, and has to be released before it's prepared again.
+    bool isPrepared() const { return preparedConfiguration.has_value(); }
+    
+    /// Called when the host prepares the wrapper, whether the hosted plugin is prepared again or not.
+    void prepareStarted();
+    
+    /// Records the configuration the hosted plugin has just been prepared with, and how long that took.
+    void prepared(const Configuration& configuration, double prepareMs);
+    
+    /// Records a prepare which left the hosted plugin as it was.
+    void prepareSkipped();
+    
+    /// Forgets the configuration, so that the next prepare is applied. Call this when the hosted plugin is replaced.
+    void invalidate();
+    
+    /// Whether `blockProcessed` needs to know if the block is audible, so that the check can be skipped otherwise.
+    bool needsAudibilityCheck(bool isPlaying) const { return isPlaying && (!wasPlaying || awaitingAudibleBlock); }
+    
+    void blockProcessed(bool isPlaying, bool isAudible);
+    
+    struct Statistics
+    {
+        int numPrepares = 0;
+        int numSkippedPrepares = 0;
+        /// How long the hosted plugin took to prepare the last time
+        double lastPrepareMs = 0.0;
+        /// The time from the start of the last playback to its first audible block, or 0 if it hasn't been measured yet
+        double lastPlaybackStartMs = 0.0;
+    };
+    
+    Statistics getStatistics() const;
+    
+    /// Returns `true` and sets `ms` if a playback start has been measured since the last call. Call this on a single (e.g. message) thread.
+    bool readPlaybackStart(double& ms);
+    
+private:
+    std::optional<Configuration> preparedConfiguration;
+    
+    std::atomic<int> numPrepares { 0 };
+    std::atomic<int> numSkippedPrepares { 0 };
+    std::atomic<double> lastPrepareMs { 0.0 };
+    std::atomic<double> lastPlaybackStartMs { 0.0 };
+    std::atomic<bool> hasUnreadPlaybackStart { false };
+    
+    // Counts the host's prepares, so that the rendering thread can tell whether one happened since the last stopped block
+    std::atomic<int> prepareGeneration { 0 };
+    std::atomic<double> prepareStartMs { 0.0 };
+    
+    // Rendering thread state
+    bool wasPlaying = false;
+    bool awaitingAudibleBlock = false;
+    int prepareGenerationWhenStopped = 0;
+    double playbackStartMs = 0.0;
+};
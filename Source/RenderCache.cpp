@@ -0,0 +1,592 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "RenderCache.h"
+
+//==============================================================================
+
+RenderCache::RenderCache()
+    : juce::Thread("VST3 Render Cache"), directory(getDefaultDirectory())
+{
+}
+
+RenderCache::~RenderCache()
+{
+    stopTimer();
+    stopBackgroundThread();
+}
+
+void RenderCache::setEnabled(bool shouldBeEnabled)
+{
+    if (enabled.exchange(shouldBeEnabled) == shouldBeEnabled) { return; }
+    
+    if (shouldBeEnabled)
+    {
+        invalidateStateKey();
+        startTimer(stateKeyRefreshIntervalMs);
+    }
+    else
+    {
+        stopTimer();
+    }
+}
+
+void RenderCache::prepare(double sampleRate, int maximumBlockSize, int newNumChannels)
+{
+    // The background thread is stopped, so that it doesn't touch the chunks while they are reallocated.
+    // Recorded chunks it hasn't written yet are written here instead.
+    stopBackgroundThread();
+    finishRecording();
+    
+    for (auto& chunk : chunks)
+    {
+        if (chunk.state == ChunkState::writing)
+        {
+            writeChunk(chunk);
+        }
+        
+        chunk.state = ChunkState::free;
+    }
+    
+    runKey = 0;
+    chainKey = 0;
+    blockIndex = -1;
+    readChunk = nullptr;
+    loadFifo.reset();
+    
+    const auto shouldAllocate = enabled && newNumChannels > 0 && maximumBlockSize > 0;
+    numChannels = shouldAllocate ? newNumChannels : 0;
+    chunkCapacity = shouldAllocate ? blocksPerChunk * maximumBlockSize : 0;
+    
+    for (auto& chunk : chunks)
+    {
+        chunk.audio.setSize(numChannels, chunkCapacity);
+    }
+    
+    // Audio recorded at another sample rate or channel count never matches
+    BlockHash configuration;
+    configuration.add(sampleRate);
+    configuration.add(numChannels);
+    configurationKey = configuration.get();
+    
+    if (shouldAllocate)
+    {
+        startThread(juce::Thread::Priority::background);
+    }
+}
+
+void RenderCache::stopBackgroundThread()
+{
+    signalThreadShouldExit();
+    workAvailable.signal();
+    stopThread(4000);
+}
+
+void RenderCache::invalidateStateKey()
+{
+    // Set in this order, so that `timerCallback` never leaves a key computed before the change
+    isStateKeyStale = true;
+    stateKey = 0;
+}
+
+void RenderCache::timerCallback()
+{
+    if (!isStateKeyStale.exchange(false) || computeStateKey == nullptr) { return; }
+    
+    const auto newKey = computeStateKey();
+    stateKey = newKey != 0 ? newKey : 1;
+    
+    // The state has changed again while it was being hashed, so the next tick hashes it again
+    if (isStateKeyStale)
+    {
+        stateKey = 0;
+    }
+}
+
+RenderCache::Statistics RenderCache::getStatistics() const
+{
+    Statistics statistics;
+    statistics.hits = hits;
+    statistics.misses = misses;
+    statistics.cpuSavedMs = (double) cpuSavedMicroseconds / 1000.0;
+    return statistics;
+}
+
+void RenderCache::clearAll()
+{
+    getDefaultDirectory().deleteRecursively();
+}
+
+juce::File RenderCache::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("Application Support/AU-VST3-Wrapper/RenderCache");
+}
+
+//==============================================================================
+// Rendering thread
+//==============================================================================
+
+bool RenderCache::read(juce::uint64 blockHash, bool startsRun, juce::AudioBuffer<float>& buffer)
+{
+    BlockHash chain;
+    
+    if (startsRun || blockIndex < 0)
+    {
+        chain.add(configurationKey);
+        chain.add(blockHash);
+        startRun(chain.get());
+    }
+    else
+    {
+        chain.add(chainKey);
+        chain.add(blockHash);
+        
+        if (++blockIndex % blocksPerChunk == 0)
+        {
+            advanceToChunk(blockIndex / blocksPerChunk);
+        }
+    }
+    
+    // A zero key marks a hole in a chunk
+    chainKey = chain.get() != 0 ? chain.get() : 1;
+    
+    const auto blockInChunk = blockIndex % blocksPerChunk;
+    const auto numSamples = buffer.getNumSamples();
+    
+    // The chunk may have been loaded since the run reached it
+    if (readChunk == nullptr)
+    {
+        readChunk = findChunk(runKey, blockIndex / blocksPerChunk);
+    }
+    
+    if (readChunk != nullptr && blockInChunk < readChunk->numBlocks
+        && readChunk->keys[(size_t) blockInChunk] == chainKey && readChunk->lengths[(size_t) blockInChunk] == numSamples)
+    {
+        const auto offset = readChunk->offsets[(size_t) blockInChunk];
+        
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            if (channel < numChannels)
+                buffer.copyFrom(channel, 0, readChunk->audio, channel, offset, numSamples);
+            else
+                buffer.clear(channel, 0, numSamples);
+        }
+        
+        const auto savedMicroseconds = (juce::int64) (readChunk->renderMs[(size_t) blockInChunk] * 1000.0f);
+        hits.fetch_add(1, std::memory_order_relaxed);
+        runHits.fetch_add(1, std::memory_order_relaxed);
+        cpuSavedMicroseconds.fetch_add(savedMicroseconds, std::memory_order_relaxed);
+        runCpuSavedMicroseconds.fetch_add(savedMicroseconds, std::memory_order_relaxed);
+        return true;
+    }
+    
+    misses.fetch_add(1, std::memory_order_relaxed);
+    runMisses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void RenderCache::write(const juce::AudioBuffer<float>& buffer, double renderMs)
+{
+    if (blockIndex < 0) { return; }
+    
+    const auto index = blockIndex / blocksPerChunk;
+    const auto blockInChunk = blockIndex % blocksPerChunk;
+    
+    if (recordingChunk == nullptr)
+    {
+        for (auto& chunk : chunks)
+        {
+            auto expected = ChunkState::free;
+            
+            if (chunk.state.compare_exchange_strong(expected, ChunkState::recording))
+            {
+                recordingChunk = &chunk;
+                break;
+            }
+        }
+        
+        // Every chunk is in use, so the block stays uncached
+        if (recordingChunk == nullptr) { return; }
+        
+        recordingChunk->runKey = runKey;
+        recordingChunk->index = index;
+        recordingChunk->numBlocks = 0;
+        recordingChunk->numSamples = 0;
+        recordedBlocks = 0;
+    }
+    
+    fillRecordingChunkUpTo(blockInChunk);
+    
+    auto& chunk = *recordingChunk;
+    const auto numSamples = buffer.getNumSamples();
+    
+    // A block longer than the prepared maximum is left as a hole
+    if (chunk.numSamples + numSamples > chunkCapacity) { return; }
+    
+    for (int channel = 0; channel < juce::jmin(numChannels, buffer.getNumChannels()); ++channel)
+    {
+        chunk.audio.copyFrom(channel, chunk.numSamples, buffer, channel, 0, numSamples);
+    }
+    
+    chunk.keys[(size_t) blockInChunk] = chainKey;
+    chunk.offsets[(size_t) blockInChunk] = chunk.numSamples;
+    chunk.lengths[(size_t) blockInChunk] = numSamples;
+    chunk.renderMs[(size_t) blockInChunk] = (float) renderMs;
+    chunk.numSamples += numSamples;
+    chunk.numBlocks = blockInChunk + 1;
+    ++recordedBlocks;
+}
+
+void RenderCache::endRun()
+{
+    if (blockIndex < 0) { return; }
+    
+    finishRecording();
+    blockIndex = -1;
+    readChunk = nullptr;
+    
+    shouldReportRun = true;
+    workAvailable.signal();
+}
+
+RenderCache::Chunk* RenderCache::findChunk(juce::uint64 chunkRunKey, int chunkIndex)
+{
+    for (auto& chunk : chunks)
+    {
+        const auto state = chunk.state.load();
+        
+        // A chunk being written is complete, and stays readable while it's written
+        if ((state == ChunkState::ready || state == ChunkState::writing) && chunk.runKey == chunkRunKey && chunk.index == chunkIndex)
+        {
+            return &chunk;
+        }
+    }
+    
+    return nullptr;
+}
+
+void RenderCache::startRun(juce::uint64 newRunKey)
+{
+    endRun();
+    
+    runKey = newRunKey;
+    blockIndex = 0;
+    advanceToChunk(0);
+}
+
+void RenderCache::advanceToChunk(int index)
+{
+    // The recording is finished first, as it may still copy blocks from the chunk the run is leaving
+    finishRecording();
+    releaseChunksOutside(index, index + readAheadChunks);
+    readChunk = findChunk(runKey, index);
+    
+    for (int i = index; i <= index + readAheadChunks; ++i)
+    {
+        if (findChunk(runKey, i) == nullptr)
+        {
+            requestLoad(i);
+        }
+    }
+    
+    workAvailable.signal();
+}
+
+void RenderCache::requestLoad(int index)
+{
+    // Requests the background thread hasn't picked up yet are simply dropped, and requested again at the next chunk
+    if (loadFifo.getFreeSpace() < 1) { return; }
+    
+    int start1, size1, start2, size2;
+    loadFifo.prepareToWrite(1, start1, size1, start2, size2);
+    loadRequests[(size_t) start1] = { runKey, index };
+    loadFifo.finishedWrite(1);
+}
+
+void RenderCache::releaseChunksOutside(int firstIndex, int lastIndex)
+{
+    for (auto& chunk : chunks)
+    {
+        if (chunk.state != ChunkState::ready) { continue; }
+        
+        if (chunk.runKey == runKey && chunk.index >= firstIndex && chunk.index <= lastIndex) { continue; }
+        
+        // Only this thread releases ready chunks, so the chunk is still ready here
+        chunk.state = ChunkState::free;
+        
+        if (&chunk == readChunk)
+        {
+            readChunk = nullptr;
+        }
+    }
+}
+
+void RenderCache::fillRecordingChunkUpTo(int blockInChunk)
+{
+    auto& chunk = *recordingChunk;
+    
+    // Blocks served from the cache since the recording started are copied from the chunk they were read from
+    const auto* source = readChunk != nullptr && readChunk->runKey == chunk.runKey && readChunk->index == chunk.index ? readChunk : nullptr;
+    
+    for (auto block = chunk.numBlocks; block < blockInChunk; ++block)
+    {
+        const auto length = source != nullptr && block < source->numBlocks ? source->lengths[(size_t) block] : 0;
+        
+        chunk.offsets[(size_t) block] = chunk.numSamples;
+        
+        if (length > 0 && source->keys[(size_t) block] != 0 && chunk.numSamples + length <= chunkCapacity)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                chunk.audio.copyFrom(channel, chunk.numSamples, source->audio, channel, source->offsets[(size_t) block], length);
+            }
+            
+            chunk.keys[(size_t) block] = source->keys[(size_t) block];
+            chunk.lengths[(size_t) block] = length;
+            chunk.renderMs[(size_t) block] = source->renderMs[(size_t) block];
+            chunk.numSamples += length;
+        }
+        else
+        {
+            chunk.keys[(size_t) block] = 0;
+            chunk.lengths[(size_t) block] = 0;
+            chunk.renderMs[(size_t) block] = 0.0f;
+        }
+    }
+    
+    chunk.numBlocks = juce::jmax(chunk.numBlocks, blockInChunk);
+}
+
+void RenderCache::finishRecording()
+{
+    if (recordingChunk == nullptr) { return; }
+    
+    // Whatever was cached after the last recorded block is kept, and the recorded chunk then replaces the cached one
+    if (readChunk != nullptr && readChunk->runKey == recordingChunk->runKey && readChunk->index == recordingChunk->index)
+    {
+        fillRecordingChunkUpTo(readChunk->numBlocks);
+        
+        if (recordedBlocks > 0 && readChunk->state == ChunkState::ready)
+        {
+            readChunk->state = ChunkState::free;
+            readChunk = nullptr;
+        }
+    }
+    
+    recordingChunk->state = recordedBlocks > 0 ? ChunkState::writing : ChunkState::free;
+    recordingChunk = nullptr;
+    recordedBlocks = 0;
+    workAvailable.signal();
+}
+
+//==============================================================================
+// Background thread
+//==============================================================================
+
+void RenderCache::run()
+{
+    if (directoryBytes < 0)
+    {
+        directoryBytes = 0;
+        
+        for (const auto& entry : juce::RangedDirectoryIterator(directory, true, "*.chunk", juce::File::findFiles))
+        {
+            directoryBytes += entry.getFileSize();
+        }
+    }
+    
+    while (!threadShouldExit())
+    {
+        workAvailable.wait(-1);
+        
+        // Loads go first, as the rendering thread is about to need them
+        while (loadFifo.getNumReady() > 0 && !threadShouldExit())
+        {
+            int start1, size1, start2, size2;
+            loadFifo.prepareToRead(1, start1, size1, start2, size2);
+            const auto request = loadRequests[(size_t) start1];
+            loadFifo.finishedRead(1);
+            
+            loadChunk(request);
+        }
+        
+        for (auto& chunk : chunks)
+        {
+            if (chunk.state != ChunkState::writing) { continue; }
+            
+            writeChunk(chunk);
+            // The chunk stays in memory, in case the run is played again right away (e.g. in a cycle)
+            chunk.state = ChunkState::ready;
+        }
+        
+        if (shouldReportRun.exchange(false))
+        {
+            reportRun();
+        }
+    }
+}
+
+void RenderCache::loadChunk(const LoadRequest& request)
+{
+    for (auto& chunk : chunks)
+    {
+        const auto state = chunk.state.load();
+        
+        if ((state == ChunkState::ready || state == ChunkState::writing) && chunk.runKey == request.runKey && chunk.index == request.index)
+        {
+            return;
+        }
+    }
+    
+    const auto file = getChunkFile(request.runKey, request.index);
+    
+    if (!file.existsAsFile()) { return; }
+    
+    Chunk* target = nullptr;
+    
+    for (auto& chunk : chunks)
+    {
+        auto expected = ChunkState::free;
+        
+        if (chunk.state.compare_exchange_strong(expected, ChunkState::loading))
+        {
+            target = &chunk;
+            break;
+        }
+    }
+    
+    if (target == nullptr) { return; }
+    
+    juce::FileInputStream stream (file);
+    auto isValid = stream.openedOk()
+        && stream.readInt() == chunkFileMagic
+        && stream.readInt() == chunkFileVersion
+        && stream.readInt() == numChannels;
+    
+    const auto numBlocks = isValid ? stream.readInt() : 0;
+    isValid = isValid && juce::isPositiveAndNotGreaterThan(numBlocks, blocksPerChunk);
+    auto numSamples = 0;
+    
+    for (int block = 0; isValid && block < numBlocks; ++block)
+    {
+        target->keys[(size_t) block] = (juce::uint64) stream.readInt64();
+        target->lengths[(size_t) block] = stream.readInt();
+        target->renderMs[(size_t) block] = stream.readFloat();
+        target->offsets[(size_t) block] = numSamples;
+        
+        isValid = target->lengths[(size_t) block] >= 0 && numSamples + target->lengths[(size_t) block] <= chunkCapacity;
+        numSamples += target->lengths[(size_t) block];
+    }
+    
+    const auto channelBytes = (juce::int64) numSamples * (juce::int64) sizeof(float);
+    
+    for (int channel = 0; isValid && channel < numChannels; ++channel)
+    {
+        isValid = stream.read(target->audio.getWritePointer(channel), (int) channelBytes) == channelBytes;
+    }
+    
+    if (!isValid)
+    {
+        juce::Logger::writeToLog("AU-VST3-Wrapper render_cache: error=invalid_chunk path=" + file.getFullPathName());
+        target->state = ChunkState::free;
+        return;
+    }
+    
+    target->runKey = request.runKey;
+    target->index = request.index;
+    target->numBlocks = numBlocks;
+    target->numSamples = numSamples;
+    target->state = ChunkState::ready;
+}
+
+void RenderCache::writeChunk(const Chunk& chunk)
+{
+    if (directoryBytes >= maxDirectoryBytes)
+    {
+        if (!hasReportedFullDirectory)
+        {
+            juce::Logger::writeToLog("AU-VST3-Wrapper render_cache: error=directory_full bytes=" + juce::String(directoryBytes));
+            hasReportedFullDirectory = true;
+        }
+        
+        return;
+    }
+    
+    const auto file = getChunkFile(chunk.runKey, chunk.index);
+    
+    if (!file.getParentDirectory().createDirectory()) { return; }
+    
+    // Written next to the chunk and renamed, so that another instance never loads a half-written chunk
+    juce::TemporaryFile temporaryFile (file);
+    
+    {
+        juce::FileOutputStream stream (temporaryFile.getFile());
+        
+        if (!stream.openedOk()) { return; }
+        
+        // The samples are stored in the native byte order, one channel after another
+        stream.writeInt(chunkFileMagic);
+        stream.writeInt(chunkFileVersion);
+        stream.writeInt(numChannels);
+        stream.writeInt(chunk.numBlocks);
+        
+        for (int block = 0; block < chunk.numBlocks; ++block)
+        {
+            stream.writeInt64((juce::int64) chunk.keys[(size_t) block]);
+            stream.writeInt(chunk.lengths[(size_t) block]);
+            stream.writeFloat(chunk.renderMs[(size_t) block]);
+        }
+        
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            stream.write(chunk.audio.getReadPointer(channel), (size_t) chunk.numSamples * sizeof(float));
+        }
+        
+        stream.flush();
+        
+        if (stream.getStatus().failed()) { return; }
+    }
+    
+    const auto previousBytes = file.getSize();
+    
+    if (!temporaryFile.overwriteTargetFileWithTemporary())
+    {
+        juce::Logger::writeToLog("AU-VST3-Wrapper render_cache: error=write_failed path=" + file.getFullPathName());
+        return;
+    }
+    
+    directoryBytes += file.getSize() - previousBytes;
+}
+
+void RenderCache::reportRun()
+{
+    const auto runHitCount = runHits.exchange(0);
+    const auto runMissCount = runMisses.exchange(0);
+    const auto runSavedMicroseconds = runCpuSavedMicroseconds.exchange(0);
+    const auto numBlocks = runHitCount + runMissCount;
+    
+    if (numBlocks == 0) { return; }
+    
+    juce::Logger::writeToLog("AU-VST3-Wrapper render_cache: blocks=" + juce::String(numBlocks)
+                             + " hits=" + juce::String(runHitCount)
+                             + " hit_rate=" + juce::String(100.0 * (double) runHitCount / (double) numBlocks, 1)
+                             + " cpu_saved_ms=" + juce::String((double) runSavedMicroseconds / 1000.0, 1));
+}
+
+juce::File RenderCache::getChunkFile(juce::uint64 chunkRunKey, int chunkIndex) const
+{
+    return directory.getChildFile(juce::String::toHexString((juce::int64) chunkRunKey).paddedLeft('0', 16))
+        .getChildFile(juce::String(chunkIndex) + ".chunk");
+}
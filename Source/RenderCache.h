@@ -0,0 +1,221 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief An opt-in cache of the hosted instrument's output during playback, like a freeze that follows edits.
+ *
+ * Every block is keyed by a hash of everything the output depends on (MIDI, position, parameter values, sidechain input
+ * and the hosted plugin's state), chained to the keys of all the blocks played before it since the transport started or jumped.
+ * A chain of blocks played from the same position is a run. Runs are stored on disk in chunks of `blocksPerChunk` blocks,
+ * which a background thread loads ahead of the play position and writes after they are recorded.
+ * When a block's key matches the cached one, its audio is copied from the chunk and the hosted plugin isn't called at all.
+ *
+ * The chain makes a hit mean that the whole run so far is the same as when it was recorded, so a hosted plugin
+ * which is deterministic renders exactly the cached audio. Once a run diverges (e.g. a note is edited), every following block misses.
+ *
+ * `read`, `write` and `endRun` are called on the rendering thread and never block or allocate.
+ * `prepare` must be called while the rendering thread isn't processing. Everything else can be called on any thread.
+ */
+class RenderCache : private juce::Thread, private juce::Timer
+{
+public:
+    /// Called on the message thread to hash the hosted plugin's current state (see `invalidateStateKey`).
+    std::function<juce::uint64()> computeStateKey;
+
+    RenderCache();
+    ~RenderCache() override;
+
+    /// The background thread only runs while the cache is enabled. Takes effect in `prepare`.
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const { return enabled; }
+
+    /// Allocates the chunks when the cache is enabled, releases them otherwise. Ends the current run.
+    void prepare(double sampleRate, int maximumBlockSize, int numChannels);
+
+    /// Returns `true` if the cache has been prepared while enabled, so the rendering thread can use it.
+    bool isActive() const { return numChannels > 0; }
+
+    /**
+     * @brief Marks the state key as unknown until `computeStateKey` is called again, shortly after.
+     *        Nothing is read or recorded meanwhile, so blocks rendered with a changed state are never cached under the old one.
+     */
+    void invalidateStateKey();
+
+    /// Returns the hash of the hosted plugin's state, or 0 while it isn't known.
+    juce::uint64 getStateKey() const { return stateKey; }
+
+    /// A fast non-cryptographic (FNV-1a) hash of everything a block's output depends on.
+    class BlockHash
+    {
+    public:
+        void add(const void* data, size_t numBytes)
+        {
+            const auto* bytes = static_cast<const juce::uint8*>(data);
+
+            for (size_t i = 0; i < numBytes; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= fnvPrime;
+            }
+        }
+
+        template <typename T>
+        void add(T value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            add(&value, sizeof(T));
+        }
+
+        juce::uint64 get() const { return hash; }
+
+    private:
+        static constexpr juce::uint64 fnvPrime = 1099511628211ULL;
+        juce::uint64 hash = 14695981039346656037ULL;
+    };
+
+    /**
+     * @brief Looks up the block in the current run, or in a new run if `startsRun` is `true`.
+     *        Returns `true` and replaces the buffer's content with the cached audio on a hit.
+     *        On a miss, the rendered block should be passed to `write`.
+     */
+    bool read(juce::uint64 blockHash, bool startsRun, juce::AudioBuffer<float>& buffer);
+
+    /// Records the block which has just missed, along with the time the hosted plugin took to render it.
+    void write(const juce::AudioBuffer<float>& buffer, double renderMs);
+
+    /// Ends the current run, e.g. when the transport stops, and queues its recorded chunk for writing.
+    void endRun();
+
+    struct Statistics
+    {
+        juce::int64 hits = 0;
+        juce::int64 misses = 0;
+        /// The hosted plugin's render time of the cached blocks when they were recorded
+        double cpuSavedMs = 0.0;
+
+        double getHitRate() const { return hits + misses > 0 ? (double) hits / (double) (hits + misses) : 0.0; }
+    };
+
+    /// Returns the statistics since the wrapper was created.
+    Statistics getStatistics() const;
+
+    /// Deletes every cached run from disk, for all wrapper instances.
+    static void clearAll();
+
+    /// The folder in the user's application data folder
+    static juce::File getDefaultDirectory();
+
+    static constexpr int blocksPerChunk = 64;
+    static constexpr int numChunks = 8;
+    static constexpr int readAheadChunks = 3;
+    /// Recording stops once this instance has filled the folder up to this size
+    static constexpr juce::int64 maxDirectoryBytes = (juce::int64) 4 << 30;
+
+private:
+    enum class ChunkState
+    {
+        free = 0,
+        loading,
+        ready,
+        recording,
+        writing
+    };
+
+    struct Chunk
+    {
+        // Only `free` chunks are taken, by the rendering thread (to record) or the background thread (to load)
+        std::atomic<ChunkState> state { ChunkState::free };
+        // Atomic only because the background thread may still look at a chunk the rendering thread has just taken
+        std::atomic<juce::uint64> runKey { 0 };
+        std::atomic<int> index { 0 };
+        int numBlocks = 0;
+        int numSamples = 0;
+        // A block with a zero key is a hole, which was neither rendered nor read while the chunk was recorded
+        std::array<juce::uint64, blocksPerChunk> keys {};
+        std::array<int, blocksPerChunk> offsets {};
+        std::array<int, blocksPerChunk> lengths {};
+        std::array<float, blocksPerChunk> renderMs {};
+        juce::AudioBuffer<float> audio;
+    };
+
+    struct LoadRequest
+    {
+        juce::uint64 runKey = 0;
+        int index = 0;
+    };
+
+    void run() override;
+    void timerCallback() override;
+    void stopBackgroundThread();
+
+    // Rendering thread
+    Chunk* findChunk(juce::uint64 chunkRunKey, int chunkIndex);
+    void startRun(juce::uint64 newRunKey);
+    void advanceToChunk(int index);
+    void requestLoad(int index);
+    void releaseChunksOutside(int firstIndex, int lastIndex);
+    void fillRecordingChunkUpTo(int blockInChunk);
+    void finishRecording();
+
+    // Background thread
+    void loadChunk(const LoadRequest& request);
+    void writeChunk(const Chunk& chunk);
+    void reportRun();
+    juce::File getChunkFile(juce::uint64 chunkRunKey, int chunkIndex) const;
+
+    static constexpr int chunkFileMagic = 0x43523356; // "V3RC"
+    static constexpr int chunkFileVersion = 1;
+    static constexpr int stateKeyRefreshIntervalMs = 300;
+
+    const juce::File directory;
+    std::atomic<bool> enabled { false };
+    std::atomic<juce::uint64> stateKey { 0 };
+    std::atomic<bool> isStateKeyStale { false };
+
+    // Set in `prepare`
+    int numChannels = 0;
+    int chunkCapacity = 0;
+    juce::uint64 configurationKey = 0;
+    std::array<Chunk, numChunks> chunks;
+
+    // Rendering thread state
+    juce::uint64 runKey = 0;
+    juce::uint64 chainKey = 0;
+    int blockIndex = -1;
+    Chunk* readChunk = nullptr;
+    Chunk* recordingChunk = nullptr;
+    // The number of blocks passed to `write` since the recording chunk was taken
+    int recordedBlocks = 0;
+
+    // Rendering thread -> background thread
+    juce::AbstractFifo loadFifo { 32 };
+    std::array<LoadRequest, 32> loadRequests;
+    juce::WaitableEvent workAvailable;
+    std::atomic<bool> shouldReportRun { false };
+
+    // Owned by the background thread
+    juce::int64 directoryBytes = -1;
+    bool hasReportedFullDirectory = false;
+
+    std::atomic<juce::int64> hits { 0 };
+    std::atomic<juce::int64> misses { 0 };
+    std::atomic<juce::int64> cpuSavedMicroseconds { 0 };
+    std::atomic<juce::int64> runHits { 0 };
+    std::atomic<juce::int64> runMisses { 0 };
+    std::atomic<juce::int64> runCpuSavedMicroseconds { 0 };
+};
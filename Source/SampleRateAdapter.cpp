@@ -0,0 +1,371 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "SampleRateAdapter.h"
+
+//==============================================================================
+
+void StreamingResampler::prepare(int newNumChannels, double inputRate, double outputRate, Quality quality, int maximumInputBlockSize)
+{
+    numChannels = newNumChannels;
+    step = inputRate / outputRate;
+    radius = quality == Quality::low ? 1 : (quality == Quality::medium ? 8 : 32);
+    numTaps = 2 * radius;
+    
+    // Below the lower of the two Nyquist frequencies (relative to the input's), leaving room for the transition band
+    const auto cutoff = juce::jmin(1.0, outputRate / inputRate) * 0.92;
+    
+    kernel.assign((size_t) ((numPhases + 1) * numTaps), 0.0f);
+    weights.assign((size_t) numTaps, 0.0f);
+    
+    for (int phase = 0; phase <= numPhases; ++phase)
+    {
+        auto* row = kernel.data() + phase * numTaps;
+        const auto fraction = (double) phase / (double) numPhases;
+        auto sum = 0.0;
+        
+        for (int tap = 0; tap < numTaps; ++tap)
+        {
+            const auto x = (double) (tap - radius + 1) - fraction;
+            auto weight = 0.0;
+            
+            if (quality == Quality::low)
+            {
+                weight = juce::jmax(0.0, 1.0 - std::abs(x));
+            }
+            else
+            {
+                const auto u = x / (double) radius;
+                const auto window = std::abs(u) < 1.0 ? 0.42 + 0.5 * std::cos(juce::MathConstants<double>::pi * u)
+                                                           + 0.08 * std::cos(juce::MathConstants<double>::twoPi * u) : 0.0;
+                const auto y = juce::MathConstants<double>::pi * cutoff * x;
+                weight = cutoff * (y == 0.0 ? 1.0 : std::sin(y) / y) * window;
+            }
+            
+            row[tap] = (float) weight;
+            sum += weight;
+        }
+        
+        // Every phase passes DC at unity gain
+        for (int tap = 0; tap < numTaps && sum != 0.0; ++tap)
+        {
+            row[tap] = (float) (row[tap] / sum);
+        }
+    }
+    
+    history.setSize(numChannels, maximumInputBlockSize + 2 * numTaps + (int) std::ceil(step) + 16);
+    reset();
+}
+
+void StreamingResampler::reset()
+{
+    // The first output sample is at the first pushed sample, after `radius` samples of silence it may need
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        juce::FloatVectorOperations::clear(history.getWritePointer(channel), history.getNumSamples());
+    }
+    
+    numBuffered = radius;
+    position = (double) radius;
+}
+
+void StreamingResampler::push(const juce::AudioBuffer<float>& source, int numSamples)
+{
+    jassert(numBuffered + numSamples <= history.getNumSamples());
+    numSamples = juce::jmin(numSamples, history.getNumSamples() - numBuffered);
+    
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        if (channel < source.getNumChannels())
+            history.copyFrom(channel, numBuffered, source, channel, 0, numSamples);
+        else
+            history.clear(channel, numBuffered, numSamples);
+    }
+    
+    numBuffered += numSamples;
+}
+
+int StreamingResampler::getNumAvailable() const
+{
+    // The last tap of an output sample at `position` is at `floor(position) + radius`
+    const auto end = (double) (numBuffered - radius);
+    
+    if (position >= end) { return 0; }
+    
+    return (int) std::ceil((end - position) / step);
+}
+
+void StreamingResampler::pull(juce::AudioBuffer<float>& destination, int startSample, int numSamples)
+{
+    jassert(numSamples <= getNumAvailable());
+    
+    const auto numDestinationChannels = juce::jmin(numChannels, destination.getNumChannels());
+    
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const auto index = (int) position;
+        computeWeights(position - (double) index);
+        
+        for (int channel = 0; channel < numDestinationChannels; ++channel)
+        {
+            const auto* samples = history.getReadPointer(channel, index - radius + 1);
+            destination.getWritePointer(channel, startSample + i)[0] = dotProduct(samples, weights.data(), numTaps);
+        }
+        
+        position += step;
+    }
+    
+    // The samples no later output needs are dropped, so that the history never grows past one block
+    const auto numDropped = juce::jlimit(0, numBuffered, (int) position - radius + 1);
+    
+    if (numDropped == 0) { return; }
+    
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        auto* samples = history.getWritePointer(channel);
+        std::memmove(samples, samples + numDropped, (size_t) (numBuffered - numDropped) * sizeof(float));
+    }
+    
+    numBuffered -= numDropped;
+    position -= (double) numDropped;
+}
+
+void StreamingResampler::computeWeights(double fraction)
+{
+    const auto phase = fraction * (double) numPhases;
+    const auto row = juce::jmin((int) phase, numPhases - 1);
+    const auto alpha = (float) (phase - (double) row);
+    const auto* lower = kernel.data() + row * numTaps;
+    const auto* upper = lower + numTaps;
+    
+    for (int tap = 0; tap < numTaps; ++tap)
+    {
+        weights[(size_t) tap] = lower[tap] + alpha * (upper[tap] - lower[tap]);
+    }
+}
+
+float StreamingResampler::dotProduct(const float* samples, const float* taps, int numTapsToSum)
+{
+    // Independent accumulators let the compiler vectorize the loop without reordering a single floating point sum
+    float sums[4] = {};
+    int i = 0;
+    
+    for (; i + 4 <= numTapsToSum; i += 4)
+    {
+        sums[0] += samples[i] * taps[i];
+        sums[1] += samples[i + 1] * taps[i + 1];
+        sums[2] += samples[i + 2] * taps[i + 2];
+        sums[3] += samples[i + 3] * taps[i + 3];
+    }
+    
+    for (; i < numTapsToSum; ++i)
+    {
+        sums[0] += samples[i] * taps[i];
+    }
+    
+    return sums[0] + sums[1] + sums[2] + sums[3];
+}
+
+//==============================================================================
+
+void SampleRateAdapter::prepare(double hostRate, double internalRate, int numInputChannels, int numOutputChannels, int maximumHostBlockSize, Quality quality)
+{
+    active = hostRate > 0.0 && internalRate > 0.0 && std::abs(internalRate - hostRate) >= 1.0 && maximumHostBlockSize > 0;
+    hostSampleRate = hostRate;
+    internalSampleRate = active ? internalRate : hostRate;
+    ratio = active ? internalRate / hostRate : 1.0;
+    numInputs = numInputChannels;
+    numOutputs = numOutputChannels;
+    
+    if (!active)
+    {
+        internalBuffer.setSize(0, 0);
+        outputFifo.setSize(0, 0);
+        maximumInternalBlockSize = 0;
+        latencySamples = 0;
+        return;
+    }
+    
+    maximumInternalBlockSize = (int) std::ceil((double) maximumHostBlockSize * ratio) + 2;
+    inputResampler.prepare(numInputs, hostRate, internalRate, quality, maximumHostBlockSize);
+    outputResampler.prepare(numOutputs, internalRate, hostRate, quality, maximumInternalBlockSize);
+    
+    // Both resamplers hold back their kernel radius, and the number of internal samples per block varies by one either way
+    latencySamples = (int) std::ceil((double) inputResampler.getKernelRadius() + (double) outputResampler.getKernelRadius() / ratio) + 2;
+    
+    internalBuffer.setSize(juce::jmax(numInputs, numOutputs), maximumInternalBlockSize);
+    outputFifo.setSize(numOutputs, latencySamples + 2 * maximumHostBlockSize + 16);
+    numOutputFifoSamples = latencySamples;
+    
+    for (int channel = 0; channel < numOutputs; ++channel)
+    {
+        juce::FloatVectorOperations::clear(outputFifo.getWritePointer(channel), numOutputFifoSamples);
+    }
+    
+    for (auto* midiBuffer : { &internalMidi, &pendingMidi, &pendingOutputMidi, &scratchMidi })
+    {
+        midiBuffer->clear();
+        midiBuffer->ensureSize(4096);
+    }
+    
+    hostSamplesProcessed = 0;
+    internalSamplesProduced = 0;
+    resamplingTicks = 0;
+    numBlocks = 0;
+    
+    juce::Logger::writeToLog("AU-VST3-Wrapper resampler: host_rate=" + juce::String(hostRate, 0)
+                             + " internal_rate=" + juce::String(internalRate, 0)
+                             + " quality=" + juce::String((int) quality)
+                             + " latency=" + juce::String(latencySamples));
+}
+
+double SampleRateAdapter::getMicrosecondsPerBlock() const
+{
+    const auto blocks = numBlocks.load();
+    
+    if (blocks == 0) { return 0.0; }
+    
+    return juce::Time::highResolutionTicksToSeconds(resamplingTicks.load()) * 1.0e6 / (double) blocks;
+}
+
+void SampleRateAdapter::resampleInput(const juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    inputResampler.push(buffer, buffer.getNumSamples());
+    numInternalSamples = juce::jmin(inputResampler.getNumAvailable(), maximumInternalBlockSize);
+    
+    // The buffer was allocated at the maximum size, so resizing it never reallocates
+    internalBuffer.setSize(internalBuffer.getNumChannels(), numInternalSamples, false, false, true);
+    internalBuffer.clear();
+    inputResampler.pull(internalBuffer, 0, numInternalSamples);
+    
+    // An event is due at the internal sample matching its host time, which the input resampler's delay
+    // usually puts in a later internal block
+    internalMidi.clear();
+    scratchMidi.clear();
+    
+    const auto addEvent = [this](const juce::MidiMessageMetadata& metadata, juce::int64 internalPosition)
+    {
+        if (internalPosition < numInternalSamples)
+            internalMidi.addEvent(metadata.data, metadata.numBytes, (int) juce::jmax((juce::int64) 0, internalPosition));
+        else
+            scratchMidi.addEvent(metadata.data, metadata.numBytes, (int) (internalPosition - numInternalSamples));
+    };
+    
+    for (const auto metadata : pendingMidi)
+    {
+        addEvent(metadata, metadata.samplePosition);
+    }
+    
+    for (const auto metadata : midiMessages)
+    {
+        const auto internalSample = (juce::int64) std::floor((double) (hostSamplesProcessed + metadata.samplePosition) * ratio);
+        addEvent(metadata, internalSample - internalSamplesProduced);
+    }
+    
+    pendingMidi.swapWith(scratchMidi);
+}
+
+juce::Optional<juce::AudioPlayHead::PositionInfo> SampleRateAdapter::getInternalPosition(const juce::Optional<juce::AudioPlayHead::PositionInfo>& position) const
+{
+    if (!position.hasValue()) { return position; }
+    
+    auto result = *position;
+    const auto isPlaying = position->getIsPlaying();
+    
+    // While playing, the internal block starts as much earlier than the host's block as the input resampler delays it.
+    // The transport is continuous across internal blocks, as the difference between the host's time and the adapter's stays the same.
+    const auto offsetHostSamples = isPlaying ? (double) internalSamplesProduced / ratio - (double) hostSamplesProcessed : 0.0;
+    const auto offsetSeconds = offsetHostSamples / hostSampleRate;
+    
+    if (const auto timeInSamples = result.getTimeInSamples())
+    {
+        const auto hostTime = isPlaying ? (double) (*timeInSamples - hostSamplesProcessed) : (double) *timeInSamples;
+        result.setTimeInSamples((juce::int64) std::floor(hostTime * ratio) + (isPlaying ? internalSamplesProduced : 0));
+    }
+    
+    if (const auto timeInSeconds = result.getTimeInSeconds())
+        result.setTimeInSeconds(*timeInSeconds + offsetSeconds);
+    
+    if (const auto hostTimeNs = result.getHostTimeNs())
+        result.setHostTimeNs((juce::uint64) ((juce::int64) *hostTimeNs + (juce::int64) (offsetSeconds * 1.0e9)));
+    
+    if (const auto ppqPosition = result.getPpqPosition())
+    {
+        if (const auto bpm = result.getBpm())
+            result.setPpqPosition(*ppqPosition + offsetSeconds * *bpm / 60.0);
+    }
+    
+    return result;
+}
+
+void SampleRateAdapter::resampleOutput(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    outputResampler.push(internalBuffer, numInternalSamples);
+    
+    const auto numResampled = juce::jmin(outputResampler.getNumAvailable(), outputFifo.getNumSamples() - numOutputFifoSamples);
+    outputResampler.pull(outputFifo, numOutputFifoSamples, numResampled);
+    numOutputFifoSamples += numResampled;
+    
+    const auto numSamples = buffer.getNumSamples();
+    const auto numReady = juce::jmin(numSamples, numOutputFifoSamples);
+    
+    // The latency covers the fewest internal samples a block can get
+    jassert(numReady == numSamples);
+    
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        if (channel < numOutputs)
+        {
+            buffer.copyFrom(channel, 0, outputFifo, channel, 0, numReady);
+            buffer.clear(channel, numReady, numSamples - numReady);
+        }
+        else
+        {
+            buffer.clear(channel, 0, numSamples);
+        }
+    }
+    
+    for (int channel = 0; channel < numOutputs; ++channel)
+    {
+        auto* samples = outputFifo.getWritePointer(channel);
+        std::memmove(samples, samples + numReady, (size_t) (numOutputFifoSamples - numReady) * sizeof(float));
+    }
+    
+    numOutputFifoSamples -= numReady;
+    
+    // MIDI the hosted plugin has produced is delayed by the latency along with its audio, so it's often due in a later host block
+    midiMessages.clear();
+    scratchMidi.clear();
+    
+    const auto addEvent = [&](const juce::MidiMessageMetadata& metadata, juce::int64 hostPosition)
+    {
+        if (hostPosition < numSamples)
+            midiMessages.addEvent(metadata.data, metadata.numBytes, (int) juce::jmax((juce::int64) 0, hostPosition));
+        else
+            scratchMidi.addEvent(metadata.data, metadata.numBytes, (int) (hostPosition - numSamples));
+    };
+    
+    for (const auto metadata : pendingOutputMidi)
+    {
+        addEvent(metadata, metadata.samplePosition);
+    }
+    
+    for (const auto metadata : internalMidi)
+    {
+        const auto hostSample = (juce::int64) std::floor((double) (internalSamplesProduced + metadata.samplePosition) / ratio) + latencySamples;
+        addEvent(metadata, hostSample - hostSamplesProcessed);
+    }
+    
+    pendingOutputMidi.swapWith(scratchMidi);
+}
@@ -0,0 +1,185 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief A band-limited resampler of a continuous multichannel stream, at a fixed ratio.
+ *
+ * Input is pushed in blocks of any size, and output is pulled as soon as enough input has arrived to produce it.
+ * Output sample `k` is the input signal at input position `k * inputRate / outputRate`, so the signal isn't shifted in time,
+ * but an output sample can only be produced once `getKernelRadius()` input samples past its position have been pushed.
+ *
+ * The kernel is a Blackman-windowed sinc (or a triangle, for `Quality::low`) tabulated at `numPhases` fractional positions,
+ * and the weights of a position are interpolated between the two nearest phases.
+ * `push` and `pull` never allocate.
+ */
+class StreamingResampler
+{
+public:
+    enum class Quality
+    {
+        /// Linear interpolation, without any filtering
+        low = 0,
+        /// A 16-tap windowed sinc
+        medium,
+        /// A 64-tap windowed sinc
+        high
+    };
+
+    /// Allocates the buffers. `maximumInputBlockSize` is the most input pushed between two pulls.
+    void prepare(int numChannels, double inputRate, double outputRate, Quality quality, int maximumInputBlockSize);
+
+    /// Clears the history, as if only silence had been pushed so far.
+    void reset();
+
+    /// Appends the first `numSamples` samples of the buffer. Channels the buffer doesn't have are pushed as silence.
+    void push(const juce::AudioBuffer<float>& source, int numSamples);
+
+    /// The number of output samples which can be pulled now.
+    int getNumAvailable() const;
+
+    /// Writes `numSamples` output samples (at most `getNumAvailable()`) to the buffer, starting at `startSample`.
+    void pull(juce::AudioBuffer<float>& destination, int startSample, int numSamples);
+
+    /// How many input samples past an output sample's position are needed to produce it.
+    int getKernelRadius() const { return radius; }
+
+private:
+    static constexpr int numPhases = 256;
+
+    void computeWeights(double fraction);
+    static float dotProduct(const float* samples, const float* weights, int numTaps);
+
+    int numChannels = 0;
+    int radius = 1;
+    int numTaps = 2;
+    double step = 1.0;
+
+    // One row of `numTaps` weights per phase, plus one more for interpolating the last phase
+    std::vector<float> kernel;
+    std::vector<float> weights;
+
+    juce::AudioBuffer<float> history;
+    int numBuffered = 0;
+    // The position of the next output sample in `history`
+    double position = 0.0;
+};
+
+//==============================================================================
+
+/**
+ * @brief Runs the hosted plugin at a fixed internal sample rate, whatever the host's rate is.
+ *
+ * The host's block is resampled to the internal rate, rendered by the callback, and resampled back.
+ * As the number of internal samples per host block varies, the output passes through a FIFO primed with `getLatencySamples()` samples
+ * of silence, which is the adapter's exact latency at the host rate. MIDI events are delayed along with the audio and moved to the
+ * internal sample where they belong, and the callback gets a position shifted to the start of the internal block.
+ *
+ * `process` is called on the rendering thread and never blocks or allocates. `prepare` must be called while it isn't running.
+ */
+class SampleRateAdapter
+{
+public:
+    using Quality = StreamingResampler::Quality;
+
+    /// Passing an internal rate of 0 (or the host's rate) deactivates the adapter.
+    void prepare(double hostRate, double internalRate, int numInputChannels, int numOutputChannels, int maximumHostBlockSize, Quality quality);
+
+    bool isActive() const { return active; }
+
+    /// The rate and maximum block size the hosted plugin must be prepared with. Only valid while active.
+    double getInternalRate() const { return internalSampleRate; }
+    int getMaximumInternalBlockSize() const { return maximumInternalBlockSize; }
+
+    /// The latency added by the adapter, in samples at the host rate.
+    int getLatencySamples() const { return active ? latencySamples : 0; }
+
+    /// Converts a latency reported by the hosted plugin to the host rate.
+    int toHostSamples(int internalSamples) const { return active ? juce::roundToInt((double) internalSamples / ratio) : internalSamples; }
+
+    /**
+     * @brief Resamples the block to the internal rate, calls `render(buffer, midiMessages, position)` with the internal block,
+     *        and replaces the block's content with the output delayed by `getLatencySamples()`.
+     */
+    template <typename RenderCallback>
+    void process(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                 const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, RenderCallback&& render);
+
+    /// The average time spent resampling (without rendering) per host block. Can be called on any thread.
+    double getMicrosecondsPerBlock() const;
+
+private:
+    void resampleInput(const juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+    juce::Optional<juce::AudioPlayHead::PositionInfo> getInternalPosition(const juce::Optional<juce::AudioPlayHead::PositionInfo>& position) const;
+    void resampleOutput(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+
+    bool active = false;
+    double hostSampleRate = 44100.0;
+    double internalSampleRate = 44100.0;
+    // Internal samples per host sample
+    double ratio = 1.0;
+    int latencySamples = 0;
+    int numInputs = 0;
+    int numOutputs = 0;
+
+    StreamingResampler inputResampler;
+    StreamingResampler outputResampler;
+    juce::AudioBuffer<float> internalBuffer;
+    int maximumInternalBlockSize = 0;
+    int numInternalSamples = 0;
+
+    // Host rate output waiting to be played, which always holds at least a block
+    juce::AudioBuffer<float> outputFifo;
+    int numOutputFifoSamples = 0;
+
+    // Events not yet due, timed relative to the start of the next internal block (or host block, for the output)
+    juce::MidiBuffer internalMidi;
+    juce::MidiBuffer pendingMidi;
+    juce::MidiBuffer pendingOutputMidi;
+    juce::MidiBuffer scratchMidi;
+
+    juce::int64 hostSamplesProcessed = 0;
+    juce::int64 internalSamplesProduced = 0;
+
+    std::atomic<juce::int64> resamplingTicks { 0 };
+    std::atomic<juce::int64> numBlocks { 0 };
+};
+
+//==============================================================================
+
+template <typename RenderCallback>
+void SampleRateAdapter::process(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                                const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, RenderCallback&& render)
+{
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    resampleInput(buffer, midiMessages);
+    const auto internalPosition = getInternalPosition(position);
+    const auto inputTicks = juce::Time::getHighResolutionTicks() - startTicks;
+
+    if (numInternalSamples > 0)
+    {
+        render(internalBuffer, internalMidi, internalPosition);
+    }
+
+    const auto outputStartTicks = juce::Time::getHighResolutionTicks();
+    resampleOutput(buffer, midiMessages);
+
+    hostSamplesProcessed += buffer.getNumSamples();
+    internalSamplesProduced += numInternalSamples;
+    resamplingTicks.fetch_add(inputTicks + juce::Time::getHighResolutionTicks() - outputStartTicks, std::memory_order_relaxed);
+    numBlocks.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,405 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+// The entry point of "VST3 Sandbox Helper", the process in which the wrapper hosts a VST3 plugin
+// when sandboxing is enabled (see `SandboxedPluginHost`). It's built by the "Sandbox Helper" Projucer project.
+
+#include <JuceHeader.h>
+#include "SandboxTransport.h"
+#include "HostedPlayHead.h"
+
+//==============================================================================
+
+class SandboxHelperWorker : public juce::ChildProcessWorker, private juce::AudioProcessorListener, private juce::MouseListener, private juce::Timer, private juce::Thread
+{
+public:
+    SandboxHelperWorker() : juce::Thread("VST3 Sandbox Render")
+    {
+    }
+
+    ~SandboxHelperWorker() override
+    {
+        stopRendering();
+        stopTimer();
+        editorWindow.reset();
+
+        if (pluginInstance != nullptr)
+        {
+            pluginInstance->removeListener(this);
+        }
+    }
+
+    void handleMessageFromCoordinator(const juce::MemoryBlock& data) override
+    {
+        const auto message = SandboxMessages::fromMemoryBlock(data);
+
+        // Plugins must be created, configured and shown on the message thread
+        juce::MessageManager::callAsync([this, message]() { handleMessage(message); });
+    }
+
+    void handleConnectionLost() override
+    {
+        juce::JUCEApplicationBase::quit();
+    }
+
+private:
+    //==============================================================================
+
+    class EditorWindow : public juce::DocumentWindow
+    {
+    public:
+        EditorWindow(juce::AudioProcessorEditor* editor, const juce::String& title, juce::MouseListener* interactionListener)
+            : juce::DocumentWindow(title, juce::Colours::black, juce::DocumentWindow::closeButton | juce::DocumentWindow::minimiseButton)
+        {
+            setUsingNativeTitleBar(true);
+            setContentOwned(editor, true);
+            // Interaction with the editor may change plugin's state without any parameter change
+            editor->addMouseListener(interactionListener, true);
+            setAlwaysOnTop(true);
+            centreWithSize(getWidth(), getHeight());
+            setVisible(true);
+        }
+
+        void closeButtonPressed() override
+        {
+            setVisible(false);
+        }
+    };
+
+    //==============================================================================
+
+    void handleMessage(const juce::ValueTree& message)
+    {
+        if (message.hasType(SandboxMessages::load))
+        {
+            load(message);
+        }
+        else if (message.hasType(SandboxMessages::prepare))
+        {
+            prepare(message[SandboxMessages::sampleRate], message[SandboxMessages::blockSize]);
+        }
+        else if (message.hasType(SandboxMessages::getState))
+        {
+            juce::MemoryBlock state;
+
+            {
+                const juce::ScopedLock sl (pluginLock);
+                if (pluginInstance != nullptr) { pluginInstance->getStateInformation(state); }
+            }
+
+            juce::ValueTree reply (SandboxMessages::state);
+            reply.setProperty(SandboxMessages::requestId, message[SandboxMessages::requestId], nullptr);
+            reply.setProperty(SandboxMessages::pluginState, state, nullptr);
+            sendMessageToCoordinator(SandboxMessages::toMemoryBlock(reply));
+        }
+        else if (message.hasType(SandboxMessages::showEditor))
+        {
+            showEditor();
+        }
+    }
+
+    void load(const juce::ValueTree& message)
+    {
+        stopRendering();
+        editorWindow.reset();
+        setPluginInstance(nullptr);
+
+        const auto error = createPluginInstance(message);
+
+        juce::ValueTree reply (SandboxMessages::loaded);
+        reply.setProperty(SandboxMessages::error, error, nullptr);
+
+        if (error.isEmpty())
+        {
+            sharedMemory = SandboxSharedMemory::open(message[SandboxMessages::sharedMemoryName].toString());
+
+            if (sharedMemory == nullptr)
+            {
+                setPluginInstance(nullptr);
+                reply.setProperty(SandboxMessages::error, "Could not open the sandbox's shared memory", nullptr);
+            }
+            else
+            {
+                const auto desc = pluginInstance->getPluginDescription();
+                reply.setProperty(SandboxMessages::pluginName, desc.manufacturerName + " - " + desc.name, nullptr);
+                reply.setProperty(SandboxMessages::latencySamples, pluginInstance->getLatencySamples(), nullptr);
+                reply.setProperty(SandboxMessages::hasSidechainInput, hasSidechainInput, nullptr);
+                startRendering();
+            }
+        }
+
+        sendMessageToCoordinator(SandboxMessages::toMemoryBlock(reply));
+    }
+
+    /// Returns an error description, or an empty string if the plugin has been created.
+    juce::String createPluginInstance(const juce::ValueTree& message)
+    {
+        const auto pluginPath = message[SandboxMessages::pluginPath].toString();
+        const bool wantsInstrument = message[SandboxMessages::wantsInstrument];
+        const bool requiresMidiInputAndOutput = message[SandboxMessages::requiresMidiInputAndOutput];
+        const double sampleRate = message[SandboxMessages::sampleRate];
+        const int blockSize = message[SandboxMessages::blockSize];
+
+        juce::OwnedArray<juce::PluginDescription> descs;
+        vst3Format.findAllTypesForFile(descs, pluginPath);
+
+        if (descs.isEmpty()) { return "No valid VST3 found in selected file"; }
+
+        const juce::PluginDescription* description = nullptr;
+
+        for (const auto* d : descs)
+        {
+            if (d->isInstrument == wantsInstrument)
+            {
+                description = d;
+                break;
+            }
+        }
+
+        if (description == nullptr)
+        {
+            return wantsInstrument ? "Selected VST3 is not an instrument" : "Selected VST3 is not an effect";
+        }
+
+        juce::String error;
+        auto instance = vst3Format.createInstanceFromDescription(*description, sampleRate, blockSize, error);
+
+        if (instance == nullptr)
+        {
+            return error.isEmpty() ? "An unexpected error has occurred while loading the plugin" : error;
+        }
+
+        if (requiresMidiInputAndOutput && !instance->acceptsMidi()) { return "Selected VST3 Plugin Does Not Accept MIDI"; }
+        if (requiresMidiInputAndOutput && !instance->producesMidi()) { return "Selected VST3 Plugin Does Not Produce MIDI"; }
+
+        instance->enableAllBuses();
+        isMidiEffect = requiresMidiInputAndOutput;
+        // The sidechain is the first input bus of an instrument and the second input bus of an effect
+        const auto sideChainBusIndex = wantsInstrument ? 0 : 1;
+        hasSidechainInput = !requiresMidiInputAndOutput && instance->getBusCount(true) == sideChainBusIndex + 1;
+
+        setPluginInstance(std::move(instance));
+        prepare(sampleRate, blockSize);
+
+        if (const auto* state = message[SandboxMessages::pluginState].getBinaryData())
+        {
+            if (!state->isEmpty())
+            {
+                pluginInstance->setStateInformation(state->getData(), (int) state->getSize());
+            }
+        }
+
+        return {};
+    }
+
+    void setPluginInstance(std::unique_ptr<juce::AudioPluginInstance> newInstance)
+    {
+        const juce::ScopedLock sl (pluginLock);
+
+        if (pluginInstance != nullptr)
+        {
+            pluginInstance->removeListener(this);
+        }
+
+        pluginInstance = std::move(newInstance);
+
+        if (pluginInstance != nullptr)
+        {
+            pluginInstance->addListener(this);
+        }
+    }
+
+    void prepare(double sampleRate, int blockSize)
+    {
+        const juce::ScopedLock sl (pluginLock);
+
+        if (pluginInstance == nullptr) { return; }
+
+        pluginInstance->releaseResources();
+
+        if (isMidiEffect)
+            pluginInstance->setPlayConfigDetails(0, 2, sampleRate, blockSize);
+        else
+            pluginInstance->setRateAndBufferSizeDetails(sampleRate, blockSize);
+
+        pluginInstance->prepareToPlay(sampleRate, blockSize);
+    }
+
+    void showEditor()
+    {
+        if (pluginInstance == nullptr) { return; }
+
+        if (editorWindow == nullptr)
+        {
+            auto* editor = pluginInstance->createEditorIfNeeded();
+
+            if (editor == nullptr)
+            {
+                editor = new juce::GenericAudioProcessorEditor(*pluginInstance);
+            }
+
+            editorWindow = std::make_unique<EditorWindow>(editor, pluginInstance->getName(), this);
+        }
+
+        editorWindow->setVisible(true);
+        editorWindow->toFront(true);
+    }
+
+    //==============================================================================
+    // State change notifications
+    //==============================================================================
+
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override { hasStateChanged = true; }
+    void audioProcessorChanged(juce::AudioProcessor*, const juce::AudioProcessorListener::ChangeDetails&) override { hasStateChanged = true; }
+    void mouseUp(const juce::MouseEvent&) override { hasStateChanged = true; }
+
+    // Parameters may change on the render thread, which mustn't send messages itself
+    void timerCallback() override
+    {
+        if (hasStateChanged.exchange(false))
+        {
+            sendMessageToCoordinator(SandboxMessages::toMemoryBlock(juce::ValueTree(SandboxMessages::stateChanged)));
+        }
+    }
+
+    //==============================================================================
+    // Rendering
+    //==============================================================================
+
+    void startRendering()
+    {
+        // Acknowledge whatever the wrapper sent before the plugin was ready, so that it can send the next block
+        auto& block = sharedMemory->getBlock();
+        lastRequest = block.requestCounter.load(std::memory_order_acquire);
+        sharedMemory->postResponse(lastRequest);
+
+        startThread(juce::Thread::Priority::highest);
+        startTimerHz(stateChangePollingRateHz);
+    }
+
+    void stopRendering()
+    {
+        signalThreadShouldExit();
+
+        if (sharedMemory != nullptr)
+        {
+            sharedMemory->wakeHelper();
+        }
+
+        stopThread(1000);
+    }
+
+    void run() override
+    {
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midiMessages;
+        midiMessages.ensureSize((size_t) SandboxSharedBlock::maxMidiBytes);
+        std::array<float*, SandboxSharedBlock::maxChannels> channels;
+        auto& block = sharedMemory->getBlock();
+
+        while (!threadShouldExit())
+        {
+            if (!sharedMemory->waitForRequest(lastRequest, requestWaitTimeoutMs)) { continue; }
+
+            lastRequest = block.requestCounter.load(std::memory_order_acquire);
+
+            const juce::ScopedLock sl (pluginLock);
+
+            if (pluginInstance == nullptr)
+            {
+                sharedMemory->postResponse(lastRequest);
+                continue;
+            }
+
+            // Rendered in place, with at least as many channels as the plugin has (see `renderHostedBlock` in the wrapper)
+            const auto numSamples = juce::jlimit(0, SandboxSharedBlock::maxBlockSize, (int) block.numSamples);
+            const auto numChannels = juce::jlimit(0, SandboxSharedBlock::maxChannels, (int) block.numChannels);
+            const auto pluginChannels = juce::jmax(pluginInstance->getTotalNumInputChannels(), pluginInstance->getTotalNumOutputChannels());
+            const auto bufferChannels = juce::jlimit(numChannels, SandboxSharedBlock::maxChannels, pluginChannels);
+
+            for (int i = 0; i < bufferChannels; ++i)
+            {
+                channels[(size_t) i] = block.getChannel(i);
+
+                if (i >= numChannels)
+                {
+                    juce::FloatVectorOperations::clear(channels[(size_t) i], numSamples);
+                }
+            }
+
+            buffer.setDataToReferTo(channels.data(), bufferChannels, numSamples);
+            block.readMidi(midiMessages);
+            playHead.setPosition(block.position.toPositionInfo());
+            pluginInstance->setPlayHead(&playHead);
+
+            if (block.isActive != 0)
+                pluginInstance->processBlock(buffer, midiMessages);
+            else
+                pluginInstance->processBlockBypassed(buffer, midiMessages);
+
+            block.writeMidi(midiMessages);
+            sharedMemory->postResponse(lastRequest);
+        }
+    }
+
+    //==============================================================================
+
+    static constexpr int requestWaitTimeoutMs = 100;
+    static constexpr int stateChangePollingRateHz = 10;
+
+    juce::VST3PluginFormat vst3Format;
+    juce::CriticalSection pluginLock;
+    std::unique_ptr<juce::AudioPluginInstance> pluginInstance;
+    std::unique_ptr<EditorWindow> editorWindow;
+    std::unique_ptr<SandboxSharedMemory> sharedMemory;
+    HostedPlayHead playHead;
+    juce::uint32 lastRequest = 0;
+    bool hasSidechainInput = false;
+    bool isMidiEffect = false;
+    std::atomic<bool> hasStateChanged { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxHelperWorker)
+};
+
+//==============================================================================
+
+class SandboxHelperApplication : public juce::JUCEApplication
+{
+public:
+    const juce::String getApplicationName() override { return ProjectInfo::projectName; }
+    const juce::String getApplicationVersion() override { return ProjectInfo::versionString; }
+    bool moreThanOneInstanceAllowed() override { return true; }
+
+    void initialise(const juce::String& commandLine) override
+    {
+        worker = std::make_unique<SandboxHelperWorker>();
+
+        // Launched by something other than the wrapper
+        if (!worker->initialiseFromCommandLine(commandLine, SandboxMessages::processUID))
+        {
+            worker.reset();
+            quit();
+        }
+    }
+
+    void shutdown() override
+    {
+        worker.reset();
+    }
+
+private:
+    std::unique_ptr<SandboxHelperWorker> worker;
+};
+
+START_JUCE_APPLICATION (SandboxHelperApplication)
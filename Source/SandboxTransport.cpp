@@ -0,0 +1,326 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "SandboxTransport.h"
+
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if JUCE_LINUX
+ #include <linux/futex.h>
+ #include <sys/syscall.h>
+#endif
+
+#if JUCE_MAC && __has_include(<os/os_sync_wait_on_address.h>)
+ #include <os/os_sync_wait_on_address.h>
+ #define VST3WRAPPER_HAS_OS_SYNC 1
+#else
+ #define VST3WRAPPER_HAS_OS_SYNC 0
+#endif
+
+//==============================================================================
+
+SandboxPosition SandboxPosition::fromPositionInfo(const juce::Optional<juce::AudioPlayHead::PositionInfo>& position)
+{
+    SandboxPosition result;
+
+    if (!position.hasValue()) { return result; }
+
+    result.hasPosition = 1;
+    result.isPlaying = position->getIsPlaying() ? 1 : 0;
+    result.isRecording = position->getIsRecording() ? 1 : 0;
+    result.isLooping = position->getIsLooping() ? 1 : 0;
+    result.timeInSamples = position->getTimeInSamples().orFallback(0);
+    result.timeInSeconds = position->getTimeInSeconds().orFallback(0.0);
+    result.bpm = position->getBpm().orFallback(120.0);
+    result.ppqPosition = position->getPpqPosition().orFallback(0.0);
+    result.ppqPositionOfLastBarStart = position->getPpqPositionOfLastBarStart().orFallback(0.0);
+
+    if (const auto timeSignature = position->getTimeSignature())
+    {
+        result.timeSignatureNumerator = timeSignature->numerator;
+        result.timeSignatureDenominator = timeSignature->denominator;
+    }
+
+    if (const auto loopPoints = position->getLoopPoints())
+    {
+        result.loopStartPpq = loopPoints->ppqStart;
+        result.loopEndPpq = loopPoints->ppqEnd;
+    }
+
+    return result;
+}
+
+juce::Optional<juce::AudioPlayHead::PositionInfo> SandboxPosition::toPositionInfo() const
+{
+    if (hasPosition == 0) { return {}; }
+
+    juce::AudioPlayHead::PositionInfo position;
+    position.setIsPlaying(isPlaying != 0);
+    position.setIsRecording(isRecording != 0);
+    position.setIsLooping(isLooping != 0);
+    position.setTimeInSamples(timeInSamples);
+    position.setTimeInSeconds(timeInSeconds);
+    position.setBpm(bpm);
+    position.setPpqPosition(ppqPosition);
+    position.setPpqPositionOfLastBarStart(ppqPositionOfLastBarStart);
+    position.setTimeSignature(juce::AudioPlayHead::TimeSignature { timeSignatureNumerator, timeSignatureDenominator });
+    position.setLoopPoints(juce::AudioPlayHead::LoopPoints { loopStartPpq, loopEndPpq });
+    return position;
+}
+
+//==============================================================================
+
+// Each event is stored as its sample position (int32), its size (uint16) and its bytes
+void SandboxSharedBlock::writeMidi(const juce::MidiBuffer& midiMessages)
+{
+    constexpr size_t headerSize = sizeof(juce::int32) + sizeof(juce::uint16);
+    size_t position = 0;
+
+    for (const auto metadata : midiMessages)
+    {
+        const auto size = (size_t) metadata.numBytes;
+
+        // Whatever doesn't fit is dropped rather than allocated for
+        if (position + headerSize + size > (size_t) maxMidiBytes) { break; }
+
+        const auto samplePosition = (juce::int32) metadata.samplePosition;
+        const auto size16 = (juce::uint16) size;
+        memcpy(midi + position, &samplePosition, sizeof(samplePosition));
+        memcpy(midi + position + sizeof(samplePosition), &size16, sizeof(size16));
+        memcpy(midi + position + headerSize, metadata.data, size);
+        position += headerSize + size;
+    }
+
+    numMidiBytes = (juce::int32) position;
+}
+
+void SandboxSharedBlock::readMidi(juce::MidiBuffer& midiMessages) const
+{
+    constexpr size_t headerSize = sizeof(juce::int32) + sizeof(juce::uint16);
+    const auto end = (size_t) juce::jlimit(0, maxMidiBytes, (int) numMidiBytes);
+    size_t position = 0;
+
+    midiMessages.clear();
+
+    while (position + headerSize <= end)
+    {
+        juce::int32 samplePosition;
+        juce::uint16 size;
+        memcpy(&samplePosition, midi + position, sizeof(samplePosition));
+        memcpy(&size, midi + position + sizeof(samplePosition), sizeof(size));
+
+        if (position + headerSize + size > end) { break; }
+
+        midiMessages.addEvent(midi + position + headerSize, (int) size, (int) samplePosition);
+        position += headerSize + size;
+    }
+}
+
+//==============================================================================
+
+// Wakes every thread, in any process, sleeping in `waitOnAddress` on this counter
+static void wakeByAddress(std::atomic<juce::uint32>& word)
+{
+   #if JUCE_LINUX
+    syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+   #elif VST3WRAPPER_HAS_OS_SYNC
+    if (__builtin_available(macOS 14.4, *))
+    {
+        os_sync_wake_by_address_all(&word, sizeof(juce::uint32), OS_SYNC_WAKE_BY_ADDRESS_SHARED);
+    }
+   #else
+    juce::ignoreUnused(word);
+   #endif
+}
+
+// Sleeps while the counter still holds `expected`, at most for `timeoutMs`. Returns `false` if the system can't wait on a
+// shared address (macOS before 14.4), in which case the caller has to poll.
+static bool waitOnAddress(std::atomic<juce::uint32>& word, juce::uint32 expected, double timeoutMs)
+{
+   #if JUCE_LINUX
+    timespec timeout;
+    timeout.tv_sec = (time_t) (timeoutMs / 1000.0);
+    timeout.tv_nsec = (long) ((timeoutMs - timeout.tv_sec * 1000.0) * 1000000.0);
+    syscall(SYS_futex, reinterpret_cast<juce::uint32*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    return true;
+   #elif VST3WRAPPER_HAS_OS_SYNC
+    if (__builtin_available(macOS 14.4, *))
+    {
+        os_sync_wait_on_address_with_timeout(&word, (uint64_t) expected, sizeof(juce::uint32), OS_SYNC_WAIT_ON_ADDRESS_SHARED,
+                                             OS_CLOCK_MACH_ABSOLUTE_TIME, (uint64_t) (timeoutMs * 1000000.0));
+        return true;
+    }
+    return false;
+   #else
+    juce::ignoreUnused(word, expected, timeoutMs);
+    return false;
+   #endif
+}
+
+static juce::String getSemaphoreName(const juce::String& name)
+{
+    return name + "r";
+}
+
+SandboxSharedMemory::SandboxSharedMemory(const juce::String& nameToUse, bool shouldOwn)
+    : name(nameToUse), isOwner(shouldOwn)
+{
+}
+
+std::unique_ptr<SandboxSharedMemory> SandboxSharedMemory::create(const juce::String& name)
+{
+    std::unique_ptr<SandboxSharedMemory> sharedMemory (new SandboxSharedMemory(name, true));
+
+    shm_unlink(name.toRawUTF8());
+    sharedMemory->fileDescriptor = shm_open(name.toRawUTF8(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    if (sharedMemory->fileDescriptor < 0 || ftruncate(sharedMemory->fileDescriptor, (off_t) sizeof(SandboxSharedBlock)) != 0)
+    {
+        return nullptr;
+    }
+
+    if (!sharedMemory->map()) { return nullptr; }
+
+    auto& block = sharedMemory->getBlock();
+    new (&block.requestCounter) std::atomic<juce::uint32> (0);
+    new (&block.responseCounter) std::atomic<juce::uint32> (0);
+    block.numChannels = 0;
+    block.numSamples = 0;
+    block.isActive = 0;
+    block.numMidiBytes = 0;
+    block.magic = SandboxSharedBlock::magicNumber;
+
+   #if ! JUCE_LINUX
+    sem_unlink(getSemaphoreName(name).toRawUTF8());
+    auto* semaphore = sem_open(getSemaphoreName(name).toRawUTF8(), O_CREAT | O_EXCL, 0600, 0);
+    if (semaphore == SEM_FAILED) { return nullptr; }
+    sharedMemory->semaphore = semaphore;
+   #endif
+
+    return sharedMemory;
+}
+
+std::unique_ptr<SandboxSharedMemory> SandboxSharedMemory::open(const juce::String& name)
+{
+    std::unique_ptr<SandboxSharedMemory> sharedMemory (new SandboxSharedMemory(name, false));
+
+    sharedMemory->fileDescriptor = shm_open(name.toRawUTF8(), O_RDWR, 0600);
+
+    if (sharedMemory->fileDescriptor < 0 || !sharedMemory->map()) { return nullptr; }
+
+    if (sharedMemory->getBlock().magic != SandboxSharedBlock::magicNumber) { return nullptr; }
+
+   #if ! JUCE_LINUX
+    auto* semaphore = sem_open(getSemaphoreName(name).toRawUTF8(), 0);
+    if (semaphore == SEM_FAILED) { return nullptr; }
+    sharedMemory->semaphore = semaphore;
+   #endif
+
+    return sharedMemory;
+}
+
+bool SandboxSharedMemory::map()
+{
+    auto* address = mmap(nullptr, sizeof(SandboxSharedBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+
+    if (address == MAP_FAILED) { return false; }
+
+    block = static_cast<SandboxSharedBlock*>(address);
+    return true;
+}
+
+SandboxSharedMemory::~SandboxSharedMemory()
+{
+   #if ! JUCE_LINUX
+    if (semaphore != nullptr)
+    {
+        sem_close(static_cast<sem_t*>(semaphore));
+        if (isOwner) { sem_unlink(getSemaphoreName(name).toRawUTF8()); }
+    }
+   #endif
+
+    if (block != nullptr) { munmap(block, sizeof(SandboxSharedBlock)); }
+    if (fileDescriptor >= 0) { close(fileDescriptor); }
+    if (isOwner) { shm_unlink(name.toRawUTF8()); }
+}
+
+juce::String SandboxSharedMemory::createUniqueName()
+{
+    static std::atomic<int> counter { 0 };
+    return "/v3sb." + juce::String((int) getpid()) + "." + juce::String(++counter);
+}
+
+//==============================================================================
+
+juce::uint32 SandboxSharedMemory::postRequest()
+{
+    const auto request = block->requestCounter.load(std::memory_order_relaxed) + 1;
+    block->requestCounter.store(request, std::memory_order_release);
+    wakeHelper();
+    return request;
+}
+
+void SandboxSharedMemory::wakeHelper()
+{
+   #if JUCE_LINUX
+    wakeByAddress(block->requestCounter);
+   #else
+    sem_post(static_cast<sem_t*>(semaphore));
+   #endif
+}
+
+bool SandboxSharedMemory::waitForResponse(juce::uint32 request, double timeoutMs)
+{
+    const auto deadline = juce::Time::getMillisecondCounterHiRes() + timeoutMs;
+
+    for (;;)
+    {
+        const auto response = block->responseCounter.load(std::memory_order_acquire);
+
+        if (response == request) { return true; }
+
+        const auto remainingMs = deadline - juce::Time::getMillisecondCounterHiRes();
+
+        if (remainingMs <= 0.0) { return false; }
+
+        if (!waitOnAddress(block->responseCounter, response, remainingMs))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool SandboxSharedMemory::waitForRequest(juce::uint32 lastRequest, int timeoutMs)
+{
+    if (block->requestCounter.load(std::memory_order_acquire) != lastRequest) { return true; }
+
+   #if JUCE_LINUX
+    waitOnAddress(block->requestCounter, lastRequest, (double) timeoutMs);
+   #else
+    // The semaphore only wakes the helper up, the counter tells whether there's work to do
+    juce::ignoreUnused(timeoutMs);
+    sem_wait(static_cast<sem_t*>(semaphore));
+   #endif
+
+    return block->requestCounter.load(std::memory_order_acquire) != lastRequest;
+}
+
+void SandboxSharedMemory::postResponse(juce::uint32 request)
+{
+    block->responseCounter.store(request, std::memory_order_release);
+    wakeByAddress(block->responseCounter);
+}
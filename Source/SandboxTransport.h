@@ -0,0 +1,174 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Shared between the wrapper and the sandbox helper process (see `SandboxedPluginHost` and `SandboxHelperMain.cpp`).
+// Audio, MIDI and transport travel through a block of shared memory, while commands, state and
+// notifications travel through the `ChildProcessCoordinator` / `ChildProcessWorker` connection.
+//==============================================================================
+
+/// The host position, in a layout that can be copied to another process.
+struct SandboxPosition
+{
+    juce::int32 hasPosition = 0;
+    juce::int32 isPlaying = 0;
+    juce::int32 isRecording = 0;
+    juce::int32 isLooping = 0;
+    juce::int32 timeSignatureNumerator = 4;
+    juce::int32 timeSignatureDenominator = 4;
+    juce::int64 timeInSamples = 0;
+    double timeInSeconds = 0.0;
+    double bpm = 120.0;
+    double ppqPosition = 0.0;
+    double ppqPositionOfLastBarStart = 0.0;
+    double loopStartPpq = 0.0;
+    double loopEndPpq = 0.0;
+
+    static SandboxPosition fromPositionInfo(const juce::Optional<juce::AudioPlayHead::PositionInfo>& position);
+    juce::Optional<juce::AudioPlayHead::PositionInfo> toPositionInfo() const;
+};
+
+/// The fixed layout of the shared memory block. One block is in flight at a time.
+struct SandboxSharedBlock
+{
+    static constexpr juce::uint32 magicNumber = 0x56335342;
+    static constexpr int maxChannels = 64;
+    static constexpr int maxBlockSize = 8192;
+    static constexpr int maxMidiBytes = 64 * 1024;
+
+    juce::uint32 magic;
+
+    /// Incremented by the wrapper when a block is ready to be rendered
+    std::atomic<juce::uint32> requestCounter;
+    /// Set to the request counter by the helper when the block has been rendered
+    std::atomic<juce::uint32> responseCounter;
+
+    juce::int32 numChannels;
+    juce::int32 numSamples;
+    juce::int32 isActive;
+    SandboxPosition position;
+
+    /// Serialized MIDI input on the way to the helper, and MIDI output on the way back
+    juce::int32 numMidiBytes;
+    juce::uint8 midi[maxMidiBytes];
+
+    /// Non-interleaved, `maxBlockSize` samples per channel, rendered in place
+    float audio[maxChannels * maxBlockSize];
+
+    float* getChannel(int channel) { return audio + (size_t) channel * maxBlockSize; }
+
+    void writeMidi(const juce::MidiBuffer& midiMessages);
+    void readMidi(juce::MidiBuffer& midiMessages) const;
+};
+
+static_assert(std::atomic<juce::uint32>::is_always_lock_free, "Shared memory counters must be lock-free to work across processes");
+
+/**
+ * @brief A named shared memory block plus the wake-up mechanism for both directions.
+ *
+ * On Linux, both sides sleep on the block's counters with futexes.
+ * Elsewhere, the helper sleeps on a named POSIX semaphore. As there is no timed wait on a shared semaphore on macOS,
+ * the wrapper's audio thread sleeps on the response counter with `os_sync_wait_on_address` (macOS 14.4 and later),
+ * and only spins (yielding) until its deadline on older systems.
+ */
+class SandboxSharedMemory
+{
+public:
+    /// Creates the block. Called by the wrapper, which owns its lifetime.
+    static std::unique_ptr<SandboxSharedMemory> create(const juce::String& name);
+
+    /// Maps a block created by the wrapper. Called by the helper.
+    static std::unique_ptr<SandboxSharedMemory> open(const juce::String& name);
+
+    ~SandboxSharedMemory();
+
+    SandboxSharedBlock& getBlock() { return *block; }
+
+    const juce::String& getName() const { return name; }
+
+    /// Wrapper: publishes a new request and wakes the helper up.
+    juce::uint32 postRequest();
+
+    /// Wrapper, audio thread: waits until the request is rendered or the timeout expires.
+    bool waitForResponse(juce::uint32 request, double timeoutMs);
+
+    /// Helper: waits until a request newer than `lastRequest` arrives or the timeout expires.
+    bool waitForRequest(juce::uint32 lastRequest, int timeoutMs);
+
+    /// Helper: marks the request as rendered and wakes the wrapper up.
+    void postResponse(juce::uint32 request);
+
+    /// Wakes up a helper thread waiting in `waitForRequest`, e.g. so that it can quit.
+    void wakeHelper();
+
+    /// Returns a name unique to this process and call, short enough for macOS' limits on shared memory and semaphore names.
+    static juce::String createUniqueName();
+
+private:
+    SandboxSharedMemory(const juce::String& name, bool isOwner);
+
+    bool map();
+
+    juce::String name;
+    bool isOwner;
+    int fileDescriptor = -1;
+    SandboxSharedBlock* block = nullptr;
+    void* semaphore = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxSharedMemory)
+};
+
+/// Message and property names of the side channel.
+struct SandboxMessages
+{
+    static inline const juce::Identifier load { "load" };
+    static inline const juce::Identifier loaded { "loaded" };
+    static inline const juce::Identifier prepare { "prepare" };
+    static inline const juce::Identifier getState { "get_state" };
+    static inline const juce::Identifier state { "state" };
+    static inline const juce::Identifier stateChanged { "state_changed" };
+    static inline const juce::Identifier showEditor { "show_editor" };
+
+    static inline const juce::Identifier requestId { "request_id" };
+    static inline const juce::Identifier pluginPath { "plugin_path" };
+    static inline const juce::Identifier pluginName { "plugin_name" };
+    static inline const juce::Identifier pluginState { "plugin_state" };
+    static inline const juce::Identifier sharedMemoryName { "shared_memory" };
+    static inline const juce::Identifier sampleRate { "sample_rate" };
+    static inline const juce::Identifier blockSize { "block_size" };
+    static inline const juce::Identifier wantsInstrument { "wants_instrument" };
+    static inline const juce::Identifier requiresMidiInputAndOutput { "requires_midi_io" };
+    static inline const juce::Identifier error { "error" };
+    static inline const juce::Identifier latencySamples { "latency" };
+    static inline const juce::Identifier hasSidechainInput { "has_sidechain" };
+
+    /// The `ChildProcessCoordinator` / `ChildProcessWorker` command line identifier.
+    static constexpr const char* processUID = "au-vst3-wrapper-sandbox";
+
+    static juce::MemoryBlock toMemoryBlock(const juce::ValueTree& message)
+    {
+        juce::MemoryOutputStream stream;
+        message.writeToStream(stream);
+        return stream.getMemoryBlock();
+    }
+
+    static juce::ValueTree fromMemoryBlock(const juce::MemoryBlock& data)
+    {
+        return juce::ValueTree::readFromData(data.getData(), data.getSize());
+    }
+};
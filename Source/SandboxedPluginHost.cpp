@@ -0,0 +1,246 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "SandboxedPluginHost.h"
+
+//==============================================================================
+
+SandboxedPluginHost::SandboxedPluginHost()
+{
+}
+
+SandboxedPluginHost::~SandboxedPluginHost()
+{
+    isShuttingDown = true;
+    loaded = false;
+    killWorkerProcess();
+}
+
+juce::File SandboxedPluginHost::findHelperExecutable()
+{
+    // In a plugin, this is the plugin's own binary, i.e. "<Wrapper>.component/Contents/MacOS/<Wrapper>"
+    const auto pluginBinary = juce::File::getSpecialLocation(juce::File::currentExecutableFile);
+    const auto appBundleBinary = helperName + ".app/Contents/MacOS/" + helperName;
+
+    const juce::File candidates[] =
+    {
+        pluginBinary.getParentDirectory().getSiblingFile("Resources").getChildFile(appBundleBinary),
+        juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+            .getChildFile("Application Support/AU-VST3-Wrapper").getChildFile(appBundleBinary),
+        pluginBinary.getSiblingFile(helperName)
+    };
+
+    for (const auto& candidate : candidates)
+    {
+        if (candidate.existsAsFile()) { return candidate; }
+    }
+
+    return {};
+}
+
+bool SandboxedPluginHost::launchHelperIfNeeded(juce::String& error)
+{
+    if (isHelperRunning) { return true; }
+
+    if (sharedMemory == nullptr)
+    {
+        sharedMemory = SandboxSharedMemory::create(SandboxSharedMemory::createUniqueName());
+
+        if (sharedMemory == nullptr)
+        {
+            error = "Could not create shared memory for the sandbox";
+            return false;
+        }
+    }
+
+    const auto helper = findHelperExecutable();
+
+    if (!helper.existsAsFile())
+    {
+        error = "Could not find " + helperName;
+        return false;
+    }
+
+    isShuttingDown = false;
+
+    // The helper's output isn't read, so it must not be captured or the helper would block on a full pipe
+    if (!launchWorkerProcess(helper, SandboxMessages::processUID, helperLaunchTimeoutMs, 0))
+    {
+        error = "Could not launch " + helperName;
+        return false;
+    }
+
+    isHelperRunning = true;
+    return true;
+}
+
+void SandboxedPluginHost::sendMessage(const juce::ValueTree& message)
+{
+    if (isHelperRunning)
+    {
+        sendMessageToWorker(SandboxMessages::toMemoryBlock(message));
+    }
+}
+
+//==============================================================================
+
+void SandboxedPluginHost::load(const LoadRequest& request)
+{
+    loaded = false;
+    crashed = false;
+    latencySamples = 0;
+    sampleRate = request.sampleRate;
+
+    juce::String error;
+
+    if (!launchHelperIfNeeded(error))
+    {
+        LoadResult result;
+        result.error = error;
+        if (onLoaded != nullptr) { onLoaded(result); }
+        return;
+    }
+
+    isLoadPending = true;
+
+    juce::ValueTree message (SandboxMessages::load);
+    message.setProperty(SandboxMessages::pluginPath, request.pluginPath, nullptr);
+    message.setProperty(SandboxMessages::pluginState, request.pluginState, nullptr);
+    message.setProperty(SandboxMessages::sharedMemoryName, sharedMemory->getName(), nullptr);
+    message.setProperty(SandboxMessages::sampleRate, request.sampleRate, nullptr);
+    message.setProperty(SandboxMessages::blockSize, request.blockSize, nullptr);
+    message.setProperty(SandboxMessages::wantsInstrument, request.wantsInstrument, nullptr);
+    message.setProperty(SandboxMessages::requiresMidiInputAndOutput, request.requiresMidiInputAndOutput, nullptr);
+    sendMessage(message);
+}
+
+void SandboxedPluginHost::unload()
+{
+    loaded = false;
+    crashed = false;
+    isLoadPending = false;
+
+    if (!isHelperRunning) { return; }
+
+    isShuttingDown = true;
+    killWorkerProcess();
+    isHelperRunning = false;
+}
+
+void SandboxedPluginHost::prepare(double newSampleRate, int blockSize)
+{
+    sampleRate = newSampleRate;
+
+    juce::ValueTree message (SandboxMessages::prepare);
+    message.setProperty(SandboxMessages::sampleRate, newSampleRate, nullptr);
+    message.setProperty(SandboxMessages::blockSize, blockSize, nullptr);
+    sendMessage(message);
+}
+
+bool SandboxedPluginHost::getState(juce::MemoryBlock& destData, int timeoutMs)
+{
+    if (!loaded) { return false; }
+
+    int requestId;
+
+    {
+        const juce::ScopedLock sl (stateLock);
+        requestId = ++lastStateRequestId;
+        stateReceived.reset();
+    }
+
+    juce::ValueTree message (SandboxMessages::getState);
+    message.setProperty(SandboxMessages::requestId, requestId, nullptr);
+    sendMessage(message);
+
+    stateReceived.wait(timeoutMs);
+
+    const juce::ScopedLock sl (stateLock);
+
+    if (receivedStateRequestId != requestId) { return false; }
+
+    destData = receivedState;
+    return true;
+}
+
+void SandboxedPluginHost::showEditor()
+{
+    sendMessage(juce::ValueTree(SandboxMessages::showEditor));
+}
+
+//==============================================================================
+
+void SandboxedPluginHost::handleMessageFromWorker(const juce::MemoryBlock& data)
+{
+    const auto message = SandboxMessages::fromMemoryBlock(data);
+
+    if (message.hasType(SandboxMessages::loaded))
+    {
+        LoadResult result;
+        result.error = message[SandboxMessages::error].toString();
+        result.succeeded = result.error.isEmpty();
+        result.pluginName = message[SandboxMessages::pluginName].toString();
+        result.latencySamples = message[SandboxMessages::latencySamples];
+        result.hasSidechainInput = message[SandboxMessages::hasSidechainInput];
+
+        latencySamples = result.latencySamples;
+        isLoadPending = false;
+        loaded.store(result.succeeded, std::memory_order_release);
+
+        if (onLoaded != nullptr) { onLoaded(result); }
+    }
+    else if (message.hasType(SandboxMessages::state))
+    {
+        const juce::ScopedLock sl (stateLock);
+
+        if (const auto* state = message[SandboxMessages::pluginState].getBinaryData())
+        {
+            receivedState = *state;
+        }
+        else
+        {
+            receivedState.reset();
+        }
+
+        receivedStateRequestId = message[SandboxMessages::requestId];
+        stateReceived.signal();
+    }
+    else if (message.hasType(SandboxMessages::stateChanged))
+    {
+        if (onStateChanged != nullptr) { onStateChanged(); }
+    }
+}
+
+void SandboxedPluginHost::handleConnectionLost()
+{
+    isHelperRunning = false;
+
+    if (isShuttingDown) { return; }
+
+    loaded = false;
+    stateReceived.signal();
+
+    // A plugin that crashes while loading is reported as a failed load
+    if (isLoadPending.exchange(false))
+    {
+        LoadResult result;
+        result.error = "The plugin crashed while loading";
+        if (onLoaded != nullptr) { onLoaded(result); }
+        return;
+    }
+
+    crashed = true;
+
+    if (onCrashed != nullptr) { onCrashed(); }
+}
@@ -0,0 +1,193 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SandboxTransport.h"
+
+/**
+ * @brief Hosts the VST3 plugin in a separate helper process ("VST3 Sandbox Helper"), so that a crash or a hang of the plugin
+ *        only silences this wrapper instead of taking the host down with it.
+ *
+ * Every block is copied to shared memory, the helper renders it in place and the audio thread waits for the result
+ * until a fraction of the block's duration has passed. A late block is replaced with silence.
+ * If the helper process dies, `onCrashed` is called and the wrapper stays silent until the plugin is loaded again.
+ *
+ * The helper is launched by `load` if it isn't running yet, and quit by `unload`. The shared memory block lives as long as this object.
+ * `onLoaded`, `onStateChanged` and `onCrashed` are called on the connection's background thread.
+ */
+class SandboxedPluginHost : private juce::ChildProcessCoordinator
+{
+public:
+    struct LoadRequest
+    {
+        juce::String pluginPath;
+        juce::MemoryBlock pluginState;
+        double sampleRate = 44100.0;
+        int blockSize = 512;
+        bool wantsInstrument = false;
+        bool requiresMidiInputAndOutput = false;
+    };
+
+    struct LoadResult
+    {
+        bool succeeded = false;
+        juce::String error;
+        juce::String pluginName;
+        int latencySamples = 0;
+        bool hasSidechainInput = false;
+    };
+
+    SandboxedPluginHost();
+    ~SandboxedPluginHost() override;
+
+    std::function<void(const LoadResult&)> onLoaded;
+    std::function<void()> onStateChanged;
+    std::function<void()> onCrashed;
+
+    /// Starts loading the plugin in the helper, launching the helper first if needed. `onLoaded` is called when it's done.
+    void load(const LoadRequest& request);
+
+    /// Quits the helper process, and with it the hosted plugin.
+    void unload();
+
+    void prepare(double sampleRate, int blockSize);
+
+    bool isLoaded() const { return loaded; }
+
+    bool hasCrashed() const { return crashed; }
+
+    int getLatencySamples() const { return latencySamples; }
+
+    /// Returns the number of blocks which the helper didn't render in time, so silence was played instead.
+    int getNumDeadlineMisses() const { return deadlineMisses; }
+
+    /// Asks the helper for the hosted plugin's state and waits for the reply. Returns `false` on timeout or if the helper isn't running.
+    bool getState(juce::MemoryBlock& destData, int timeoutMs);
+
+    /// Opens the hosted plugin's editor in a window owned by the helper process.
+    void showEditor();
+
+    /// Renders a block in the helper. Called on the audio thread.
+    template <typename FloatType>
+    void process(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive);
+
+    /// Looks for the helper inside the AU bundle's resources, then in the wrapper's application support folder.
+    static juce::File findHelperExecutable();
+
+    static inline const juce::String helperName = "VST3 Sandbox Helper";
+
+    /// The fraction of a block's duration the audio thread waits for the helper before giving up on the block
+    static constexpr double responseBudget = 0.7;
+
+private:
+    void handleMessageFromWorker(const juce::MemoryBlock& data) override;
+    void handleConnectionLost() override;
+
+    bool launchHelperIfNeeded(juce::String& error);
+    void sendMessage(const juce::ValueTree& message);
+
+    static constexpr int helperLaunchTimeoutMs = 10000;
+
+    std::unique_ptr<SandboxSharedMemory> sharedMemory;
+    std::atomic<bool> loaded { false };
+    std::atomic<bool> crashed { false };
+    std::atomic<bool> isHelperRunning { false };
+    std::atomic<bool> isShuttingDown { false };
+    std::atomic<bool> isLoadPending { false };
+    std::atomic<int> latencySamples { 0 };
+    std::atomic<int> deadlineMisses { 0 };
+    std::atomic<double> sampleRate { 44100.0 };
+
+    juce::CriticalSection stateLock;
+    juce::WaitableEvent stateReceived;
+    int lastStateRequestId = 0;
+    int receivedStateRequestId = 0;
+    juce::MemoryBlock receivedState;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxedPluginHost)
+};
+
+//==============================================================================
+
+template <typename FloatType>
+void SandboxedPluginHost::process(juce::AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages, const juce::Optional<juce::AudioPlayHead::PositionInfo>& position, bool isActive)
+{
+    const auto numSamples = buffer.getNumSamples();
+
+    auto silence = [&]
+    {
+        buffer.clear();
+        midiMessages.clear();
+    };
+
+    if (!loaded.load(std::memory_order_acquire) || numSamples > SandboxSharedBlock::maxBlockSize)
+    {
+        silence();
+        return;
+    }
+
+    auto& block = sharedMemory->getBlock();
+
+    // The helper is still busy with a block we gave up on, so it can't take this one
+    if (block.responseCounter.load(std::memory_order_acquire) != block.requestCounter.load(std::memory_order_relaxed))
+    {
+        ++deadlineMisses;
+        silence();
+        return;
+    }
+
+    const auto numChannels = juce::jmin(buffer.getNumChannels(), SandboxSharedBlock::maxChannels);
+
+    for (int i = 0; i < numChannels; ++i)
+    {
+        const auto* source = buffer.getReadPointer(i);
+        auto* destination = block.getChannel(i);
+
+        for (int j = 0; j < numSamples; ++j)
+        {
+            destination[j] = (float) source[j];
+        }
+    }
+
+    block.numChannels = numChannels;
+    block.numSamples = numSamples;
+    block.isActive = isActive ? 1 : 0;
+    block.position = SandboxPosition::fromPositionInfo(position);
+    block.writeMidi(midiMessages);
+
+    const auto request = sharedMemory->postRequest();
+    const auto timeoutMs = 1000.0 * numSamples / sampleRate.load() * responseBudget;
+
+    if (!sharedMemory->waitForResponse(request, timeoutMs))
+    {
+        ++deadlineMisses;
+        silence();
+        return;
+    }
+
+    for (int i = 0; i < numChannels; ++i)
+    {
+        const auto* source = block.getChannel(i);
+        auto* destination = buffer.getWritePointer(i);
+
+        for (int j = 0; j < numSamples; ++j)
+        {
+            destination[j] = (FloatType) source[j];
+        }
+    }
+
+    block.readMidi(midiMessages);
+}
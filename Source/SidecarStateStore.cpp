@@ -0,0 +1,116 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "SidecarStateStore.h"
+
+//==============================================================================
+
+PluginStateData::PluginStateData(const juce::MemoryBlock& blockToUse)
+: block(blockToUse.isEmpty() ? nullptr : std::make_shared<const juce::MemoryBlock>(blockToUse))
+{
+}
+
+PluginStateData::PluginStateData(std::shared_ptr<const juce::MemoryMappedFile> mappedFileToUse)
+: mappedFile(std::move(mappedFileToUse))
+{
+}
+
+const void* PluginStateData::getData() const
+{
+    if (block != nullptr) { return block->getData(); }
+    if (mappedFile != nullptr) { return mappedFile->getData(); }
+
+    return nullptr;
+}
+
+size_t PluginStateData::getSize() const
+{
+    if (block != nullptr) { return block->getSize(); }
+    if (mappedFile != nullptr && mappedFile->getData() != nullptr) { return mappedFile->getSize(); }
+
+    return 0;
+}
+
+void PluginStateData::reset()
+{
+    block.reset();
+    mappedFile.reset();
+}
+
+juce::MemoryBlock PluginStateData::toMemoryBlock() const
+{
+    return isEmpty() ? juce::MemoryBlock() : juce::MemoryBlock(getData(), getSize());
+}
+
+//==============================================================================
+
+SidecarStateStore::SidecarStateStore()
+: directory(getDefaultDirectory())
+{
+}
+
+juce::File SidecarStateStore::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("Application Support/AU-VST3-Wrapper/States");
+}
+
+juce::File SidecarStateStore::getBlobFile(const juce::String& reference) const
+{
+    // Fanned out by the first two digits, so that no folder grows too large
+    return directory.getChildFile(reference.substring(0, 2)).getChildFile(reference + ".state");
+}
+
+juce::String SidecarStateStore::store(const void* data, size_t size)
+{
+    if (data == nullptr || size == 0) { return {}; }
+
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+    const auto reference = juce::SHA256(data, size).toHexString();
+    const auto file = getBlobFile(reference);
+
+    if (!file.existsAsFile() || (size_t) file.getSize() != size)
+    {
+        if (!file.getParentDirectory().createDirectory()) { return {}; }
+
+        // Written next to the blob and renamed, so that a blob is never seen half-written, even if several instances store it at once
+        juce::TemporaryFile temporaryFile (file);
+
+        if (!temporaryFile.getFile().replaceWithData(data, size) || !temporaryFile.overwriteTargetFileWithTemporary())
+        {
+            juce::Logger::writeToLog("AU-VST3-Wrapper sidecar: error=write_failed path=" + file.getFullPathName());
+            return {};
+        }
+
+        juce::Logger::writeToLog("AU-VST3-Wrapper sidecar: stored=" + reference + " bytes=" + juce::String((juce::int64) size)
+                                 + " ms=" + juce::String(juce::Time::getMillisecondCounterHiRes() - startMs, 1));
+    }
+
+    return reference;
+}
+
+PluginStateData SidecarStateStore::open(const juce::String& reference, size_t expectedSize)
+{
+    if (reference.length() != 64 || !reference.containsOnly("0123456789abcdef")) { return {}; }
+
+    const auto file = getBlobFile(reference);
+    auto mappedFile = std::make_shared<const juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+
+    if (mappedFile->getData() == nullptr || mappedFile->getSize() != expectedSize)
+    {
+        juce::Logger::writeToLog("AU-VST3-Wrapper sidecar: error=missing reference=" + reference + " path=" + file.getFullPathName());
+        return {};
+    }
+    return PluginStateData(std::move(mappedFile));
+}
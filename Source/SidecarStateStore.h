@@ -0,0 +1,76 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * @brief A state of the hosted plugin, held either in memory or as a read-only mapping of a blob in `SidecarStateStore`.
+ *        Copies share the same memory.
+ */
+class PluginStateData
+{
+public:
+    PluginStateData() = default;
+    explicit PluginStateData(const juce::MemoryBlock& block);
+    explicit PluginStateData(std::shared_ptr<const juce::MemoryMappedFile> mappedFile);
+
+    const void* getData() const;
+    size_t getSize() const;
+    bool isEmpty() const { return getSize() == 0; }
+
+    void reset();
+
+    /// Copies the state, e.g. to send it to the sandbox helper.
+    juce::MemoryBlock toMemoryBlock() const;
+
+private:
+    std::shared_ptr<const juce::MemoryBlock> block;
+    std::shared_ptr<const juce::MemoryMappedFile> mappedFile;
+};
+
+//==============================================================================
+
+/**
+ * @brief A content-addressed store of large hosted plugin states, shared by all wrapper instances and projects.
+ *
+ * The wrapper's state then holds only the SHA-256 of the hosted state, which is written to the store once,
+ * however many instances or projects share it, and is memory-mapped when restored rather than decoded into memory.
+ * Blobs are never deleted, as any project on the computer may refer to them.
+ *
+ * All the methods can be called on any thread.
+ */
+class SidecarStateStore
+{
+public:
+    SidecarStateStore();
+
+    /// Smaller states are always embedded in the wrapper's state
+    static constexpr size_t minimumStoredBytes = 64 * 1024;
+
+    /// Writes the state to the store, unless it's already there. Returns the reference to the blob, or an empty string if it can't be written.
+    juce::String store(const void* data, size_t size);
+
+    /// Maps the referenced blob. Returns an empty state if the blob is missing or its size doesn't match.
+    PluginStateData open(const juce::String& reference, size_t expectedSize);
+
+    /// The folder in the user's application data folder
+    static juce::File getDefaultDirectory();
+
+private:
+    juce::File getBlobFile(const juce::String& reference) const;
+
+    const juce::File directory;
+};
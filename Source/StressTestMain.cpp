@@ -0,0 +1,401 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+// The entry point of "VST3 Wrapper Stress Test", a command-line tool which hammers wrapper instances with random, concurrent
+// plugin loads, state saves and restores, closes, mode switches and instance re-creation while their audio threads keep processing.
+// It's built by the "Stress Test" Projucer project with ThreadSanitizer, so data races fail the run as well.
+//
+// Usage: "VST3 Wrapper Stress Test" --plugins=<path>[;<path>...] [--instances=<count>] [--seconds=<duration>] [--seed=<number>]
+// Exits with 1 when the 99.9th percentile of an instance's audio thread lock stalls exceeds VST3WRAPPER_STALL_BUDGET_US
+// (see `AudioThreadStalls`), and with ThreadSanitizer's exit code (66) when it has reported a race.
+// The summary line also reports how long state saves took with and without the state cache, with all the instances running.
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+//==============================================================================
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+    constexpr int actionIntervalMs = 20;
+    constexpr int maxSavedStates = 16;
+
+    /// One wrapper instance, driven by its own audio thread at the pace of a real host.
+    class Instance : private juce::Thread
+    {
+    public:
+        explicit Instance(juce::int64 seed)
+        : juce::Thread("VST3 Wrapper Stress Test Audio"), random(seed)
+        {
+            processor = std::make_unique<VST3WrapperAudioProcessor>();
+            prepare(blockSize);
+        }
+
+        ~Instance() override
+        {
+            stopThread(-1);
+            processor->releaseResources();
+        }
+
+        /// Hosts stop processing while they prepare a plugin again, e.g. when the user changes the buffer size.
+        void prepare(int newBlockSize)
+        {
+            stopThread(-1);
+            currentBlockSize = newBlockSize;
+            processor->setRateAndBufferSizeDetails(sampleRate, currentBlockSize);
+            processor->prepareToPlay(sampleRate, currentBlockSize);
+            startThread(juce::Thread::Priority::highest);
+        }
+
+        VST3WrapperAudioProcessor& getProcessor() { return *processor; }
+
+        AudioThreadStalls::Summary getStalls() { return processor->getAudioThreadStalls(); }
+
+    private:
+        void run() override
+        {
+            const auto numChannels = juce::jmax(processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels());
+            const auto numSamples = currentBlockSize;
+            juce::AudioBuffer<float> buffer (numChannels, numSamples);
+            juce::MidiBuffer midiMessages;
+            midiMessages.ensureSize(4096);
+
+            const auto blockMs = 1000.0 * numSamples / sampleRate;
+            auto nextBlockMs = juce::Time::getMillisecondCounterHiRes();
+
+            while (!threadShouldExit())
+            {
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    auto* samples = buffer.getWritePointer(channel);
+
+                    for (int i = 0; i < numSamples; ++i)
+                    {
+                        samples[i] = random.nextFloat() * 0.2f - 0.1f;
+                    }
+                }
+
+                midiMessages.clear();
+
+                if (random.nextInt(4) == 0)
+                {
+                    const auto note = 36 + random.nextInt(48);
+                    midiMessages.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8) 100), random.nextInt(numSamples));
+                    midiMessages.addEvent(juce::MidiMessage::noteOff(1, note), numSamples - 1);
+                }
+
+                {
+                    // What a host's audio callback does, which the wrapper's suspendProcessing calls rely on
+                    const juce::ScopedLock sl (processor->getCallbackLock());
+
+                    if (processor->isSuspended())
+                    {
+                        buffer.clear();
+                        midiMessages.clear();
+                    }
+                    else
+                    {
+                        processor->processBlock(buffer, midiMessages);
+                    }
+                }
+
+                // Paced like a host's audio callback, so that the message thread gets to contend for the wrapper's locks
+                nextBlockMs += blockMs;
+                const auto waitMs = nextBlockMs - juce::Time::getMillisecondCounterHiRes();
+
+                if (waitMs > 1.0)
+                    wait((int) waitMs);
+                else if (waitMs < -blockMs)
+                    nextBlockMs = juce::Time::getMillisecondCounterHiRes();
+            }
+        }
+
+        std::unique_ptr<VST3WrapperAudioProcessor> processor;
+        juce::Random random;
+        int currentBlockSize = blockSize;
+
+        JUCE_DECLARE_NON_COPYABLE (Instance)
+    };
+
+    struct Result
+    {
+        juce::String pluginName;
+        AudioThreadStalls::Summary stalls;
+    };
+
+    /// Performs one random action on a random instance on every timer tick, until the duration is over.
+    class StressTest : private juce::Timer, private juce::Thread
+    {
+    public:
+        StressTest(const juce::StringArray& pluginPathsToUse, int numInstances, int durationSeconds, juce::int64 seed)
+        : juce::Thread("VST3 Wrapper Stress Test Saver"), pluginPaths(pluginPathsToUse), random(seed), saverSeed(random.nextInt64())
+        {
+            for (int i = 0; i < numInstances; ++i)
+            {
+                instances.add(new Instance(random.nextInt64()));
+            }
+
+            endMs = juce::Time::getMillisecondCounterHiRes() + 1000.0 * durationSeconds;
+            startTimer(actionIntervalMs);
+            startThread();
+        }
+
+        ~StressTest() override
+        {
+            stopTimer();
+            stopThread(-1);
+        }
+
+        /// Stops every instance and returns the stalls of all the instances created during the run.
+        juce::Array<Result> finish()
+        {
+            stopThread(-1);
+            saveMilliseconds.sort();
+            uncachedSaveMilliseconds.sort();
+
+            const juce::ScopedLock sl (instancesLock);
+
+            for (auto* instance : instances)
+            {
+                addResult(*instance);
+            }
+
+            instances.clear();
+            return results;
+        }
+
+        int getNumActions() const { return numActions; }
+
+        /// The durations of all the state saves with and without the wrapper's state cache, sorted. Only valid after `finish`.
+        const juce::Array<double>& getSaveMilliseconds(bool withStateCache) const
+        {
+            return withStateCache ? saveMilliseconds : uncachedSaveMilliseconds;
+        }
+
+    private:
+        void timerCallback() override
+        {
+            if (juce::Time::getMillisecondCounterHiRes() >= endMs)
+            {
+                stopTimer();
+                juce::MessageManager::getInstance()->stopDispatchLoop();
+                return;
+            }
+
+            const juce::ScopedLock sl (instancesLock);
+
+            const auto index = random.nextInt(instances.size());
+            auto& processor = instances[index]->getProcessor();
+            const auto action = random.nextInt(100);
+            ++numActions;
+
+            if (action < 30)
+            {
+                processor.loadPlugin(pluginPaths[random.nextInt(pluginPaths.size())]);
+            }
+            else if (action < 45)
+            {
+                const juce::ScopedLock stateLock (savedStatesLock);
+
+                if (!savedStates.isEmpty())
+                {
+                    const auto& state = savedStates.getReference(random.nextInt(savedStates.size()));
+                    processor.setStateInformation(state.getData(), (int) state.getSize());
+                }
+            }
+            else if (action < 60)
+            {
+                processor.closeHostedPlugin();
+            }
+            else if (action < 70)
+            {
+                processor.cancelPendingLoad();
+            }
+            else if (action < 80)
+            {
+                processor.setRenderThreadEnabled(!processor.isRenderThreadEnabled());
+            }
+            else if (action < 90)
+            {
+                processor.setNonRealtime(!processor.isNonRealtime());
+            }
+            else if (action < 95)
+            {
+                instances[index]->prepare(random.nextBool() ? blockSize : blockSize / 2);
+            }
+            else
+            {
+                // Closing the wrapper itself, the way a host does when a track is deleted
+                addResult(*instances[index]);
+                instances.set(index, new Instance(random.nextInt64()), true);
+            }
+        }
+
+        // Hosts save projects (and autosave) while the audio keeps running and the user keeps editing
+        void run() override
+        {
+            juce::Random saverRandom (saverSeed);
+
+            while (!threadShouldExit())
+            {
+                juce::MemoryBlock state;
+
+                {
+                    const juce::ScopedLock sl (instancesLock);
+
+                    if (instances.isEmpty()) { return; }
+
+                    // Every other save on average bypasses the cache, so both costs are measured under the same load
+                    auto& processor = instances[saverRandom.nextInt(instances.size())]->getProcessor();
+                    const auto withStateCache = saverRandom.nextBool();
+                    processor.setStateCacheEnabled(withStateCache);
+
+                    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+                    processor.getStateInformation(state);
+                    (withStateCache ? saveMilliseconds : uncachedSaveMilliseconds).add(juce::Time::getMillisecondCounterHiRes() - startMs);
+
+                    processor.setStateCacheEnabled(true);
+                }
+
+                if (!state.isEmpty())
+                {
+                    const juce::ScopedLock sl (savedStatesLock);
+
+                    if (savedStates.size() >= maxSavedStates)
+                    {
+                        savedStates.remove(saverRandom.nextInt(savedStates.size()));
+                    }
+
+                    savedStates.add(state);
+                }
+
+                wait(5 + saverRandom.nextInt(45));
+            }
+        }
+
+        void addResult(Instance& instance)
+        {
+            results.add({ instance.getProcessor().getHostedPluginName(), instance.getStalls() });
+        }
+
+        juce::StringArray pluginPaths;
+        juce::Random random;
+        const juce::int64 saverSeed;
+        double endMs = 0.0;
+        int numActions = 0;
+        // Saver thread only, until `finish`
+        juce::Array<double> saveMilliseconds;
+        juce::Array<double> uncachedSaveMilliseconds;
+
+        juce::CriticalSection instancesLock;
+        juce::OwnedArray<Instance> instances;
+        juce::Array<Result> results;
+
+        juce::CriticalSection savedStatesLock;
+        juce::Array<juce::MemoryBlock> savedStates;
+
+        JUCE_DECLARE_NON_COPYABLE (StressTest)
+    };
+
+    int getIntOption(const juce::ArgumentList& arguments, const juce::String& option, int defaultValue)
+    {
+        return arguments.containsOption(option) ? arguments.getValueForOption(option).getIntValue() : defaultValue;
+    }
+}
+
+//==============================================================================
+
+int main(int argc, char* argv[])
+{
+    const juce::ArgumentList arguments (argc, argv);
+
+    auto pluginPaths = juce::StringArray::fromTokens(arguments.getValueForOption("--plugins"), ";", {});
+    pluginPaths.removeEmptyStrings();
+
+    if (pluginPaths.isEmpty())
+    {
+        std::cerr << "Usage: \"VST3 Wrapper Stress Test\" --plugins=<path>[;<path>...] [--instances=<count>] [--seconds=<duration>] [--seed=<number>]" << std::endl;
+        return 2;
+    }
+
+    const auto numInstances = juce::jmax(1, getIntOption(arguments, "--instances", 8));
+    const auto durationSeconds = juce::jmax(1, getIntOption(arguments, "--seconds", 60));
+    const auto seed = arguments.containsOption("--seed") ? arguments.getValueForOption("--seed").getLargeIntValue()
+                                                         : juce::Time::currentTimeMillis();
+
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    std::cout << "Stress testing " << numInstances << " instance(s) for " << durationSeconds << " s, seed " << seed << std::endl;
+
+    juce::Array<Result> results;
+    juce::Array<double> saveMilliseconds;
+    juce::Array<double> uncachedSaveMilliseconds;
+    int numActions = 0;
+
+    {
+        StressTest stressTest (pluginPaths, numInstances, durationSeconds, seed);
+        juce::MessageManager::getInstance()->runDispatchLoop();
+        numActions = stressTest.getNumActions();
+        results = stressTest.finish();
+        saveMilliseconds = stressTest.getSaveMilliseconds(true);
+        uncachedSaveMilliseconds = stressTest.getSaveMilliseconds(false);
+    }
+
+    auto hasPassed = true;
+    AudioThreadStalls::Summary worst;
+
+    for (const auto& result : results)
+    {
+        const auto& stalls = result.stalls;
+        hasPassed = hasPassed && stalls.isWithinBudget();
+
+        worst.numBlocks += stalls.numBlocks;
+        worst.numStalledBlocks += stalls.numStalledBlocks;
+        worst.p99Microseconds = juce::jmax(worst.p99Microseconds, stalls.p99Microseconds);
+        worst.p999Microseconds = juce::jmax(worst.p999Microseconds, stalls.p999Microseconds);
+        worst.maxMicroseconds = juce::jmax(worst.maxMicroseconds, stalls.maxMicroseconds);
+
+        std::cout << "  " << (result.pluginName.isNotEmpty() ? result.pluginName : juce::String("(no plugin)")).paddedRight(' ', 32)
+                  << " blocks=" << stalls.numBlocks << " stalled=" << stalls.numStalledBlocks
+                  << " p999_us=" << juce::String(stalls.p999Microseconds, 1) << (stalls.isWithinBudget() ? "" : "  OVER BUDGET") << "\n";
+    }
+
+    // A cached save only reads the hosted plugin's state when something has changed, an uncached one always does
+    const auto getPercentile = [] (const juce::Array<double>& sorted, double percentile)
+    {
+        return sorted.isEmpty() ? 0.0 : sorted[juce::roundToInt((sorted.size() - 1) * percentile)];
+    };
+
+    // The same format as the wrapper's own stalls line, with the worst percentiles of all instances
+    std::cout << "AU-VST3-Wrapper stress: instances=" << results.size()
+              << " actions=" << numActions
+              << " blocks=" << worst.numBlocks
+              << " stalled_blocks=" << worst.numStalledBlocks
+              << " p99_us=" << juce::String(worst.p99Microseconds, 1)
+              << " p999_us=" << juce::String(worst.p999Microseconds, 1)
+              << " max_us=" << juce::String(worst.maxMicroseconds, 1)
+              << " saves=" << saveMilliseconds.size()
+              << " save_median_ms=" << juce::String(getPercentile(saveMilliseconds, 0.5), 2)
+              << " save_p99_ms=" << juce::String(getPercentile(saveMilliseconds, 0.99), 2)
+              << " uncached_saves=" << uncachedSaveMilliseconds.size()
+              << " uncached_save_median_ms=" << juce::String(getPercentile(uncachedSaveMilliseconds, 0.5), 2)
+              << " uncached_save_p99_ms=" << juce::String(getPercentile(uncachedSaveMilliseconds, 0.99), 2)
+              << " budget_us=" << juce::String(AudioThreadStalls::budgetMicroseconds, 0)
+              << " result=" << (hasPassed ? "pass" : "fail") << std::endl;
+
+    return hasPassed ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "TelemetryLayout.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//==============================================================================
+
+void TelemetryEntry::writePluginName(const juce::String& name)
+{
+    sequence.fetch_add(1, std::memory_order_acq_rel);
+    std::atomic_thread_fence(std::memory_order_release);
+    name.copyToUTF8(pluginName, (size_t) maxNameBytes);
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+juce::String TelemetryEntry::readPluginName() const
+{
+    static constexpr int maxAttempts = 16;
+
+    for (int attempt = 0; attempt < maxAttempts; ++attempt)
+    {
+        const auto before = sequence.load(std::memory_order_acquire);
+
+        if ((before & 1) != 0) { continue; }
+
+        char copy[maxNameBytes];
+        std::memcpy(copy, pluginName, (size_t) maxNameBytes);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (sequence.load(std::memory_order_relaxed) == before)
+        {
+            copy[maxNameBytes - 1] = 0;
+            return juce::String::fromUTF8(copy);
+        }
+    }
+
+    return {};
+}
+
+//==============================================================================
+
+TelemetrySharedMemory::TelemetrySharedMemory(const juce::String& nameToUse, bool shouldOwn)
+    : name(nameToUse), isOwner(shouldOwn)
+{
+}
+
+juce::String TelemetrySharedMemory::getName(int processID)
+{
+    // Short enough for macOS' limit on shared memory names
+    return "/" + juce::String(namePrefix) + juce::String(processID);
+}
+
+std::unique_ptr<TelemetrySharedMemory> TelemetrySharedMemory::create()
+{
+    const auto processID = (int) getpid();
+    std::unique_ptr<TelemetrySharedMemory> sharedMemory (new TelemetrySharedMemory(getName(processID), true));
+
+    // A table left behind by a crashed process with a recycled ID is simply replaced
+    shm_unlink(sharedMemory->name.toRawUTF8());
+    sharedMemory->fileDescriptor = shm_open(sharedMemory->name.toRawUTF8(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    if (sharedMemory->fileDescriptor < 0 || ftruncate(sharedMemory->fileDescriptor, (off_t) sizeof(TelemetryLayout)) != 0)
+    {
+        return nullptr;
+    }
+
+    if (!sharedMemory->map(true)) { return nullptr; }
+
+    // A new mapping is zero-filled, which is a valid initial state of every entry
+    auto& layout = sharedMemory->getLayout();
+    layout.version = TelemetryLayout::layoutVersion;
+    layout.processID = processID;
+    layout.numEntries = TelemetryLayout::maxEntries;
+    std::atomic_thread_fence(std::memory_order_release);
+    layout.magic = TelemetryLayout::magicNumber;
+
+    return sharedMemory;
+}
+
+std::unique_ptr<TelemetrySharedMemory> TelemetrySharedMemory::open(int processID)
+{
+    std::unique_ptr<TelemetrySharedMemory> sharedMemory (new TelemetrySharedMemory(getName(processID), false));
+
+    sharedMemory->fileDescriptor = shm_open(sharedMemory->name.toRawUTF8(), O_RDONLY, 0600);
+
+    if (sharedMemory->fileDescriptor < 0 || !sharedMemory->map(false)) { return nullptr; }
+
+    const auto& layout = sharedMemory->getLayout();
+
+    if (layout.magic != TelemetryLayout::magicNumber || layout.version != TelemetryLayout::layoutVersion) { return nullptr; }
+
+    return sharedMemory;
+}
+
+juce::Array<int> TelemetrySharedMemory::findProcessIDs()
+{
+    juce::Array<int> processIDs;
+
+   #if JUCE_LINUX
+    for (const auto& entry : juce::RangedDirectoryIterator(juce::File("/dev/shm"), false, juce::String(namePrefix) + "*"))
+    {
+        const auto processID = entry.getFile().getFileName().fromFirstOccurrenceOf(namePrefix, false, false).getIntValue();
+
+        if (processID > 0) { processIDs.add(processID); }
+    }
+   #endif
+
+    return processIDs;
+}
+
+bool TelemetrySharedMemory::map(bool isWritable)
+{
+    const auto protection = isWritable ? PROT_READ | PROT_WRITE : PROT_READ;
+    auto* address = mmap(nullptr, sizeof(TelemetryLayout), protection, MAP_SHARED, fileDescriptor, 0);
+
+    if (address == MAP_FAILED) { return false; }
+
+    layout = static_cast<TelemetryLayout*>(address);
+    return true;
+}
+
+TelemetrySharedMemory::~TelemetrySharedMemory()
+{
+    if (layout != nullptr) { munmap(layout, sizeof(TelemetryLayout)); }
+    if (fileDescriptor >= 0) { close(fileDescriptor); }
+    if (isOwner) { shm_unlink(name.toRawUTF8()); }
+}
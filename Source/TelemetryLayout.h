@@ -0,0 +1,118 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Shared between the wrappers in a host process (see `TelemetryTable`) and the "VST3 Telemetry Viewer" command-line tool
+// (see `TelemetryViewerMain.cpp`). Every host process publishes one fixed-layout table, named after its process ID.
+//==============================================================================
+
+/**
+ * @brief The status of one wrapper instance. Every field is written lock-free, by the rendering thread (the per-block fields)
+ *        or by the message thread (the others), and can be read at any time.
+ *
+ * The plugin name isn't atomic, so it's guarded by `sequence`, which is odd while the name is being rewritten.
+ */
+struct TelemetryEntry
+{
+    enum class LoadState : juce::int32
+    {
+        empty = 0,
+        loading,
+        loaded,
+        failed,
+        crashed,
+        dormant
+    };
+
+    static constexpr int maxNameBytes = 64;
+
+    /// Non-zero while a wrapper instance owns the entry
+    std::atomic<juce::int32> inUse;
+    std::atomic<juce::uint32> sequence;
+    char pluginName[maxNameBytes];
+
+    std::atomic<juce::int32> loadState;
+    std::atomic<juce::int32> isSandboxed;
+    std::atomic<juce::int32> latencySamples;
+
+    /// The time the hosted plugin takes to render a block as a fraction of the block's duration, exponentially weighted
+    std::atomic<float> cpuLoad;
+    std::atomic<juce::int32> overruns;
+    std::atomic<juce::int32> isSuspended;
+    std::atomic<juce::int64> numBlocks;
+    std::atomic<juce::uint32> lastBlockMs;
+
+    /// Message thread: rewrites the plugin name, which readers see either before or after the change, but never torn.
+    void writePluginName(const juce::String& name);
+
+    /// Copies the plugin name, retrying while it's being rewritten. Returns an empty string if it keeps changing.
+    juce::String readPluginName() const;
+};
+
+/// The fixed layout of a host process' telemetry table.
+struct TelemetryLayout
+{
+    static constexpr juce::uint32 magicNumber = 0x56335443;
+    static constexpr juce::int32 layoutVersion = 1;
+    static constexpr int maxEntries = 256;
+
+    juce::uint32 magic;
+    juce::int32 version;
+    juce::int32 processID;
+    juce::int32 numEntries;
+    TelemetryEntry entries[maxEntries];
+};
+
+static_assert(std::atomic<juce::int32>::is_always_lock_free && std::atomic<juce::int64>::is_always_lock_free && std::atomic<float>::is_always_lock_free,
+              "Telemetry fields must be lock-free to work across processes");
+
+/**
+ * @brief The named shared memory holding a `TelemetryLayout`.
+ */
+class TelemetrySharedMemory
+{
+public:
+    /// Creates the table of the calling process. Called by `TelemetryTable`, which owns its lifetime.
+    static std::unique_ptr<TelemetrySharedMemory> create();
+
+    /// Maps the table of another process read-only. Returns `nullptr` if the process has no table, or it has another layout.
+    static std::unique_ptr<TelemetrySharedMemory> open(int processID);
+
+    /// Returns the IDs of the processes which have a table. Only Linux can list shared memory, elsewhere this returns an empty array.
+    static juce::Array<int> findProcessIDs();
+
+    static juce::String getName(int processID);
+
+    ~TelemetrySharedMemory();
+
+    TelemetryLayout& getLayout() { return *layout; }
+
+private:
+    TelemetrySharedMemory(const juce::String& name, bool isOwner);
+
+    bool map(bool isWritable);
+
+    juce::String name;
+    bool isOwner;
+    int fileDescriptor = -1;
+    TelemetryLayout* layout = nullptr;
+
+    static constexpr const char* namePrefix = "v3tm.";
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TelemetrySharedMemory)
+};
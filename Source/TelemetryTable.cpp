@@ -0,0 +1,119 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#include "TelemetryTable.h"
+
+//==============================================================================
+
+TelemetryTable::TelemetryTable()
+: sharedMemory(TelemetrySharedMemory::create())
+{
+    if (sharedMemory == nullptr)
+    {
+        juce::Logger::writeToLog("AU-VST3-Wrapper telemetry: error=shared_memory_unavailable");
+        return;
+    }
+
+    startTimer(statusPollingIntervalMs);
+}
+
+TelemetryTable::~TelemetryTable()
+{
+    stopTimer();
+    // Every registration holds a reference to the table
+    jassert(registrations.isEmpty());
+}
+
+TelemetryEntry* TelemetryTable::add(Registration* registration)
+{
+    const juce::ScopedLock sl (lock);
+
+    if (sharedMemory == nullptr) { return nullptr; }
+
+    for (auto& entry : sharedMemory->getLayout().entries)
+    {
+        if (entry.inUse.load() != 0) { continue; }
+
+        entry.loadState = (juce::int32) TelemetryEntry::LoadState::empty;
+        entry.isSandboxed = 0;
+        entry.latencySamples = 0;
+        entry.cpuLoad = 0.0f;
+        entry.overruns = 0;
+        entry.isSuspended = 0;
+        entry.numBlocks = 0;
+        entry.lastBlockMs = 0;
+        entry.writePluginName({});
+        entry.inUse = 1;
+
+        registrations.add(registration);
+        return &entry;
+    }
+
+    juce::Logger::writeToLog("AU-VST3-Wrapper telemetry: error=table_full entries=" + juce::String(TelemetryLayout::maxEntries));
+    return nullptr;
+}
+
+void TelemetryTable::remove(Registration* registration)
+{
+    const juce::ScopedLock sl (lock);
+
+    registrations.removeFirstMatchingValue(registration);
+
+    if (registration->entry != nullptr)
+    {
+        registration->entry->inUse = 0;
+    }
+}
+
+void TelemetryTable::timerCallback()
+{
+    const juce::ScopedLock sl (lock);
+
+    for (auto* registration : registrations)
+    {
+        publishStatus(*registration);
+    }
+}
+
+void TelemetryTable::publishStatus(Registration& registration)
+{
+    if (registration.entry == nullptr || registration.getStatus == nullptr) { return; }
+
+    const auto status = registration.getStatus();
+    auto& entry = *registration.entry;
+
+    // Rewriting the name makes the viewer retry, so it's only rewritten when it changes
+    if (status.pluginName != registration.publishedName)
+    {
+        entry.writePluginName(status.pluginName);
+        registration.publishedName = status.pluginName;
+    }
+
+    entry.loadState = (juce::int32) status.loadState;
+    entry.isSandboxed = status.isSandboxed ? 1 : 0;
+    entry.latencySamples = status.latencySamples;
+}
+
+//==============================================================================
+
+TelemetryTable::Registration::Registration(std::function<Status()> getStatusToUse)
+: getStatus(std::move(getStatusToUse))
+{
+    entry = table->add(this);
+}
+
+TelemetryTable::Registration::~Registration()
+{
+    table->remove(this);
+}
@@ -0,0 +1,84 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "TelemetryLayout.h"
+
+/**
+ * @brief The process-wide telemetry table (see `TelemetryLayout`), in which every wrapper instance publishes its status
+ *        for the "VST3 Telemetry Viewer" command-line tool.
+ *
+ * Instances hold a `Registration`. The per-block fields are published by the rendering thread through `publishBlock`,
+ * while the table polls every registration's `Status` on the message thread a few times a second.
+ * If the shared memory can't be created, or all the entries are taken, registrations silently publish nothing.
+ */
+class TelemetryTable : private juce::Timer
+{
+public:
+    struct Status
+    {
+        juce::String pluginName;
+        TelemetryEntry::LoadState loadState = TelemetryEntry::LoadState::empty;
+        bool isSandboxed = false;
+        int latencySamples = 0;
+    };
+
+    class Registration
+    {
+    public:
+        /// `getStatus` is called on the message thread.
+        explicit Registration(std::function<Status()> getStatus);
+        ~Registration();
+
+        /// Called on the rendering thread after every block. Never blocks or allocates.
+        void publishBlock(float cpuLoad, int overruns, bool isSuspended)
+        {
+            if (entry == nullptr) { return; }
+
+            entry->cpuLoad.store(cpuLoad, std::memory_order_relaxed);
+            entry->overruns.store(overruns, std::memory_order_relaxed);
+            entry->isSuspended.store(isSuspended ? 1 : 0, std::memory_order_relaxed);
+            entry->numBlocks.fetch_add(1, std::memory_order_relaxed);
+            entry->lastBlockMs.store(juce::Time::getMillisecondCounter(), std::memory_order_relaxed);
+        }
+
+    private:
+        friend class TelemetryTable;
+
+        juce::SharedResourcePointer<TelemetryTable> table;
+        std::function<Status()> getStatus;
+        TelemetryEntry* entry = nullptr;
+        juce::String publishedName;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Registration)
+    };
+
+    TelemetryTable();
+    ~TelemetryTable() override;
+
+private:
+    TelemetryEntry* add(Registration* registration);
+    void remove(Registration* registration);
+
+    void timerCallback() override;
+    void publishStatus(Registration& registration);
+
+    std::unique_ptr<TelemetrySharedMemory> sharedMemory;
+    juce::CriticalSection lock;
+    juce::Array<Registration*> registrations;
+
+    static constexpr int statusPollingIntervalMs = 500;
+};
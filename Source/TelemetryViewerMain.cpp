@@ -0,0 +1,186 @@
+/*
+ ==============================================================================
+
+ Copyright 2024 Ivica Milovanovic (excluding JUCE framework code)
+
+ This file is part of AU-VST3-Wrapper
+
+ AU-VST3-Wrapper is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ AU-VST3-Wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License along with AU-VST3-Wrapper. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+// The entry point of "VST3 Telemetry Viewer", a command-line tool which shows the wrapper instances of every host process
+// (see `TelemetryTable`), ranked by CPU load like `top`. It's built by the "Telemetry Viewer" Projucer project.
+//
+// Usage: "VST3 Telemetry Viewer" [--pid=<process ID>] [--interval=<ms>] [--count=<refreshes>] [--top=<rows>]
+// Without --pid, every process' table is shown, which only works on Linux.
+
+#include <JuceHeader.h>
+#include "TelemetryLayout.h"
+
+#include <signal.h>
+
+//==============================================================================
+
+namespace
+{
+    struct Row
+    {
+        int processID = 0;
+        int index = 0;
+        juce::String pluginName;
+        TelemetryEntry::LoadState loadState = TelemetryEntry::LoadState::empty;
+        bool isSandboxed = false;
+        int latencySamples = 0;
+        float cpuLoad = 0.0f;
+        int overruns = 0;
+        bool isSuspended = false;
+        juce::int64 numBlocks = 0;
+        bool isIdle = false;
+    };
+
+    // Blocks older than this don't count as processing
+    constexpr juce::uint32 idleTimeoutMs = 1000;
+
+    juce::String getLoadStateName(TelemetryEntry::LoadState loadState)
+    {
+        switch (loadState)
+        {
+            case TelemetryEntry::LoadState::loading: return "loading";
+            case TelemetryEntry::LoadState::loaded:  return "loaded";
+            case TelemetryEntry::LoadState::failed:  return "failed";
+            case TelemetryEntry::LoadState::crashed: return "crashed";
+            case TelemetryEntry::LoadState::dormant: return "dormant";
+            case TelemetryEntry::LoadState::empty:
+            default:                                 return "empty";
+        }
+    }
+
+    void readRows(TelemetrySharedMemory& sharedMemory, juce::Array<Row>& rows)
+    {
+        const auto& layout = sharedMemory.getLayout();
+        const auto nowMs = juce::Time::getMillisecondCounter();
+        const auto numEntries = juce::jlimit(0, TelemetryLayout::maxEntries, (int) layout.numEntries);
+
+        for (int i = 0; i < numEntries; ++i)
+        {
+            const auto& entry = layout.entries[i];
+
+            if (entry.inUse.load() == 0) { continue; }
+
+            Row row;
+            row.processID = layout.processID;
+            row.index = i;
+            row.pluginName = entry.readPluginName();
+            row.loadState = (TelemetryEntry::LoadState) entry.loadState.load();
+            row.isSandboxed = entry.isSandboxed.load() != 0;
+            row.latencySamples = entry.latencySamples.load();
+            row.cpuLoad = entry.cpuLoad.load();
+            row.overruns = entry.overruns.load();
+            row.isSuspended = entry.isSuspended.load() != 0;
+            row.numBlocks = entry.numBlocks.load();
+            row.isIdle = row.numBlocks == 0 || nowMs - entry.lastBlockMs.load() > idleTimeoutMs;
+            rows.add(row);
+        }
+    }
+
+    void printRows(juce::Array<Row>& rows, int maxRows)
+    {
+        // Idle instances keep their last load, so they are ranked below every processing one
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b)
+        {
+            if (a.isIdle != b.isIdle) { return b.isIdle; }
+            return a.cpuLoad > b.cpuLoad;
+        });
+
+        float totalLoad = 0.0f;
+        int numProcessing = 0;
+
+        for (const auto& row : rows)
+        {
+            if (row.isIdle) { continue; }
+
+            totalLoad += row.cpuLoad;
+            ++numProcessing;
+        }
+
+        // Clears the terminal and moves the cursor home, like top does on every refresh
+        std::cout << "\x1b[2J\x1b[H";
+        std::cout << "VST3 Telemetry Viewer - " << juce::Time::getCurrentTime().toString(false, true, true, true)
+                  << "   instances: " << rows.size() << "   processing: " << numProcessing
+                  << "   total load: " << juce::String(totalLoad * 100.0f, 1) << "%\n\n";
+
+        std::cout << juce::String("PID").paddedRight(' ', 8) << juce::String("#").paddedRight(' ', 5)
+                  << juce::String("PLUGIN").paddedRight(' ', 32) << juce::String("STATE").paddedRight(' ', 10)
+                  << juce::String("LOAD%").paddedLeft(' ', 7) << juce::String("OVERRUNS").paddedLeft(' ', 10)
+                  << juce::String("LATENCY").paddedLeft(' ', 9) << "  FLAGS\n";
+
+        for (int i = 0; i < juce::jmin(maxRows, rows.size()); ++i)
+        {
+            const auto& row = rows.getReference(i);
+
+            juce::StringArray flags;
+            if (row.isSuspended) { flags.add("suspended"); }
+            if (row.isSandboxed) { flags.add("sandboxed"); }
+            if (row.isIdle)      { flags.add("idle"); }
+
+            std::cout << juce::String(row.processID).paddedRight(' ', 8) << juce::String(row.index).paddedRight(' ', 5)
+                      << row.pluginName.substring(0, 31).paddedRight(' ', 32) << getLoadStateName(row.loadState).paddedRight(' ', 10)
+                      << juce::String(row.cpuLoad * 100.0f, 1).paddedLeft(' ', 7) << juce::String(row.overruns).paddedLeft(' ', 10)
+                      << juce::String(row.latencySamples).paddedLeft(' ', 9) << "  " << flags.joinIntoString(",") << "\n";
+        }
+
+        std::cout << std::flush;
+    }
+
+    int getIntOption(const juce::ArgumentList& arguments, const juce::String& option, int defaultValue)
+    {
+        return arguments.containsOption(option) ? arguments.getValueForOption(option).getIntValue() : defaultValue;
+    }
+}
+
+//==============================================================================
+
+int main(int argc, char* argv[])
+{
+    const juce::ArgumentList arguments (argc, argv);
+
+    const auto processID = getIntOption(arguments, "--pid", 0);
+    const auto intervalMs = juce::jmax(100, getIntOption(arguments, "--interval", 1000));
+    const auto numRefreshes = getIntOption(arguments, "--count", 0);
+    const auto maxRows = juce::jmax(1, getIntOption(arguments, "--top", 30));
+
+    if (processID == 0)
+    {
+       #if ! JUCE_LINUX
+        std::cerr << "Listing every process' telemetry is only supported on Linux, use --pid=<process ID>" << std::endl;
+        return 1;
+       #endif
+    }
+
+    for (int refresh = 0; numRefreshes == 0 || refresh < numRefreshes; ++refresh)
+    {
+        const auto processIDs = processID != 0 ? juce::Array<int> { processID } : TelemetrySharedMemory::findProcessIDs();
+        juce::Array<Row> rows;
+
+        // Tables are mapped for one refresh only, so that the ones of exited processes aren't kept alive
+        for (const auto id : processIDs)
+        {
+            // A process which has crashed leaves its table behind
+            if (kill(id, 0) != 0 && errno == ESRCH) { continue; }
+
+            if (auto sharedMemory = TelemetrySharedMemory::open(id))
+            {
+                readRows(*sharedMemory, rows);
+            }
+        }
+
+        printRows(rows, maxRows);
+        juce::Thread::sleep(intervalMs);
+    }
+
+    return 0;
+}